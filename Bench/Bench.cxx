@@ -0,0 +1,304 @@
+#include "Bench.hxx"
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <sstream>
+#include <vector>
+
+#include "Utils.hxx"
+
+namespace
+{
+    std::atomic<std::size_t> allocationCount{ 0 };
+} // anonymous namespace
+
+// every allocation of the benchmark executable is counted (the array and nothrow forms end up in here as well)
+void* operator new(std::size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    void* ptr = std::malloc((size > 0) ? size : 1);
+    if (ptr == nullptr) throw (std::bad_alloc());
+    return (ptr);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+    return;
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+    return;
+}
+
+namespace FWMFW
+{
+    namespace Bench
+    {
+        namespace
+        {
+            struct Measurement
+            {
+                std::string benchmark;
+                std::string metric;
+                double value;
+                std::string unit;
+            }; // struct Measurement
+
+            OutputFormat outputFormat = OutputFormat::Text;
+            std::vector<Measurement> measurements;
+
+            std::string toJSONString(const std::string& str)
+            {
+                std::string result{ "\"" };
+                for (char c : str) {
+                    switch (c) {
+                        case '"': result.append("\\\""); break;
+                        case '\\': result.append("\\\\"); break;
+                        case '\n': result.append("\\n"); break;
+                        case '\r': result.append("\\r"); break;
+                        case '\t': result.append("\\t"); break;
+                        default:
+                            if (static_cast<unsigned char>(c) < 0x20) {
+                                char escaped[8];
+                                std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned int>(c));
+                                result.append(escaped);
+                            }
+                            else {
+                                result.push_back(c);
+                            }
+                            break;
+                    }
+                }
+                result.push_back('"');
+                return (result);
+            }
+        } // anonymous namespace
+
+        std::size_t Arguments::getSize(const std::string& name, std::size_t defaultValue) const
+        {
+            auto itr = _values.find(name);
+            if (itr == _values.end()) return (defaultValue);
+            return (static_cast<std::size_t>(std::stoull(itr->second)));
+        }
+
+        std::string Arguments::getString(const std::string& name, const std::string& defaultValue) const
+        {
+            auto itr = _values.find(name);
+            if (itr == _values.end()) return (defaultValue);
+            return (itr->second);
+        }
+
+        ScratchDirectory::ScratchDirectory(const std::string& tag) : _path()
+        {
+            static std::atomic<unsigned int> counter{ 0 };
+
+            auto dir = std::filesystem::temp_directory_path() / (
+                "FWMFWBench_" + tag + "_" +
+                std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + "_" +
+                std::to_string(counter++)
+            );
+            std::filesystem::create_directories(dir);
+
+            _path = dir.string();
+            _path.push_back(Utils::PATH_SEPARATOR);
+            return;
+        }
+
+        ScratchDirectory::~ScratchDirectory(void)
+        {
+            std::error_code errorCode;
+            std::filesystem::remove_all(_path, errorCode);
+            return;
+        }
+
+        std::size_t generateTree(const std::string& root, const TreeShape& shape)
+        {
+            std::size_t executables = 0;
+
+            std::function<void(const std::string&, std::size_t)> populate =
+                [&] (const std::string& dir, std::size_t level) -> void {
+                    for (std::size_t idx = 0; idx < shape.filesPerDirectory; idx++) {
+                        std::string file = dir + "file" + std::to_string(idx);
+                        if (idx < shape.executablesPerDirectory) {
+                            file.append(".exe");
+                            executables++;
+                        }
+                        else {
+                            file.append(".dat");
+                        }
+                        std::ofstream{ file };
+                    }
+
+                    if (level == shape.depth) return;
+
+                    for (std::size_t idx = 0; idx < shape.fanOut; idx++) {
+                        std::string subdir = dir + "dir" + std::to_string(idx);
+                        std::filesystem::create_directory(subdir);
+                        subdir.push_back(Utils::PATH_SEPARATOR);
+                        populate(subdir, level + 1);
+                    }
+                    return;
+                };
+
+            populate(root, 0);
+            return (executables);
+        }
+
+        void ageTree(const std::string& root)
+        {
+            auto past = std::filesystem::file_time_type::clock::now() - std::chrono::hours(1);
+            std::filesystem::last_write_time(root, past);
+            for (auto&& entry : std::filesystem::recursive_directory_iterator(root)) {
+                if (entry.is_directory()) std::filesystem::last_write_time(entry.path(), past);
+            }
+            return;
+        }
+
+        std::size_t getAllocationCount(void)
+        {
+            return (allocationCount.load(std::memory_order_relaxed));
+        }
+
+        void setOutputFormat(OutputFormat format)
+        {
+            outputFormat = format;
+            return;
+        }
+
+        void report(const std::string& benchmark, const std::string& metric, double value, const std::string& unit)
+        {
+            if (outputFormat == OutputFormat::JSON) {
+                measurements.push_back(Measurement{ benchmark, metric, value, unit });
+                return;
+            }
+            std::cout << benchmark << "." << metric << " = " << value << " " << unit << std::endl;
+            return;
+        }
+
+        void printReport(const Arguments& arguments, const std::vector<std::string>& benchmarks)
+        {
+            if (outputFormat != OutputFormat::JSON) return;
+
+            std::ostringstream out;
+            out.precision(std::numeric_limits<double>::max_digits10);
+
+            out << "{\n    \"arguments\": {";
+            const char* separator = "";
+            for (auto&& argument : arguments.getValues()) {
+                out << separator << "\n        " << toJSONString(argument.first) << ": " <<
+                    toJSONString(argument.second);
+                separator = ",";
+            }
+            out << "\n    },\n    \"benchmarks\": [";
+            separator = "";
+            for (auto&& benchmark : benchmarks) {
+                out << separator << toJSONString(benchmark);
+                separator = ", ";
+            }
+            out << "],\n    \"results\": [";
+            separator = "";
+            for (auto&& measurement : measurements) {
+                out << separator << "\n        { \"benchmark\": " << toJSONString(measurement.benchmark) <<
+                    ", \"metric\": " << toJSONString(measurement.metric) << ", \"value\": ";
+                // JSON has no representation of infinity and NaN
+                if (std::isfinite(measurement.value)) out << measurement.value;
+                else out << "null";
+                out << ", \"unit\": " << toJSONString(measurement.unit) << " }";
+                separator = ",";
+            }
+            out << "\n    ]\n}\n";
+
+            std::cout << out.str() << std::flush;
+            return;
+        }
+    } // namespace Bench
+} // namespace FWMFW
+
+int main(int argc, const char* const argv[])
+{
+    typedef std::function<void(const FWMFW::Bench::Arguments&)> BenchmarkFunction;
+    const std::vector<std::pair<std::string, BenchmarkFunction>> BENCHMARKS{
+        { "scan", FWMFW::Bench::runScanBenchmark },
+        { "scan-index", FWMFW::Bench::runScanIndexBenchmark },
+        { "scan-prune", FWMFW::Bench::runScanPruneBenchmark },
+        { "scan-links", FWMFW::Bench::runScanLinksBenchmark },
+        { "classify", FWMFW::Bench::runClassifyBenchmark },
+        { "policy", FWMFW::Bench::runPolicyBenchmark },
+        { "enumerate", FWMFW::Bench::runEnumerateBenchmark },
+        { "enumerate-stream", FWMFW::Bench::runEnumerateStreamBenchmark },
+        { "commit", FWMFW::Bench::runCommitBenchmark },
+        { "commit-scaling", FWMFW::Bench::runCommitScalingBenchmark },
+        { "journal", FWMFW::Bench::runJournalBenchmark },
+        { "rule-names", FWMFW::Bench::runRuleNamesBenchmark },
+        { "list-parse", FWMFW::Bench::runListParseBenchmark },
+        { "reconcile", FWMFW::Bench::runReconcileBenchmark },
+        { "reconcile-memory", FWMFW::Bench::runReconcileMemoryBenchmark },
+        { "transcode", FWMFW::Bench::runTranscodeBenchmark },
+        { "pipeline", FWMFW::Bench::runPipelineBenchmark },
+        { "pipelined", FWMFW::Bench::runPipelinedBenchmark },
+        { "service", FWMFW::Bench::runServiceBenchmark },
+        { "groups", FWMFW::Bench::runGroupsBenchmark },
+        { "filesystem", FWMFW::Bench::runFileSystemBenchmark },
+    };
+
+    // usage: FWMFWBench [benchmark...] [name=value...], format=json prints the results as one JSON document
+    FWMFW::Bench::Arguments arguments;
+    std::vector<std::string> selected;
+    for (int idx = 1; idx < argc; idx++) {
+        std::string arg{ argv[idx] };
+        auto separator = arg.find('=');
+        if (separator != std::string::npos) {
+            arguments.set(arg.substr(0, separator), arg.substr(separator + 1));
+        }
+        else {
+            selected.push_back(arg);
+        }
+    }
+
+    std::string format = arguments.getString("format", "text");
+    if (format == "json") {
+        FWMFW::Bench::setOutputFormat(FWMFW::Bench::OutputFormat::JSON);
+    }
+    else if (format != "text") {
+        std::cerr << "Error: unknown format \"" << format << "\", use format=text or format=json." << std::endl;
+        return (-2);
+    }
+
+    try {
+        std::vector<std::string> ran;
+        for (auto&& benchmark : BENCHMARKS) {
+            bool isSelected = selected.empty();
+            for (auto&& name : selected) isSelected = isSelected || (name == benchmark.first);
+            if (!isSelected) continue;
+
+            benchmark.second(arguments);
+            ran.push_back(benchmark.first);
+        }
+
+        if (ran.empty()) {
+            std::cerr << "Error: unknown benchmark. Available benchmarks:";
+            for (auto&& benchmark : BENCHMARKS) std::cerr << " " << benchmark.first;
+            std::cerr << std::endl;
+            return (-2);
+        }
+
+        FWMFW::Bench::printReport(arguments, ran);
+    }
+    catch (std::exception& e) {
+        std::cerr << "An error has occurred: " << e.what() << "\n";
+        return (-1);
+    }
+
+    return (0);
+}
@@ -0,0 +1,136 @@
+#if !defined(DOTSLASHZERO_FWMFW_BENCH_HXX)
+#define DOTSLASHZERO_FWMFW_BENCH_HXX
+
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace FWMFW
+{
+    // shared helpers for the benchmark executable
+    namespace Bench
+    {
+        // arguments given as "name=value" on the command line
+        class Arguments
+        {
+        public:
+            Arguments(void) : _values() { return; }
+
+            void set(const std::string& name, const std::string& value) { _values[name] = value; return; }
+
+            std::size_t getSize(const std::string& name, std::size_t defaultValue) const;
+
+            std::string getString(const std::string& name, const std::string& defaultValue) const;
+
+            const std::map<std::string, std::string>& getValues(void) const { return (_values); }
+
+        private:
+            std::map<std::string, std::string> _values;
+        }; // class Arguments
+
+        class Stopwatch
+        {
+        public:
+            Stopwatch(void) : _start(std::chrono::steady_clock::now()) { return; }
+
+            void restart(void) { _start = std::chrono::steady_clock::now(); return; }
+
+            double getElapsedMilliseconds(void) const
+            {
+                return (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _start).count());
+            }
+
+        private:
+            std::chrono::steady_clock::time_point _start;
+        }; // class Stopwatch
+
+        // best of a few runs in milliseconds, the first one also warms up the file system cache
+        template<typename Function>
+        double timeBestOf(std::size_t repetitions, Function&& function)
+        {
+            double best = 0.0;
+            for (std::size_t idx = 0; idx <= repetitions; idx++) {
+                Stopwatch stopwatch;
+                function();
+                double elapsed = stopwatch.getElapsedMilliseconds();
+                if (idx == 1 || (idx > 1 && elapsed < best)) best = elapsed;
+            }
+            return (best);
+        }
+
+        // a directory under the system's temporary directory that is removed (with everything in it) on destruction
+        class ScratchDirectory
+        {
+        public:
+            ScratchDirectory(const std::string& tag);
+            ~ScratchDirectory(void);
+
+            // always ends with a path separator
+            const std::string& getPath(void) const { return (_path); }
+
+            ScratchDirectory(const ScratchDirectory&) = delete;
+            ScratchDirectory& operator=(const ScratchDirectory&) = delete;
+
+        private:
+            std::string _path;
+        }; // class ScratchDirectory
+
+        struct TreeShape
+        {
+            std::size_t depth;              // levels of directories below the root
+            std::size_t fanOut;             // subdirectories per directory
+            std::size_t filesPerDirectory;  // files per directory, including executables
+            std::size_t executablesPerDirectory;
+        }; // struct TreeShape
+
+        // creates a synthetic tree of empty files under root. returns the number of executables created.
+        std::size_t generateTree(const std::string& root, const TreeShape& shape);
+
+        // moves the modification time of every directory under root (and root itself) an hour back
+        void ageTree(const std::string& root);
+
+        // the number of calls to operator new since the start of the program, on all threads
+        std::size_t getAllocationCount(void);
+
+        enum class OutputFormat
+        {
+            Text,   // one "benchmark.metric = value unit" line per measurement, as they come in
+            JSON    // everything collected into one JSON document, printed by printReport
+        }; // enum class OutputFormat
+
+        void setOutputFormat(OutputFormat format);
+
+        // records a single measurement
+        void report(const std::string& benchmark, const std::string& metric, double value, const std::string& unit);
+
+        // prints the JSON document of the arguments, the benchmarks that ran and all measurements (JSON format only)
+        void printReport(const Arguments& arguments, const std::vector<std::string>& benchmarks);
+
+        // benchmarks, each implemented in its own translation unit
+        void runPolicyBenchmark(const Arguments& arguments);
+        void runEnumerateBenchmark(const Arguments& arguments);
+        void runEnumerateStreamBenchmark(const Arguments& arguments);
+        void runCommitBenchmark(const Arguments& arguments);
+        void runCommitScalingBenchmark(const Arguments& arguments);
+        void runJournalBenchmark(const Arguments& arguments);
+        void runRuleNamesBenchmark(const Arguments& arguments);
+        void runListParseBenchmark(const Arguments& arguments);
+        void runPipelineBenchmark(const Arguments& arguments);
+        void runPipelinedBenchmark(const Arguments& arguments);
+        void runReconcileBenchmark(const Arguments& arguments);
+        void runReconcileMemoryBenchmark(const Arguments& arguments);
+        void runScanBenchmark(const Arguments& arguments);
+        void runScanIndexBenchmark(const Arguments& arguments);
+        void runScanPruneBenchmark(const Arguments& arguments);
+        void runScanLinksBenchmark(const Arguments& arguments);
+        void runClassifyBenchmark(const Arguments& arguments);
+        void runTranscodeBenchmark(const Arguments& arguments);
+        void runServiceBenchmark(const Arguments& arguments);
+        void runGroupsBenchmark(const Arguments& arguments);
+        void runFileSystemBenchmark(const Arguments& arguments);
+    } // namespace Bench
+} // namespace FWMFW
+
+#endif // !defined(DOTSLASHZERO_FWMFW_BENCH_HXX)
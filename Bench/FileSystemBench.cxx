@@ -0,0 +1,370 @@
+#include "Bench.hxx"
+
+#if defined(__linux__)
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif // defined(__linux__)
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Classifier.hxx"
+#include "FileInfo.hxx"
+#include "ScanIndex.hxx"
+#include "Scanner.hxx"
+#include "Utils.hxx"
+
+namespace FWMFW
+{
+    namespace Bench
+    {
+        namespace
+        {
+            // the file system calls made by a piece of code, by kind
+            struct SyscallCounts
+            {
+                std::size_t metadata;   // stat and its relatives
+                std::size_t listings;   // getdents
+                std::size_t opens;      // open and close
+            }; // struct SyscallCounts
+
+#if defined(__linux__) && defined(SECCOMP_USER_NOTIF_FLAG_CONTINUE)
+            const int NOTIFICATION_POLL_MS = 10;
+
+            enum class SyscallKind
+            {
+                Metadata,
+                Listing,
+                Open
+            }; // enum class SyscallKind
+
+            const std::vector<std::pair<long, SyscallKind>>& getCountedSyscalls(void)
+            {
+                // what the architecture has of them
+                static const std::vector<std::pair<long, SyscallKind>> SYSCALLS{
+#if defined(SYS_stat)
+                    { SYS_stat, SyscallKind::Metadata },
+#endif // defined(SYS_stat)
+#if defined(SYS_lstat)
+                    { SYS_lstat, SyscallKind::Metadata },
+#endif // defined(SYS_lstat)
+#if defined(SYS_newfstatat)
+                    { SYS_newfstatat, SyscallKind::Metadata },
+#endif // defined(SYS_newfstatat)
+#if defined(SYS_fstatat64)
+                    { SYS_fstatat64, SyscallKind::Metadata },
+#endif // defined(SYS_fstatat64)
+#if defined(SYS_statx)
+                    { SYS_statx, SyscallKind::Metadata },
+#endif // defined(SYS_statx)
+                    { SYS_fstat, SyscallKind::Metadata },
+#if defined(SYS_getdents)
+                    { SYS_getdents, SyscallKind::Listing },
+#endif // defined(SYS_getdents)
+                    { SYS_getdents64, SyscallKind::Listing },
+#if defined(SYS_open)
+                    { SYS_open, SyscallKind::Open },
+#endif // defined(SYS_open)
+                    { SYS_openat, SyscallKind::Open },
+                    { SYS_close, SyscallKind::Open }
+                };
+                return (SYSCALLS);
+            }
+
+            void addSyscall(long number, SyscallCounts& counts)
+            {
+                for (auto&& entry : getCountedSyscalls()) {
+                    if (entry.first != number) continue;
+                    if (entry.second == SyscallKind::Metadata) counts.metadata++;
+                    else if (entry.second == SyscallKind::Listing) counts.listings++;
+                    else counts.opens++;
+                    return;
+                }
+                return;
+            }
+
+            // runs function on a thread of its own. a seccomp filter hands every file system call of that thread
+            // (and of the threads it starts) over to the calling thread, which counts it and lets it go on. returns
+            // false if the kernel does not let the process do that.
+            bool countSyscalls(const std::function<void(void)>& function, SyscallCounts& counts)
+            {
+                counts = SyscallCounts{ 0, 0, 0 };
+                seccomp_notif_sizes sizes;
+                if (syscall(SYS_seccomp, SECCOMP_GET_NOTIF_SIZES, 0, &sizes) != 0) return (false);
+
+                std::vector<sock_filter> program;
+                program.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, nr)));
+                for (auto&& entry : getCountedSyscalls()) {
+                    auto number = static_cast<std::uint32_t>(entry.first);
+                    program.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, number, 0, 1));
+                    program.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_USER_NOTIF));
+                }
+                program.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+                sock_fprog filter{ static_cast<unsigned short>(program.size()), program.data() };
+                // allocated up front: the worker may be holding a lock of the allocator while it waits for an answer
+                std::vector<char> request(sizes.seccomp_notif);
+                std::vector<char> response(sizes.seccomp_notif_resp);
+
+                // the listening descriptor, -1 until the filter is in place and -2 if it could not be installed
+                std::atomic<int> listener{ -1 };
+                std::atomic<bool> isDone{ false };
+                std::exception_ptr error;
+                std::thread worker([&function, &filter, &listener, &isDone, &error] (void) -> void {
+                    int fd = -2;
+                    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == 0) {
+                        fd = static_cast<int>(
+                            syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, SECCOMP_FILTER_FLAG_NEW_LISTENER, &filter)
+                        );
+                    }
+                    listener = (fd < 0) ? -2 : fd;
+                    if (fd < 0) return;
+                    try {
+                        function();
+                    } catch (...) {
+                        error = std::current_exception();
+                    }
+                    isDone = true;
+                    return;
+                });
+                while (listener.load() == -1) std::this_thread::yield();
+
+                int fd = listener.load();
+                if (fd < 0) {
+                    worker.join();
+                    return (false);
+                }
+
+                // the worker waits in each of its calls until it is answered, so what it calls once it is done
+                // (while it exits) is answered but not counted. the listener hangs up when the worker is gone, kernels
+                // that do not tell are given a poll interval of quiet.
+                for (;;) {
+                    pollfd pollFd{ fd, POLLIN, 0 };
+                    if (poll(&pollFd, 1, NOTIFICATION_POLL_MS) <= 0) {
+                        if (isDone.load()) break;
+                        continue;
+                    }
+                    if ((pollFd.revents & POLLIN) == 0) break;
+
+                    std::fill(request.begin(), request.end(), '\0');
+                    auto* notification = reinterpret_cast<seccomp_notif*>(request.data());
+                    if (ioctl(fd, SECCOMP_IOCTL_NOTIF_RECV, notification) != 0) continue;
+                    if (!isDone.load()) addSyscall(notification->data.nr, counts);
+
+                    std::fill(response.begin(), response.end(), '\0');
+                    auto* answer = reinterpret_cast<seccomp_notif_resp*>(response.data());
+                    answer->id = notification->id;
+                    answer->flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+                    ioctl(fd, SECCOMP_IOCTL_NOTIF_SEND, answer);
+                }
+                worker.join();
+                close(fd);
+
+                if (error) std::rethrow_exception(error);
+                return (true);
+            }
+#else
+            // only Linux hands the calls of a thread over to be counted
+            bool countSyscalls(const std::function<void(void)>& function, SyscallCounts& counts)
+            {
+                (void) function;
+                counts = SyscallCounts{ 0, 0, 0 };
+                return (false);
+            }
+#endif // defined(__linux__) && defined(SECCOMP_USER_NOTIF_FLAG_CONTINUE)
+
+            // what BlockList made of a line before: a directory, or else a candidate that exists. a probe each.
+            Utils::FileType probeSeparately(const std::string& path, const Scanner::Classifier& classifier)
+            {
+                std::error_code errorCode;
+                if (std::filesystem::is_directory(path, errorCode)) return (Utils::FileType::Directory);
+                if (classifier.isCandidate(path) && std::filesystem::exists(path, errorCode)) {
+                    return (Utils::FileType::File);
+                }
+                return (Utils::FileType::Missing);
+            }
+
+            // the same decision from what one call told
+            Utils::FileType probeOnce(const std::string& path, const Scanner::Classifier& classifier)
+            {
+                Utils::FileInfo info;
+                Utils::getFileInfo(path, info);
+                if (info.type == Utils::FileType::Directory) return (Utils::FileType::Directory);
+                if ((info.type != Utils::FileType::Missing) && classifier.isCandidate(path)) {
+                    return (Utils::FileType::File);
+                }
+                return (Utils::FileType::Missing);
+            }
+
+            // what a directory was asked before: its time and its identity in a call each
+            class SeparateCallsBackend : public Scanner::NativeBackend
+            {
+            public:
+                virtual bool getInfo(const std::string& dir, bool withIdentity, Utils::FileInfo& info) const override
+                {
+                    if (!Utils::getFileInfo(dir, info)) return (false);
+                    info.hasIdentity = false;
+                    Utils::FileInfo identityInfo;
+                    if (withIdentity && Utils::getFileInfo(dir, identityInfo, true) && identityInfo.hasIdentity) {
+                        info.hasIdentity = true;
+                        info.identity = identityInfo.identity;
+                    }
+                    return (true);
+                }
+            }; // class SeparateCallsBackend
+
+            void reportCounts(const std::string& run, const SyscallCounts& counts, double units, const char* unit)
+            {
+                report("filesystem", run + "_metadata_calls", static_cast<double>(counts.metadata), "calls");
+                report("filesystem", run + "_listing_calls", static_cast<double>(counts.listings), "calls");
+                report("filesystem", run + "_open_calls", static_cast<double>(counts.opens), "calls");
+                report(
+                    "filesystem", run + "_metadata_per_" + unit, static_cast<double>(counts.metadata) / units, "calls"
+                );
+                return;
+            }
+        } // anonymous namespace
+
+        void runFileSystemBenchmark(const Arguments& arguments)
+        {
+            TreeShape shape;
+            shape.depth = arguments.getSize("scan.depth", 4);
+            shape.fanOut = arguments.getSize("scan.fanout", 6);
+            shape.filesPerDirectory = arguments.getSize("scan.files", 16);
+            shape.executablesPerDirectory = arguments.getSize("scan.exes", 4);
+            std::size_t entryCount = std::max<std::size_t>(arguments.getSize("filesystem.entries", 4000), 4);
+            std::size_t repetitions = arguments.getSize("repetitions", 3);
+
+            ScratchDirectory scratch("filesystem");
+            const std::string& root = scratch.getPath();
+            std::size_t expected = generateTree(root, shape);
+
+            // a list with files that are candidates, files that are not, directories and missing files in turn
+            Scanner::Classifier classifier;
+            std::vector<std::string> candidates;
+            std::vector<std::string> others;
+            std::vector<std::string> directories{ root };
+            for (auto&& entry : std::filesystem::recursive_directory_iterator(root)) {
+                auto path = entry.path().string();
+                if (entry.is_directory()) directories.push_back(path + Utils::PATH_SEPARATOR);
+                else if (classifier.isCandidate(path)) candidates.push_back(path);
+                else others.push_back(path);
+            }
+            if (candidates.empty() || others.empty()) {
+                throw (std::runtime_error("filesystem: the tree needs executables and other files"));
+            }
+            std::vector<std::string> entries;
+            entries.reserve(entryCount + 3);
+            for (std::size_t idx = 0; entries.size() < entryCount; idx++) {
+                entries.push_back(candidates[idx % candidates.size()]);
+                entries.push_back(others[idx % others.size()]);
+                entries.push_back(directories[idx % directories.size()]);
+                entries.push_back(root + "missing" + std::to_string(idx) + ".exe");
+            }
+            entries.resize(entryCount);
+
+            std::vector<Utils::FileType> separateTypes;
+            std::vector<Utils::FileType> onceTypes;
+            auto probeAllSeparately = [&entries, &classifier, &separateTypes] (void) -> void {
+                separateTypes.clear();
+                for (auto&& entry : entries) separateTypes.push_back(probeSeparately(entry, classifier));
+                return;
+            };
+            auto probeAllOnce = [&entries, &classifier, &onceTypes] (void) -> void {
+                onceTypes.clear();
+                for (auto&& entry : entries) onceTypes.push_back(probeOnce(entry, classifier));
+                return;
+            };
+
+            double separateTime = timeBestOf(repetitions, probeAllSeparately);
+            double onceTime = timeBestOf(repetitions, probeAllOnce);
+            if (separateTypes != onceTypes) throw (std::runtime_error("filesystem: the probes tell different things"));
+            report("filesystem", "list_entries", static_cast<double>(entries.size()), "entries");
+            report("filesystem", "list_two_probes", separateTime, "ms");
+            report("filesystem", "list_one_call", onceTime, "ms");
+            report("filesystem", "list_speedup", separateTime / std::max(onceTime, 1e-9), "x");
+
+            // the walks, on a single walker so that the calls can be told apart
+            auto scanOnce = [&root, expected] (
+                const std::shared_ptr<const Scanner::Backend>& backend, bool isIndexed
+            ) -> void {
+                Scanner::ScanOptions options;
+                options.threadCount = 1;
+                // both need the time and the identity of every directory
+                options.followLinks = isIndexed;
+                Scanner::ScanIndexBuilder nextIndex(options.classifier.getIndexKey());
+                if (isIndexed) options.nextIndex = &nextIndex;
+                Scanner::VectorSink sink;
+                Scanner::DirectoryScanner(options, backend).scan({ root }, sink);
+                if (sink.matches.size() != expected) {
+                    throw (std::runtime_error("filesystem: unexpected number of files found"));
+                }
+                return;
+            };
+            std::vector<std::pair<std::string, std::function<void(void)>>> walks{
+                { "walk_std_filesystem", [&scanOnce] (void) -> void {
+                    scanOnce(std::make_shared<Scanner::FileSystemBackend>(), false);
+                    return;
+                } },
+                { "walk_native", [&scanOnce] (void) -> void {
+                    scanOnce(std::make_shared<Scanner::NativeBackend>(), false);
+                    return;
+                } },
+                { "walk_indexed_separate", [&scanOnce] (void) -> void {
+                    scanOnce(std::make_shared<SeparateCallsBackend>(), true);
+                    return;
+                } },
+                { "walk_indexed_merged", [&scanOnce] (void) -> void {
+                    scanOnce(std::make_shared<Scanner::NativeBackend>(), true);
+                    return;
+                } }
+            };
+            std::vector<double> walkTimes;
+            report("filesystem", "directories", static_cast<double>(directories.size()), "dirs");
+            for (auto&& walk : walks) {
+                walkTimes.push_back(timeBestOf(repetitions, walk.second));
+                report("filesystem", walk.first, walkTimes.back(), "ms");
+            }
+            report("filesystem", "walk_speedup", walkTimes[0] / std::max(walkTimes[1], 1e-9), "x");
+            report("filesystem", "walk_indexed_speedup", walkTimes[2] / std::max(walkTimes[3], 1e-9), "x");
+
+            // the calls, counted apart from the timed runs: handing them over costs far more than they do
+            SyscallCounts counts;
+            if (!countSyscalls(probeAllSeparately, counts)) {
+                report("filesystem", "syscalls_supported", 0.0, "");
+                return;
+            }
+            report("filesystem", "syscalls_supported", 1.0, "");
+            double entryUnits = static_cast<double>(entries.size());
+            reportCounts("list_two_probes", counts, entryUnits, "entry");
+            countSyscalls(probeAllOnce, counts);
+            reportCounts("list_one_call", counts, entryUnits, "entry");
+            if (counts.metadata != entries.size()) {
+                throw (std::runtime_error("filesystem: not one call per entry of the list"));
+            }
+
+            double directoryUnits = static_cast<double>(directories.size());
+            for (auto&& walk : walks) {
+                countSyscalls(walk.second, counts);
+                reportCounts(walk.first, counts, directoryUnits, "dir");
+            }
+            // the merged walk asks each directory (the root included) once, what it lists is not asked again
+            if (counts.metadata != directories.size()) {
+                throw (std::runtime_error("filesystem: not one call per directory"));
+            }
+            return;
+        }
+    } // namespace Bench
+} // namespace FWMFW
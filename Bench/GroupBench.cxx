@@ -0,0 +1,245 @@
+#include "Bench.hxx"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <unordered_set>
+
+#include "BlockList.hxx"
+#include "MemoryRuleStore.hxx"
+#include "PathTable.hxx"
+#include "Reconcile.hxx"
+#include "RuleGroups.hxx"
+#include "ScanIndex.hxx"
+#include "Scanner.hxx"
+#include "Utils.hxx"
+#include "WinNetFW.hxx"
+
+namespace FWMFW
+{
+    namespace Bench
+    {
+        namespace
+        {
+            // a section per group with the group's folder, and in changedGroup also extraFile
+            void writeGroupedList(
+                const std::string& listFile, const std::vector<std::string>& roots, std::size_t changedGroup,
+                const std::string& extraFile
+            )
+            {
+                std::ofstream list{ listFile };
+                list << "# generated by FWMFWBench\n";
+                for (std::size_t idx = 0; idx < roots.size(); idx++) {
+                    list << "[group" << idx << "]\n" << roots[idx] << "\n";
+                    if ((idx == changedGroup) && !extraFile.empty()) list << extraFile << "\n";
+                }
+                return;
+            }
+
+            std::shared_ptr<WinNetFW::MemoryRuleStore> createStore(std::size_t foreignCount)
+            {
+                auto store = std::make_shared<WinNetFW::MemoryRuleStore>();
+                for (std::size_t idx = 0; idx < foreignCount; idx++) {
+                    store->addRule(WinNetFW::Rule{
+                        "Vendor rule " + std::to_string(idx), "C:\\Program Files\\app" + std::to_string(idx) + ".exe",
+                        "", (idx % 2 == 0) ? WinNetFW::RuleDirection::In : WinNetFW::RuleDirection::Out,
+                        WinNetFW::RuleAction::Allow, true
+                    });
+                }
+                return (store);
+            }
+
+            // expands as main does with --scan-index, so that the folders are not what the runs spend their time on
+            void expandIndexed(
+                const std::string& indexFile, const Scanner::ScanOptions& options,
+                const std::function<void(const Scanner::ScanOptions&)>& expand
+            )
+            {
+                Scanner::ScanIndex previousIndex;
+                previousIndex.load(indexFile, options.classifier.getIndexKey());
+                Scanner::ScanIndexBuilder nextIndex(options.classifier.getIndexKey());
+                Scanner::ScanOptions indexedOptions = options;
+                indexedOptions.previousIndex = &previousIndex;
+                indexedOptions.nextIndex = &nextIndex;
+                expand(indexedOptions);
+                previousIndex.close();
+                if (!nextIndex.save(indexFile)) throw (std::runtime_error("groups: unable to save the scan index"));
+                return;
+            }
+
+            // what main does with a list without groups: every file against every rule
+            void reconcileFlat(
+                const std::string& listFile, const std::string& indexFile, const Scanner::ScanOptions& options,
+                WinNetFW::FireWallPolicy& policy
+            )
+            {
+                Reconcile::BlockList blockList;
+                if (!blockList.load(listFile, options.classifier)) {
+                    throw (std::runtime_error("groups: unable to read the list file"));
+                }
+                Utils::PathTable files;
+                expandIndexed(indexFile, options, [&blockList, &files] (const Scanner::ScanOptions& options) -> void {
+                    blockList.expand(options, files);
+                    return;
+                });
+                Utils::PathTable rules;
+                policy.getBlockRules(rules);
+                Reconcile::applyPlan(Reconcile::createPlan(std::move(files), std::move(rules)), policy);
+                return;
+            }
+
+            // what main does with groups: only the groups that differ from the state, against the rules in the state.
+            // the state is updated.
+            Reconcile::GroupPlan reconcileGroups(
+                const std::string& listFile, const std::string& indexFile, const std::string& stateFile,
+                const Scanner::ScanOptions& options, WinNetFW::FireWallPolicy& policy
+            )
+            {
+                Reconcile::GroupedList list;
+                if (!list.load(listFile, options.classifier)) throw (std::runtime_error("groups: " + list.getError()));
+                expandIndexed(indexFile, options, [&list] (const Scanner::ScanOptions& options) -> void {
+                    list.expand(options);
+                    return;
+                });
+                Reconcile::GroupState state;
+                state.load(stateFile);
+                auto groupPlan = Reconcile::createGroupPlan(list.getGroups(), state, policy);
+                for (auto&& result : Reconcile::applyPlans(groupPlan.plans, policy)) {
+                    if (result.status != WinNetFW::RuleChangeResult::Status::Applied) {
+                        throw (std::runtime_error("groups: a change was not applied"));
+                    }
+                }
+                state.update(list.getGroups(), groupPlan.plans);
+                if (!state.save(stateFile, policy.getRuleCount())) {
+                    throw (std::runtime_error("groups: unable to save the group state"));
+                }
+                return (groupPlan);
+            }
+
+            std::unordered_set<std::string> getBlockedFiles(const WinNetFW::FireWallPolicy& policy)
+            {
+                std::unordered_set<std::string> blocked;
+                for (auto&& rule : policy.enumerateRules(WinNetFW::getBlockRuleQuery())) {
+                    blocked.insert(rule.applicationName);
+                }
+                return (blocked);
+            }
+        } // anonymous namespace
+
+        void runGroupsBenchmark(const Arguments& arguments)
+        {
+            std::size_t groupCount = std::max<std::size_t>(arguments.getSize("groups.groups", 50), 1);
+            std::size_t foreignCount = arguments.getSize("groups.foreign_rules", 20000);
+            TreeShape shape{
+                arguments.getSize("groups.depth", 2),
+                arguments.getSize("groups.fanout", 4),
+                arguments.getSize("groups.files", 8),
+                arguments.getSize("groups.exes", 4)
+            };
+
+            WinNetFW::MemoryRuleStore::Latency latency;
+            latency.enumerateCall = std::chrono::nanoseconds(arguments.getSize("latency.enumerate_call_ns", 2000));
+            latency.enumerateRule = std::chrono::nanoseconds(arguments.getSize("latency.enumerate_rule_ns", 100));
+            latency.add = std::chrono::nanoseconds(arguments.getSize("latency.add_ns", 20000));
+            latency.remove = std::chrono::nanoseconds(arguments.getSize("latency.remove_ns", 20000));
+
+            ScratchDirectory scratch("groups");
+            std::vector<std::string> roots;
+            std::size_t fileCount = 0;
+            for (std::size_t idx = 0; idx < groupCount; idx++) {
+                roots.push_back(scratch.getPath() + "group" + std::to_string(idx) + Utils::PATH_SEPARATOR);
+                std::filesystem::create_directory(roots.back());
+                fileCount += generateTree(roots.back(), shape);
+                // freshly modified directories are never trusted by the index
+                ageTree(roots.back());
+            }
+            std::string extraFile = scratch.getPath() + "extra.exe";
+            std::ofstream{ extraFile };
+            std::string listFile = scratch.getPath() + "list.txt";
+            std::string stateFile = scratch.getPath() + "groups.state";
+            std::string flatIndexFile = scratch.getPath() + "flat.idx";
+            std::string groupIndexFile = scratch.getPath() + "groups.idx";
+            std::size_t changedGroup = groupCount / 2;
+
+            Scanner::ScanOptions options;
+            report("groups", "groups", static_cast<double>(groupCount), "groups");
+            report("groups", "files", static_cast<double>(fileCount), "files");
+
+            // the runs before the change, which leave both policies with the same files blocked (untimed)
+            writeGroupedList(listFile, roots, changedGroup, std::string());
+            auto flatStore = createStore(foreignCount);
+            WinNetFW::FireWallPolicy flatPolicy(flatStore);
+            reconcileFlat(listFile, flatIndexFile, options, flatPolicy);
+            auto groupStore = createStore(foreignCount);
+            WinNetFW::FireWallPolicy groupPolicy(groupStore);
+            reconcileGroups(listFile, groupIndexFile, stateFile, options, groupPolicy);
+            flatStore->setLatency(latency);
+            groupStore->setLatency(latency);
+
+            // one line added to one group
+            writeGroupedList(listFile, roots, changedGroup, extraFile);
+            Stopwatch stopwatch;
+            reconcileFlat(listFile, flatIndexFile, options, flatPolicy);
+            double flatElapsed = stopwatch.getElapsedMilliseconds();
+
+            groupStore->resetCallCounts();
+            stopwatch.restart();
+            auto groupPlan = reconcileGroups(listFile, groupIndexFile, stateFile, options, groupPolicy);
+            double groupsElapsed = stopwatch.getElapsedMilliseconds();
+            if (groupPlan.isEnumerated || (groupStore->getCallCounts().enumerateCalls != 0)) {
+                throw (std::runtime_error("groups: the policy was read although the state is current"));
+            }
+            if ((groupPlan.plans.size() != 1) ||
+                (groupPlan.plans.front().getGroup() != "group" + std::to_string(changedGroup)) ||
+                (groupPlan.plans.front().getAdds().size() != 1)) {
+                throw (std::runtime_error("groups: not only the changed group was reconciled"));
+            }
+            auto blocked = getBlockedFiles(groupPolicy);
+            if ((blocked != getBlockedFiles(flatPolicy)) || (blocked.size() != fileCount + 1)) {
+                throw (std::runtime_error("groups: the grouped run blocked other files than the flat one"));
+            }
+
+            report("groups", "flat", flatElapsed, "ms");
+            report("groups", "grouped", groupsElapsed, "ms");
+            report("groups", "speedup", flatElapsed / std::max(groupsElapsed, 1e-9), "x");
+            report("groups", "groups_reconciled", static_cast<double>(groupPlan.plans.size()), "groups");
+            auto&& plan = groupPlan.plans.front();
+            report(
+                "groups", "files_planned", static_cast<double>(plan.getAdds().size() + plan.getKeeps().size()), "files"
+            );
+
+            // nothing changed since: nothing is planned
+            groupStore->resetCallCounts();
+            stopwatch.restart();
+            groupPlan = reconcileGroups(listFile, groupIndexFile, stateFile, options, groupPolicy);
+            double unchangedElapsed = stopwatch.getElapsedMilliseconds();
+            if (!groupPlan.plans.empty() || groupPlan.isEnumerated ||
+                (groupStore->getCallCounts().enumerateCalls != 0)) {
+                throw (std::runtime_error("groups: an unchanged list was reconciled"));
+            }
+            report("groups", "grouped_unchanged", unchangedElapsed, "ms");
+
+            // a rule added by someone else: the state is not trusted, every group is planned against the policy
+            groupStore->addRule(WinNetFW::Rule{
+                "Vendor rule added", "C:\\Program Files\\added.exe", "", WinNetFW::RuleDirection::In,
+                WinNetFW::RuleAction::Allow, true
+            });
+            stopwatch.restart();
+            groupPlan = reconcileGroups(listFile, groupIndexFile, stateFile, options, groupPolicy);
+            double untrustedElapsed = stopwatch.getElapsedMilliseconds();
+            bool isChanged = std::any_of(
+                groupPlan.plans.begin(), groupPlan.plans.end(), [] (const Reconcile::Plan& plan) -> bool {
+                    return (!plan.isEmpty());
+                }
+            );
+            if (!groupPlan.isEnumerated || (groupPlan.unchangedCount != 0) || isChanged) {
+                throw (std::runtime_error("groups: a policy that changed was not read"));
+            }
+            report("groups", "grouped_untrusted", untrustedElapsed, "ms");
+            return;
+        }
+    } // namespace Bench
+} // namespace FWMFW
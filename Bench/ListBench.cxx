@@ -0,0 +1,164 @@
+#include "Bench.hxx"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+
+#include "ListFile.hxx"
+#include "Utils.hxx"
+
+namespace FWMFW
+{
+    namespace Bench
+    {
+        namespace
+        {
+            // the string utilities as they were before they moved onto std::string_view, for the baseline
+            std::string copyingTrimChars(const std::string& str, std::function<bool(int)>&& trimPred)
+            {
+                if (str.length() == 0) return (str);
+                std::string trimmed = str;
+                while (!trimmed.empty() && trimPred(trimmed[0])) trimmed = trimmed.substr(1);
+                while (!trimmed.empty() && trimPred(trimmed[trimmed.length() - 1])) {
+                    trimmed = trimmed.substr(0, trimmed.length() - 1);
+                }
+                return (trimmed);
+            }
+
+            std::string copyingTrimWhiteSpaces(const std::string& str)
+            {
+                return (copyingTrimChars(str, [](int c) -> bool { return (std::isspace(c) != 0); }));
+            }
+
+            std::string copyingReplaceChars(const std::string& str, const char findChar, const char replacement)
+            {
+                if (str.length() == 0) return (str);
+                std::string result = str;
+                for (std::string::size_type idx = 0; idx < result.length(); idx++) {
+                    if (result[idx] == findChar) result[idx] = replacement;
+                }
+                return (result);
+            }
+
+            bool copyingStringEndsWith(const std::string& str, const std::string& ending)
+            {
+                if (str.length() < ending.length()) return (false);
+                return (str.substr(str.length() - ending.length()).compare(ending) == 0);
+            }
+
+            // what the parser saw, to check that both paths read the same entries
+            struct ParseResult
+            {
+                std::size_t exclusions;
+                std::size_t files;
+                std::size_t others;
+                std::size_t characters;
+
+                bool operator==(const ParseResult& other) const
+                {
+                    return (
+                        exclusions == other.exclusions && files == other.files && others == other.others &&
+                        characters == other.characters
+                    );
+                }
+            }; // struct ParseResult
+
+            // the line handling of BlockList::load, without the file system checks that follow it
+            ParseResult parseWithGetLine(const std::string& listFile)
+            {
+                ParseResult result{ 0, 0, 0, 0 };
+                std::ifstream inFile{ listFile };
+                for (std::string line; std::getline(inFile, line);) {
+                    auto item = copyingTrimWhiteSpaces(line);
+                    if (item.empty() || item[0] == '#') continue;
+
+                    if (item[0] == '!') {
+                        auto pattern = copyingTrimWhiteSpaces(item.substr(1));
+                        result.exclusions++;
+                        result.characters += pattern.length();
+                        continue;
+                    }
+
+                    auto itemF = copyingReplaceChars(item, '/', Utils::PATH_SEPARATOR);
+                    if (copyingStringEndsWith(itemF, ".exe")) result.files++;
+                    else result.others++;
+                    result.characters += itemF.length();
+                }
+                return (result);
+            }
+
+            ParseResult parseWithReader(const std::string& listFile)
+            {
+                ParseResult result{ 0, 0, 0, 0 };
+                Reconcile::ListFileReader reader;
+                if (!reader.open(listFile)) throw (std::runtime_error("list-parse: unable to open the list file"));
+
+                std::string itemF;
+                for (Reconcile::ListLine line; reader.next(line);) {
+                    if (line.isExclusion) {
+                        result.exclusions++;
+                        result.characters += line.text.length();
+                        continue;
+                    }
+
+                    itemF.assign(line.text);
+                    Utils::replaceCharsInPlace(itemF, '/', Utils::PATH_SEPARATOR, false);
+                    if (Utils::stringEndsWith(itemF, ".exe")) result.files++;
+                    else result.others++;
+                    result.characters += itemF.length();
+                }
+                return (result);
+            }
+        } // anonymous namespace
+
+        void runListParseBenchmark(const Arguments& arguments)
+        {
+            std::size_t lineCount = arguments.getSize("list-parse.lines", 1000000);
+
+            // what hand written lists look like: indentation, comments, blank lines, mixed separators, CRLF
+            ScratchDirectory scratch("listparse");
+            std::string listFile = scratch.getPath() + "list.txt";
+            {
+                std::ofstream outFile{ listFile, std::ios::binary };
+                for (std::size_t idx = 0; idx < lineCount; idx++) {
+                    switch (idx % 8) {
+                        case 0: outFile << "# group " << idx << "\r\n"; break;
+                        case 1: outFile << "\r\n"; break;
+                        case 2: outFile << "!node_modules\r\n"; break;
+                        case 3: outFile << "    C:/Games/Vendor" << idx / 64 << "/bin\t \r\n"; break;
+                        default:
+                            outFile << "\tC:\\Program Files\\Vendor" << idx / 64 << "/app" << idx << ".exe   \r\n";
+                            break;
+                    }
+                }
+            }
+
+            std::size_t allocations = getAllocationCount();
+            Stopwatch stopwatch;
+            auto before = parseWithGetLine(listFile);
+            double beforeTime = stopwatch.getElapsedMilliseconds();
+            std::size_t beforeAllocations = getAllocationCount() - allocations;
+
+            allocations = getAllocationCount();
+            stopwatch.restart();
+            auto after = parseWithReader(listFile);
+            double afterTime = stopwatch.getElapsedMilliseconds();
+            std::size_t afterAllocations = getAllocationCount() - allocations;
+
+            if (!(after == before) || after.files != lineCount / 2) {
+                throw (std::runtime_error("list-parse: the reader read different entries"));
+            }
+
+            report("list-parse", "lines", static_cast<double>(lineCount), "lines");
+            report("list-parse", "getline", beforeTime, "ms");
+            report("list-parse", "getline_allocations", static_cast<double>(beforeAllocations), "allocs");
+            report("list-parse", "reader", afterTime, "ms");
+            report("list-parse", "reader_allocations", static_cast<double>(afterAllocations), "allocs");
+            report("list-parse", "reader_per_line", afterTime * 1e6 / static_cast<double>(lineCount), "ns");
+            report("list-parse", "speedup", beforeTime / std::max(afterTime, 1e-9), "x");
+            return;
+        }
+    } // namespace Bench
+} // namespace FWMFW
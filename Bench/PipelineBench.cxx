@@ -0,0 +1,401 @@
+#include "Bench.hxx"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+#include "BlockList.hxx"
+#include "MemoryRuleStore.hxx"
+#include "PathTable.hxx"
+#include "Pipeline.hxx"
+#include "Reconcile.hxx"
+#include "Scanner.hxx"
+#include "Utils.hxx"
+#include "WinNetFW.hxx"
+
+namespace FWMFW
+{
+    namespace Bench
+    {
+        namespace
+        {
+            struct PipelineShape
+            {
+                std::size_t fileCount;          // executables to block in total
+                std::size_t rootCount;          // folders in the list file
+                std::size_t singlePerMille;     // of the files, listed on their own instead of found in a folder
+                std::size_t executablesPerDirectory;
+                std::size_t othersPerDirectory; // files that are not executables
+            }; // struct PipelineShape
+
+            // creates the folders and files of a list file under dir and writes the list file. returns the files
+            // that the list asks to block.
+            std::vector<std::string> generateListedTree(
+                const std::string& dir, const std::string& listFile, const PipelineShape& shape
+            )
+            {
+                std::vector<std::string> result;
+                result.reserve(shape.fileCount);
+                std::ofstream list{ listFile };
+                list << "# generated by FWMFWBench\n!cache\n";
+
+                auto createFile = [] (const std::string& path) -> void {
+                    std::ofstream{ path };
+                    return;
+                };
+
+                std::size_t singleCount = shape.fileCount * shape.singlePerMille / 1000;
+                std::string singleDir = dir + "single" + Utils::PATH_SEPARATOR;
+                std::filesystem::create_directory(singleDir);
+                for (std::size_t idx = 0; idx < singleCount; idx++) {
+                    std::string name = "tool" + std::to_string(idx) + ".exe";
+                    createFile(singleDir + name);
+                    list << singleDir << name << "\n";
+                    result.push_back(singleDir + name);
+                }
+
+                std::vector<std::string> roots;
+                for (std::size_t idx = 0; idx < shape.rootCount; idx++) {
+                    roots.push_back(dir + "vendor" + std::to_string(idx) + Utils::PATH_SEPARATOR);
+                    std::filesystem::create_directory(roots.back());
+                    list << roots.back() << "\n";
+                }
+
+                // games spread over the roots, each with its executables, other files and every so often a cache
+                // of executables that the exclusion in the list leaves out
+                std::size_t remaining = shape.fileCount - singleCount;
+                for (std::size_t game = 0; remaining > 0; game++) {
+                    std::string gameName = "game" + std::to_string(game);
+                    std::string gameDir = roots[game % roots.size()] + gameName + Utils::PATH_SEPARATOR;
+                    std::filesystem::create_directory(gameDir);
+
+                    for (std::size_t idx = 0; idx < shape.executablesPerDirectory && remaining > 0; idx++) {
+                        std::string name = "app" + std::to_string(idx) + ".exe";
+                        createFile(gameDir + name);
+                        result.push_back(gameDir + name);
+                        remaining--;
+                    }
+                    for (std::size_t idx = 0; idx < shape.othersPerDirectory; idx++) {
+                        createFile(gameDir + "data" + std::to_string(idx) + ".pak");
+                    }
+                    if (game % 8 == 0) {
+                        std::string cacheDir = gameDir + "cache" + Utils::PATH_SEPARATOR;
+                        std::filesystem::create_directory(cacheDir);
+                        for (std::size_t idx = 0; idx < 4; idx++) {
+                            createFile(cacheDir + "shader" + std::to_string(idx) + ".exe");
+                        }
+                    }
+                }
+                return (result);
+            }
+
+            PipelineShape getPipelineShape(const Arguments& arguments)
+            {
+                PipelineShape shape;
+                shape.fileCount = arguments.getSize("pipeline.files", 20000);
+                shape.rootCount = std::max<std::size_t>(arguments.getSize("pipeline.roots", 16), 1);
+                shape.singlePerMille = arguments.getSize("pipeline.single_per_mille", 10);
+                shape.executablesPerDirectory = std::max<std::size_t>(arguments.getSize("pipeline.exes", 16), 1);
+                shape.othersPerDirectory = arguments.getSize("pipeline.others", 16);
+                return (shape);
+            }
+
+            WinNetFW::MemoryRuleStore::Latency getLatency(const Arguments& arguments)
+            {
+                WinNetFW::MemoryRuleStore::Latency latency;
+                latency.enumerateCall = std::chrono::nanoseconds(arguments.getSize("latency.enumerate_call_ns", 2000));
+                latency.enumerateRule = std::chrono::nanoseconds(arguments.getSize("latency.enumerate_rule_ns", 100));
+                latency.create = std::chrono::nanoseconds(arguments.getSize("latency.create_ns", 10000));
+                latency.add = std::chrono::nanoseconds(arguments.getSize("latency.add_ns", 20000));
+                latency.remove = std::chrono::nanoseconds(arguments.getSize("latency.remove_ns", 20000));
+                return (latency);
+            }
+
+            // one of every RESPELLED_EVERY blocked files was listed in another case (the file name in upper case) by
+            // the previous run: its rules have the names of the file and have to be kept
+            const std::size_t RESPELLED_EVERY = 8;
+
+            std::string respell(const std::string& appName)
+            {
+                std::string result = appName;
+                for (std::size_t idx = result.find_last_of(Utils::PATH_SEPARATOR) + 1; idx < result.length(); idx++) {
+                    char c = result[idx];
+                    if ((c >= 'a') && (c <= 'z')) result[idx] = static_cast<char>(c - 'a' + 'A');
+                }
+                return (result);
+            }
+
+            struct PreviousRun
+            {
+                std::shared_ptr<WinNetFW::MemoryRuleStore> store;
+                std::size_t blockedCount;   // requested files that are blocked already, some of them in another case
+                std::size_t staleCount;     // blocked files that are no longer listed
+            }; // struct PreviousRun
+
+            // the policy as a previous run left it: foreign rules, some of the files blocked, some stale blocks. the
+            // same arguments give the same policy.
+            PreviousRun createPreviousRun(
+                const Arguments& arguments, const std::string& dir, const std::vector<std::string>& requested
+            )
+            {
+                // per mille of the files that are blocked already, and rules of files that are no longer listed
+                std::size_t blockedPerMille = arguments.getSize("pipeline.blocked_per_mille", 500);
+                std::size_t stalePerMille = arguments.getSize("pipeline.stale_per_mille", 50);
+                std::size_t foreignCount = arguments.getSize("pipeline.foreign_rules", requested.size());
+
+                PreviousRun result{ std::make_shared<WinNetFW::MemoryRuleStore>(), 0, 0 };
+                WinNetFW::FireWallPolicy policy(result.store);
+                std::vector<WinNetFW::Rule> foreignRules;
+                for (std::size_t idx = 0; idx < foreignCount; idx++) {
+                    foreignRules.push_back(WinNetFW::Rule{
+                        "Vendor rule " + std::to_string(idx),
+                        "C:\\Program Files\\Vendor\\app" + std::to_string(idx) + ".exe", "",
+                        (idx % 2 == 0) ? WinNetFW::RuleDirection::In : WinNetFW::RuleDirection::Out,
+                        WinNetFW::RuleAction::Allow, true
+                    });
+                }
+                result.store->addRules(foreignRules);
+
+                std::mt19937 random(42);
+                WinNetFW::RuleTransaction previousRun;
+                for (auto&& appName : requested) {
+                    if (random() % 1000 >= blockedPerMille) continue;
+                    previousRun.block((result.blockedCount % RESPELLED_EVERY == 0) ? respell(appName) : appName);
+                    result.blockedCount++;
+                }
+                result.staleCount = requested.size() * stalePerMille / 1000;
+                for (std::size_t idx = 0; idx < result.staleCount; idx++) {
+                    previousRun.block(dir + "removed" + std::to_string(idx) + Utils::PATH_SEPARATOR + "app.exe");
+                }
+                policy.commit(previousRun);
+                return (result);
+            }
+
+            // a cold disk: every directory costs a seek before it can be enumerated
+            class ColdBackend : public Scanner::Backend
+            {
+            public:
+                explicit ColdBackend(std::chrono::microseconds latency) :
+                    _backend(Scanner::getDefaultBackend()), _latency(latency)
+                { return; }
+
+                virtual bool enumerate(const std::string& dir, const EntryCallback& callback) const override
+                {
+                    // the thread waits for the disk, it does not keep a processor busy
+                    std::this_thread::sleep_for(_latency);
+                    return (_backend->enumerate(dir, callback));
+                }
+
+                virtual bool getInfo(const std::string& dir, bool withIdentity, Utils::FileInfo& info) const override
+                {
+                    return (_backend->getInfo(dir, withIdentity, info));
+                }
+
+                virtual std::int64_t getCurrentTime(void) const override { return (_backend->getCurrentTime()); }
+
+            private:
+                std::shared_ptr<const Scanner::Backend> _backend;
+                std::chrono::microseconds _latency;
+            }; // class ColdBackend
+        } // anonymous namespace
+
+        void runPipelineBenchmark(const Arguments& arguments)
+        {
+            typedef WinNetFW::RuleChangeResult::Status Status;
+
+            PipelineShape shape = getPipelineShape(arguments);
+            std::size_t threads = arguments.getSize("threads", 0);
+
+            ScratchDirectory scratch("pipeline");
+            std::string listFile = scratch.getPath() + "list.txt";
+            auto requested = generateListedTree(scratch.getPath(), listFile, shape);
+
+            auto previousRun = createPreviousRun(arguments, scratch.getPath(), requested);
+            auto store = previousRun.store;
+            WinNetFW::FireWallPolicy policy(store);
+            std::size_t blockedCount = previousRun.blockedCount;
+            std::size_t staleCount = previousRun.staleCount;
+            std::size_t foreignCount = store->getRuleCount() - (blockedCount + staleCount) * 2;
+            std::size_t rulesBefore = store->getRuleCount();
+            store->setLatency(getLatency(arguments));
+
+            report("pipeline", "files", static_cast<double>(requested.size()), "files");
+            report("pipeline", "rules", static_cast<double>(rulesBefore), "rules");
+
+            auto check = [] (bool condition, const char* what) -> void {
+                if (!condition) throw (std::runtime_error(std::string("pipeline: ") + what));
+                return;
+            };
+            auto reportPhase = [&] (const std::string& phase, double elapsed, std::size_t count) -> void {
+                report("pipeline", phase, elapsed, "ms");
+                double perEntry = elapsed * 1e6 / static_cast<double>(std::max<std::size_t>(count, 1));
+                report("pipeline", phase + "_per_entry", perEntry, "ns");
+                return;
+            };
+
+            // the phases in the order main runs them
+            Stopwatch stopwatch;
+            Reconcile::BlockList blockList;
+            Scanner::ScanOptions scanOptions;
+            scanOptions.threadCount = threads;
+            check(blockList.load(listFile, scanOptions.classifier), "unable to read the list file");
+            double parseTime = stopwatch.getElapsedMilliseconds();
+            check(blockList.getFolders().size() == shape.rootCount, "unexpected number of folders");
+            reportPhase("parse", parseTime, shape.rootCount + blockList.getFiles().size());
+
+            // the first scan only warms up the file system cache
+            {
+                Utils::PathTable warmUp;
+                blockList.expand(scanOptions, warmUp);
+            }
+            stopwatch.restart();
+            Utils::PathTable requests;
+            blockList.expand(scanOptions, requests);
+            double scanTime = stopwatch.getElapsedMilliseconds();
+            check(requests.size() == requested.size(), "unexpected number of files found");
+            reportPhase("scan", scanTime, requests.size());
+
+            stopwatch.restart();
+            Utils::PathTable rules;
+            rules.reserve(requests.size());
+            policy.getBlockRules(rules);
+            double enumerateTime = stopwatch.getElapsedMilliseconds();
+            check(rules.size() == blockedCount + staleCount, "unexpected number of block rules");
+            reportPhase("enumerate", enumerateTime, rulesBefore);
+
+            stopwatch.restart();
+            std::size_t reconciledCount = requests.size() + rules.size();
+            const auto plan = Reconcile::createPlan(std::move(requests), std::move(rules));
+            double reconcileTime = stopwatch.getElapsedMilliseconds();
+            check(
+                plan.getAdds().size() == requested.size() - blockedCount && plan.getRemoves().size() == staleCount &&
+                    plan.getKeeps().size() == blockedCount,
+                "unexpected plan"
+            );
+            reportPhase("reconcile", reconcileTime, reconciledCount);
+
+            stopwatch.restart();
+            auto results = Reconcile::applyPlan(plan, policy);
+            double applyTime = stopwatch.getElapsedMilliseconds();
+            for (auto&& change : results) check(change.status == Status::Applied, "a change was not applied");
+            check(store->getRuleCount() == foreignCount + requested.size() * 2, "unexpected number of rules");
+            reportPhase("apply", applyTime, results.size());
+
+            report("pipeline", "total", parseTime + scanTime + enumerateTime + reconcileTime + applyTime, "ms");
+            return;
+        }
+
+        void runPipelinedBenchmark(const Arguments& arguments)
+        {
+            typedef WinNetFW::RuleChangeResult::Status Status;
+
+            PipelineShape shape = getPipelineShape(arguments);
+            Scanner::ScanOptions scanOptions;
+            scanOptions.threadCount = arguments.getSize("threads", 0);
+            scanOptions.backend = std::make_shared<ColdBackend>(
+                std::chrono::microseconds(arguments.getSize("pipelined.directory_latency_us", 1000))
+            );
+            Reconcile::PipelineOptions pipelineOptions;
+            pipelineOptions.queueCapacity = arguments.getSize("pipelined.queue", pipelineOptions.queueCapacity);
+            pipelineOptions.batchSize = arguments.getSize("pipelined.batch", pipelineOptions.batchSize);
+            auto latency = getLatency(arguments);
+
+            ScratchDirectory scratch("pipelined");
+            std::string listFile = scratch.getPath() + "list.txt";
+            auto requested = generateListedTree(scratch.getPath(), listFile, shape);
+
+            auto check = [] (bool condition, const char* what) -> void {
+                if (!condition) throw (std::runtime_error(std::string("pipelined: ") + what));
+                return;
+            };
+
+            // one phase after the other, as main runs without --pipelined
+            auto previousRun = createPreviousRun(arguments, scratch.getPath(), requested);
+            std::size_t rulesAfter = previousRun.store->getRuleCount() +
+                (requested.size() - previousRun.blockedCount - previousRun.staleCount) * 2;
+            previousRun.store->setLatency(latency);
+            WinNetFW::FireWallPolicy policy(previousRun.store);
+
+            Stopwatch stopwatch;
+            Reconcile::BlockList blockList;
+            check(blockList.load(listFile, scanOptions.classifier), "unable to read the list file");
+            Utils::PathTable desired;
+            blockList.expand(scanOptions, desired);
+            double scanTime = stopwatch.getElapsedMilliseconds();
+            Utils::PathTable existing;
+            policy.getBlockRules(existing);
+            auto plan = Reconcile::createPlan(std::move(desired), std::move(existing));
+            auto results = Reconcile::applyPlan(plan, policy);
+            double sequentialTime = stopwatch.getElapsedMilliseconds();
+            for (auto&& change : results) check(change.status == Status::Applied, "a change was not applied");
+            check(previousRun.store->getRuleCount() == rulesAfter, "unexpected number of rules after the run");
+
+            // the same on the policy as it was before
+            previousRun = createPreviousRun(arguments, scratch.getPath(), requested);
+            previousRun.store->setLatency(latency);
+            auto store = previousRun.store;
+            // every thread of the pipeline gets a policy of its own on the shared store
+            auto getPolicyFactory = [] (std::shared_ptr<WinNetFW::RuleStore> store) -> Reconcile::PolicyFactory {
+                return ([store] (void) -> std::unique_ptr<WinNetFW::FireWallPolicy> {
+                    return (std::make_unique<WinNetFW::FireWallPolicy>(store));
+                });
+            };
+
+            stopwatch.restart();
+            Reconcile::BlockList pipelinedList;
+            check(pipelinedList.load(listFile, scanOptions.classifier), "unable to read the list file");
+            auto pipelineResult = Reconcile::runPipelined(
+                pipelinedList, scanOptions, getPolicyFactory(store), pipelineOptions
+            );
+            double pipelinedTime = stopwatch.getElapsedMilliseconds();
+
+            std::size_t blocks = 0;
+            for (auto&& change : pipelineResult.results) {
+                check(change.status == Status::Applied, "a change was not applied");
+                if (change.isBlock) blocks++;
+            }
+            check(
+                blocks == plan.getAdds().size() && pipelineResult.results.size() - blocks == plan.getRemoves().size() &&
+                    pipelineResult.keptCount == plan.getKeeps().size(),
+                "the pipeline differs from the plan"
+            );
+            check(store->getRuleCount() == rulesAfter, "unexpected number of rules after the pipeline");
+
+            // a store that fails half way through: the batch with the failure is rolled back, nothing after it is
+            // attempted, and the batches before it stay
+            previousRun = createPreviousRun(arguments, scratch.getPath(), requested);
+            store = previousRun.store;
+            std::size_t rulesBefore = store->getRuleCount();
+            store->setAddFailureAfter(blocks + 1);
+            auto failedResult = Reconcile::runPipelined(
+                pipelinedList, scanOptions, getPolicyFactory(store), pipelineOptions
+            );
+            std::size_t applied = 0;
+            std::size_t failed = 0;
+            std::size_t notAttempted = 0;
+            for (auto&& change : failedResult.results) {
+                if (change.status == Status::Applied) applied++;
+                else if (change.status == Status::Failed) failed++;
+                else if (change.status == Status::NotAttempted) notAttempted++;
+            }
+            check(
+                failed == 1 && failedResult.results.size() == blocks + plan.getRemoves().size() &&
+                    notAttempted >= plan.getRemoves().size() && store->getRuleCount() == rulesBefore + applied * 2,
+                "the failed pipeline left unexpected rules"
+            );
+
+            report("pipelined", "files", static_cast<double>(requested.size()), "files");
+            report("pipelined", "blocks", static_cast<double>(blocks), "files");
+            report("pipelined", "batches", static_cast<double>(pipelineResult.batchCount), "batches");
+            report("pipelined", "scan", scanTime, "ms");
+            report("pipelined", "sequential_end_to_end", sequentialTime, "ms");
+            report("pipelined", "pipelined_end_to_end", pipelinedTime, "ms");
+            report("pipelined", "speedup", sequentialTime / std::max(pipelinedTime, 1e-9), "x");
+            return;
+        }
+    } // namespace Bench
+} // namespace FWMFW
@@ -0,0 +1,648 @@
+#include "Bench.hxx"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "MemoryRuleStore.hxx"
+#include "PathTable.hxx"
+#include "Reconcile.hxx"
+#include "RuleJournal.hxx"
+#include "ShardedCommit.hxx"
+#include "Utils.hxx"
+#include "WinNetFW.hxx"
+
+namespace FWMFW
+{
+    namespace Bench
+    {
+        namespace
+        {
+            std::string makeAppName(const std::string& vendor, std::size_t idx)
+            {
+                return (
+                    "C:\\Program Files\\" + vendor + std::to_string(idx / 16) + "\\app" + std::to_string(idx) + ".exe"
+                );
+            }
+
+            // fills the store with foreign rules and blockedCount FWMFW IN/OUT pairs, ruleCount rules in total
+            void populatePolicy(
+                WinNetFW::MemoryRuleStore& store, WinNetFW::FireWallPolicy& policy,
+                std::size_t ruleCount, std::size_t blockedCount
+            )
+            {
+                if (blockedCount * 2 > ruleCount) throw (std::runtime_error("policy: too many blocked files"));
+
+                for (std::size_t idx = 0; idx < ruleCount - blockedCount * 2; idx++) {
+                    store.addRule(WinNetFW::Rule{
+                        "Vendor rule " + std::to_string(idx), makeAppName("Vendor", idx), "",
+                        (idx % 2 == 0) ? WinNetFW::RuleDirection::In : WinNetFW::RuleDirection::Out,
+                        WinNetFW::RuleAction::Allow, true
+                    });
+                }
+
+                std::vector<std::string> blocked;
+                blocked.reserve(blockedCount);
+                for (std::size_t idx = 0; idx < blockedCount; idx++) blocked.push_back(makeAppName("Games", idx));
+                policy.addBlockRules(blocked);
+                return;
+            }
+
+            // getRules as it was before the enumeration was batched: one rule per call to the enumerator, and every
+            // rule is converted before the name filter gets to see it
+            std::unordered_map<std::string, std::string> getRulesOneByOne(
+                const WinNetFW::RuleStore& store, const std::string& ruleNamePrefix
+            )
+            {
+                std::unordered_map<std::string, std::string> result;
+                WinNetFW::RuleQuery query;
+                query.batchSize = 1;
+                store.enumerateRules(query, [&] (const std::string& ruleName, const std::string& appName) -> void {
+                    if (ruleName.empty() || appName.empty()) return;
+                    if (Utils::stringStartsWith(ruleName, ruleNamePrefix)) result[appName] = ruleName;
+                    return;
+                });
+                return (result);
+            }
+        } // anonymous namespace
+
+        void runPolicyBenchmark(const Arguments& arguments)
+        {
+            std::size_t ruleCount = arguments.getSize("policy.rules", 100000);
+            std::size_t blockedCount = arguments.getSize("policy.blocked", 10000);
+            std::size_t changeCount = arguments.getSize("policy.changes", 1000);
+
+            WinNetFW::MemoryRuleStore::Latency latency;
+            latency.enumerateCall = std::chrono::nanoseconds(arguments.getSize("latency.enumerate_call_ns", 2000));
+            latency.enumerateRule = std::chrono::nanoseconds(arguments.getSize("latency.enumerate_rule_ns", 100));
+            latency.add = std::chrono::nanoseconds(arguments.getSize("latency.add_ns", 20000));
+            latency.remove = std::chrono::nanoseconds(arguments.getSize("latency.remove_ns", 20000));
+
+            auto store = std::make_shared<WinNetFW::MemoryRuleStore>();
+            WinNetFW::FireWallPolicy policy(store);
+            populatePolicy(*store, policy, ruleCount, blockedCount);
+            store->setLatency(latency);
+
+            report("policy", "rules", static_cast<double>(store->getRuleCount()), "rules");
+
+            Stopwatch stopwatch;
+            auto rules = policy.getRulesByPrefix("FWMFW_OUT_", blockedCount);
+            double elapsed = stopwatch.getElapsedMilliseconds();
+            if (rules.size() != blockedCount) throw (std::runtime_error("policy: unexpected number of rules found"));
+            report("policy", "get_rules", elapsed, "ms");
+            report("policy", "get_rules_per_rule", elapsed * 1e6 / static_cast<double>(ruleCount), "ns");
+
+            std::vector<std::string> toAdd;
+            for (std::size_t idx = 0; idx < changeCount; idx++) toAdd.push_back(makeAppName("Tools", idx));
+            stopwatch.restart();
+            std::size_t added = policy.addBlockRules(toAdd);
+            elapsed = stopwatch.getElapsedMilliseconds();
+            if (added != changeCount) throw (std::runtime_error("policy: unexpected number of files blocked"));
+            report("policy", "add_block_rules", elapsed, "ms");
+            report("policy", "add_block_rules_per_file", elapsed * 1e3 / static_cast<double>(changeCount), "us");
+
+            std::unordered_map<std::string, std::string> toRemove;
+            for (auto&& rule : rules) {
+                if (toRemove.size() == changeCount) break;
+                toRemove.insert(rule);
+            }
+            stopwatch.restart();
+            std::size_t removed = policy.removeBlockRules(toRemove);
+            elapsed = stopwatch.getElapsedMilliseconds();
+            if (removed != toRemove.size()) throw (std::runtime_error("policy: unexpected number of files unblocked"));
+            report("policy", "remove_block_rules", elapsed, "ms");
+            report(
+                "policy", "remove_block_rules_per_file",
+                elapsed * 1e3 / static_cast<double>(std::max<std::size_t>(toRemove.size(), 1)), "us"
+            );
+            return;
+        }
+
+        void runEnumerateBenchmark(const Arguments& arguments)
+        {
+            std::size_t ruleCount = arguments.getSize("enumerate.rules", 50000);
+            std::size_t blockedCount = arguments.getSize("enumerate.blocked", 1000);
+
+            WinNetFW::MemoryRuleStore::Latency latency;
+            latency.enumerateCall = std::chrono::nanoseconds(arguments.getSize("latency.enumerate_call_ns", 2000));
+            latency.enumerateRule = std::chrono::nanoseconds(arguments.getSize("latency.enumerate_rule_ns", 100));
+
+            auto store = std::make_shared<WinNetFW::MemoryRuleStore>();
+            WinNetFW::FireWallPolicy policy(store);
+            populatePolicy(*store, policy, ruleCount, blockedCount);
+            const std::string OUT_PREFIX{ "FWMFW_OUT_" };
+
+            // once with the conversion and allocation costs only, once with simulated enumerator latencies
+            for (auto&& simulated : { false, true }) {
+                store->setLatency(simulated ? latency : WinNetFW::MemoryRuleStore::Latency());
+                std::string suffix = simulated ? "_simulated" : "_cpu";
+
+                Stopwatch stopwatch;
+                auto before = getRulesOneByOne(*store, OUT_PREFIX);
+                double beforeTime = stopwatch.getElapsedMilliseconds();
+
+                stopwatch.restart();
+                auto after = policy.getRulesByPrefix(OUT_PREFIX, blockedCount);
+                double afterTime = stopwatch.getElapsedMilliseconds();
+
+                if (before.size() != blockedCount || after != before) {
+                    throw (std::runtime_error("enumerate: batched enumeration returned different rules"));
+                }
+
+                report("enumerate", "one_by_one_per_rule" + suffix, beforeTime * 1e6 / ruleCount, "ns");
+                report("enumerate", "batched_prefix_per_rule" + suffix, afterTime * 1e6 / ruleCount, "ns");
+                report("enumerate", "speedup" + suffix, beforeTime / std::max(afterTime, 1e-9), "x");
+            }
+            return;
+        }
+
+        void runEnumerateStreamBenchmark(const Arguments& arguments)
+        {
+            std::size_t ruleCount = arguments.getSize("enumerate.rules", 50000);
+            std::size_t blockedCount = arguments.getSize("enumerate.blocked", 1000);
+
+            WinNetFW::MemoryRuleStore::Latency latency;
+            latency.enumerateCall = std::chrono::nanoseconds(arguments.getSize("latency.enumerate_call_ns", 2000));
+            latency.enumerateRule = std::chrono::nanoseconds(arguments.getSize("latency.enumerate_rule_ns", 100));
+
+            auto store = std::make_shared<WinNetFW::MemoryRuleStore>();
+            WinNetFW::FireWallPolicy policy(store);
+            populatePolicy(*store, policy, ruleCount, blockedCount);
+            store->setLatency(latency);
+
+            // the rules of one vendor folder (16 applications), and one application a tenth into the policy
+            const std::string vendorFolder = "C:\\Program Files\\Vendor1\\";
+            auto isVendorApp = [&vendorFolder] (const std::string& appName) -> bool {
+                return (Utils::stringStartsWith(appName, vendorFolder));
+            };
+            const std::string wanted = makeAppName("Vendor", ruleCount / 10);
+
+            // the whole policy in a map first, as the callers of getRules had to
+            std::size_t allocations = getAllocationCount();
+            Stopwatch stopwatch;
+            std::size_t mapCount = 0;
+            for (auto&& rule : policy.getRules()) {
+                if (isVendorApp(rule.first)) mapCount++;
+            }
+            double mapCountTime = stopwatch.getElapsedMilliseconds();
+            std::size_t mapCountAllocations = getAllocationCount() - allocations;
+
+            stopwatch.restart();
+            auto rules = policy.getRules();
+            bool isMapFound = (rules.find(wanted) != rules.end());
+            double mapFindTime = stopwatch.getElapsedMilliseconds();
+
+            // the filter pushed down into the store, the rules counted as they come
+            WinNetFW::RuleQuery query;
+            query.applicationNameFilter = isVendorApp;
+            allocations = getAllocationCount();
+            stopwatch.restart();
+            std::size_t streamCount = 0;
+            for (auto&& rule : policy.enumerateRules(query)) {
+                (void) rule;
+                streamCount++;
+            }
+            double streamCountTime = stopwatch.getElapsedMilliseconds();
+            std::size_t streamCountAllocations = getAllocationCount() - allocations;
+
+            // stops at the first match, the rest of the policy is never fetched
+            stopwatch.restart();
+            bool isStreamFound = false;
+            for (auto&& rule : policy.enumerateRules(WinNetFW::RuleQuery())) {
+                if (rule.applicationName != wanted) continue;
+                isStreamFound = true;
+                break;
+            }
+            double streamFindTime = stopwatch.getElapsedMilliseconds();
+
+            if ((mapCount != 16) || (streamCount != mapCount) || !isMapFound || !isStreamFound) {
+                throw (std::runtime_error("enumerate-stream: the enumerations found different rules"));
+            }
+
+            // the application filter of getRules used to be given the rule name, and matched nothing here
+            auto filtered = policy.getRules(nullptr, isVendorApp);
+            if (filtered.size() != mapCount) throw (std::runtime_error("enumerate-stream: getRules filter broken"));
+
+            // the properties are filtered by the store as well
+            query = WinNetFW::RuleQuery();
+            query.direction = WinNetFW::RuleDirection::In;
+            query.action = WinNetFW::RuleAction::Block;
+            std::size_t inBlockCount = 0;
+            for (auto&& rule : policy.enumerateRules(query)) {
+                if ((rule.direction != WinNetFW::RuleDirection::In) || (rule.action != WinNetFW::RuleAction::Block) ||
+                    !rule.enabled) {
+                    throw (std::runtime_error("enumerate-stream: unexpected rule properties"));
+                }
+                inBlockCount++;
+            }
+            if (inBlockCount != blockedCount) throw (std::runtime_error("enumerate-stream: unexpected IN rules"));
+
+            report("enumerate-stream", "map_count_time", mapCountTime, "ms");
+            report("enumerate-stream", "map_count_allocations", static_cast<double>(mapCountAllocations), "allocs");
+            report("enumerate-stream", "stream_count_time", streamCountTime, "ms");
+            report(
+                "enumerate-stream", "stream_count_allocations", static_cast<double>(streamCountAllocations), "allocs"
+            );
+            report("enumerate-stream", "count_speedup", mapCountTime / std::max(streamCountTime, 1e-9), "x");
+            report("enumerate-stream", "map_find_time", mapFindTime, "ms");
+            report("enumerate-stream", "stream_find_time", streamFindTime, "ms");
+            report("enumerate-stream", "find_speedup", mapFindTime / std::max(streamFindTime, 1e-9), "x");
+            return;
+        }
+
+        void runCommitBenchmark(const Arguments& arguments)
+        {
+            typedef WinNetFW::RuleChangeResult::Status Status;
+
+            std::size_t ruleCount = arguments.getSize("commit.rules", 20000);
+            std::size_t fileCount = arguments.getSize("commit.files", 10000);
+
+            WinNetFW::MemoryRuleStore::Latency latency;
+            latency.create = std::chrono::nanoseconds(arguments.getSize("latency.create_ns", 10000));
+            latency.add = std::chrono::nanoseconds(arguments.getSize("latency.add_ns", 20000));
+            latency.remove = std::chrono::nanoseconds(arguments.getSize("latency.remove_ns", 20000));
+
+            auto store = std::make_shared<WinNetFW::MemoryRuleStore>();
+            WinNetFW::FireWallPolicy policy(store);
+            populatePolicy(*store, policy, ruleCount, 0);
+            store->setLatency(latency);
+
+            std::vector<std::string> files;
+            WinNetFW::RuleTransaction transaction;
+            transaction.reserve(fileCount, 0);
+            for (std::size_t idx = 0; idx < fileCount; idx++) {
+                files.push_back(makeAppName("Games", idx));
+                transaction.block(files.back());
+            }
+
+            // the rules as addBlockRules commits them: one object created and added at a time
+            Stopwatch stopwatch;
+            std::size_t blocked = policy.addBlockRules(files);
+            double beforeTime = stopwatch.getElapsedMilliseconds();
+            if (blocked != fileCount) throw (std::runtime_error("commit: unexpected number of files blocked"));
+
+            store->setLatency(WinNetFW::MemoryRuleStore::Latency());
+            policy.removeBlockRules(policy.getRulesByPrefix("FWMFW_OUT_", fileCount));
+            if (store->getRuleCount() != ruleCount) throw (std::runtime_error("commit: store was not cleaned up"));
+            store->setLatency(latency);
+
+            stopwatch.restart();
+            auto results = policy.commit(transaction);
+            double afterTime = stopwatch.getElapsedMilliseconds();
+            for (auto&& change : results) {
+                if (change.status != Status::Applied) throw (std::runtime_error("commit: a change was not applied"));
+            }
+            if (store->getRuleCount() != ruleCount + fileCount * 2) {
+                throw (std::runtime_error("commit: unexpected number of rules"));
+            }
+
+            report("commit", "add_block_rules", beforeTime, "ms");
+            report("commit", "transaction", afterTime, "ms");
+            report("commit", "transaction_per_file", afterTime * 1e3 / static_cast<double>(fileCount), "us");
+            report("commit", "speedup", beforeTime / std::max(afterTime, 1e-9), "x");
+
+            // undo the blocks and replace them by a new set of blocks, with the store failing half way through
+            WinNetFW::RuleTransaction failing;
+            failing.reserve(fileCount, fileCount);
+            for (std::size_t idx = 0; idx < fileCount; idx++) {
+                failing.block(makeAppName("Tools", idx));
+            }
+            for (auto&& rule : policy.getRulesByPrefix("FWMFW_OUT_", fileCount)) {
+                failing.unblock(rule.first, rule.second);
+            }
+
+            std::size_t rulesBefore = store->getRuleCount();
+            store->setAddFailureAfter(fileCount + 1);
+            stopwatch.restart();
+            results = policy.commit(failing);
+            double rollbackTime = stopwatch.getElapsedMilliseconds();
+            store->setAddFailureAfter(WinNetFW::MemoryRuleStore::NO_FAILURE);
+
+            std::size_t failedCount = 0;
+            std::size_t rolledBackCount = 0;
+            for (auto&& change : results) {
+                if (change.status == Status::Failed) failedCount++;
+                else if (change.status == Status::RolledBack) rolledBackCount++;
+                else if (change.status != Status::NotAttempted) {
+                    throw (std::runtime_error("commit: unexpected result of a failed transaction"));
+                }
+            }
+            if (failedCount != 1 || rolledBackCount != (fileCount + 1) / 2 || store->getRuleCount() != rulesBefore) {
+                throw (std::runtime_error("commit: the failed transaction was not rolled back"));
+            }
+            report("commit", "rollback", rollbackTime, "ms");
+            return;
+        }
+        void runCommitScalingBenchmark(const Arguments& arguments)
+        {
+            typedef WinNetFW::RuleChangeResult::Status Status;
+
+            std::size_t ruleCount = arguments.getSize("commit_scaling.rules", 10000);
+            std::size_t fileCount = arguments.getSize("commit_scaling.files", 2000);
+            std::size_t maxThreads = std::max<std::size_t>(arguments.getSize("commit_scaling.max_threads", 8), 1);
+            std::size_t shardSize = arguments.getSize("commit_scaling.shard_size", 64);
+
+            // the calls block without using the processor, like calls into the firewall service do
+            WinNetFW::MemoryRuleStore::Latency latency;
+            latency.isSleeping = true;
+            latency.add = std::chrono::microseconds(arguments.getSize("commit_scaling.latency_us", 500));
+            latency.remove = latency.add;
+
+            auto store = std::make_shared<WinNetFW::MemoryRuleStore>();
+            WinNetFW::FireWallPolicy policy(store);
+            populatePolicy(*store, policy, ruleCount, 0);
+            store->setLatency(latency);
+            auto createPolicy = [store] (void) -> std::unique_ptr<WinNetFW::FireWallPolicy> {
+                return (std::make_unique<WinNetFW::FireWallPolicy>(store));
+            };
+
+            WinNetFW::RuleTransaction transaction;
+            transaction.reserve(fileCount, 0);
+            for (std::size_t idx = 0; idx < fileCount; idx++) {
+                transaction.block(makeAppName("Games", idx));
+            }
+            auto undo = transaction.getInverse();
+
+            double singleTime = 0.0;
+            for (std::size_t threadCount = 1; threadCount <= maxThreads; threadCount *= 2) {
+                WinNetFW::ShardedCommitOptions options;
+                options.threadCount = threadCount;
+                options.shardSize = shardSize;
+
+                Stopwatch stopwatch;
+                auto results = WinNetFW::commitSharded(transaction, createPolicy, options);
+                double elapsed = stopwatch.getElapsedMilliseconds();
+                for (auto&& change : results) {
+                    if (change.status != Status::Applied) {
+                        throw (std::runtime_error("commit-scaling: a change was not applied"));
+                    }
+                }
+                if (store->getRuleCount() != ruleCount + fileCount * 2) {
+                    throw (std::runtime_error("commit-scaling: unexpected number of rules"));
+                }
+                if (threadCount == 1) singleTime = elapsed;
+
+                std::string suffix = "_" + std::to_string(threadCount) + "_threads";
+                report("commit-scaling", "commit" + suffix, elapsed, "ms");
+                report("commit-scaling", "speedup" + suffix, singleTime / std::max(elapsed, 1e-9), "x");
+
+                store->setLatency(WinNetFW::MemoryRuleStore::Latency());
+                policy.commit(undo);
+                store->setLatency(latency);
+                if (store->getRuleCount() != ruleCount) {
+                    throw (std::runtime_error("commit-scaling: store was not cleaned up"));
+                }
+            }
+
+            // the store fails half way through: the shards committed by then have to be undone
+            store->setAddFailureAfter(fileCount);
+            WinNetFW::ShardedCommitOptions options;
+            options.threadCount = maxThreads;
+            options.shardSize = shardSize;
+            Stopwatch stopwatch;
+            auto results = WinNetFW::commitSharded(transaction, createPolicy, options);
+            double rollbackTime = stopwatch.getElapsedMilliseconds();
+            store->setAddFailureAfter(WinNetFW::MemoryRuleStore::NO_FAILURE);
+
+            std::size_t failedCount = 0;
+            for (auto&& change : results) {
+                if (change.status == Status::Failed) failedCount++;
+                else if (change.status == Status::Applied || change.status == Status::RollbackFailed) {
+                    throw (std::runtime_error("commit-scaling: unexpected result of a failed commit"));
+                }
+            }
+            if (failedCount == 0 || store->getRuleCount() != ruleCount) {
+                throw (std::runtime_error("commit-scaling: the failed commit was not rolled back"));
+            }
+            report("commit-scaling", "rollback_" + std::to_string(maxThreads) + "_threads", rollbackTime, "ms");
+            return;
+        }
+        void runJournalBenchmark(const Arguments& arguments)
+        {
+            std::size_t ruleCount = arguments.getSize("journal.rules", 100000);
+            std::size_t blockedCount = arguments.getSize("journal.blocked", 5000);
+            std::size_t repetitions = std::max<std::size_t>(arguments.getSize("repetitions", 3), 1);
+
+            WinNetFW::MemoryRuleStore::Latency latency;
+            latency.enumerateCall = std::chrono::nanoseconds(arguments.getSize("latency.enumerate_call_ns", 2000));
+            latency.enumerateRule = std::chrono::nanoseconds(arguments.getSize("latency.enumerate_rule_ns", 100));
+
+            auto store = std::make_shared<WinNetFW::MemoryRuleStore>();
+            WinNetFW::FireWallPolicy policy(store);
+            populatePolicy(*store, policy, ruleCount, blockedCount);
+            store->setLatency(latency);
+
+            ScratchDirectory scratch("journal");
+            std::string journalFile = scratch.getPath() + "rules.jnl";
+
+            // the previous run: enumerated, then journaled
+            Utils::PathTable enumerated;
+            policy.getBlockRules(enumerated);
+            if (enumerated.size() != blockedCount) throw (std::runtime_error("journal: unexpected number of rules"));
+            if (!Reconcile::RuleJournal::save(journalFile, enumerated, policy.getRuleCount())) {
+                throw (std::runtime_error("journal: unable to save the journal"));
+            }
+
+            // startup, best of a few runs: the rules from the policy, and from the journal
+            double enumerateTime = 0.0;
+            double journalTime = 0.0;
+            for (std::size_t idx = 0; idx < repetitions; idx++) {
+                Stopwatch stopwatch;
+                Utils::PathTable fromPolicy;
+                policy.getBlockRules(fromPolicy);
+                double elapsed = stopwatch.getElapsedMilliseconds();
+                if (idx == 0 || elapsed < enumerateTime) enumerateTime = elapsed;
+
+                stopwatch.restart();
+                Reconcile::RuleJournal journal;
+                Utils::PathTable fromJournal;
+                if (!journal.load(journalFile) || !journal.isCurrent(policy.getRuleCount())) {
+                    throw (std::runtime_error("journal: the journal was not accepted"));
+                }
+                journal.getBlockRules(fromJournal);
+                elapsed = stopwatch.getElapsedMilliseconds();
+                if (idx == 0 || elapsed < journalTime) journalTime = elapsed;
+
+                if (!journal.isEqual(fromPolicy)) throw (std::runtime_error("journal: the journal differs"));
+            }
+            report("journal", "policy_rules", static_cast<double>(store->getRuleCount()), "rules");
+            report("journal", "enumerate_startup", enumerateTime, "ms");
+            report("journal", "journal_startup", journalTime, "ms");
+            report("journal", "speedup", enumerateTime / std::max(journalTime, 1e-9), "x");
+            report(
+                "journal", "journal_size",
+                static_cast<double>(std::filesystem::file_size(journalFile)) / 1024.0, "KiB"
+            );
+
+            // a journal that no longer fits the policy must not be used
+            Reconcile::RuleJournal journal;
+            store->addRule(WinNetFW::Rule{
+                "Vendor rule added", makeAppName("Vendor", ruleCount), "", WinNetFW::RuleDirection::In,
+                WinNetFW::RuleAction::Allow, true
+            });
+            if (!journal.load(journalFile) || journal.isCurrent(policy.getRuleCount())) {
+                throw (std::runtime_error("journal: a changed policy was not noticed"));
+            }
+            journal.close();
+            {
+                std::fstream file(journalFile, std::ios::binary | std::ios::in | std::ios::out);
+                file.seekp(-1, std::ios::end);
+                file.put('?');
+            }
+            if (journal.load(journalFile)) throw (std::runtime_error("journal: a damaged journal was loaded"));
+            return;
+        }
+
+        void runRuleNamesBenchmark(const Arguments& arguments)
+        {
+            typedef WinNetFW::RuleChangeResult::Status Status;
+
+            std::size_t ruleCount = arguments.getSize("rule_names.rules", 100000);
+            std::size_t blockedCount = arguments.getSize("rule_names.blocked", 5000);
+            std::size_t changeCount = std::min(arguments.getSize("rule_names.changes", 100), blockedCount / 2);
+
+            WinNetFW::MemoryRuleStore::Latency latency;
+            latency.enumerateCall = std::chrono::nanoseconds(arguments.getSize("latency.enumerate_call_ns", 2000));
+            latency.enumerateRule = std::chrono::nanoseconds(arguments.getSize("latency.enumerate_rule_ns", 100));
+            latency.remove = std::chrono::nanoseconds(arguments.getSize("latency.remove_ns", 20000));
+            latency.lookup = std::chrono::nanoseconds(arguments.getSize("latency.lookup_ns", 20000));
+
+            auto store = std::make_shared<WinNetFW::MemoryRuleStore>();
+            WinNetFW::FireWallPolicy policy(store);
+            populatePolicy(*store, policy, ruleCount, blockedCount);
+            store->setLatency(latency);
+            auto check = [] (bool condition, const char* message) -> void {
+                if (!condition) throw (std::runtime_error(std::string("rule-names: ") + message));
+                return;
+            };
+
+            // whether files are blocked: found in an enumeration of the policy, and looked up by their rule names
+            std::vector<std::string> files;
+            for (std::size_t idx = 0; idx < changeCount * 2; idx++) files.push_back(makeAppName("Games", idx));
+            Stopwatch stopwatch;
+            Utils::PathTable enumerated;
+            policy.getBlockRules(enumerated);
+            std::size_t enumeratedCount = 0;
+            for (auto&& file : files) {
+                if (enumerated.find(file) != Utils::PathTable::NO_ID) enumeratedCount++;
+            }
+            double enumerateTime = stopwatch.getElapsedMilliseconds();
+
+            store->resetCallCounts();
+            stopwatch.restart();
+            std::size_t lookedUpCount = 0;
+            for (auto&& file : files) {
+                if (policy.isBlocked(file)) lookedUpCount++;
+            }
+            double lookupTime = stopwatch.getElapsedMilliseconds();
+            check(enumeratedCount == files.size() && lookedUpCount == files.size(), "a blocked file was not found");
+            check(store->getCallCounts().enumerateCalls == 0, "a look up by name enumerated the policy");
+            report("rule-names", "exists_enumerate", enumerateTime, "ms");
+            report("rule-names", "exists_by_name", lookupTime, "ms");
+            report("rule-names", "exists_speedup", enumerateTime / std::max(lookupTime, 1e-9), "x");
+
+            // unblocking half of them with the names from an enumeration, the other half by the names of the paths
+            stopwatch.restart();
+            auto rules = policy.getBlockRules(blockedCount);
+            WinNetFW::RuleTransaction enumeratedUnblocks;
+            for (std::size_t idx = 0; idx < changeCount; idx++) {
+                enumeratedUnblocks.unblock(files[idx], rules[files[idx]]);
+            }
+            auto results = policy.commit(enumeratedUnblocks);
+            double enumeratedUnblockTime = stopwatch.getElapsedMilliseconds();
+
+            store->resetCallCounts();
+            stopwatch.restart();
+            WinNetFW::RuleTransaction namedUnblocks;
+            for (std::size_t idx = changeCount; idx < files.size(); idx++) namedUnblocks.unblockNamed(files[idx]);
+            auto namedResults = policy.commit(namedUnblocks);
+            double namedUnblockTime = stopwatch.getElapsedMilliseconds();
+            check(store->getCallCounts().enumerateCalls == 0, "an unblock by name enumerated the policy");
+
+            results.insert(results.end(), namedResults.begin(), namedResults.end());
+            for (auto&& change : results) check(change.status == Status::Applied, "an unblock was not applied");
+            store->setLatency(WinNetFW::MemoryRuleStore::Latency());
+            for (auto&& file : files) check(!policy.isBlocked(file), "an unblocked file is still blocked");
+            check(store->getRuleCount() == ruleCount - files.size() * 2, "unexpected number of rules");
+            report("rule-names", "unblock_enumerate", enumeratedUnblockTime, "ms");
+            report("rule-names", "unblock_by_name", namedUnblockTime, "ms");
+            report("rule-names", "unblock_speedup", enumeratedUnblockTime / std::max(namedUnblockTime, 1e-9), "x");
+
+            // two installs of the same program get rules of their own, whatever case and separators a path uses
+            const std::string firstInstall = "C:\\Games\\Vendor\\bin\\tool.exe";
+            const std::string secondInstall = "D:\\Mirror\\bin\\tool.exe";
+            check(
+                WinNetFW::getRuleName(WinNetFW::RuleDirection::Out, firstInstall) !=
+                WinNetFW::getRuleName(WinNetFW::RuleDirection::Out, secondInstall),
+                "two files got the same rule name"
+            );
+            WinNetFW::RuleTransaction installs;
+            installs.block(firstInstall);
+            installs.block(secondInstall);
+            policy.commit(installs);
+            check(policy.isBlocked("c:/games/vendor/BIN/Tool.EXE"), "a differently written path was not found");
+            WinNetFW::RuleTransaction uninstall;
+            uninstall.unblockNamed(firstInstall);
+            policy.commit(uninstall);
+            check(!policy.isBlocked(firstInstall) && policy.isBlocked(secondInstall), "the installs share their rules");
+
+            // the rules of a file in a group are found by name in that group only
+            WinNetFW::RuleTransaction groupInstall;
+            groupInstall.block(firstInstall, "games");
+            policy.commit(groupInstall);
+            bool isFoundInGroup = policy.isBlocked(firstInstall, "games") && !policy.isBlocked(firstInstall);
+            check(isFoundInGroup, "a grouped file was not found by name");
+            WinNetFW::RuleTransaction groupUninstall;
+            groupUninstall.unblockNamed(firstInstall, "games");
+            for (auto&& change : policy.commit(groupUninstall)) {
+                check(change.status == Status::Applied, "a grouped unblock was not applied");
+            }
+            check(!policy.isBlocked(firstInstall, "games"), "a grouped file is still blocked");
+
+            // rules named the way earlier versions did (after the path from the listed folder's parent on) are
+            // renamed by the next plan, in the same transaction
+            for (std::size_t idx = 0; idx < changeCount; idx++) {
+                std::string legacyName = "Legacy\\app" + std::to_string(idx) + ".exe";
+                store->addRule(WinNetFW::Rule{
+                    "FWMFW_IN_" + legacyName, makeAppName("Legacy", idx), "", WinNetFW::RuleDirection::In,
+                    WinNetFW::RuleAction::Block, true
+                });
+                store->addRule(WinNetFW::Rule{
+                    "FWMFW_OUT_" + legacyName, makeAppName("Legacy", idx), "", WinNetFW::RuleDirection::Out,
+                    WinNetFW::RuleAction::Block, true
+                });
+            }
+            std::size_t rulesBefore = store->getRuleCount();
+            Utils::PathTable existing;
+            policy.getBlockRules(existing);
+            Utils::PathTable desired;
+            for (Utils::PathTable::Id id = 0; id < static_cast<Utils::PathTable::Id>(existing.size()); id++) {
+                desired.add(existing.getPath(id), std::string_view());
+            }
+            auto plan = Reconcile::createPlan(std::move(desired), std::move(existing));
+            check(
+                plan.getRenameCount() == changeCount && plan.getAdds().size() == changeCount &&
+                plan.getRemoves().size() == changeCount, "unexpected plan for the renamed rules"
+            );
+            store->setLatency(latency);
+            stopwatch.restart();
+            results = Reconcile::applyPlan(plan, policy);
+            double renameTime = stopwatch.getElapsedMilliseconds();
+            store->setLatency(WinNetFW::MemoryRuleStore::Latency());
+            for (auto&& change : results) check(change.status == Status::Applied, "a rename was not applied");
+            for (std::size_t idx = 0; idx < changeCount; idx++) {
+                check(policy.isBlocked(makeAppName("Legacy", idx)), "a renamed file is not blocked");
+                check(
+                    !store->hasRule("FWMFW_OUT_Legacy\\app" + std::to_string(idx) + ".exe"),
+                    "the rule of the old naming scheme is left"
+                );
+            }
+            check(store->getRuleCount() == rulesBefore, "unexpected number of rules after renaming");
+            report("rule-names", "rename", renameTime, "ms");
+            return;
+        }
+    } // namespace Bench
+} // namespace FWMFW
@@ -0,0 +1,284 @@
+#include "Bench.hxx"
+
+#if !defined(_WIN32)
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <functional>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "PathTable.hxx"
+#include "Reconcile.hxx"
+
+namespace FWMFW
+{
+    namespace Bench
+    {
+        namespace
+        {
+            typedef std::unordered_map<std::string, std::string> FileMap;
+
+            struct InputShape
+            {
+                std::size_t fileCount;
+                std::size_t blockedPerMille;    // of the files that are blocked already
+                std::size_t keptPerMille;       // of the blocked ones that are still requested
+            }; // struct InputShape
+
+            typedef std::function<void(const std::string& appName, const std::string& ruleName, bool isRequested,
+                bool isBlocked)> FileVisitor;
+
+            // the same synthetic files on every call, generated one at a time
+            void generateFiles(const InputShape& shape, const FileVisitor& visitor)
+            {
+                std::mt19937 random(42);
+                std::string appName;
+                std::string ruleName;
+                for (std::size_t idx = 0; idx < shape.fileCount; idx++) {
+                    ruleName = "Game" + std::to_string(idx) + "\\app.exe";
+                    appName = "C:\\Games\\Vendor" + std::to_string(random() % 1000) + "\\" + ruleName;
+
+                    bool isBlocked = (random() % 1000 < shape.blockedPerMille);
+                    bool isRequested = !isBlocked || (random() % 1000 < shape.keptPerMille);
+                    visitor(appName, ruleName, isRequested, isBlocked);
+                }
+                return;
+            }
+
+            // the reconciliation as main did it before the plan existed: look every existing rule up in the requests,
+            // erase the ones found and collect the others
+            void diffHashMaps(FileMap& requests, const FileMap& existing, FileMap& toUnblock)
+            {
+                for (auto&& rule : existing) {
+                    if (requests.find(rule.first) != requests.end()) {
+                        requests.erase(rule.first);
+                    }
+                    else {
+                        toUnblock[rule.first] = rule.second;
+                    }
+                }
+                return;
+            }
+
+            // the adds carry no rule name, the tables get the files to block without one (as from BlockList)
+            bool isSameSet(const Reconcile::EntryList& entries, const FileMap& files)
+            {
+                if (entries.size() != files.size()) return (false);
+                for (auto&& entry : entries) {
+                    auto itr = files.find(std::string(entry.appName));
+                    if (itr == files.end()) return (false);
+                    if (!entry.ruleName.empty() && (itr->second != entry.ruleName)) return (false);
+                }
+                return (true);
+            }
+
+            // what a memory benchmark run hands back to the parent
+            struct MemoryResult
+            {
+                double elapsed;         // ms
+                std::size_t adds;
+                std::size_t removes;
+                std::size_t peakRSS;    // bytes
+            }; // struct MemoryResult
+
+            MemoryResult reconcileHashMaps(const InputShape& shape)
+            {
+                Stopwatch stopwatch;
+                FileMap requestedFilesToBlock;
+                FileMap rules;
+                generateFiles(shape, [&] (const std::string& appName, const std::string& ruleName, bool isRequested,
+                    bool isBlocked) -> void {
+                    if (isRequested) requestedFilesToBlock[appName] = ruleName;
+                    if (isBlocked) rules[appName] = WinNetFW::getRuleName(WinNetFW::RuleDirection::Out, appName);
+                    return;
+                });
+                FileMap filesToUnblock;
+                diffHashMaps(requestedFilesToBlock, rules, filesToUnblock);
+                return (MemoryResult{
+                    stopwatch.getElapsedMilliseconds(), requestedFilesToBlock.size(), filesToUnblock.size(), 0
+                });
+            }
+
+            MemoryResult reconcilePathTables(const InputShape& shape)
+            {
+                Stopwatch stopwatch;
+                Utils::PathTable requestedFilesToBlock;
+                Utils::PathTable rules;
+                generateFiles(shape, [&] (const std::string& appName, const std::string&, bool isRequested,
+                    bool isBlocked) -> void {
+                    if (isRequested) requestedFilesToBlock.add(appName, std::string_view());
+                    if (isBlocked) rules.add(appName, WinNetFW::getRuleName(WinNetFW::RuleDirection::Out, appName));
+                    return;
+                });
+                auto plan = Reconcile::createPlan(std::move(requestedFilesToBlock), std::move(rules));
+                return (MemoryResult{
+                    stopwatch.getElapsedMilliseconds(), plan.getAdds().size(), plan.getRemoves().size(), 0
+                });
+            }
+
+#if !defined(_WIN32)
+            // runs the reconciliation in a child process, so that its peak RSS is its own
+            MemoryResult runInChild(const std::function<MemoryResult(void)>& reconcile)
+            {
+                int fds[2];
+                if (pipe(fds) != 0) throw (std::runtime_error("reconcile-memory: unable to create a pipe"));
+
+                pid_t pid = fork();
+                if (pid < 0) throw (std::runtime_error("reconcile-memory: unable to fork"));
+                if (pid == 0) {
+                    close(fds[0]);
+                    // the child starts out with the parent's pages, including the heap that earlier benchmarks freed.
+                    // that heap is given back and the peak is reset to what is left (where the system allows it).
+#if defined(__GLIBC__)
+                    malloc_trim(0);
+#endif
+#if defined(__linux__)
+                    std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+                    MemoryResult result = reconcile();
+                    bool isWritten = (write(fds[1], &result, sizeof(result)) == static_cast<ssize_t>(sizeof(result)));
+                    // no destructors and no atexit handlers of the parent's state
+                    _exit(isWritten ? 0 : 1);
+                }
+
+                close(fds[1]);
+                MemoryResult result{};
+                bool isRead = (read(fds[0], &result, sizeof(result)) == static_cast<ssize_t>(sizeof(result)));
+                close(fds[0]);
+
+                int status = 0;
+                struct rusage usage{};
+                if (wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0 ||
+                    !isRead) {
+                    throw (std::runtime_error("reconcile-memory: the child process failed"));
+                }
+#if defined(__APPLE__)
+                result.peakRSS = static_cast<std::size_t>(usage.ru_maxrss);
+#else
+                result.peakRSS = static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+#endif
+                return (result);
+            }
+#endif
+        } // anonymous namespace
+
+        void runReconcileBenchmark(const Arguments& arguments)
+        {
+            InputShape shape{
+                arguments.getSize("reconcile.files", 500000),
+                arguments.getSize("reconcile.blocked_per_mille", 900),
+                arguments.getSize("reconcile.kept_per_mille", 950)
+            };
+
+            // the requests in the order the scanner delivers them, the rules in the order the policy has them
+            typedef std::pair<std::string, std::string> File;
+            std::vector<File> requests;
+            std::vector<File> existing;
+            generateFiles(shape, [&] (const std::string& appName, const std::string& ruleName, bool isRequested,
+                bool isBlocked) -> void {
+                if (isRequested) requests.push_back(File{ appName, ruleName });
+                if (isBlocked) {
+                    existing.push_back(File{ appName, WinNetFW::getRuleName(WinNetFW::RuleDirection::Out, appName) });
+                }
+                return;
+            });
+            std::mt19937 random(43);
+            std::shuffle(requests.begin(), requests.end(), random);
+            std::shuffle(existing.begin(), existing.end(), random);
+            report("reconcile", "requested", static_cast<double>(requests.size()), "files");
+            report("reconcile", "blocked", static_cast<double>(existing.size()), "files");
+
+            // the maps as main used to collect them, then the diff
+            Stopwatch stopwatch;
+            FileMap toBlock;
+            FileMap blocked;
+            FileMap toUnblock;
+            for (auto&& file : requests) toBlock[file.first] = file.second;
+            for (auto&& file : existing) blocked[file.first] = file.second;
+            double buildTime = stopwatch.getElapsedMilliseconds();
+            diffHashMaps(toBlock, blocked, toUnblock);
+            double hashTime = stopwatch.getElapsedMilliseconds();
+
+            // the tables as main collects them now, then the plan: the sorted merge of the tables
+            stopwatch.restart();
+            Utils::PathTable requestTable;
+            Utils::PathTable existingTable;
+            for (auto&& file : requests) requestTable.add(file.first, std::string_view());
+            for (auto&& file : existing) existingTable.add(file.first, file.second);
+            double tableBuildTime = stopwatch.getElapsedMilliseconds();
+            auto plan = Reconcile::createPlan(std::move(requestTable), std::move(existingTable));
+            double mergeTime = stopwatch.getElapsedMilliseconds();
+
+            if (!isSameSet(plan.getAdds(), toBlock) || !isSameSet(plan.getRemoves(), toUnblock) ||
+                plan.getKeeps().size() != blocked.size() - toUnblock.size()) {
+                throw (std::runtime_error("reconcile: the plan differs from the hash map diff"));
+            }
+            report("reconcile", "adds", static_cast<double>(plan.getAdds().size()), "files");
+            report("reconcile", "removes", static_cast<double>(plan.getRemoves().size()), "files");
+
+            report("reconcile", "hash_map", hashTime, "ms");
+            report("reconcile", "hash_map_diff_only", hashTime - buildTime, "ms");
+            report("reconcile", "sorted_merge", mergeTime, "ms");
+            report("reconcile", "sorted_merge_plan_only", mergeTime - tableBuildTime, "ms");
+            report("reconcile", "speedup", hashTime / std::max(mergeTime, 1e-9), "x");
+            // the diff against the plan alone, without collecting the files
+            report(
+                "reconcile", "plan_speedup", (hashTime - buildTime) / std::max(mergeTime - tableBuildTime, 1e-9), "x"
+            );
+            return;
+        }
+
+        void runReconcileMemoryBenchmark(const Arguments& arguments)
+        {
+            InputShape shape{
+                arguments.getSize("reconcile_memory.files", 1000000),
+                arguments.getSize("reconcile.blocked_per_mille", 900),
+                arguments.getSize("reconcile.kept_per_mille", 950)
+            };
+            report("reconcile-memory", "files", static_cast<double>(shape.fileCount), "files");
+
+#if !defined(_WIN32)
+            // every run gets a fresh copy of this process, the one that does nothing is what that copy costs
+            auto baseline = runInChild([] (void) -> MemoryResult { return (MemoryResult{ 0, 0, 0, 0 }); });
+            auto before = runInChild([&shape] (void) -> MemoryResult { return (reconcileHashMaps(shape)); });
+            auto after = runInChild([&shape] (void) -> MemoryResult { return (reconcilePathTables(shape)); });
+
+            if (before.adds != after.adds || before.removes != after.removes) {
+                throw (std::runtime_error("reconcile-memory: the plan differs from the hash map diff"));
+            }
+
+            const double MB = 1024.0 * 1024.0;
+            double beforePeak = static_cast<double>(before.peakRSS - std::min(before.peakRSS, baseline.peakRSS));
+            double afterPeak = static_cast<double>(after.peakRSS - std::min(after.peakRSS, baseline.peakRSS));
+            report("reconcile-memory", "baseline_peak_rss", static_cast<double>(baseline.peakRSS) / MB, "MB");
+            report("reconcile-memory", "hash_map_peak_rss", beforePeak / MB, "MB");
+            report("reconcile-memory", "path_table_peak_rss", afterPeak / MB, "MB");
+            report("reconcile-memory", "hash_map_per_file", beforePeak / static_cast<double>(shape.fileCount), "B");
+            report("reconcile-memory", "path_table_per_file", afterPeak / static_cast<double>(shape.fileCount), "B");
+            report("reconcile-memory", "reduction", beforePeak / std::max(afterPeak, 1.0), "x");
+            report("reconcile-memory", "hash_map", before.elapsed, "ms");
+            report("reconcile-memory", "path_table", after.elapsed, "ms");
+#else
+            // without fork the peak of one run would hide the other, only the times are measured here
+            auto before = reconcileHashMaps(shape);
+            auto after = reconcilePathTables(shape);
+            if (before.adds != after.adds || before.removes != after.removes) {
+                throw (std::runtime_error("reconcile-memory: the plan differs from the hash map diff"));
+            }
+            report("reconcile-memory", "hash_map", before.elapsed, "ms");
+            report("reconcile-memory", "path_table", after.elapsed, "ms");
+#endif
+            return;
+        }
+    } // namespace Bench
+} // namespace FWMFW
@@ -0,0 +1,482 @@
+#include "Bench.hxx"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+#include "Classifier.hxx"
+#include "PathMatcher.hxx"
+#include "ScanIndex.hxx"
+#include "Scanner.hxx"
+#include "Utils.hxx"
+
+namespace FWMFW
+{
+    namespace Bench
+    {
+        namespace
+        {
+            // the recursive Utils::getFilesInDirectory as it was before the scanner, moved onto std::filesystem so
+            // that it can serve as the baseline: one walker, and every level copies its result into its parent.
+            std::vector<std::string> recursiveGetFilesInDirectory(
+                const std::string& dir, const std::string& fileEnding, bool traverseAll
+            )
+            {
+                std::vector<std::string> result;
+                std::error_code errorCode;
+                std::filesystem::directory_iterator itr{ dir, errorCode };
+                if (errorCode) return (result);
+
+                for (; itr != std::filesystem::directory_iterator(); itr.increment(errorCode)) {
+                    std::string name = itr->path().filename().string();
+                    if (itr->is_directory(errorCode) && traverseAll) {
+                        auto subdir = dir + name + Utils::PATH_SEPARATOR;
+                        auto subdirFiles = recursiveGetFilesInDirectory(subdir, fileEnding, traverseAll);
+                        result.insert(result.cend(), subdirFiles.cbegin(), subdirFiles.cend());
+                    }
+                    else if (Utils::stringEndsWith(name, fileEnding)) {
+                        result.push_back(dir + name);
+                    }
+                }
+
+                return (result);
+            }
+
+            // the headers of a PE image as far as Classifier::isPEImage looks at them, padded to size
+            std::string makePEImage(std::size_t size)
+            {
+                std::string image(std::max<std::size_t>(size, 0x84), '\0');
+                image[0] = 'M';
+                image[1] = 'Z';
+                image[0x3C] = '\x80'; // e_lfanew, little endian
+                image.replace(0x80, 4, std::string("PE\0\0", 4));
+                return (image);
+            }
+        } // anonymous namespace
+
+        void runScanBenchmark(const Arguments& arguments)
+        {
+            TreeShape shape;
+            shape.depth = arguments.getSize("scan.depth", 4);
+            shape.fanOut = arguments.getSize("scan.fanout", 6);
+            shape.filesPerDirectory = arguments.getSize("scan.files", 16);
+            shape.executablesPerDirectory = arguments.getSize("scan.exes", 4);
+            std::size_t repetitions = arguments.getSize("repetitions", 3);
+            std::size_t threads = arguments.getSize("threads", 0);
+
+            ScratchDirectory scratch("scan");
+            std::size_t expected = generateTree(scratch.getPath(), shape);
+            report("scan", "executables", static_cast<double>(expected), "files");
+
+            auto check = [expected] (std::size_t found) -> void {
+                if (found != expected) throw (std::runtime_error("scan: unexpected number of files found"));
+                return;
+            };
+
+            double recursiveTime = timeBestOf(repetitions, [&] (void) -> void {
+                check(recursiveGetFilesInDirectory(scratch.getPath(), ".exe", true).size());
+                return;
+            });
+            report("scan", "recursive", recursiveTime, "ms");
+
+            auto timeScanner = [&] (std::size_t threadCount) -> double {
+                Scanner::ScanOptions options;
+                options.threadCount = threadCount;
+                Scanner::DirectoryScanner scanner(options, std::make_shared<Scanner::FileSystemBackend>());
+                return (timeBestOf(repetitions, [&] (void) -> void {
+                    Scanner::VectorSink sink;
+                    scanner.scan({ scratch.getPath() }, sink);
+                    check(sink.matches.size());
+                    return;
+                }));
+            };
+
+            double singleTime = timeScanner(1);
+            report("scan", "scanner_1_thread", singleTime, "ms");
+
+            Scanner::ScanOptions defaultOptions;
+            defaultOptions.threadCount = threads;
+            Scanner::DirectoryScanner defaultScanner{ defaultOptions };
+            std::size_t threadCount = defaultScanner.getOptions().threadCount;
+            double parallelTime = timeScanner(threadCount);
+            report("scan", "scanner_" + std::to_string(threadCount) + "_threads", parallelTime, "ms");
+
+            report("scan", "speedup_1_thread", recursiveTime / std::max(singleTime, 1e-9), "x");
+            report("scan", "speedup_parallel", recursiveTime / std::max(parallelTime, 1e-9), "x");
+            return;
+        }
+
+        void runScanIndexBenchmark(const Arguments& arguments)
+        {
+            TreeShape shape;
+            shape.depth = arguments.getSize("scan.depth", 4);
+            shape.fanOut = arguments.getSize("scan.fanout", 6);
+            shape.filesPerDirectory = arguments.getSize("scan.files", 16);
+            shape.executablesPerDirectory = arguments.getSize("scan.exes", 4);
+            std::size_t changedDirectories = arguments.getSize("scan-index.changes", 10);
+            std::size_t threads = arguments.getSize("threads", 0);
+
+            ScratchDirectory scratch("scanindex");
+            std::string root = scratch.getPath() + "tree" + Utils::PATH_SEPARATOR;
+            std::filesystem::create_directory(root);
+            std::size_t expected = generateTree(root, shape);
+            // freshly modified directories are never trusted by the index
+            ageTree(root);
+
+            std::string indexFile = scratch.getPath() + "scan.idx";
+            auto runScan = [&] (const char* metric) -> void {
+                Scanner::ScanIndex previousIndex;
+                previousIndex.load(indexFile, ".exe");
+                Scanner::ScanIndexBuilder nextIndex(".exe");
+
+                Scanner::ScanOptions options;
+                options.threadCount = threads;
+                options.previousIndex = &previousIndex;
+                options.nextIndex = &nextIndex;
+
+                Stopwatch stopwatch;
+                Scanner::VectorSink sink;
+                auto summary = Scanner::DirectoryScanner(options).scan({ root }, sink);
+                double elapsed = stopwatch.getElapsedMilliseconds();
+
+                previousIndex.close();
+                if (!nextIndex.save(indexFile)) throw (std::runtime_error("scan-index: unable to save the index"));
+                if (sink.matches.size() != expected) {
+                    throw (std::runtime_error("scan-index: unexpected number of files found"));
+                }
+
+                report("scan-index", std::string(metric) + "_time", elapsed, "ms");
+                report(
+                    "scan-index", std::string(metric) + "_enumerated",
+                    static_cast<double>(summary.directoriesEnumerated), "dirs"
+                );
+                return;
+            };
+
+            // the first scan only warms up the file system cache and creates the index
+            std::filesystem::remove(indexFile);
+            runScan("cold");
+            std::filesystem::remove(indexFile);
+            runScan("cold");
+            runScan("warm");
+
+            // add an executable to a chain of nested directories, only those should be enumerated again
+            std::size_t changed = 0;
+            std::string dir = root;
+            for (std::size_t idx = 0; idx < changedDirectories && idx < shape.depth; idx++) {
+                dir.append("dir0").push_back(Utils::PATH_SEPARATOR);
+                std::ofstream{ dir + "added.exe" };
+                changed++;
+            }
+            expected += changed;
+            runScan("warm_changed");
+            report("scan-index", "changed", static_cast<double>(changed), "dirs");
+            return;
+        }
+
+        void runScanPruneBenchmark(const Arguments& arguments)
+        {
+            std::size_t projectCount = arguments.getSize("scan-prune.projects", 20);
+            std::size_t repetitions = arguments.getSize("repetitions", 3);
+            std::size_t threads = arguments.getSize("threads", 0);
+
+            // projects with a few executables of their own, next to large dependency trees nobody wants to block
+            TreeShape appShape{ 2, 3, 8, 2 };
+            TreeShape dependencyShape{ 3, 5, 10, 1 };
+
+            ScratchDirectory scratch("scanprune");
+            std::string root = scratch.getPath() + "projects" + Utils::PATH_SEPARATOR;
+            std::filesystem::create_directory(root);
+            std::size_t appExecutables = 0;
+            std::size_t allExecutables = 0;
+            for (std::size_t idx = 0; idx < projectCount; idx++) {
+                std::string project = root + "project" + std::to_string(idx) + Utils::PATH_SEPARATOR;
+                std::filesystem::create_directory(project);
+                for (auto&& name : { "app", "node_modules" }) {
+                    std::string dir = project + name + Utils::PATH_SEPARATOR;
+                    std::filesystem::create_directory(dir);
+                    std::size_t created = generateTree(dir, (name[0] == 'a') ? appShape : dependencyShape);
+                    if (name[0] == 'a') appExecutables += created;
+                    allExecutables += created;
+                }
+            }
+
+            Scanner::PathMatcher matcher;
+            matcher.addInclude(root);
+            matcher.addExclude("node_modules");
+
+            auto runScan = [&] (
+                const Scanner::PathMatcher* scanMatcher, std::size_t expected, const std::string& metric
+            ) -> double {
+                Scanner::ScanOptions options;
+                options.threadCount = threads;
+                options.matcher = scanMatcher;
+                Scanner::DirectoryScanner scanner(options);
+
+                Scanner::ScanSummary summary{ 0, 0, 0, 0, 0, 0 };
+                double elapsed = timeBestOf(repetitions, [&] (void) -> void {
+                    Scanner::VectorSink sink;
+                    summary = scanner.scan({ root }, sink);
+                    if (sink.matches.size() != expected) {
+                        throw (std::runtime_error("scan-prune: unexpected number of files found"));
+                    }
+                    return;
+                });
+
+                report("scan-prune", metric + "_time", elapsed, "ms");
+                report("scan-prune", metric + "_visited", static_cast<double>(summary.directoriesVisited), "dirs");
+                report("scan-prune", metric + "_pruned", static_cast<double>(summary.directoriesPruned), "dirs");
+                return (elapsed);
+            };
+
+            double fullTime = runScan(nullptr, allExecutables, "full");
+            double prunedTime = runScan(&matcher, appExecutables, "pruned");
+            report("scan-prune", "speedup", fullTime / std::max(prunedTime, 1e-9), "x");
+
+            // the cost of the matcher per directory entry, with an exclusion that is live at every level
+            const std::size_t STEPS = 1000000;
+            auto state = matcher.getState(root + "project0" + Utils::PATH_SEPARATOR + "app" + Utils::PATH_SEPARATOR);
+            std::size_t matched = 0;
+            Stopwatch stopwatch;
+            for (std::size_t idx = 0; idx < STEPS; idx++) {
+                if (matcher.isMatch(state, (idx % 2 == 0) ? "file0.exe" : "node_modules")) matched++;
+                if (!matcher.isPruned(matcher.step(state, (idx % 2 == 0) ? "dir0" : "node_modules"))) matched++;
+            }
+            double stepTime = stopwatch.getElapsedMilliseconds();
+            if (matched != STEPS) throw (std::runtime_error("scan-prune: unexpected matcher results"));
+            report("scan-prune", "matcher_per_entry", stepTime * 1e6 / static_cast<double>(STEPS * 2), "ns");
+            return;
+        }
+
+        void runScanLinksBenchmark(const Arguments& arguments)
+        {
+            TreeShape shape;
+            shape.depth = arguments.getSize("scan.depth", 4);
+            shape.fanOut = arguments.getSize("scan.fanout", 6);
+            shape.filesPerDirectory = arguments.getSize("scan.files", 16);
+            shape.executablesPerDirectory = arguments.getSize("scan.exes", 4);
+            std::size_t repetitions = arguments.getSize("repetitions", 3);
+            std::size_t threads = arguments.getSize("threads", 0);
+
+            ScratchDirectory scratch("scanlinks");
+            const std::string& root = scratch.getPath();
+            std::size_t expected = generateTree(root, shape);
+            auto getDir = [&root] (std::initializer_list<const char*> names) -> std::string {
+                std::string dir = root;
+                for (auto&& name : names) dir.append(name).push_back(Utils::PATH_SEPARATOR);
+                return (dir);
+            };
+
+            // a list with the same tree under a few names: the whole of it, folders inside, and a duplicate
+            std::vector<std::string> roots{
+                getDir({ "dir0", "dir1" }), root, getDir({ "dir0" }), getDir({ "dir1" }), getDir({ "dir0", "dir1" }),
+                getDir({ "dir2", ".." })
+            };
+
+            auto scanOnce = [&] (
+                const std::vector<std::string>& scanRoots, bool followLinks, Scanner::ScanSummary& summary
+            ) -> std::vector<Scanner::Match> {
+                Scanner::ScanOptions options;
+                options.threadCount = threads;
+                options.followLinks = followLinks;
+                Scanner::VectorSink sink;
+                summary = Scanner::DirectoryScanner(options).scan(scanRoots, sink);
+                return (std::move(sink.matches));
+            };
+            auto checkOnce = [] (
+                const std::vector<Scanner::Match>& matches, std::size_t count, const char* what
+            ) -> void {
+                std::set<std::string> paths;
+                for (auto&& match : matches) paths.insert(match.path);
+                if ((matches.size() != count) || (paths.size() != count)) {
+                    throw (std::runtime_error(std::string("scan-links: ") + what + " not found exactly once"));
+                }
+                return;
+            };
+
+            // every root walked on its own, as the list was scanned before
+            Scanner::ScanSummary summary{ 0, 0, 0, 0, 0, 0 };
+            std::size_t separateVisited = 0;
+            std::size_t separateFound = 0;
+            double separateTime = timeBestOf(repetitions, [&] (void) -> void {
+                separateVisited = 0;
+                separateFound = 0;
+                for (auto&& scanRoot : roots) {
+                    separateFound += scanOnce({ scanRoot }, false, summary).size();
+                    separateVisited += summary.directoriesVisited;
+                }
+                return;
+            });
+            double dedupedTime = timeBestOf(repetitions, [&] (void) -> void {
+                checkOnce(scanOnce(roots, false, summary), expected, "files under overlapping roots");
+                return;
+            });
+            if (summary.rootsSkipped != roots.size() - 1) {
+                throw (std::runtime_error("scan-links: overlapping roots not skipped"));
+            }
+            report("scan-links", "roots", static_cast<double>(roots.size()), "roots");
+            report("scan-links", "separate_visited", static_cast<double>(separateVisited), "dirs");
+            report("scan-links", "separate_found", static_cast<double>(separateFound), "files");
+            report("scan-links", "separate_time", separateTime, "ms");
+            report("scan-links", "deduped_visited", static_cast<double>(summary.directoriesVisited), "dirs");
+            report("scan-links", "deduped_found", static_cast<double>(expected), "files");
+            report("scan-links", "deduped_time", dedupedTime, "ms");
+            report("scan-links", "speedup", separateTime / std::max(dedupedTime, 1e-9), "x");
+
+            // a link back up to the root, a second way into a folder, and a link to a file
+            std::error_code errorCode;
+            std::filesystem::create_directory_symlink(root, getDir({ "dir0" }) + "loop", errorCode);
+            if (!errorCode) {
+                std::filesystem::create_directory_symlink(getDir({ "dir2" }), getDir({ "dir1" }) + "alias", errorCode);
+            }
+            if (!errorCode) {
+                std::filesystem::create_symlink(root + "file0.exe", root + "link.exe", errorCode);
+            }
+            if (errorCode) {
+                // creating links takes a privilege on Windows
+                report("scan-links", "links_supported", 0.0, "");
+                return;
+            }
+            report("scan-links", "links_supported", 1.0, "");
+
+            checkOnce(scanOnce({ root }, false, summary), expected + 1, "files next to links");
+            if (summary.directoriesSkipped != 0) throw (std::runtime_error("scan-links: links followed"));
+
+            // the same folder as a root of its own and through a link
+            std::size_t linkedExpected = scanOnce({ getDir({ "dir2" }) }, false, summary).size();
+            checkOnce(
+                scanOnce({ getDir({ "dir2" }), getDir({ "dir1", "alias" }) }, false, summary), linkedExpected,
+                "files under a root and a link to it"
+            );
+            if (summary.rootsSkipped != 1) throw (std::runtime_error("scan-links: linked root not skipped"));
+
+            Stopwatch stopwatch;
+            auto matches = scanOnce({ root }, true, summary);
+            double followTime = stopwatch.getElapsedMilliseconds();
+            checkOnce(matches, expected + 1, "files behind links");
+            if (summary.directoriesSkipped < 2) throw (std::runtime_error("scan-links: links walked twice"));
+            report("scan-links", "follow_time", followTime, "ms");
+            report("scan-links", "follow_skipped", static_cast<double>(summary.directoriesSkipped), "dirs");
+            return;
+        }
+        void runClassifyBenchmark(const Arguments& arguments)
+        {
+            std::size_t nameCount = arguments.getSize("classify.names", 1000000);
+            std::size_t directoryCount = arguments.getSize("classify.dirs", 200);
+            std::size_t filesPerKind = arguments.getSize("classify.files", 5);
+            std::size_t sniffThreads = std::max<std::size_t>(arguments.getSize("classify.sniff_threads", 4), 1);
+            std::size_t repetitions = arguments.getSize("repetitions", 3);
+            std::size_t threads = arguments.getSize("threads", 0);
+
+            // the headers, including ones that only look like PE images at first
+            std::string image = makePEImage(1024);
+            std::string truncated = image.substr(0, 0x40);
+            std::string outOfBounds = image;
+            outOfBounds[0x3D] = '\x10'; // e_lfanew 0x1080, past the end
+            if (!Scanner::Classifier::isPEImage(image.data(), image.size()) ||
+                Scanner::Classifier::isPEImage(truncated.data(), truncated.size()) ||
+                Scanner::Classifier::isPEImage(outOfBounds.data(), outOfBounds.size()) ||
+                Scanner::Classifier::isPEImage("MZ", 2)) {
+                throw (std::runtime_error("classify: wrong PE header check"));
+            }
+
+            // names: the old case sensitive ".exe" check against the extension set, folded in one pass
+            const char* const EXTENSIONS[] = { ".exe", ".EXE", ".Exe", ".scr", ".com", ".dll", ".txt", ".exe.txt" };
+            const std::size_t EXTENSION_COUNT = sizeof(EXTENSIONS) / sizeof(EXTENSIONS[0]);
+            std::vector<std::string> names;
+            names.reserve(nameCount);
+            for (std::size_t idx = 0; idx < nameCount; idx++) {
+                names.push_back("Application " + std::to_string(idx) + EXTENSIONS[idx % EXTENSION_COUNT]);
+            }
+            Scanner::Classifier classifier({ ".exe", ".scr", ".com" });
+
+            std::size_t endsWithCount = 0;
+            Stopwatch stopwatch;
+            for (auto&& name : names) {
+                if (Utils::stringEndsWith(name, ".exe")) endsWithCount++;
+            }
+            double endsWithTime = stopwatch.getElapsedMilliseconds();
+
+            std::size_t extensionCount = 0;
+            stopwatch.restart();
+            for (auto&& name : names) {
+                if (classifier.hasExtension(name)) extensionCount++;
+            }
+            double extensionTime = stopwatch.getElapsedMilliseconds();
+
+            // 5 of every 8 names have one of the extensions in some case, only 1 has exactly ".exe"
+            std::size_t expectedCount = 0;
+            for (std::size_t idx = 0; idx < nameCount; idx++) {
+                if (idx % EXTENSION_COUNT < 5) expectedCount++;
+            }
+            std::size_t exactCount = (nameCount + EXTENSION_COUNT - 1) / EXTENSION_COUNT;
+            if (extensionCount != expectedCount || endsWithCount != exactCount) {
+                throw (std::runtime_error("classify: unexpected number of names matched"));
+            }
+            report("classify", "ends_with_per_name", endsWithTime * 1e6 / static_cast<double>(nameCount), "ns");
+            report("classify", "extensions_per_name", extensionTime * 1e6 / static_cast<double>(nameCount), "ns");
+
+            // files: PE images and other files under the right and the wrong names
+            ScratchDirectory scratch("classify");
+            std::string root = scratch.getPath();
+            std::size_t fileCount = 0;
+            for (std::size_t dirIdx = 0; dirIdx < directoryCount; dirIdx++) {
+                std::string dir = root + "dir" + std::to_string(dirIdx) + Utils::PATH_SEPARATOR;
+                std::filesystem::create_directory(dir);
+                for (std::size_t idx = 0; idx < filesPerKind; idx++) {
+                    std::string stem = dir + "file" + std::to_string(idx);
+                    std::ofstream(stem + "a.exe", std::ios::binary) << image;
+                    std::ofstream(stem + "b.SCR", std::ios::binary) << image;
+                    std::ofstream(stem + "c.exe", std::ios::binary) << "not an executable";
+                    std::ofstream(stem + "d.dat", std::ios::binary) << image;
+                    std::ofstream(stem + "e.txt", std::ios::binary) << "text";
+                    fileCount += 5;
+                }
+            }
+            std::size_t perKind = directoryCount * filesPerKind;
+            report("classify", "files", static_cast<double>(fileCount), "files");
+
+            struct Mode
+            {
+                const char* name;
+                Scanner::ContentCheck contentCheck;
+                std::size_t expected;
+            }; // struct Mode
+            const Mode MODES[] = {
+                { "extensions", Scanner::ContentCheck::None, perKind * 3 },
+                { "confirm", Scanner::ContentCheck::Confirm, perKind * 2 },
+                { "detect", Scanner::ContentCheck::Detect, perKind * 3 }
+            };
+
+            for (auto&& mode : MODES) {
+                for (std::size_t sniffThreadCount : { std::size_t{ 1 }, sniffThreads }) {
+                    if (mode.contentCheck == Scanner::ContentCheck::None && sniffThreadCount != 1) continue;
+
+                    Scanner::ScanOptions options;
+                    options.classifier = Scanner::Classifier({ ".exe", ".scr" }, mode.contentCheck);
+                    options.threadCount = threads;
+                    options.sniffThreadCount = sniffThreadCount;
+                    Scanner::DirectoryScanner scanner(options);
+                    double elapsed = timeBestOf(repetitions, [&] (void) -> void {
+                        Scanner::VectorSink sink;
+                        scanner.scan({ root }, sink);
+                        if (sink.matches.size() != mode.expected) {
+                            throw (std::runtime_error("classify: unexpected number of files found"));
+                        }
+                        return;
+                    });
+
+                    std::string metric = std::string(mode.name) + "_scan";
+                    if (mode.contentCheck != Scanner::ContentCheck::None) {
+                        metric += "_" + std::to_string(sniffThreadCount) + "_sniffers";
+                    }
+                    report("classify", metric, elapsed, "ms");
+                }
+            }
+            return;
+        }
+    } // namespace Bench
+} // namespace FWMFW
@@ -0,0 +1,216 @@
+#include "Bench.hxx"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <unordered_set>
+
+#include "MemoryRuleStore.hxx"
+#include "Service.hxx"
+#include "WinNetFW.hxx"
+
+namespace FWMFW
+{
+    namespace Bench
+    {
+        namespace
+        {
+            struct LoadShape
+            {
+                std::size_t clients;
+                std::size_t requestsPerClient;
+                std::size_t filesPerRequest;
+            }; // struct LoadShape
+
+            std::string makeToolName(std::size_t client, std::size_t request, std::size_t file)
+            {
+                return (
+                    "C:\\Agents\\Agent" + std::to_string(client) + "\\Build" + std::to_string(request) + "\\tool" +
+                    std::to_string(file) + ".exe"
+                );
+            }
+
+            // what a client sends: every request blocks new tools, and every other one also unblocks the tools of
+            // the request before it
+            std::vector<Service::RequestedChange> makeRequest(
+                const LoadShape& shape, std::size_t client, std::size_t request
+            )
+            {
+                std::vector<Service::RequestedChange> changes;
+                for (std::size_t file = 0; file < shape.filesPerRequest; file++) {
+                    changes.push_back(Service::RequestedChange{ makeToolName(client, request, file), true });
+                    if (request % 2 == 1) {
+                        changes.push_back(Service::RequestedChange{ makeToolName(client, request - 1, file), false });
+                    }
+                }
+                return (changes);
+            }
+
+            std::unordered_set<std::string> getExpectedBlocked(const LoadShape& shape)
+            {
+                std::unordered_set<std::string> blocked;
+                for (std::size_t client = 0; client < shape.clients; client++) {
+                    for (std::size_t request = 0; request < shape.requestsPerClient; request++) {
+                        for (auto&& change : makeRequest(shape, client, request)) {
+                            if (change.isBlock) blocked.insert(change.appName);
+                            else blocked.erase(change.appName);
+                        }
+                    }
+                }
+                return (blocked);
+            }
+
+            std::shared_ptr<WinNetFW::MemoryRuleStore> createStore(std::size_t ruleCount)
+            {
+                auto store = std::make_shared<WinNetFW::MemoryRuleStore>();
+                for (std::size_t idx = 0; idx < ruleCount; idx++) {
+                    store->addRule(WinNetFW::Rule{
+                        "Vendor rule " + std::to_string(idx), "C:\\Program Files\\app" + std::to_string(idx) + ".exe",
+                        "", (idx % 2 == 0) ? WinNetFW::RuleDirection::In : WinNetFW::RuleDirection::Out,
+                        WinNetFW::RuleAction::Allow, true
+                    });
+                }
+                return (store);
+            }
+
+            void checkBlocked(
+                const char* name, const WinNetFW::FireWallPolicy& policy, std::size_t blockedCount,
+                const std::unordered_set<std::string>& expected
+            )
+            {
+                if (blockedCount != expected.size()) {
+                    throw (std::runtime_error(std::string(name) + ": unexpected number of files blocked"));
+                }
+                for (auto&& appName : expected) {
+                    if (!policy.isBlocked(appName)) {
+                        throw (std::runtime_error(std::string(name) + ": a file is not blocked"));
+                    }
+                }
+                return;
+            }
+
+            void checkResults(const std::vector<WinNetFW::RuleChangeResult>& results, std::size_t changeCount)
+            {
+                if (results.size() != changeCount) throw (std::runtime_error("service: missing results"));
+                for (auto&& result : results) {
+                    if (result.status != WinNetFW::RuleChangeResult::Status::Applied) {
+                        throw (std::runtime_error("service: a change was not applied"));
+                    }
+                }
+                return;
+            }
+        } // anonymous namespace
+
+        void runServiceBenchmark(const Arguments& arguments)
+        {
+            std::size_t ruleCount = arguments.getSize("service.rules", 20000);
+            LoadShape shape{
+                arguments.getSize("service.clients", 8),
+                arguments.getSize("service.requests", 25),
+                arguments.getSize("service.files", 4)
+            };
+            Service::ServiceOptions serviceOptions;
+            serviceOptions.coalesceWindow = std::chrono::milliseconds(arguments.getSize("service.coalesce_ms", 20));
+
+            WinNetFW::MemoryRuleStore::Latency latency;
+            latency.enumerateCall = std::chrono::nanoseconds(arguments.getSize("latency.enumerate_call_ns", 2000));
+            latency.enumerateRule = std::chrono::nanoseconds(arguments.getSize("latency.enumerate_rule_ns", 100));
+            latency.add = std::chrono::nanoseconds(arguments.getSize("latency.add_ns", 20000));
+            latency.remove = std::chrono::nanoseconds(arguments.getSize("latency.remove_ns", 20000));
+
+            auto expected = getExpectedBlocked(shape);
+            double requestCount = static_cast<double>(shape.clients * shape.requestsPerClient);
+            report("service", "requests", requestCount, "requests");
+
+            // every request a launch of its own, one after the other: it reads the rules and commits its changes
+            double launchesElapsed = 0;
+            {
+                auto store = createStore(ruleCount);
+                store->setLatency(latency);
+                Stopwatch stopwatch;
+                for (std::size_t request = 0; request < shape.requestsPerClient; request++) {
+                    for (std::size_t client = 0; client < shape.clients; client++) {
+                        WinNetFW::FireWallPolicy policy(store);
+                        auto rules = policy.getBlockRules();
+                        WinNetFW::RuleTransaction transaction;
+                        for (auto&& change : makeRequest(shape, client, request)) {
+                            auto rule = rules.find(change.appName);
+                            if (change.isBlock && (rule == rules.end())) transaction.block(change.appName);
+                            if (!change.isBlock && (rule != rules.end())) {
+                                transaction.unblock(change.appName, rule->second);
+                            }
+                        }
+                        policy.commit(transaction);
+                    }
+                }
+                launchesElapsed = stopwatch.getElapsedMilliseconds();
+
+                WinNetFW::FireWallPolicy policy(store);
+                checkBlocked("launches", policy, policy.getBlockRules().size(), expected);
+            }
+            report("service", "launches", launchesElapsed, "ms");
+            report("service", "launches_per_request", launchesElapsed * 1e3 / requestCount, "us");
+
+            // the same requests from concurrent clients, each request over a connection of its own
+            auto store = createStore(ruleCount);
+            store->setLatency(latency);
+            WinNetFW::FireWallPolicy policy(store);
+            Service::RuleService service(policy, serviceOptions);
+            service.load();
+
+#if defined(_WIN32)
+            std::string address = "\\\\.\\pipe\\FWMFWBench";
+#else
+            ScratchDirectory scratch("service");
+            std::string address = scratch.getPath() + "FWMFW.sock";
+#endif // defined(_WIN32)
+            auto listener = Service::listen(address);
+            std::atomic<bool> isStopping{ false };
+            std::thread serviceThread([&service, &listener, &isStopping] (void) -> void {
+                service.run(*listener, isStopping);
+                return;
+            });
+
+            Stopwatch stopwatch;
+            std::vector<std::thread> clients;
+            std::vector<std::exception_ptr> errors(shape.clients);
+            for (std::size_t client = 0; client < shape.clients; client++) {
+                clients.emplace_back([&shape, &address, &errors, client] (void) -> void {
+                    try {
+                        for (std::size_t request = 0; request < shape.requestsPerClient; request++) {
+                            auto changes = makeRequest(shape, client, request);
+                            checkResults(Service::sendRequest(address, changes), changes.size());
+                        }
+                    } catch (...) {
+                        errors[client] = std::current_exception();
+                    }
+                    return;
+                });
+            }
+            for (auto&& client : clients) client.join();
+            double serviceElapsed = stopwatch.getElapsedMilliseconds();
+
+            isStopping = true;
+            serviceThread.join();
+            for (auto&& error : errors) {
+                if (error != nullptr) std::rethrow_exception(error);
+            }
+            checkBlocked("service", policy, service.getBlockedCount(), expected);
+
+            auto stats = service.getStats();
+            report("service", "service", serviceElapsed, "ms");
+            report("service", "service_per_request", serviceElapsed * 1e3 / requestCount, "us");
+            report("service", "throughput", requestCount * 1e3 / serviceElapsed, "requests/s");
+            report("service", "commits", static_cast<double>(stats.commits), "commits");
+            report(
+                "service", "requests_per_commit",
+                requestCount / static_cast<double>(std::max<std::size_t>(stats.commits, 1)), "requests"
+            );
+            report("service", "speedup", launchesElapsed / serviceElapsed, "x");
+            return;
+        }
+    } // namespace Bench
+} // namespace FWMFW
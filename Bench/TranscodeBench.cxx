@@ -0,0 +1,297 @@
+#include "Bench.hxx"
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "Transcode.hxx"
+#include "Utils.hxx"
+
+namespace FWMFW
+{
+    namespace Bench
+    {
+        namespace
+        {
+            // the conversions as Utils had them before the transcoder: one code point at a time, appending to a
+            // std::string. they serve as the baseline and as the reference the transcoder is checked against.
+            std::string referenceUTF16ToUTF8(const std::u16string& str)
+            {
+                std::string result;
+                result.reserve(str.length());
+
+                for (std::u16string::size_type idx = 0; idx < str.length(); idx++) {
+                    char32_t codePoint = str[idx];
+                    if (codePoint >= 0xD800 && codePoint <= 0xDBFF && idx + 1 < str.length() &&
+                        str[idx + 1] >= 0xDC00 && str[idx + 1] <= 0xDFFF) {
+                        codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (str[idx + 1] - 0xDC00);
+                        idx++;
+                    }
+                    else if (codePoint >= 0xD800 && codePoint <= 0xDFFF) {
+                        codePoint = 0xFFFD;
+                    }
+
+                    if (codePoint < 0x80) {
+                        result.push_back(static_cast<char>(codePoint));
+                    }
+                    else if (codePoint < 0x800) {
+                        result.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+                        result.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+                    }
+                    else if (codePoint < 0x10000) {
+                        result.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+                        result.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+                        result.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+                    }
+                    else {
+                        result.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+                        result.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+                        result.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+                        result.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+                    }
+                }
+
+                return (result);
+            }
+
+            std::u16string referenceUTF8ToUTF16(const std::string& str)
+            {
+                std::u16string result;
+                result.reserve(str.length());
+
+                std::string::size_type idx = 0;
+                while (idx < str.length()) {
+                    auto lead = static_cast<unsigned char>(str[idx]);
+                    std::size_t trailCount = 0;
+                    char32_t codePoint = 0;
+                    char32_t minimum = 0;
+                    if (lead < 0x80) {
+                        result.push_back(static_cast<char16_t>(lead));
+                        idx++;
+                        continue;
+                    }
+                    else if ((lead & 0xE0) == 0xC0) {
+                        trailCount = 1;
+                        codePoint = lead & 0x1F;
+                        minimum = 0x80;
+                    }
+                    else if ((lead & 0xF0) == 0xE0) {
+                        trailCount = 2;
+                        codePoint = lead & 0x0F;
+                        minimum = 0x800;
+                    }
+                    else if ((lead & 0xF8) == 0xF0) {
+                        trailCount = 3;
+                        codePoint = lead & 0x07;
+                        minimum = 0x10000;
+                    }
+                    else {
+                        result.push_back(0xFFFD);
+                        idx++;
+                        continue;
+                    }
+
+                    std::size_t consumed = 1;
+                    while (consumed <= trailCount && idx + consumed < str.length() &&
+                        (static_cast<unsigned char>(str[idx + consumed]) & 0xC0) == 0x80) {
+                        codePoint = (codePoint << 6) | (static_cast<unsigned char>(str[idx + consumed]) & 0x3F);
+                        consumed++;
+                    }
+                    idx += consumed;
+
+                    if (consumed != trailCount + 1 || codePoint < minimum || codePoint > 0x10FFFF ||
+                        (codePoint >= 0xD800 && codePoint <= 0xDFFF)) {
+                        result.push_back(0xFFFD);
+                    }
+                    else if (codePoint >= 0x10000) {
+                        codePoint -= 0x10000;
+                        result.push_back(static_cast<char16_t>(0xD800 + (codePoint >> 10)));
+                        result.push_back(static_cast<char16_t>(0xDC00 + (codePoint & 0x3FF)));
+                    }
+                    else {
+                        result.push_back(static_cast<char16_t>(codePoint));
+                    }
+                }
+
+                return (result);
+            }
+
+            void check(bool condition, const char* what)
+            {
+                if (!condition) throw (std::runtime_error(std::string("transcode: ") + what));
+                return;
+            }
+
+            // known answers, then every case again at every offset around the block size of the fast path, then
+            // random input against the reference
+            void checkTranscoder(void)
+            {
+                const std::u16string REPLACEMENT{ u"\uFFFD" };
+
+                struct UTF16Case
+                {
+                    std::u16string input;
+                    std::string expected;
+                }; // struct UTF16Case
+                const std::vector<UTF16Case> UTF16_CASES{
+                    { u"", "" },
+                    { u"C:\\Games\\app.exe", "C:\\Games\\app.exe" },
+                    { u"J\u00FCrgen \u20AC", "J\xC3\xBCrgen \xE2\x82\xAC" },
+                    { std::u16string{ 0xD83D, 0xDE00 }, "\xF0\x9F\x98\x80" },               // surrogate pair
+                    { std::u16string{ 0xDBFF, 0xDFFF }, "\xF4\x8F\xBF\xBF" },               // U+10FFFF
+                    { std::u16string{ 0xD83D }, "\xEF\xBF\xBD" },                           // high surrogate at the end
+                    { std::u16string{ 0xDE00, u'a' }, "\xEF\xBF\xBD" "a" },                 // lone low surrogate
+                    { std::u16string{ 0xD83D, u'a' }, "\xEF\xBF\xBD" "a" },                 // high without low
+                    { std::u16string{ 0xD83D, 0xD83D, 0xDE00 }, "\xEF\xBF\xBD\xF0\x9F\x98\x80" },
+                };
+
+                struct UTF8Case
+                {
+                    std::string input;
+                    std::u16string expected;
+                }; // struct UTF8Case
+                const std::vector<UTF8Case> UTF8_CASES{
+                    { "", u"" },
+                    { "C:\\Games\\app.exe", u"C:\\Games\\app.exe" },
+                    { "J\xC3\xBCrgen \xE2\x82\xAC", u"J\u00FCrgen \u20AC" },
+                    { "\xF0\x9F\x98\x80", std::u16string{ 0xD83D, 0xDE00 } },
+                    { "\xC0\xAF", REPLACEMENT },                                             // overlong
+                    { "\xE0\x80\xAF", REPLACEMENT },                                         // overlong
+                    { "\xED\xA0\x80", REPLACEMENT },                                         // encoded surrogate
+                    { "\xF4\x90\x80\x80", REPLACEMENT },                                     // above U+10FFFF
+                    { "\xE2\x82", REPLACEMENT },                                             // truncated at the end
+                    { "\xE2\x82" "a", REPLACEMENT + u"a" },                                  // truncated
+                    { "\x80" "a", REPLACEMENT + u"a" },                                      // stray continuation
+                    { "\xFF\xFE", REPLACEMENT + REPLACEMENT },                               // invalid lead bytes
+                };
+
+                for (std::size_t prefix = 0; prefix <= 40; prefix++) {
+                    std::u16string prefix16(prefix, u'x');
+                    std::string prefix8(prefix, 'x');
+                    for (auto&& testCase : UTF16_CASES) {
+                        auto input = prefix16 + testCase.input + u"tail";
+                        check(Utils::utf16StrToUTF8Str(input) == prefix8 + testCase.expected + "tail", "bad UTF-8");
+                    }
+                    for (auto&& testCase : UTF8_CASES) {
+                        auto input = prefix8 + testCase.input + "tail";
+                        check(Utils::utf8StrToUTF16Str(input) == prefix16 + testCase.expected + u"tail", "bad UTF-16");
+                    }
+                }
+
+                // mostly ASCII with a few arbitrary code units (or bytes) in between, which makes for plenty of
+                // invalid input as well
+                std::mt19937 random(42);
+                for (std::size_t round = 0; round < 20000; round++) {
+                    std::size_t length = random() % 100;
+                    std::u16string str16;
+                    std::string str8;
+                    for (std::size_t idx = 0; idx < length; idx++) {
+                        bool isASCII = (random() % 8 != 0);
+                        str16.push_back(static_cast<char16_t>(isASCII ? random() % 0x80 : random() % 0x10000));
+                        str8.push_back(static_cast<char>(isASCII ? random() % 0x80 : random() % 0x100));
+                    }
+                    check(Utils::utf16StrToUTF8Str(str16) == referenceUTF16ToUTF8(str16), "UTF-8 differs");
+                    check(Utils::utf8StrToUTF16Str(str8) == referenceUTF8ToUTF16(str8), "UTF-16 differs");
+                    check(Utils::utf16StrToUTF8Str(referenceUTF8ToUTF16(str8)) == referenceUTF16ToUTF8(
+                        referenceUTF8ToUTF16(str8)), "round trip differs");
+                }
+                return;
+            }
+
+            // MB of input per second
+            double getThroughput(std::size_t bytes, double milliseconds)
+            {
+                return (static_cast<double>(bytes) / 1e6 / (std::max(milliseconds, 1e-9) / 1e3));
+            }
+        } // anonymous namespace
+
+        void runTranscodeBenchmark(const Arguments& arguments)
+        {
+            std::size_t stringCount = arguments.getSize("transcode.strings", 200000);
+            std::size_t repetitions = arguments.getSize("repetitions", 3);
+
+            checkTranscoder();
+            report("transcode", "self_check", 1, "passed");
+
+            // rule names and application paths: nearly all pure ASCII, some with a non-ASCII user or vendor name
+            std::vector<std::string> ascii8;
+            std::vector<std::string> mixed8;
+            for (std::size_t idx = 0; idx < stringCount; idx++) {
+                std::string tail = std::to_string(idx / 16) + "\\Binaries\\Win64\\app" + std::to_string(idx) + ".exe";
+                ascii8.push_back("C:\\Program Files (x86)\\Vendor" + tail);
+                mixed8.push_back("C:\\Users\\J\xC3\xBCrgen\\AppData\\Local\\Vendor\xE2\x84\xA2" + tail);
+            }
+
+            for (auto&& input : { std::make_pair("ascii", &ascii8), std::make_pair("mixed", &mixed8) }) {
+                const auto& strings8 = *input.second;
+                std::vector<std::u16string> strings16;
+                std::size_t bytes8 = 0;
+                std::size_t bytes16 = 0;
+                for (auto&& str : strings8) {
+                    strings16.push_back(Utils::utf8StrToUTF16Str(str));
+                    bytes8 += str.length();
+                    bytes16 += strings16.back().length() * sizeof(char16_t);
+                }
+                std::string metric{ input.first };
+
+                // every conversion into a fresh string, as the callers did it, and into a reused one
+                std::size_t sink = 0;
+                double before = 0.0;
+                double after = 0.0;
+                double reused = 0.0;
+                for (std::size_t rep = 0; rep < repetitions; rep++) {
+                    Stopwatch stopwatch;
+                    for (auto&& str : strings16) sink += referenceUTF16ToUTF8(str).length();
+                    double elapsed = stopwatch.getElapsedMilliseconds();
+                    before = (rep == 0) ? elapsed : std::min(before, elapsed);
+
+                    stopwatch.restart();
+                    for (auto&& str : strings16) sink += Utils::utf16StrToUTF8Str(str).length();
+                    elapsed = stopwatch.getElapsedMilliseconds();
+                    after = (rep == 0) ? elapsed : std::min(after, elapsed);
+
+                    std::string buffer;
+                    stopwatch.restart();
+                    for (auto&& str : strings16) {
+                        Utils::utf16StrToUTF8Str(str, buffer);
+                        sink += buffer.length();
+                    }
+                    elapsed = stopwatch.getElapsedMilliseconds();
+                    reused = (rep == 0) ? elapsed : std::min(reused, elapsed);
+                }
+                report("transcode", metric + "_utf16_to_utf8_scalar", getThroughput(bytes16, before), "MB/s");
+                report("transcode", metric + "_utf16_to_utf8", getThroughput(bytes16, after), "MB/s");
+                report("transcode", metric + "_utf16_to_utf8_reused", getThroughput(bytes16, reused), "MB/s");
+
+                for (std::size_t rep = 0; rep < repetitions; rep++) {
+                    Stopwatch stopwatch;
+                    for (auto&& str : strings8) sink += referenceUTF8ToUTF16(str).length();
+                    double elapsed = stopwatch.getElapsedMilliseconds();
+                    before = (rep == 0) ? elapsed : std::min(before, elapsed);
+
+                    stopwatch.restart();
+                    for (auto&& str : strings8) sink += Utils::utf8StrToUTF16Str(str).length();
+                    elapsed = stopwatch.getElapsedMilliseconds();
+                    after = (rep == 0) ? elapsed : std::min(after, elapsed);
+
+                    std::u16string buffer;
+                    stopwatch.restart();
+                    for (auto&& str : strings8) {
+                        Utils::utf8StrToUTF16Str(str, buffer);
+                        sink += buffer.length();
+                    }
+                    elapsed = stopwatch.getElapsedMilliseconds();
+                    reused = (rep == 0) ? elapsed : std::min(reused, elapsed);
+                }
+                report("transcode", metric + "_utf8_to_utf16_scalar", getThroughput(bytes8, before), "MB/s");
+                report("transcode", metric + "_utf8_to_utf16", getThroughput(bytes8, after), "MB/s");
+                report("transcode", metric + "_utf8_to_utf16_reused", getThroughput(bytes8, reused), "MB/s");
+
+                // keeps the conversions from being optimized away
+                if (sink == 0) throw (std::runtime_error("transcode: nothing was converted"));
+            }
+            return;
+        }
+    } // namespace Bench
+} // namespace FWMFW
@@ -0,0 +1,167 @@
+#include "BlockList.hxx"
+
+#include <algorithm>
+
+#include "FileInfo.hxx"
+#include "ListFile.hxx"
+#include "Utils.hxx"
+
+namespace FWMFW
+{
+    namespace Reconcile
+    {
+        namespace
+        {
+            // collects the scanned files into the table of files to block
+            class RequestSink : public Scanner::Sink
+            {
+            public:
+                RequestSink(Utils::PathTable& requests, const BlockList::AddedCallback& added) :
+                    _requests(requests), _added(added)
+                { return; }
+
+                virtual void consume(std::vector<Scanner::Match>& matches) override
+                {
+                    for (auto&& match : matches) add(match.path);
+                    return;
+                }
+
+                void add(std::string_view path)
+                {
+                    std::size_t count = _requests.size();
+                    auto id = _requests.add(path, std::string_view());
+                    if (_added != nullptr && _requests.size() != count) _added(id);
+                    return;
+                }
+
+            private:
+                Utils::PathTable& _requests;
+                const BlockList::AddedCallback& _added;
+            }; // class RequestSink
+        } // anonymous namespace
+
+        bool BlockList::load(const std::string& listFile, const Scanner::Classifier& classifier)
+        {
+            clear();
+            std::string error;
+            bool isRead = readListFile(
+                listFile,
+                [this, &classifier] (const std::string&, const ListLine& line) -> void {
+                    if (line.type == ListLine::Type::Entry) addLine(line, classifier);
+                    return;
+                },
+                error
+            );
+            finish();
+            return (isRead);
+        }
+
+        void BlockList::clear(void)
+        {
+            _folders.clear();
+            _files.clear();
+            _matcher = Scanner::PathMatcher();
+            _hasPatterns = false;
+            return;
+        }
+
+        void BlockList::addLine(const ListLine& line, const Scanner::Classifier& classifier)
+        {
+            if (line.isExclusion) {
+                if (line.text.empty()) return;
+                _matcher.addExclude(line.text);
+                _hasPatterns = true;
+                return;
+            }
+
+            // normalize path separators. one buffer for the paths of all lines, it only allocates when a line is
+            // longer than all before
+            std::string& itemF = _item;
+            itemF.assign(line.text);
+            Utils::replaceCharsInPlace(itemF, '/', Utils::PATH_SEPARATOR, false);
+
+            // a single look at the file system per line, whatever the line turns out to be
+            Utils::FileInfo info;
+            if (Scanner::PathMatcher::hasWildcards(itemF)) {
+                // the folder the pattern starts with is walked, the matcher picks the files
+                auto base = Scanner::PathMatcher::getBase(itemF);
+                _matcher.addInclude(itemF);
+                _hasPatterns = true;
+                if (Utils::getFileInfo(base, info) && (info.type == Utils::FileType::Directory)) addFolder(base);
+            }
+            else if (Utils::getFileInfo(itemF, info) && (info.type == Utils::FileType::Directory)) {
+                // remove multiple separators at the end if there are and ensure that dir ends with exactly one
+                while (!itemF.empty() && itemF.back() == Utils::PATH_SEPARATOR) itemF.pop_back();
+                itemF.push_back(Utils::PATH_SEPARATOR);
+
+                _matcher.addInclude(itemF);
+                addFolder(itemF);
+            }
+            else if ((info.type != Utils::FileType::Missing) && classifier.isCandidate(itemF) &&
+                classifier.isMatch(itemF)) {
+                _files.push_back(itemF);
+            }
+            return;
+        }
+
+        void BlockList::finish(void)
+        {
+            // exclusions apply to the listed files as well
+            if (_hasPatterns) {
+                _files.erase(
+                    std::remove_if(
+                        _files.begin(), _files.end(),
+                        [this] (const std::string& file) -> bool { return (_matcher.getState(file).isExcluded); }
+                    ),
+                    _files.end()
+                );
+            }
+            return;
+        }
+
+        std::size_t BlockList::findFolder(const std::string& path) const
+        {
+            std::size_t result = NO_FOLDER;
+            for (std::size_t idx = 0; idx < _folders.size(); idx++) {
+                if (!Utils::stringStartsWith(path, _folders[idx])) continue;
+                if (result == NO_FOLDER || _folders[idx].length() > _folders[result].length()) result = idx;
+            }
+            return (result);
+        }
+
+        bool BlockList::isMatch(const std::string& path) const
+        {
+            if (!_hasPatterns) return (true);
+
+            auto pos = path.find_last_of(Utils::PATH_SEPARATOR);
+            if (pos == std::string::npos) return (false);
+            auto dirState = _matcher.getState(path.substr(0, pos + 1));
+            return (_matcher.isMatch(dirState, std::string_view(path).substr(pos + 1)));
+        }
+
+        Scanner::ScanOptions BlockList::getScanOptions(const Scanner::ScanOptions& options) const
+        {
+            Scanner::ScanOptions result = options;
+            result.matcher = _hasPatterns ? &_matcher : nullptr;
+            return (result);
+        }
+
+        void BlockList::expand(
+            const Scanner::ScanOptions& options, Utils::PathTable& files, const AddedCallback& added
+        ) const
+        {
+            RequestSink requestSink(files, added);
+            for (auto&& file : _files) requestSink.add(file);
+            Scanner::DirectoryScanner(getScanOptions(options)).scan(_folders, requestSink);
+            return;
+        }
+
+        void BlockList::addFolder(const std::string& folder)
+        {
+            // several patterns may start with the same folder
+            if (std::find(_folders.begin(), _folders.end(), folder) != _folders.end()) return;
+            _folders.push_back(folder);
+            return;
+        }
+    } // namespace Reconcile
+} // namespace FWMFW
@@ -0,0 +1,75 @@
+#if !defined(DOTSLASHZERO_FWMFW_BLOCKLIST_HXX)
+#define DOTSLASHZERO_FWMFW_BLOCKLIST_HXX
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "ListFile.hxx"
+#include "PathMatcher.hxx"
+#include "PathTable.hxx"
+#include "Scanner.hxx"
+
+namespace FWMFW
+{
+    namespace Reconcile
+    {
+        // the contents of a list file: files and folders to block, one full absolute path per line. lines starting
+        // with '#' are comments. entries that do not exist (at load time) are left out.
+        // a line may also be a pattern (see Scanner::PathMatcher): with wildcards it blocks what matches below the
+        // folder it starts with, and with a leading '!' it excludes what matches from everything else.
+        // load takes the sections and included files of the list as one, GroupedList keeps them apart.
+        class BlockList
+        {
+        public:
+            static const std::size_t NO_FOLDER = static_cast<std::size_t>(-1);
+
+            BlockList(void) : _folders(), _files(), _matcher(), _hasPatterns(false), _item()
+            { return; }
+
+            // returns false if the list file (or one it includes) could not be read. listed files are kept if the
+            // classifier matches them.
+            bool load(const std::string& listFile, const Scanner::Classifier& classifier);
+
+            // the same, a line at a time: clear, the entry lines, then finish
+            void clear(void);
+            void addLine(const ListLine& line, const Scanner::Classifier& classifier);
+            void finish(void);
+
+            // the listed folders and the folders the patterns start with, each ending with exactly one path separator
+            const std::vector<std::string>& getFolders(void) const { return (_folders); }
+            // the listed files that are executables
+            const std::vector<std::string>& getFiles(void) const { return (_files); }
+
+            // the listed folder that contains path (the innermost one if they are nested), or NO_FOLDER
+            std::size_t findFolder(const std::string& path) const;
+
+            // whether a file found in one of the folders is to be blocked according to the patterns
+            bool isMatch(const std::string& path) const;
+
+            // options with the matcher of the patterns set (if there are any patterns)
+            Scanner::ScanOptions getScanOptions(const Scanner::ScanOptions& options) const;
+
+            typedef std::function<void(Utils::PathTable::Id id)> AddedCallback;
+
+            // adds the listed files and everything the scanner finds in the listed folders to files, without rule names
+            // (the rules are named after the paths alone). added is called with the id of every path that was not in
+            // files before, right after it went in. the calls are serialized, but may come from the scanner's threads.
+            void expand(
+                const Scanner::ScanOptions& options, Utils::PathTable& files, const AddedCallback& added = nullptr
+            ) const;
+
+        private:
+            void addFolder(const std::string& folder);
+
+            std::vector<std::string> _folders;
+            std::vector<std::string> _files;
+            Scanner::PathMatcher _matcher;
+            bool _hasPatterns;
+            std::string _item; // the line being added
+        }; // class BlockList
+    } // namespace Reconcile
+} // namespace FWMFW
+
+#endif // !defined(DOTSLASHZERO_FWMFW_BLOCKLIST_HXX)
@@ -0,0 +1,135 @@
+#if !defined(DOTSLASHZERO_FWMFW_BOUNDEDQUEUE_HXX)
+#define DOTSLASHZERO_FWMFW_BOUNDEDQUEUE_HXX
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <utility>
+
+namespace FWMFW
+{
+    namespace Utils
+    {
+        // a fixed size multi producer, multi consumer queue without locks. every cell carries a sequence number that
+        // tells producers and consumers whose turn it is, so a push or pop is one compare and swap of a position and
+        // never waits for another thread that is in the middle of one. push and pop wait (spinning, then yielding,
+        // then sleeping) while the queue is full or empty.
+        template <typename T>
+        class BoundedQueue
+        {
+        public:
+            // the capacity is rounded up to a power of two
+            explicit BoundedQueue(std::size_t capacity) :
+                _cells(), _mask(0), _enqueuePos(0), _dequeuePos(0), _isClosed(false)
+            {
+                std::size_t size = 2;
+                while (size < capacity) size *= 2;
+                _cells.reset(new Cell[size]);
+                _mask = size - 1;
+                for (std::size_t idx = 0; idx < size; idx++) _cells[idx].sequence.store(idx, std::memory_order_relaxed);
+                return;
+            }
+
+            std::size_t getCapacity(void) const { return (_mask + 1); }
+
+            bool tryPush(T&& value)
+            {
+                std::size_t pos = _enqueuePos.load(std::memory_order_relaxed);
+                for (;;) {
+                    Cell& cell = _cells[pos & _mask];
+                    std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                    auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+                    if (diff == 0) {
+                        if (_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                            cell.value = std::move(value);
+                            cell.sequence.store(pos + 1, std::memory_order_release);
+                            return (true);
+                        }
+                    }
+                    else if (diff < 0) {
+                        return (false); // full
+                    }
+                    else {
+                        pos = _enqueuePos.load(std::memory_order_relaxed);
+                    }
+                }
+            }
+
+            bool tryPop(T& value)
+            {
+                std::size_t pos = _dequeuePos.load(std::memory_order_relaxed);
+                for (;;) {
+                    Cell& cell = _cells[pos & _mask];
+                    std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                    auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos + 1);
+                    if (diff == 0) {
+                        if (_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                            value = std::move(cell.value);
+                            cell.sequence.store(pos + _mask + 1, std::memory_order_release);
+                            return (true);
+                        }
+                    }
+                    else if (diff < 0) {
+                        return (false); // empty
+                    }
+                    else {
+                        pos = _dequeuePos.load(std::memory_order_relaxed);
+                    }
+                }
+            }
+
+            void push(T&& value)
+            {
+                for (std::size_t attempt = 0; !tryPush(std::move(value)); attempt++) wait(attempt);
+                return;
+            }
+
+            // returns false once the queue is closed and everything pushed before has been popped
+            bool pop(T& value)
+            {
+                for (std::size_t attempt = 0; !tryPop(value); attempt++) {
+                    // whatever was pushed before close is visible after seeing it, so one more try settles it
+                    if (_isClosed.load(std::memory_order_acquire)) return (tryPop(value));
+                    wait(attempt);
+                }
+                return (true);
+            }
+
+            // no more pushes will follow, pop returns false when the queue runs empty
+            void close(void)
+            {
+                _isClosed.store(true, std::memory_order_release);
+                return;
+            }
+
+            BoundedQueue(const BoundedQueue&) = delete;
+            BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+        private:
+            struct Cell
+            {
+                std::atomic<std::size_t> sequence;
+                T value;
+            }; // struct Cell
+
+            static void wait(std::size_t attempt)
+            {
+                if (attempt < 64) return;
+                if (attempt < 128) std::this_thread::yield();
+                else std::this_thread::sleep_for(std::chrono::microseconds(50));
+                return;
+            }
+
+            std::unique_ptr<Cell[]> _cells;
+            std::size_t _mask;
+            // the positions are written by different sides, they should not share a cache line
+            alignas(64) std::atomic<std::size_t> _enqueuePos;
+            alignas(64) std::atomic<std::size_t> _dequeuePos;
+            alignas(64) std::atomic<bool> _isClosed;
+        }; // class BoundedQueue
+    } // namespace Utils
+} // namespace FWMFW
+
+#endif // !defined(DOTSLASHZERO_FWMFW_BOUNDEDQUEUE_HXX)
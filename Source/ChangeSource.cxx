@@ -0,0 +1,404 @@
+#include "ChangeSource.hxx"
+
+#if defined(_WIN32)
+#include <Windows.h>
+#elif defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif // defined(_WIN32)
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "Utils.hxx"
+
+namespace FWMFW
+{
+    namespace Watch
+    {
+        namespace
+        {
+            // splits a file path into its directory (ending with a separator) and its name
+            bool splitPath(const std::string& file, std::string& dir, std::string& name)
+            {
+                auto pos = file.find_last_of(Utils::PATH_SEPARATOR);
+                if (pos == std::string::npos || pos + 1 == file.length()) return (false);
+                dir = file.substr(0, pos + 1);
+                name = file.substr(pos + 1);
+                return (true);
+            }
+        } // anonymous namespace
+
+#if defined(__linux__)
+        struct InotifyChangeSource::State
+        {
+            struct Watch
+            {
+                std::string dir; // ends with a separator
+                bool isTree;
+                std::unordered_set<std::string> files; // names of the watched files in dir
+            }; // struct Watch
+
+            static const std::uint32_t TREE_MASK =
+                IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+            static const std::uint32_t FILE_MASK =
+                IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_ONLYDIR;
+
+            int fd{ -1 };
+            std::unordered_map<int, Watch> watches;
+
+            // returns the watch of dir, adding it if needed (the masks of a directory watched twice are merged)
+            Watch* addWatch(const std::string& dir, std::uint32_t mask)
+            {
+                int wd = inotify_add_watch(fd, dir.c_str(), mask | IN_MASK_ADD);
+                if (wd < 0) return (nullptr);
+                auto& watch = watches[wd];
+                watch.dir = dir;
+                return (&watch);
+            }
+
+            // returns false if any directory of the tree could not be watched
+            bool addTree(const std::string& dir)
+            {
+                Watch* watch = addWatch(dir, TREE_MASK);
+                if (watch == nullptr) return (false);
+                watch->isTree = true;
+
+                // subdirectories that are created from here on are picked up through their IN_CREATE
+                bool result = true;
+                std::error_code errorCode;
+                std::filesystem::directory_iterator itr{ dir, errorCode };
+                for (; !errorCode && itr != std::filesystem::directory_iterator(); itr.increment(errorCode)) {
+                    if (itr->is_symlink(errorCode) || !itr->is_directory(errorCode)) continue;
+                    result = addTree(itr->path().string() + Utils::PATH_SEPARATOR) && result;
+                }
+                return (result);
+            }
+
+            // drops the watches of dir and everything below it, e.g. after it was moved away
+            void removeTree(const std::string& dir)
+            {
+                for (auto itr = watches.begin(); itr != watches.end();) {
+                    const Watch& watch = itr->second;
+                    if (watch.isTree && watch.files.empty() && Utils::stringStartsWith(watch.dir, dir)) {
+                        inotify_rm_watch(fd, itr->first);
+                        itr = watches.erase(itr);
+                    }
+                    else {
+                        ++itr;
+                    }
+                }
+                return;
+            }
+
+            void handle(const inotify_event& event, std::vector<Change>& changes)
+            {
+                if ((event.mask & IN_Q_OVERFLOW) != 0) {
+                    changes.push_back(Change{ Change::Kind::Overflow, std::string(), false });
+                    return;
+                }
+
+                auto itr = watches.find(event.wd);
+                if (itr == watches.end()) return;
+                if ((event.mask & IN_IGNORED) != 0) {
+                    watches.erase(itr);
+                    return;
+                }
+
+                const Watch& watch = itr->second;
+                const bool isDirectory = ((event.mask & IN_ISDIR) != 0);
+                const std::string name = (event.len > 0) ? std::string(event.name) : std::string();
+                const std::string path = watch.dir + name;
+
+                if (watch.isTree) {
+                    if ((event.mask & (IN_DELETE_SELF | IN_MOVE_SELF)) != 0) {
+                        // the parent (if watched) reports the directory itself
+                        changes.push_back(Change{ Change::Kind::Removed, watch.dir, true });
+                    }
+                    else if ((event.mask & (IN_CREATE | IN_MOVED_TO)) != 0) {
+                        // whatever got into a new directory before its watch was added is found by looking at it
+                        if (isDirectory) addTree(path + Utils::PATH_SEPARATOR);
+                        changes.push_back(Change{ Change::Kind::Created, path, isDirectory });
+                    }
+                    else if ((event.mask & (IN_DELETE | IN_MOVED_FROM)) != 0) {
+                        if (isDirectory && (event.mask & IN_MOVED_FROM) != 0) {
+                            removeTree(path + Utils::PATH_SEPARATOR);
+                        }
+                        changes.push_back(Change{ Change::Kind::Removed, path, isDirectory });
+                    }
+                }
+
+                // the watch may have been dropped by removeTree
+                itr = watches.find(event.wd);
+                if (itr != watches.end() && !name.empty() && itr->second.files.count(name) > 0) {
+                    changes.push_back(Change{ Change::Kind::Modified, path, false });
+                }
+                return;
+            }
+        }; // struct InotifyChangeSource::State
+
+        InotifyChangeSource::InotifyChangeSource(void) : _state(new State())
+        {
+            _state->fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+            if (_state->fd < 0) {
+                throw (std::runtime_error(std::string("inotify_init1 failed: ") + std::strerror(errno)));
+            }
+            return;
+        }
+
+        InotifyChangeSource::~InotifyChangeSource(void)
+        {
+            close(_state->fd);
+            return;
+        }
+
+        bool InotifyChangeSource::watchTree(const std::string& dir)
+        {
+            return (_state->addTree(dir));
+        }
+
+        bool InotifyChangeSource::watchFile(const std::string& file)
+        {
+            std::string dir;
+            std::string name;
+            if (!splitPath(file, dir, name)) return (false);
+
+            State::Watch* watch = _state->addWatch(dir, State::FILE_MASK);
+            if (watch == nullptr) return (false);
+            watch->files.insert(name);
+            return (true);
+        }
+
+        void InotifyChangeSource::clear(void)
+        {
+            for (auto&& watch : _state->watches) inotify_rm_watch(_state->fd, watch.first);
+            _state->watches.clear();
+            return;
+        }
+
+        bool InotifyChangeSource::wait(std::chrono::milliseconds timeout, std::vector<Change>& changes)
+        {
+            pollfd pollFd{ _state->fd, POLLIN, 0 };
+            int ready = poll(&pollFd, 1, static_cast<int>(timeout.count()));
+            if (ready < 0 && errno != EINTR) {
+                throw (std::runtime_error(std::string("poll failed: ") + std::strerror(errno)));
+            }
+            if (ready <= 0) return (false);
+
+            std::size_t changeCount = changes.size();
+            alignas(inotify_event) char buffer[64 * 1024];
+            for (;;) {
+                ssize_t length = read(_state->fd, buffer, sizeof(buffer));
+                if (length < 0 && (errno == EAGAIN || errno == EINTR)) break;
+                if (length < 0) throw (std::runtime_error(std::string("read failed: ") + std::strerror(errno)));
+
+                for (ssize_t offset = 0; offset < length;) {
+                    const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                    _state->handle(*event, changes);
+                    offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+                }
+            }
+            return (changes.size() > changeCount);
+        }
+#endif // defined(__linux__)
+
+#if defined(_WIN32)
+        struct Win32ChangeSource::State
+        {
+            struct Watch
+            {
+                std::string dir; // ends with a separator
+                bool isTree;
+                std::string file; // the name of the watched file if not a tree
+                HANDLE handle;
+                OVERLAPPED overlapped;
+                // FILE_NOTIFY_INFORMATION records are DWORD aligned
+                DWORD buffer[16 * 1024];
+            }; // struct Watch
+
+            static const DWORD TREE_FILTER = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME;
+            static const DWORD FILE_FILTER = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE;
+
+            HANDLE port{ NULL };
+            std::vector<std::unique_ptr<Watch>> watches;
+
+            bool read(Watch& watch)
+            {
+                std::memset(&watch.overlapped, 0, sizeof(watch.overlapped));
+                return (ReadDirectoryChangesW(
+                    watch.handle, watch.buffer, sizeof(watch.buffer), watch.isTree ? TRUE : FALSE,
+                    watch.isTree ? TREE_FILTER : FILE_FILTER, NULL, &watch.overlapped, NULL
+                ) != 0);
+            }
+
+            bool add(const std::string& dir, bool isTree, const std::string& file)
+            {
+                std::unique_ptr<Watch> watch(new Watch());
+                watch->dir = dir;
+                watch->isTree = isTree;
+                watch->file = file;
+                watch->handle = CreateFileW(
+                    Utils::utf8StrToW32WStr(dir).c_str(), FILE_LIST_DIRECTORY,
+                    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+                    FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL
+                );
+                if (watch->handle == INVALID_HANDLE_VALUE) return (false);
+
+                // the completion key identifies the watch
+                HANDLE watchPort = CreateIoCompletionPort(
+                    watch->handle, port, reinterpret_cast<ULONG_PTR>(watch.get()), 0
+                );
+                if (watchPort == NULL || !read(*watch)) {
+                    CloseHandle(watch->handle);
+                    return (false);
+                }
+                watches.push_back(std::move(watch));
+                return (true);
+            }
+
+            void close(Watch& watch)
+            {
+                // the buffer must stay alive until the cancelled read has completed
+                CancelIoEx(watch.handle, &watch.overlapped);
+                DWORD bytes = 0;
+                GetOverlappedResult(watch.handle, &watch.overlapped, &bytes, TRUE);
+                CloseHandle(watch.handle);
+                return;
+            }
+
+            void handle(Watch& watch, DWORD bytes, std::vector<Change>& changes)
+            {
+                if (bytes == 0) {
+                    // the buffer was too small for everything that happened
+                    changes.push_back(Change{ Change::Kind::Overflow, std::string(), false });
+                    return;
+                }
+
+                const char* data = reinterpret_cast<const char*>(watch.buffer);
+                for (;;) {
+                    const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(data);
+                    std::string name = Utils::w32WStrToUTF8Str(
+                        std::wstring_view(info->FileName, info->FileNameLength / sizeof(WCHAR))
+                    );
+                    std::string path = watch.dir + name;
+
+                    if (watch.isTree) {
+                        switch (info->Action) {
+                            case FILE_ACTION_ADDED:
+                            case FILE_ACTION_RENAMED_NEW_NAME: {
+                                DWORD attributes = GetFileAttributesW(Utils::utf8StrToW32WStr(path).c_str());
+                                bool isDirectory = (attributes != INVALID_FILE_ATTRIBUTES) &&
+                                    ((attributes & FILE_ATTRIBUTE_DIRECTORY) != 0);
+                                changes.push_back(Change{ Change::Kind::Created, path, isDirectory });
+                                break;
+                            }
+                            case FILE_ACTION_REMOVED:
+                            case FILE_ACTION_RENAMED_OLD_NAME:
+                                changes.push_back(Change{ Change::Kind::Removed, path, false });
+                                break;
+                            default:
+                                break;
+                        }
+                    }
+                    else if (name == watch.file) {
+                        changes.push_back(Change{ Change::Kind::Modified, path, false });
+                    }
+
+                    if (info->NextEntryOffset == 0) break;
+                    data += info->NextEntryOffset;
+                }
+                return;
+            }
+        }; // struct Win32ChangeSource::State
+
+        Win32ChangeSource::Win32ChangeSource(void) : _state(new State())
+        {
+            _state->port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+            if (_state->port == NULL) {
+                throw (std::runtime_error("CreateIoCompletionPort failed."));
+            }
+            return;
+        }
+
+        Win32ChangeSource::~Win32ChangeSource(void)
+        {
+            clear();
+            CloseHandle(_state->port);
+            return;
+        }
+
+        bool Win32ChangeSource::watchTree(const std::string& dir)
+        {
+            return (_state->add(dir, true, std::string()));
+        }
+
+        bool Win32ChangeSource::watchFile(const std::string& file)
+        {
+            std::string dir;
+            std::string name;
+            if (!splitPath(file, dir, name)) return (false);
+            return (_state->add(dir, false, name));
+        }
+
+        void Win32ChangeSource::clear(void)
+        {
+            for (auto&& watch : _state->watches) _state->close(*watch);
+            _state->watches.clear();
+
+            // completions of the cancelled reads may still be queued, they refer to watches that are gone
+            DWORD bytes = 0;
+            ULONG_PTR key = 0;
+            OVERLAPPED* overlapped = nullptr;
+            for (;;) {
+                overlapped = nullptr;
+                GetQueuedCompletionStatus(_state->port, &bytes, &key, &overlapped, 0);
+                if (overlapped == nullptr) break;
+            }
+            return;
+        }
+
+        bool Win32ChangeSource::wait(std::chrono::milliseconds timeout, std::vector<Change>& changes)
+        {
+            std::size_t changeCount = changes.size();
+            DWORD waitTime = static_cast<DWORD>(timeout.count());
+            for (;;) {
+                DWORD bytes = 0;
+                ULONG_PTR key = 0;
+                OVERLAPPED* overlapped = nullptr;
+                BOOL isDone = GetQueuedCompletionStatus(_state->port, &bytes, &key, &overlapped, waitTime);
+                if (overlapped == nullptr) break; // timed out, nothing (else) queued
+
+                State::Watch* watch = reinterpret_cast<State::Watch*>(key);
+                if (isDone != 0) {
+                    _state->handle(*watch, bytes, changes);
+                }
+                // the directory itself is gone (or the read failed), it stays quiet from here on
+                if (!_state->read(*watch) && watch->isTree) {
+                    changes.push_back(Change{ Change::Kind::Removed, watch->dir, true });
+                }
+
+                // collect whatever else is queued already
+                waitTime = 0;
+            }
+            return (changes.size() > changeCount);
+        }
+#endif // defined(_WIN32)
+
+        std::unique_ptr<ChangeSource> createDefaultChangeSource(void)
+        {
+#if defined(_WIN32)
+            return (std::unique_ptr<ChangeSource>(new Win32ChangeSource()));
+#elif defined(__linux__)
+            return (std::unique_ptr<ChangeSource>(new InotifyChangeSource()));
+#else
+            return (nullptr);
+#endif // defined(_WIN32)
+        }
+    } // namespace Watch
+} // namespace FWMFW
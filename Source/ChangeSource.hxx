@@ -0,0 +1,99 @@
+#if !defined(DOTSLASHZERO_FWMFW_CHANGESOURCE_HXX)
+#define DOTSLASHZERO_FWMFW_CHANGESOURCE_HXX
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace FWMFW
+{
+    // keeping the firewall policy in line with the file system while it changes
+    namespace Watch
+    {
+        struct Change
+        {
+            enum class Kind
+            {
+                Created,    // a file or directory appeared in a watched tree (created, or moved in)
+                Removed,    // a file or directory disappeared from a watched tree (deleted, or moved out)
+                Modified,   // a watched file was written, replaced or removed
+                Overflow    // changes were lost, everything has to be looked at again
+            }; // enum class Kind
+
+            Kind kind;
+            std::string path; // empty for Overflow
+            bool isDirectory; // only reliable for Created
+        }; // struct Change
+
+        // file system change notifications. changes are only reported for paths below watched trees and for watched
+        // files, in the order they happened, but not necessarily one per operation.
+        class ChangeSource
+        {
+        public:
+            virtual ~ChangeSource(void) { return; }
+
+            // watches dir (ending with a path separator) and everything below it. returns false if dir can not be
+            // watched.
+            virtual bool watchTree(const std::string& dir) = 0;
+
+            // watches a single file, including it being replaced through a rename (as editors like to save)
+            virtual bool watchFile(const std::string& file) = 0;
+
+            // stops watching everything
+            virtual void clear(void) = 0;
+
+            // waits up to timeout for changes and appends them to changes. returns false if nothing happened.
+            virtual bool wait(std::chrono::milliseconds timeout, std::vector<Change>& changes) = 0;
+        }; // class ChangeSource
+
+#if defined(__linux__)
+        // inotify. every directory of a tree takes a watch of its own (see /proc/sys/fs/inotify/max_user_watches).
+        class InotifyChangeSource : public ChangeSource
+        {
+        public:
+            InotifyChangeSource(void);
+            virtual ~InotifyChangeSource(void);
+
+            virtual bool watchTree(const std::string& dir) override;
+            virtual bool watchFile(const std::string& file) override;
+            virtual void clear(void) override;
+            virtual bool wait(std::chrono::milliseconds timeout, std::vector<Change>& changes) override;
+
+            InotifyChangeSource(const InotifyChangeSource&) = delete;
+            InotifyChangeSource& operator=(const InotifyChangeSource&) = delete;
+
+        private:
+            struct State;
+            std::unique_ptr<State> _state;
+        }; // class InotifyChangeSource
+#endif // defined(__linux__)
+
+#if defined(_WIN32)
+        // ReadDirectoryChangesW on one directory handle per tree, all completing on a single I/O completion port
+        class Win32ChangeSource : public ChangeSource
+        {
+        public:
+            Win32ChangeSource(void);
+            virtual ~Win32ChangeSource(void);
+
+            virtual bool watchTree(const std::string& dir) override;
+            virtual bool watchFile(const std::string& file) override;
+            virtual void clear(void) override;
+            virtual bool wait(std::chrono::milliseconds timeout, std::vector<Change>& changes) override;
+
+            Win32ChangeSource(const Win32ChangeSource&) = delete;
+            Win32ChangeSource& operator=(const Win32ChangeSource&) = delete;
+
+        private:
+            struct State;
+            std::unique_ptr<State> _state;
+        }; // class Win32ChangeSource
+#endif // defined(_WIN32)
+
+        // the native change source of the platform, or nullptr if there is none
+        std::unique_ptr<ChangeSource> createDefaultChangeSource(void);
+    } // namespace Watch
+} // namespace FWMFW
+
+#endif // !defined(DOTSLASHZERO_FWMFW_CHANGESOURCE_HXX)
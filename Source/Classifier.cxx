@@ -0,0 +1,133 @@
+#include "Classifier.hxx"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include "MappedFile.hxx"
+#include "Stats.hxx"
+#include "Utils.hxx"
+
+namespace FWMFW
+{
+    namespace Scanner
+    {
+        namespace
+        {
+            // offset of e_lfanew in IMAGE_DOS_HEADER, and the size of that header
+            const std::size_t NEW_HEADER_OFFSET_FIELD = 0x3C;
+            const std::size_t DOS_HEADER_SIZE = 0x40;
+
+            char toLowerASCII(char c)
+            {
+                return (((c >= 'A') && (c <= 'Z')) ? static_cast<char>(c - 'A' + 'a') : c);
+            }
+        } // anonymous namespace
+
+        Classifier::Classifier(void) : Classifier(std::vector<std::string>{ ".exe" })
+        { return; }
+
+        Classifier::Classifier(const std::vector<std::string>& extensions, ContentCheck contentCheck) :
+            _extensions(), _maxExtensionLength(0), _contentCheck(contentCheck)
+        {
+            for (auto&& extension : extensions) {
+                std::string normalized;
+                if (extension.empty() || extension.front() != '.') normalized.push_back('.');
+                for (char c : extension) normalized.push_back(toLowerASCII(c));
+
+                if ((normalized.length() < 2) || (normalized.length() > MAX_EXTENSION_LENGTH) ||
+                    (normalized.find_first_of("./\\", 1) != std::string::npos)) {
+                    throw (std::invalid_argument("Invalid file extension \"" + extension + "\"."));
+                }
+                if (std::find(_extensions.begin(), _extensions.end(), normalized) != _extensions.end()) continue;
+                _maxExtensionLength = std::max(_maxExtensionLength, normalized.length());
+                _extensions.push_back(std::move(normalized));
+            }
+            std::sort(_extensions.begin(), _extensions.end());
+            return;
+        }
+
+        std::vector<std::string> Classifier::parseExtensions(std::string_view list)
+        {
+            std::vector<std::string> result;
+            while (!list.empty()) {
+                auto pos = list.find_first_of(",;");
+                auto item = list.substr(0, pos);
+                while (!item.empty() && item.front() == ' ') item.remove_prefix(1);
+                while (!item.empty() && item.back() == ' ') item.remove_suffix(1);
+                if (!item.empty()) result.emplace_back(item);
+                if (pos == std::string_view::npos) break;
+                list.remove_prefix(pos + 1);
+            }
+            return (result);
+        }
+
+        bool Classifier::hasExtension(std::string_view name) const
+        {
+            // the end of the name is folded to lower case from the back, up to the last '.' or as far as the longest
+            // extension goes, and compared once it is complete
+            char buffer[MAX_EXTENSION_LENGTH];
+            char* const bufferEnd = buffer + MAX_EXTENSION_LENGTH;
+            std::size_t limit = std::min(name.length(), _maxExtensionLength);
+
+            for (std::size_t length = 1; length <= limit; length++) {
+                char c = toLowerASCII(name[name.length() - length]);
+                if (c == Utils::PATH_SEPARATOR) return (false);
+                *(bufferEnd - length) = c;
+                if (c != '.') continue;
+
+                std::string_view extension(bufferEnd - length, length);
+                for (auto&& candidate : _extensions) {
+                    if (candidate == extension) return (true);
+                }
+                return (false);
+            }
+            return (false);
+        }
+
+        bool Classifier::isCandidate(std::string_view name) const
+        {
+            return ((_contentCheck == ContentCheck::Detect) || hasExtension(name));
+        }
+
+        bool Classifier::isMatch(const std::string& path) const
+        {
+            if (!isCandidate(path)) return (false);
+            return (!isCheckingContent() || isPEFile(path));
+        }
+
+        std::string Classifier::getIndexKey(void) const
+        {
+            // the index records the candidates, and those only depend on the extensions unless all files are
+            if (_contentCheck == ContentCheck::Detect) return ("*");
+
+            std::string result;
+            for (auto&& extension : _extensions) {
+                if (!result.empty()) result.push_back(';');
+                result.append(extension);
+            }
+            return (result);
+        }
+
+        bool Classifier::isPEImage(const char* data, std::size_t size)
+        {
+            if ((size < DOS_HEADER_SIZE) || (data[0] != 'M') || (data[1] != 'Z')) return (false);
+
+            // e_lfanew is little endian, whatever the byte order of the machine reading it
+            const auto* field = reinterpret_cast<const unsigned char*>(data + NEW_HEADER_OFFSET_FIELD);
+            std::uint32_t offset = static_cast<std::uint32_t>(field[0]) | (static_cast<std::uint32_t>(field[1]) << 8) |
+                (static_cast<std::uint32_t>(field[2]) << 16) | (static_cast<std::uint32_t>(field[3]) << 24);
+            if (offset > size - 4) return (false);
+            return (std::memcmp(data + offset, "PE\0\0", 4) == 0);
+        }
+
+        bool Classifier::isPEFile(const std::string& path)
+        {
+            Stats::count(Stats::Counter::FilesSniffed);
+            Utils::MappedFile file;
+            if (!file.open(path, HEADER_SIZE)) return (false);
+            return (isPEImage(file.getData(), file.getSize()));
+        }
+    } // namespace Scanner
+} // namespace FWMFW
@@ -0,0 +1,70 @@
+#if !defined(DOTSLASHZERO_FWMFW_CLASSIFIER_HXX)
+#define DOTSLASHZERO_FWMFW_CLASSIFIER_HXX
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace FWMFW
+{
+    namespace Scanner
+    {
+        // what the contents of a file are checked for
+        enum class ContentCheck
+        {
+            None,       // the extension alone decides
+            Confirm,    // a file with one of the extensions must also be a PE image
+            Detect      // every PE image, whatever its extension
+        }; // enum class ContentCheck
+
+        // decides which files are executables: by their extension, matched case insensitively, and optionally by
+        // their contents (the MZ header and the PE signature it points to).
+        class Classifier
+        {
+        public:
+            // the longest extension supported, including the '.'
+            static const std::size_t MAX_EXTENSION_LENGTH = 16;
+            // bytes of a file mapped to look for the headers
+            static const std::size_t HEADER_SIZE = 4096;
+
+            // ".exe" only
+            Classifier(void);
+            // extensions may be given with or without the leading '.', they must not contain another '.'.
+            // throws std::invalid_argument for an extension that is empty, too long or contains a path separator.
+            explicit Classifier(
+                const std::vector<std::string>& extensions, ContentCheck contentCheck = ContentCheck::None
+            );
+
+            // splits a list like ".exe,.scr,com" (',' or ';' separated)
+            static std::vector<std::string> parseExtensions(std::string_view list);
+
+            // lower case, each with its leading '.'
+            const std::vector<std::string>& getExtensions(void) const { return (_extensions); }
+            ContentCheck getContentCheck(void) const { return (_contentCheck); }
+            bool isCheckingContent(void) const { return (_contentCheck != ContentCheck::None); }
+
+            // whether the name (or path) ends with one of the extensions, in a single pass over its end
+            bool hasExtension(std::string_view name) const;
+            // whether a file of that name is looked at any further: it is a match unless the contents are checked
+            bool isCandidate(std::string_view name) const;
+            // the whole decision for an existing file, reads the file if the contents are checked
+            bool isMatch(const std::string& path) const;
+
+            // identifies the candidates a scan index was recorded with (ScanIndex::load rejects an index of others)
+            std::string getIndexKey(void) const;
+
+            // whether data starts with the headers of a PE image: "MZ", and "PE\0\0" at the offset in e_lfanew
+            static bool isPEImage(const char* data, std::size_t size);
+            // maps the first HEADER_SIZE bytes of the file and checks them. false if the file cannot be read.
+            static bool isPEFile(const std::string& path);
+
+        private:
+            std::vector<std::string> _extensions;
+            std::size_t _maxExtensionLength;
+            ContentCheck _contentCheck;
+        }; // class Classifier
+    } // namespace Scanner
+} // namespace FWMFW
+
+#endif // !defined(DOTSLASHZERO_FWMFW_CLASSIFIER_HXX)
@@ -0,0 +1,392 @@
+#include "ComRuleStore.hxx"
+
+#include <netfw.h>
+
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "Stats.hxx"
+#include "Utils.hxx"
+#include "WinNetFW.hxx"
+
+namespace FWMFW
+{
+    namespace WinNetFW
+    {
+        namespace
+        {
+            // A simple deleter for COM pointers stored within the std::unique_ptr class
+            template<typename COMPtrType>
+            struct ReleaseDeleter
+            {
+                void operator()(COMPtrType ptr) const
+                {
+                    ptr->Release();
+                    return;
+                }
+            }; // struct ReleaseDeleter
+
+            typedef ReleaseDeleter<INetFwRules*> FWRulesDeleter;
+            typedef std::unique_ptr<INetFwRules, FWRulesDeleter> FWRulesPtr;
+
+            FWRulesPtr getFWRules(IDispatch* implDispatch)
+            {
+                INetFwPolicy2* fwPolicy = static_cast<INetFwPolicy2*>(implDispatch);
+
+                INetFwRules* fwRulesTmp = nullptr;
+                Stats::count(Stats::Counter::ComCalls);
+                HRESULT hResult = fwPolicy->get_Rules(&fwRulesTmp);
+                if (FAILED(hResult) || fwRulesTmp == nullptr) {
+                    throw (Exception("INetFwPolicy2::get_Rules failed."));
+                }
+
+                return (FWRulesPtr(fwRulesTmp, FWRulesDeleter()));
+            }
+
+            // owns a BSTR, either one returned by a COM property or one allocated for a COM property
+            class BSTRHolder
+            {
+            public:
+                BSTRHolder(void) : _bstr(nullptr) { return; }
+                explicit BSTRHolder(const std::wstring& str) :
+                    _bstr(SysAllocStringLen(str.c_str(), static_cast<UINT>(str.length())))
+                {
+                    if (_bstr == nullptr) throw (Exception("SysAllocStringLen failed."));
+                    return;
+                }
+                ~BSTRHolder(void) { if (_bstr != nullptr) SysFreeString(_bstr); return; }
+
+                BSTR* getAddress(void) { return (&_bstr); }
+                BSTR get(void) const { return (_bstr); }
+                std::wstring_view getView(void) const { return (std::wstring_view(_bstr, SysStringLen(_bstr))); }
+
+                BSTRHolder(const BSTRHolder&) = delete;
+                BSTRHolder& operator=(const BSTRHolder&) = delete;
+
+            private:
+                BSTR _bstr;
+            }; // class BSTRHolder
+
+            void fillRule(INetFwRule* fwRule, const Rule& rule)
+            {
+                BSTRHolder name(Utils::utf8StrToW32WStr(rule.name));
+                BSTRHolder applicationName(Utils::utf8StrToW32WStr(rule.applicationName));
+
+                // the put_ calls below
+                Stats::count(Stats::Counter::ComCalls, rule.description.empty() ? 5 : 6);
+                fwRule->put_Action((rule.action == RuleAction::Block) ? NET_FW_ACTION_BLOCK : NET_FW_ACTION_ALLOW);
+                fwRule->put_ApplicationName(applicationName.get());
+                if (!rule.description.empty()) {
+                    BSTRHolder description(Utils::utf8StrToW32WStr(rule.description));
+                    fwRule->put_Description(description.get());
+                }
+                fwRule->put_Direction((rule.direction == RuleDirection::In) ? NET_FW_RULE_DIR_IN : NET_FW_RULE_DIR_OUT);
+                fwRule->put_Enabled(rule.enabled ? VARIANT_TRUE : VARIANT_FALSE);
+                fwRule->put_Name(name.get());
+                return;
+            }
+
+            // an IEnumVARIANT over INetFwRules. the properties of a rule are fetched one at a time, and only as long
+            // as the rule still matches the query.
+            class ComRuleCursor : public RuleCursor
+            {
+            public:
+                ComRuleCursor(IDispatch* implDispatch, const RuleQuery& query) :
+                    _fwRules(getFWRules(implDispatch)), _elems(), _query(query),
+                    _namePrefix(Utils::utf8StrToW32WStr(query.namePrefix)),
+                    _batchSize(static_cast<ULONG>((query.batchSize > 0) ? query.batchSize : 1)),
+                    _variants(_batchSize), _fetched(), _isDone(false)
+                {
+                    IUnknown* enumUnknownTmp = nullptr;
+                    Stats::count(Stats::Counter::ComCalls, 2);
+                    _fwRules->get__NewEnum(&enumUnknownTmp);
+                    if (enumUnknownTmp == nullptr) {
+                        throw (Exception("INetFwRules::get__NewEnum failed."));
+                    }
+
+                    typedef ReleaseDeleter<IUnknown*> UnknownDeleter;
+                    std::unique_ptr<IUnknown, UnknownDeleter> enumUnknown(enumUnknownTmp, UnknownDeleter());
+
+                    IEnumVARIANT* elemsTmp = nullptr;
+                    HRESULT hResult = enumUnknown->QueryInterface(IID_IEnumVARIANT, (void**) &elemsTmp);
+                    if (FAILED(hResult)) {
+                        throw (Exception("QueryInterface failed."));
+                    }
+                    _elems.reset(elemsTmp);
+
+                    _fetched.reserve(_batchSize);
+                    return;
+                }
+
+                virtual bool next(RuleBatch& batch) override
+                {
+                    batch.clear();
+                    while (batch.empty() && !_isDone) fetch(batch);
+                    return (!batch.empty());
+                }
+
+            private:
+                typedef ReleaseDeleter<IEnumVARIANT*> EnumVARIANTDeleter;
+                typedef ReleaseDeleter<IDispatch*> DispatchDeleter;
+
+                void fetch(RuleBatch& batch)
+                {
+                    ULONG fetched = 0;
+                    Stats::count(Stats::Counter::ComCalls);
+                    HRESULT hResult = _elems->Next(_batchSize, _variants.data(), &fetched);
+                    if (FAILED(hResult)) {
+                        throw (Exception("IEnumVARIANT::Next failed."));
+                    }
+                    // S_FALSE means that fewer rules than asked for were left
+                    if (hResult != S_OK || fetched < _batchSize) _isDone = true;
+
+                    // take ownership of the whole batch first, so that nothing leaks if a filter throws
+                    _fetched.clear();
+                    for (ULONG idx = 0; idx < fetched; idx++) {
+                        if (_variants[idx].vt == VT_DISPATCH && _variants[idx].pdispVal != nullptr) {
+                            _fetched.emplace_back(_variants[idx].pdispVal, DispatchDeleter());
+                        }
+                        else {
+                            VariantClear(&_variants[idx]);
+                        }
+                    }
+
+                    for (auto&& elem : _fetched) {
+                        // just a weak pointer
+                        INetFwRule* fwRule = static_cast<INetFwRule*>(elem.get());
+
+                        BSTRHolder name;
+                        Stats::count(Stats::Counter::ComCalls);
+                        fwRule->get_Name(name.getAddress());
+                        if (name.get() == nullptr) continue;
+                        if (name.getView().compare(0, _namePrefix.length(), _namePrefix) != 0) continue;
+
+                        NET_FW_RULE_DIRECTION direction = NET_FW_RULE_DIR_IN;
+                        NET_FW_ACTION action = NET_FW_ACTION_ALLOW;
+                        VARIANT_BOOL enabled = VARIANT_FALSE;
+                        Stats::count(Stats::Counter::ComCalls, 3);
+                        fwRule->get_Direction(&direction);
+                        fwRule->get_Action(&action);
+                        fwRule->get_Enabled(&enabled);
+                        RuleDirection ruleDirection = (direction == NET_FW_RULE_DIR_OUT) ?
+                            RuleDirection::Out : RuleDirection::In;
+                        RuleAction ruleAction = (action == NET_FW_ACTION_BLOCK) ? RuleAction::Block : RuleAction::Allow;
+                        bool isEnabled = (enabled != VARIANT_FALSE);
+                        if (_query.direction && (*_query.direction != ruleDirection)) continue;
+                        if (_query.action && (*_query.action != ruleAction)) continue;
+                        if (_query.enabled && (*_query.enabled != isEnabled)) continue;
+
+                        RuleRecord& record = batch.add();
+                        Utils::w32WStrToUTF8Str(name.getView(), record.name);
+                        if (_query.nameFilter && !_query.nameFilter(record.name)) {
+                            batch.removeLast();
+                            continue;
+                        }
+
+                        BSTRHolder applicationName;
+                        Stats::count(Stats::Counter::ComCalls);
+                        fwRule->get_ApplicationName(applicationName.getAddress());
+                        if (applicationName.get() != nullptr) {
+                            Utils::w32WStrToUTF8Str(applicationName.getView(), record.applicationName);
+                        }
+                        else {
+                            record.applicationName.clear();
+                        }
+                        if (_query.applicationNameFilter && !_query.applicationNameFilter(record.applicationName)) {
+                            batch.removeLast();
+                            continue;
+                        }
+                        record.direction = ruleDirection;
+                        record.action = ruleAction;
+                        record.enabled = isEnabled;
+                    }
+                    return;
+                }
+
+                FWRulesPtr _fwRules;
+                std::unique_ptr<IEnumVARIANT, EnumVARIANTDeleter> _elems;
+                const RuleQuery _query;
+                const std::wstring _namePrefix;
+                const ULONG _batchSize;
+                std::vector<VARIANT> _variants;
+                std::vector<std::unique_ptr<IDispatch, DispatchDeleter>> _fetched;
+                bool _isDone;
+            }; // class ComRuleCursor
+        } // anonymous namespace
+
+        ComRuleStore::ComRuleStore(void) : _implUnknown(nullptr), _implDispatch(nullptr)
+        {
+            HRESULT result = CoCreateInstance(
+                CLSID_NetFwPolicy2, NULL, CLSCTX_INPROC_SERVER, IID_IUnknown, (LPVOID*) &_implUnknown
+            );
+
+            if (FAILED(result)) {
+                throw (Exception("FireWallPolicy: CoCreateInstance failed!"));
+            }
+
+            result = _implUnknown->QueryInterface(IID_IDispatch, (void**) &_implDispatch);
+
+            if (FAILED(result)) {
+                _implUnknown->Release();
+                _implUnknown = nullptr;
+                throw (Exception("FireWallPolicy: QueryInterface failed!"));
+            }
+
+            return;
+        }
+
+        ComRuleStore::~ComRuleStore(void)
+        {
+            if (_implDispatch != nullptr) {
+                _implDispatch->Release();
+                _implDispatch = nullptr;
+            }
+            if (_implUnknown != nullptr) {
+                _implUnknown->Release();
+                _implUnknown = nullptr;
+            }
+            return;
+        }
+
+        std::size_t ComRuleStore::getRuleCount(void) const
+        {
+            auto fwRules = getFWRules(_implDispatch);
+
+            long ruleCount = 0;
+            Stats::count(Stats::Counter::ComCalls);
+            fwRules->get_Count(&ruleCount);
+            return (static_cast<std::size_t>(ruleCount));
+        }
+
+        std::unique_ptr<RuleCursor> ComRuleStore::openRules(const RuleQuery& query) const
+        {
+            return (std::unique_ptr<RuleCursor>(new ComRuleCursor(_implDispatch, query)));
+        }
+
+        bool ComRuleStore::addRule(const Rule& rule)
+        {
+            auto fwRules = getFWRules(_implDispatch);
+
+            IUnknown* fwRuleUnknownTmp = nullptr;
+            // CoCreateInstance, QueryInterface and Add
+            Stats::count(Stats::Counter::ComCalls, 3);
+            HRESULT hResult = CoCreateInstance(
+                CLSID_NetFwRule, NULL, CLSCTX_INPROC_SERVER, IID_IUnknown, (LPVOID*) &fwRuleUnknownTmp
+            );
+            if (FAILED(hResult)) {
+                throw (Exception("CoCreateInstance failed."));
+            }
+
+            typedef ReleaseDeleter<IUnknown*> UnknownDeleter;
+            std::unique_ptr<IUnknown, UnknownDeleter> fwRuleUnknown(fwRuleUnknownTmp, UnknownDeleter());
+
+            IDispatch* fwRuleDispatchTmp = nullptr;
+            hResult = fwRuleUnknown->QueryInterface(IID_IDispatch, (void**) &fwRuleDispatchTmp);
+            if (FAILED(hResult)) {
+                throw (Exception("QueryInterface failed."));
+            }
+
+            typedef ReleaseDeleter<IDispatch*> DispatchDeleter;
+            std::unique_ptr<IDispatch, DispatchDeleter> fwRuleDispatch(fwRuleDispatchTmp, DispatchDeleter());
+
+            // just a weak pointer
+            INetFwRule* fwRule = static_cast<INetFwRule*>(fwRuleDispatch.get());
+            fillRule(fwRule, rule);
+
+            hResult = fwRules->Add(fwRule);
+            return (SUCCEEDED(hResult));
+        }
+
+        bool ComRuleStore::hasRule(const std::string& name) const
+        {
+            auto fwRules = getFWRules(_implDispatch);
+
+            BSTRHolder nameBSTR(Utils::utf8StrToW32WStr(name));
+            INetFwRule* fwRuleTmp = nullptr;
+            Stats::count(Stats::Counter::ComCalls);
+            // fails with HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND) if there is no such rule
+            HRESULT hResult = fwRules->Item(nameBSTR.get(), &fwRuleTmp);
+            if (FAILED(hResult) || (fwRuleTmp == nullptr)) return (false);
+
+            typedef ReleaseDeleter<INetFwRule*> RuleDeleter;
+            std::unique_ptr<INetFwRule, RuleDeleter> fwRule(fwRuleTmp, RuleDeleter());
+            return (true);
+        }
+
+        bool ComRuleStore::removeRule(const std::string& name)
+        {
+            auto fwRules = getFWRules(_implDispatch);
+
+            BSTRHolder nameBSTR(Utils::utf8StrToW32WStr(name));
+            Stats::count(Stats::Counter::ComCalls);
+            HRESULT hResult = fwRules->Remove(nameBSTR.get());
+            return (SUCCEEDED(hResult));
+        }
+
+        std::size_t ComRuleStore::addRules(const std::vector<Rule>& rules)
+        {
+            if (rules.empty()) return (0);
+
+            auto fwRules = getFWRules(_implDispatch);
+
+            // one class factory for all the rule objects, instead of looking the class up again for every rule
+            IClassFactory* factoryTmp = nullptr;
+            Stats::count(Stats::Counter::ComCalls);
+            HRESULT hResult = CoGetClassObject(
+                CLSID_NetFwRule, CLSCTX_INPROC_SERVER, NULL, IID_IClassFactory, (LPVOID*) &factoryTmp
+            );
+            if (FAILED(hResult)) {
+                throw (Exception("CoGetClassObject failed."));
+            }
+
+            typedef ReleaseDeleter<IClassFactory*> ClassFactoryDeleter;
+            std::unique_ptr<IClassFactory, ClassFactoryDeleter> factory(factoryTmp, ClassFactoryDeleter());
+
+            // every rule object is created and filled in before the first one is added. an object is not reused for
+            // the next rule once it has been added: it may stay attached to the policy after INetFwRules::Add, and
+            // changing it would then change the committed rule.
+            typedef ReleaseDeleter<IDispatch*> DispatchDeleter;
+            std::vector<std::unique_ptr<IDispatch, DispatchDeleter>> prepared;
+            prepared.reserve(rules.size());
+            for (auto&& rule : rules) {
+                IDispatch* fwRuleDispatchTmp = nullptr;
+                Stats::count(Stats::Counter::ComCalls);
+                hResult = factory->CreateInstance(NULL, IID_IDispatch, (void**) &fwRuleDispatchTmp);
+                if (FAILED(hResult)) {
+                    throw (Exception("IClassFactory::CreateInstance failed."));
+                }
+                prepared.emplace_back(fwRuleDispatchTmp, DispatchDeleter());
+                fillRule(static_cast<INetFwRule*>(fwRuleDispatchTmp), rule);
+            }
+
+            std::size_t added = 0;
+            for (auto&& fwRuleDispatch : prepared) {
+                Stats::count(Stats::Counter::ComCalls);
+                hResult = fwRules->Add(static_cast<INetFwRule*>(fwRuleDispatch.get()));
+                if (FAILED(hResult)) break;
+                added++;
+            }
+            return (added);
+        }
+
+        std::size_t ComRuleStore::removeRules(const std::vector<std::string>& names)
+        {
+            auto fwRules = getFWRules(_implDispatch);
+
+            // convert everything first
+            std::vector<std::unique_ptr<BSTRHolder>> prepared;
+            prepared.reserve(names.size());
+            for (auto&& name : names) prepared.emplace_back(new BSTRHolder(Utils::utf8StrToW32WStr(name)));
+
+            std::size_t removed = 0;
+            for (auto&& name : prepared) {
+                Stats::count(Stats::Counter::ComCalls);
+                HRESULT hResult = fwRules->Remove(name->get());
+                if (FAILED(hResult)) break;
+                removed++;
+            }
+            return (removed);
+        }
+    } // namespace WinNetFW
+} // namespace FWMFW
@@ -0,0 +1,37 @@
+#if !defined(DOTSLASHZERO_FWMFW_COMRULESTORE_HXX)
+#define DOTSLASHZERO_FWMFW_COMRULESTORE_HXX
+
+#include <Windows.h>
+
+#include "RuleStore.hxx"
+
+namespace FWMFW
+{
+    namespace WinNetFW
+    {
+        // the rules of the Windows firewall, through INetFwPolicy2 (COM must be initialized on the calling thread)
+        class ComRuleStore : public RuleStore
+        {
+        public:
+            ComRuleStore(void);
+            virtual ~ComRuleStore(void);
+
+            virtual std::size_t getRuleCount(void) const override;
+            virtual std::unique_ptr<RuleCursor> openRules(const RuleQuery& query) const override;
+            virtual bool hasRule(const std::string& name) const override;
+            virtual bool addRule(const Rule& rule) override;
+            virtual bool removeRule(const std::string& name) override;
+            virtual std::size_t addRules(const std::vector<Rule>& rules) override;
+            virtual std::size_t removeRules(const std::vector<std::string>& names) override;
+
+            ComRuleStore(const ComRuleStore&) = delete;
+            ComRuleStore& operator=(const ComRuleStore&) = delete;
+
+        private:
+            IUnknown* _implUnknown;
+            IDispatch* _implDispatch;
+        }; // class ComRuleStore
+    } // namespace WinNetFW
+} // namespace FWMFW
+
+#endif // !defined(DOTSLASHZERO_FWMFW_COMRULESTORE_HXX)
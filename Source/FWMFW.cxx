@@ -1,122 +1,774 @@
+#if defined(_WIN32)
 #include <Windows.h>
-#include <netfw.h>
+#include <shellapi.h>
+#endif // defined(_WIN32)
 
-#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <filesystem>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
 #include <unordered_map>
+#include <vector>
 
+#include "BlockList.hxx"
+#include "ChangeSource.hxx"
+#include "Classifier.hxx"
+#if !defined(_WIN32)
+#include "MemoryRuleStore.hxx"
+#endif // !defined(_WIN32)
+#include "PathTable.hxx"
+#include "Pipeline.hxx"
+#include "Reconcile.hxx"
+#include "RuleGroups.hxx"
+#include "RuleJournal.hxx"
+#include "ScanIndex.hxx"
+#include "Scanner.hxx"
+#include "Service.hxx"
+#include "ShardedCommit.hxx"
+#include "Stats.hxx"
 #include "Utils.hxx"
 #include "WinNetFW.hxx"
+#include "Watcher.hxx"
 
 namespace
 {
-    namespace Constants
+    struct Options
     {
-        static const std::string RULE_NAME_PREFIX{ "FWMFW_" };
-        static const std::string RULE_IN_NAME_PREFIX{ RULE_NAME_PREFIX + "IN_" };
-        static const std::string RULE_OUT_NAME_PREFIX{ RULE_NAME_PREFIX + "OUT_" };
-    } // namespace Constants
-};
+        std::string listFile;
+        std::string scanIndexFile; // empty if no scan index is used
+        std::string journalFile; // empty if no rule journal is kept
+        std::string groupStateFile; // empty if every group is reconciled
+        bool isVerify{ false };
+        bool isDryRun{ false };
+        bool isWatch{ false };
+        bool isPipelined{ false };
+        bool isFollowingLinks{ false };
+        std::size_t commitThreads{ 1 }; // more than one commits through WinNetFW::commitSharded
+        FWMFW::Scanner::Classifier classifier;
+        std::size_t debounceMilliseconds{ 500 };
+        bool isService{ false };
+        bool isClient{ false };
+        std::string address{ FWMFW::Service::getDefaultAddress() };
+        std::size_t coalesceMilliseconds{ 50 };
+        std::vector<FWMFW::Service::RequestedChange> requestedChanges; // of the client
+        bool isStats{ false };
+        std::string traceFile; // empty if no trace is written
+    }; // struct Options
 
-int main(int argc, const char* const argv[])
-{
-    // process command line arguments
-    if (argc < 2) {
-        std::cerr << "Error: missing argument.\n";
-        std::cerr << "Argument must be a file containing a list of files/folders to block.\n";
-        std::cerr << "Each file/folder must be specified with full absolute paths." << std::endl;
-        return (-2);
+    void printUsage(void)
+    {
+        std::cerr << "Usage: FWMFW [options] <list file>\n";
+        std::cerr << "       FWMFW --service [--address=<address>] [--coalesce=<ms>]\n";
+        std::cerr << "       FWMFW --client [--address=<address>] [--block] <file>... [--unblock <file>...]\n";
+        std::cerr << "The list file contains the files/folders to block.\n";
+        std::cerr << "Each file/folder must be specified with full absolute paths.\n";
+        std::cerr << "Sections (\"[name]\") and included list files (\"include <file>\") are groups of their own.\n";
+        std::cerr << "Options:\n";
+        std::cerr << "    --scan-index=<file>  Reuse (and update) the folder contents recorded in <file> for folders\n";
+        std::cerr << "                         that did not change since the last run.\n";
+        std::cerr << "    --journal=<file>     Record the rules in <file> and take them from there on the next run,\n";
+        std::cerr << "                         instead of reading the whole firewall policy.\n";
+        std::cerr << "    --verify             Read the firewall policy even if the journal is up to date.\n";
+        std::cerr << "    --group-state=<file> Record the groups of the list file in <file>, and only reconcile the\n";
+        std::cerr << "                         groups that changed since then on the next run.\n";
+        std::cerr << "    --dry-run            Print the changes that would be made, without changing the firewall\n";
+        std::cerr << "                         policy.\n";
+        std::cerr << "    --watch              Keep running and update the rules as files appear and disappear in the\n";
+        std::cerr << "                         listed folders, or the list file changes (stop with Ctrl+C).\n";
+        std::cerr << "    --pipelined          Enumerate the rules during the scan and block the files as they are\n";
+        std::cerr << "                         found, in batches that are committed one by one.\n";
+        std::cerr << "    --commit-threads=<n> Commit the changes with <n> threads, each with a connection to the\n";
+        std::cerr << "                         firewall of its own (0: one per processor, default: 1).\n";
+        std::cerr << "    --extensions=<list>  The extensions of the files to block, comma separated and matched\n";
+        std::cerr << "                         case insensitively (default: .exe).\n";
+        std::cerr << "    --follow-links       Also scan the folders that symbolic links and junctions in the listed\n";
+        std::cerr << "                         folders point to (each folder is scanned once).\n";
+        std::cerr << "    --sniff=<mode>       Read the headers of the files: \"confirm\" only blocks files with the\n";
+        std::cerr << "                         extensions that are Windows executables (PE images), \"detect\"\n";
+        std::cerr << "                         blocks every PE image whatever its extension.\n";
+        std::cerr << "    --debounce=<ms>      Watch mode: wait until nothing changed for <ms> before updating the\n";
+        std::cerr << "                         rules (default: 500).\n";
+        std::cerr << "    --service            Keep running and apply the requests of FWMFW --client, committing the\n";
+        std::cerr << "                         requests that arrive close together at once (stop with Ctrl+C).\n";
+        std::cerr << "    --client             Send the files that follow to the service: to block them, or to\n";
+        std::cerr << "                         unblock those after --unblock (and block again after --block).\n";
+        std::cerr << "    --address=<address>  Where the service listens and the client connects: a named pipe\n";
+        std::cerr << "                         (default: \\\\.\\pipe\\FWMFW), or a Unix socket on other platforms\n";
+        std::cerr << "                         (default: FWMFW.sock in the temporary folder).\n";
+        std::cerr << "    --coalesce=<ms>      Service: commit the requests that arrive within <ms> of the first one\n";
+        std::cerr << "                         together (default: 50).\n";
+        std::cerr << "    --stats              Print the time spent in each phase and counters of the work done.\n";
+        std::cerr << "    --trace=<file>       Write the timed phases to <file> in the Chrome trace event format\n";
+        std::cerr << "                         (chrome://tracing)." << std::endl;
+        return;
     }
 
-    FWMFW::WinNetFW::initialize();
+    bool parseArguments(int argc, const char* const argv[], Options& options)
+    {
+        const std::string SCAN_INDEX_OPTION{ "--scan-index=" };
+        const std::string JOURNAL_OPTION{ "--journal=" };
+        const std::string GROUP_STATE_OPTION{ "--group-state=" };
+        const std::string DEBOUNCE_OPTION{ "--debounce=" };
+        const std::string TRACE_OPTION{ "--trace=" };
+        const std::string COMMIT_THREADS_OPTION{ "--commit-threads=" };
+        const std::string EXTENSIONS_OPTION{ "--extensions=" };
+        const std::string SNIFF_OPTION{ "--sniff=" };
+        const std::string ADDRESS_OPTION{ "--address=" };
+        const std::string COALESCE_OPTION{ "--coalesce=" };
 
-    // parse the text file
-    const std::string LIST_FILE{ argv[1] };
+        std::vector<std::string> extensions{ ".exe" };
+        auto contentCheck = FWMFW::Scanner::ContentCheck::None;
+        bool isBlockRequested = true; // what the client asks for the files that follow
 
-    std::unordered_map<std::string, std::string> requestedFilesToBlock;
+        for (int idx = 1; idx < argc; idx++) {
+            std::string arg{ argv[idx] };
+            if (FWMFW::Utils::stringStartsWith(arg, SCAN_INDEX_OPTION)) {
+                options.scanIndexFile = arg.substr(SCAN_INDEX_OPTION.length());
+            }
+            else if (FWMFW::Utils::stringStartsWith(arg, JOURNAL_OPTION) && arg.length() > JOURNAL_OPTION.length()) {
+                options.journalFile = arg.substr(JOURNAL_OPTION.length());
+            }
+            else if (FWMFW::Utils::stringStartsWith(arg, GROUP_STATE_OPTION) &&
+                arg.length() > GROUP_STATE_OPTION.length()) {
+                options.groupStateFile = arg.substr(GROUP_STATE_OPTION.length());
+            }
+            else if (arg == "--verify") {
+                options.isVerify = true;
+            }
+            else if (arg == "--dry-run") {
+                options.isDryRun = true;
+            }
+            else if (arg == "--watch") {
+                options.isWatch = true;
+            }
+            else if (arg == "--pipelined") {
+                options.isPipelined = true;
+            }
+            else if (arg == "--follow-links") {
+                options.isFollowingLinks = true;
+            }
+            else if (arg == "--stats") {
+                options.isStats = true;
+            }
+            else if (FWMFW::Utils::stringStartsWith(arg, TRACE_OPTION) && arg.length() > TRACE_OPTION.length()) {
+                options.traceFile = arg.substr(TRACE_OPTION.length());
+            }
+            else if (FWMFW::Utils::stringStartsWith(arg, COMMIT_THREADS_OPTION)) {
+                try {
+                    options.commitThreads = std::stoul(arg.substr(COMMIT_THREADS_OPTION.length()));
+                }
+                catch (std::exception&) {
+                    std::cerr << "Error: invalid value in \"" << arg << "\".\n";
+                    return (false);
+                }
+            }
+            else if (FWMFW::Utils::stringStartsWith(arg, EXTENSIONS_OPTION)) {
+                extensions = FWMFW::Scanner::Classifier::parseExtensions(arg.substr(EXTENSIONS_OPTION.length()));
+            }
+            else if (arg == SNIFF_OPTION + "confirm") {
+                contentCheck = FWMFW::Scanner::ContentCheck::Confirm;
+            }
+            else if (arg == SNIFF_OPTION + "detect") {
+                contentCheck = FWMFW::Scanner::ContentCheck::Detect;
+            }
+            else if (FWMFW::Utils::stringStartsWith(arg, DEBOUNCE_OPTION)) {
+                try {
+                    options.debounceMilliseconds = std::stoul(arg.substr(DEBOUNCE_OPTION.length()));
+                }
+                catch (std::exception&) {
+                    std::cerr << "Error: invalid value in \"" << arg << "\".\n";
+                    return (false);
+                }
+            }
+            else if (arg == "--service") {
+                options.isService = true;
+            }
+            else if (arg == "--client") {
+                options.isClient = true;
+            }
+            else if (arg == "--block") {
+                isBlockRequested = true;
+            }
+            else if (arg == "--unblock") {
+                isBlockRequested = false;
+            }
+            else if (FWMFW::Utils::stringStartsWith(arg, ADDRESS_OPTION) && arg.length() > ADDRESS_OPTION.length()) {
+                options.address = arg.substr(ADDRESS_OPTION.length());
+            }
+            else if (FWMFW::Utils::stringStartsWith(arg, COALESCE_OPTION)) {
+                try {
+                    options.coalesceMilliseconds = std::stoul(arg.substr(COALESCE_OPTION.length()));
+                }
+                catch (std::exception&) {
+                    std::cerr << "Error: invalid value in \"" << arg << "\".\n";
+                    return (false);
+                }
+            }
+            else if (FWMFW::Utils::stringStartsWith(arg, "--")) {
+                std::cerr << "Error: unknown option \"" << arg << "\".\n";
+                return (false);
+            }
+            else if (options.isClient) {
+                options.requestedChanges.push_back(FWMFW::Service::RequestedChange{ arg, isBlockRequested });
+            }
+            else if (options.listFile.empty()) {
+                options.listFile = arg;
+            }
+            else {
+                std::cerr << "Error: only one list file can be given.\n";
+                return (false);
+            }
+        }
 
-    try {
-        std::ifstream inFile{ LIST_FILE };
+        if (options.isService || options.isClient) {
+            if (options.isService && options.isClient) {
+                std::cerr << "Error: --service can not be combined with --client.\n";
+                return (false);
+            }
+            if (!options.listFile.empty() || options.isWatch || options.isPipelined || options.isDryRun ||
+                !options.scanIndexFile.empty() || !options.journalFile.empty() || !options.groupStateFile.empty()) {
+                std::cerr << "Error: --service and --client do not take a list file or the options for one.\n";
+                return (false);
+            }
+            if (options.isClient && options.requestedChanges.empty()) {
+                std::cerr << "Error: missing argument.\n";
+                return (false);
+            }
+            return (true);
+        }
+        if (options.listFile.empty()) {
+            std::cerr << "Error: missing argument.\n";
+            return (false);
+        }
+        try {
+            options.classifier = FWMFW::Scanner::Classifier(extensions, contentCheck);
+        }
+        catch (std::invalid_argument& e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            return (false);
+        }
+        if (options.classifier.getExtensions().empty() && (contentCheck != FWMFW::Scanner::ContentCheck::Detect)) {
+            std::cerr << "Error: no file extensions given.\n";
+            return (false);
+        }
+        if (options.isWatch && (options.isDryRun || !options.scanIndexFile.empty())) {
+            std::cerr << "Error: --watch can not be combined with --dry-run or --scan-index.\n";
+            return (false);
+        }
+        if (!options.journalFile.empty() && (options.isWatch || options.isPipelined)) {
+            std::cerr << "Error: --journal can not be combined with --watch or --pipelined.\n";
+            return (false);
+        }
+        if (!options.groupStateFile.empty() &&
+            (options.isWatch || options.isPipelined || !options.journalFile.empty())) {
+            std::cerr << "Error: --group-state can not be combined with --watch, --pipelined or --journal.\n";
+            return (false);
+        }
+        if (options.isVerify && options.journalFile.empty()) {
+            std::cerr << "Error: --verify needs --journal.\n";
+            return (false);
+        }
+        if (options.isPipelined && (options.isDryRun || options.isWatch || options.commitThreads != 1)) {
+            std::cerr << "Error: --pipelined can not be combined with --dry-run, --watch or --commit-threads.\n";
+            return (false);
+        }
+        return (true);
+    }
+
+    // turns the instrumentation on if it was asked for, and reports on it when main returns
+    class StatsReport
+    {
+    public:
+        explicit StatsReport(const Options& options) : _options(options)
+        {
+            if (_options.isStats || !_options.traceFile.empty()) FWMFW::Stats::enable();
+            return;
+        }
+
+        ~StatsReport(void)
+        {
+            if (_options.isStats) FWMFW::Stats::printSummary(std::cerr);
+            if (!_options.traceFile.empty() && !FWMFW::Stats::writeTrace(_options.traceFile)) {
+                std::cerr << "Warning: unable to write the trace to \"" << _options.traceFile << "\".\n";
+            }
+            return;
+        }
 
-        for (std::string line; std::getline(inFile, line);) {
-            auto item = FWMFW::Utils::trimWhiteSpaces(line);
+        StatsReport(const StatsReport&) = delete;
+        StatsReport& operator=(const StatsReport&) = delete;
 
-            // skip empty lines and lines marked as 'comment' (starts with '#' sign)
-            if (item.empty() || item[0] == '#') continue;
+    private:
+        const Options& _options;
+    }; // class StatsReport
 
-            // normalize path separators
-            auto itemF = FWMFW::Utils::replaceChars(item, '/', '\\', false);
+    // WinNetFW initialized on the main thread for the lifetime of the object, so that it is terminated on every way
+    // out of main. the policies created after it are released before.
+    class MainSession
+    {
+    public:
+        MainSession(void) { FWMFW::WinNetFW::initialize(); return; }
+        ~MainSession(void) { FWMFW::WinNetFW::terminate(); return; }
 
-            if (FWMFW::Utils::doesDirectoryExist(itemF)) {
-                // remove multiple '\\' at the end if there are...
-                itemF = FWMFW::Utils::trimChars(itemF, [](int c) -> bool { return (c == '\\');  });
+        MainSession(const MainSession&) = delete;
+        MainSession& operator=(const MainSession&) = delete;
+    }; // class MainSession
 
-                // ensure that dir ends with "\\"
-                if (!FWMFW::Utils::stringEndsWith(itemF, "\\")) itemF = itemF.append("\\");
+    // set by the signal handler to end watch mode
+    std::atomic<bool> isStopRequested{ false };
 
-                std::string::size_type startIdx = itemF.find_last_of('\\', itemF.find_last_of('\\') - 1) + 1;
-                auto result = FWMFW::Utils::getFilesInDirectory(itemF, ".exe", true);
-                for (auto&& f : result) {
-                    requestedFilesToBlock[f] = f.substr(startIdx);
-                }
-            }
-            else if (FWMFW::Utils::doesFileExist(itemF)) {
-                if (FWMFW::Utils::stringEndsWith(itemF, ".exe")) {
-                    // this basically gets the parent directory as the prefix for the rule name
-                    std::string::size_type startIdx = itemF.find_last_of('\\', itemF.find_last_of('\\') - 1) + 1;
-                    requestedFilesToBlock[itemF] = itemF.substr(startIdx);
-                }
+    void handleStopSignal(int)
+    {
+        isStopRequested = true;
+        return;
+    }
+
+    void printResult(const FWMFW::WinNetFW::RuleChangeResult& change)
+    {
+        typedef FWMFW::WinNetFW::RuleChangeResult::Status Status;
+        switch (change.status) {
+            case Status::Applied:
+                std::cout << (change.isBlock ? "Blocked: \"" : "Unblocked: \"") << change.appName << "\"\n";
+                break;
+            case Status::Failed:
+                std::cerr << "Failed to " << (change.isBlock ? "block" : "unblock") <<
+                    ": \"" << change.appName << "\"\n";
+                break;
+            case Status::RollbackFailed:
+                std::cerr << "Unable to roll back the change of: \"" << change.appName << "\"\n";
+                break;
+            default:
+                break;
+        }
+        return;
+    }
+
+    // prints the results and a summary. failedNote tells what a failed change means for the rest.
+    int reportResults(const std::vector<FWMFW::WinNetFW::RuleChangeResult>& results, const char* failedNote)
+    {
+        typedef FWMFW::WinNetFW::RuleChangeResult::Status Status;
+        std::size_t blockedCount = 0;
+        std::size_t unblockedCount = 0;
+        bool isFailed = false;
+        bool isRollbackFailed = false;
+        for (auto&& change : results) {
+            printResult(change);
+            if (change.status == Status::Applied) {
+                if (change.isBlock) blockedCount++;
+                else unblockedCount++;
             }
+            isFailed = isFailed || (change.status == Status::Failed);
+            isRollbackFailed = isRollbackFailed || (change.status == Status::RollbackFailed);
         }
+        std::cout.flush();
 
-        // the text file should be parsed at this point
-    
-        std::unordered_map<std::string, std::string> filesToUnblock;
+        if (isRollbackFailed) {
+            std::cerr << "The firewall policy may be left partially changed.\n";
+            return (-1);
+        }
+        if (isFailed) {
+            std::cerr << failedNote << "\n";
+            return (-1);
+        }
 
-        // get all the existing rules created by this program
-        FWMFW::WinNetFW::FireWallPolicy fwp;
-        auto rules = fwp.getRules(
-            [] (const std::string& name) -> bool {
-                return (FWMFW::Utils::stringStartsWith(name, Constants::RULE_OUT_NAME_PREFIX));
+        std::cout << "Done. Blocked " << blockedCount <<
+            " files. Unblocked " << unblockedCount << " files." << std::endl;
+        return (0);
+    }
+
+    void saveScanIndex(
+        const Options& options, FWMFW::Scanner::ScanIndex& previousIndex, FWMFW::Scanner::ScanIndexBuilder& nextIndex
+    )
+    {
+        // the old index is still mapped and has to be released before it can be replaced
+        previousIndex.close();
+        if (!nextIndex.save(options.scanIndexFile)) {
+            std::cerr << "Warning: unable to save the scan index to \"" << options.scanIndexFile << "\".\n";
+        }
+        return;
+    }
+
+    // the rules of this program: from the journal if the policy still looks the way the last run left it, and
+    // read from the policy otherwise
+    void getBlockRules(
+        const Options& options, const FWMFW::WinNetFW::FireWallPolicy& policy, FWMFW::Reconcile::RuleJournal& journal,
+        FWMFW::Utils::PathTable& rules
+    )
+    {
+        if (!options.journalFile.empty()) {
+            FWMFW::Stats::ScopedTimer timer("load journal");
+            if (journal.load(options.journalFile) && journal.isCurrent(policy.getRuleCount()) && !options.isVerify) {
+                journal.getBlockRules(rules);
+                return;
             }
-        );
+        }
 
-        for (auto&& rule : rules) {
-            // rule.first = key = appName
-            const auto& appName = rule.first;
-            // rule.second = value = ruleName
-            const auto& ruleName = rule.second;
+        // the rules come in batches and go straight into the table, the policy is never copied as a whole
+        FWMFW::Stats::ScopedTimer timer("enumerate rules");
+        for (auto&& rule : policy.enumerateRules(FWMFW::WinNetFW::getBlockRuleQuery())) {
+            if (!rule.applicationName.empty()) rules.add(rule.applicationName, rule.name);
+        }
+        timer.stop();
+        if (options.isVerify && journal.isCurrent(policy.getRuleCount()) && !journal.isEqual(rules)) {
+            std::cerr << "Note: the rule journal did not match the firewall policy.\n";
+        }
+        return;
+    }
 
-            if (requestedFilesToBlock.find(appName) != requestedFilesToBlock.end()) {
-                // remove from request so the rule will not be added twice later
-                requestedFilesToBlock.erase(appName);
+    // replaces the journal by the rules as they are after the commit. if that is not known for sure, the journal is
+    // removed, and the next run reads the policy.
+    void saveJournal(
+        const Options& options, const FWMFW::WinNetFW::FireWallPolicy& policy, FWMFW::Reconcile::RuleJournal& journal,
+        const FWMFW::Reconcile::Plan& plan, const std::vector<FWMFW::WinNetFW::RuleChangeResult>& results
+    )
+    {
+        FWMFW::Stats::ScopedTimer timer("save journal");
+        // the old journal is still mapped and has to be released before it can be replaced
+        journal.close();
+
+        FWMFW::Utils::PathTable rules;
+        if (FWMFW::Reconcile::getCommittedRules(plan, results, rules) &&
+            FWMFW::Reconcile::RuleJournal::save(options.journalFile, rules, policy.getRuleCount())) {
+            return;
+        }
+
+        std::error_code errorCode;
+        std::filesystem::remove(FWMFW::Utils::utf8StrToPath(options.journalFile), errorCode);
+        std::cerr << "Warning: unable to update the rule journal \"" << options.journalFile << "\".\n";
+        return;
+    }
+
+    // creates the policies of all threads
+    FWMFW::WinNetFW::PolicyFactory getPolicyFactory(void)
+    {
+        typedef FWMFW::WinNetFW::FireWallPolicy FireWallPolicy;
+#if defined(_WIN32)
+        // COM objects belong to the thread that created them, every thread connects to the firewall on its own
+        return ([] (void) -> std::unique_ptr<FireWallPolicy> { return (std::make_unique<FireWallPolicy>()); });
+#else
+        // the rules only live in memory, all threads have to share them
+        auto store = std::make_shared<FWMFW::WinNetFW::MemoryRuleStore>();
+        return ([store] (void) -> std::unique_ptr<FireWallPolicy> {
+            return (std::make_unique<FireWallPolicy>(store));
+        });
+#endif // defined(_WIN32)
+    }
+
+    int runPipelinedMode(const FWMFW::Reconcile::BlockList& blockList, const FWMFW::Scanner::ScanOptions& scanOptions)
+    {
+        auto createPolicy = getPolicyFactory();
+        auto pipelineResult = FWMFW::Reconcile::runPipelined(blockList, scanOptions, createPolicy);
+        std::cout << pipelineResult.keptCount << " files stay blocked, the new ones were committed in " <<
+            pipelineResult.batchCount << " batches.\n";
+        return (reportResults(
+            pipelineResult.results,
+            "The batches committed before the failure stay in place, the failed one has been rolled back."
+        ));
+    }
+
+    // reconciles the groups of the list that changed since the group state was saved (or all of them, without one).
+    // the groups have been expanded.
+    int runGroupedMode(const Options& options, FWMFW::Reconcile::GroupedList& list)
+    {
+        auto createPolicy = getPolicyFactory();
+        auto fwp = createPolicy();
+        FWMFW::Reconcile::GroupState state;
+        if (!options.groupStateFile.empty()) {
+            FWMFW::Stats::ScopedTimer timer("load group state");
+            state.load(options.groupStateFile);
+        }
+
+        FWMFW::Stats::ScopedTimer planTimer("plan");
+        const auto groupPlan = FWMFW::Reconcile::createGroupPlan(list.getGroups(), state, *fwp);
+        planTimer.stop();
+
+        std::size_t addCount = 0;
+        std::size_t removeCount = 0;
+        std::size_t keepCount = 0;
+        std::size_t renameCount = 0;
+        for (auto&& plan : groupPlan.plans) {
+            addCount += plan.getAdds().size();
+            removeCount += plan.getRemoves().size();
+            keepCount += plan.getKeeps().size();
+            renameCount += plan.getRenameCount();
+        }
+        std::cout << (list.getGroups().size() - groupPlan.unchangedCount) << " of " << list.getGroups().size() <<
+            " groups changed, " << groupPlan.removedCount << " groups are no longer listed." << std::endl;
+
+        if (options.isDryRun) {
+            for (auto&& plan : groupPlan.plans) {
+                for (auto&& entry : plan.getAdds()) std::cout << "Would block: \"" << entry.appName << "\"\n";
+                for (auto&& entry : plan.getRemoves()) std::cout << "Would unblock: \"" << entry.appName << "\"\n";
+            }
+            std::cout << "Dry run. Would block " << addCount << " files. Would unblock " << removeCount <<
+                " files. " << keepCount << " files of the changed groups stay blocked." << std::endl;
+            if (renameCount > 0) {
+                std::cout << renameCount << " of the files would only have their rules renamed." << std::endl;
+            }
+            return (0);
+        }
+
+        if (renameCount > 0) std::cout << "Renaming the rules of " << renameCount << " files." << std::endl;
+        std::vector<FWMFW::WinNetFW::RuleChangeResult> results;
+        {
+            FWMFW::Stats::ScopedTimer timer("apply");
+            if (options.commitThreads == 1) {
+                results = FWMFW::Reconcile::applyPlans(groupPlan.plans, *fwp);
             }
             else {
-                // if not in the request, then this rule will be removed
-                filesToUnblock[appName] = ruleName;
+                FWMFW::WinNetFW::ShardedCommitOptions commitOptions;
+                commitOptions.threadCount = options.commitThreads;
+                results = FWMFW::Reconcile::applyPlans(groupPlan.plans, createPolicy, commitOptions);
+            }
+        }
+
+        // the state is only kept if every group is now as it says, otherwise the next run reads the policy and
+        // reconciles all groups
+        if (!options.groupStateFile.empty()) {
+            FWMFW::Stats::ScopedTimer timer("save group state");
+            bool isApplied = std::all_of(
+                results.begin(), results.end(), [] (const FWMFW::WinNetFW::RuleChangeResult& result) -> bool {
+                    return (result.status == FWMFW::WinNetFW::RuleChangeResult::Status::Applied);
+                }
+            );
+            if (isApplied) state.update(list.getGroups(), groupPlan.plans);
+            if (!isApplied || !state.save(options.groupStateFile, fwp->getRuleCount())) {
+                std::error_code errorCode;
+                std::filesystem::remove(FWMFW::Utils::utf8StrToPath(options.groupStateFile), errorCode);
+                if (isApplied) {
+                    std::cerr << "Warning: unable to update the group state \"" << options.groupStateFile << "\".\n";
+                }
             }
         }
+        return (reportResults(
+            results, "Nothing was changed, the rules that were already changed have been rolled back."
+        ));
+    }
+
+    int runWatchMode(const Options& options)
+    {
+        auto changeSource = FWMFW::Watch::createDefaultChangeSource();
+        if (changeSource == nullptr) {
+            std::cerr << "Error: watch mode is not supported on this platform.\n";
+            return (-1);
+        }
+
+        FWMFW::Watch::WatchOptions watchOptions;
+        watchOptions.debounce = std::chrono::milliseconds(options.debounceMilliseconds);
+        watchOptions.scanOptions.classifier = options.classifier;
+        watchOptions.scanOptions.followLinks = options.isFollowingLinks;
 
-        std::size_t blockedCount = fwp.addBlockRules(
-            requestedFilesToBlock,
-            [] (const std::string& appName) -> void {
-                std::cout << "Blocked: \"" << appName << "\"\n";
+        FWMFW::WinNetFW::FireWallPolicy fwp;
+        FWMFW::Watch::Watcher watcher(
+            fwp, *changeSource, options.listFile, watchOptions,
+            [] (const FWMFW::WinNetFW::RuleChangeResult& change) -> void {
+                printResult(change);
+                std::cout.flush();
                 return;
             }
         );
-        std::cout.flush();
 
-        std::size_t unblockedCount = fwp.removeBlockRules(
-            filesToUnblock,
-            [] (const std::string& appName) -> void {
-                std::cout << "Unblocked: \"" << appName << "\"\n";
+        std::signal(SIGINT, handleStopSignal);
+        std::signal(SIGTERM, handleStopSignal);
+
+        if (!watcher.run(isStopRequested)) {
+            std::cerr << "Error: unable to read the list file \"" << options.listFile << "\".\n";
+            return (-1);
+        }
+        std::cout << "Stopped watching. " << watcher.getBlockedCount() << " files are blocked." << std::endl;
+        return (0);
+    }
+
+    int runServiceMode(const Options& options)
+    {
+        FWMFW::Service::ServiceOptions serviceOptions;
+        serviceOptions.coalesceWindow = std::chrono::milliseconds(options.coalesceMilliseconds);
+
+        // the one policy, and the rules read from it once, serve every client
+        FWMFW::WinNetFW::FireWallPolicy fwp;
+        FWMFW::Service::RuleService service(
+            fwp, serviceOptions,
+            [] (const FWMFW::WinNetFW::RuleChangeResult& change) -> void {
+                printResult(change);
+                std::cout.flush();
                 return;
             }
         );
-        std::cout.flush();
+        service.load();
+        auto listener = FWMFW::Service::listen(options.address);
 
-        std::cout << "Done. Blocked " << blockedCount <<
-            " files. Unblocked " << unblockedCount << " files." << std::endl;
+        std::signal(SIGINT, handleStopSignal);
+        std::signal(SIGTERM, handleStopSignal);
+
+        std::cout << "Listening on \"" << options.address << "\". " << service.getBlockedCount() <<
+            " files are blocked." << std::endl;
+        service.run(*listener, isStopRequested);
+        auto stats = service.getStats();
+        std::cout << "Stopped. Served " << stats.requests << " requests in " << stats.commits << " commits. " <<
+            service.getBlockedCount() << " files are blocked." << std::endl;
+        return (0);
+    }
+
+    int runClientMode(const Options& options)
+    {
+        auto results = FWMFW::Service::sendRequest(options.address, options.requestedChanges);
+        return (reportResults(
+            results, "Nothing was changed, the rules that were already changed have been rolled back."
+        ));
+    }
+};
+
+int main(int argc, const char* const argv[])
+{
+#if defined(_WIN32)
+    // argv is in the ANSI code page, which cannot hold every path: the arguments are read as UTF-16 instead
+    std::vector<std::string> arguments;
+    std::vector<const char*> argumentPointers;
+    int wideArgc = 0;
+    LPWSTR* wideArgv = CommandLineToArgvW(GetCommandLineW(), &wideArgc);
+    if (wideArgv != nullptr) {
+        for (int idx = 0; idx < wideArgc; idx++) arguments.push_back(FWMFW::Utils::w32WStrToUTF8Str(wideArgv[idx]));
+        LocalFree(wideArgv);
+        for (auto&& argument : arguments) argumentPointers.push_back(argument.c_str());
+        argc = wideArgc;
+        argv = argumentPointers.data();
+    }
+#endif // defined(_WIN32)
+
+    // process command line arguments
+    Options options;
+    if (!parseArguments(argc, argv, options)) {
+        printUsage();
+        return (-2);
+    }
+
+    StatsReport statsReport(options);
+    FWMFW::Stats::ScopedTimer runTimer("run");
+
+    // the client leaves the firewall to the service
+    if (options.isClient) {
+        try {
+            return (runClientMode(options));
+        }
+        catch (std::exception& e) {
+            std::cerr << "An error has occurred: " << e.what() << "\n";
+            return (-1);
+        }
+    }
+
+    MainSession session;
+
+#if !defined(_WIN32)
+    std::cerr << "Note: there is no system firewall on this platform, rules are only kept in memory.\n";
+#endif // !defined(_WIN32)
+
+    try {
+        if (options.isWatch) return (runWatchMode(options));
+        if (options.isService) return (runServiceMode(options));
+
+        FWMFW::Scanner::ScanOptions scanOptions;
+        scanOptions.classifier = options.classifier;
+        scanOptions.followLinks = options.isFollowingLinks;
+
+        // parse the text file, a list without sections or includes is a single group
+        FWMFW::Reconcile::GroupedList groupedList;
+        {
+            FWMFW::Stats::ScopedTimer timer("load list");
+            if (!groupedList.load(options.listFile, scanOptions.classifier)) {
+                std::cerr << "Error: " << groupedList.getError() << ".\n";
+                return (-1);
+            }
+        }
+        if (groupedList.isGrouped() && (!options.journalFile.empty() || options.isPipelined)) {
+            std::cerr << "Error: --journal and --pipelined can not be used with sections or includes in the list.\n";
+            return (-1);
+        }
+        if (!groupedList.isGrouped() && !options.groupStateFile.empty()) {
+            std::cerr << "Error: --group-state needs sections or includes in the list.\n";
+            return (-1);
+        }
+        FWMFW::Reconcile::BlockList& blockList = groupedList.getGroups().front().list;
+
+        // folders that did not change since the last run are taken from the scan index
+        FWMFW::Scanner::ScanIndex previousIndex;
+        std::unique_ptr<FWMFW::Scanner::ScanIndexBuilder> nextIndex;
+        if (!options.scanIndexFile.empty()) {
+            previousIndex.load(options.scanIndexFile, scanOptions.classifier.getIndexKey());
+            nextIndex.reset(new FWMFW::Scanner::ScanIndexBuilder(scanOptions.classifier.getIndexKey()));
+            scanOptions.previousIndex = &previousIndex;
+            scanOptions.nextIndex = nextIndex.get();
+        }
+
+        if (groupedList.isGrouped()) {
+            {
+                FWMFW::Stats::ScopedTimer timer("expand list");
+                groupedList.expand(scanOptions);
+            }
+            if (nextIndex != nullptr) saveScanIndex(options, previousIndex, *nextIndex);
+            return (runGroupedMode(options, groupedList));
+        }
+
+        if (options.isPipelined) {
+            int result = runPipelinedMode(blockList, scanOptions);
+            if (nextIndex != nullptr) saveScanIndex(options, previousIndex, *nextIndex);
+            return (result);
+        }
+
+        // the same file may be listed more than once, the table keeps it once
+        FWMFW::Utils::PathTable requestedFilesToBlock;
+        {
+            FWMFW::Stats::ScopedTimer timer("expand list");
+            blockList.expand(scanOptions, requestedFilesToBlock);
+        }
+
+        if (nextIndex != nullptr) saveScanIndex(options, previousIndex, *nextIndex);
+
+        // get all the existing rules created by this program
+        auto createPolicy = getPolicyFactory();
+        auto fwp = createPolicy();
+        FWMFW::Utils::PathTable rules;
+        rules.reserve(requestedFilesToBlock.size());
+        FWMFW::Reconcile::RuleJournal journal;
+        getBlockRules(options, *fwp, journal, rules);
+
+        FWMFW::Stats::ScopedTimer planTimer("plan");
+        const auto plan = FWMFW::Reconcile::createPlan(std::move(requestedFilesToBlock), std::move(rules));
+        planTimer.stop();
+
+        if (options.isDryRun) {
+            for (auto&& entry : plan.getAdds()) std::cout << "Would block: \"" << entry.appName << "\"\n";
+            for (auto&& entry : plan.getRemoves()) std::cout << "Would unblock: \"" << entry.appName << "\"\n";
+            std::cout << "Dry run. Would block " << plan.getAdds().size() << " files. Would unblock " <<
+                plan.getRemoves().size() << " files. " << plan.getKeeps().size() << " files stay blocked." << std::endl;
+            if (plan.getRenameCount() > 0) {
+                std::cout << plan.getRenameCount() << " of the files would only have their rules renamed." << std::endl;
+            }
+            return (0);
+        }
+
+        // rules of an earlier naming scheme are replaced, their files show up as blocked and unblocked
+        if (plan.getRenameCount() > 0) {
+            std::cout << "Renaming the rules of " << plan.getRenameCount() << " files." << std::endl;
+        }
+
+        std::vector<FWMFW::WinNetFW::RuleChangeResult> results;
+        {
+            FWMFW::Stats::ScopedTimer timer("apply");
+            if (options.commitThreads == 1) {
+                results = FWMFW::Reconcile::applyPlan(plan, *fwp);
+            }
+            else {
+                FWMFW::WinNetFW::ShardedCommitOptions commitOptions;
+                commitOptions.threadCount = options.commitThreads;
+                results = FWMFW::Reconcile::applyPlan(plan, createPolicy, commitOptions);
+            }
+        }
+        if (!options.journalFile.empty()) saveJournal(options, *fwp, journal, plan, results);
+        return (reportResults(
+            results, "Nothing was changed, the rules that were already changed have been rolled back."
+        ));
     }
     catch (std::exception& e) {
         std::cerr << "An error has occurred: " << e.what() << "\n";
@@ -126,8 +778,4 @@ int main(int argc, const char* const argv[])
         std::cerr << "Unknown error.\n";
         return (-1);
     }
-
-    FWMFW::WinNetFW::terminate();
-
-    return (0);
 }
@@ -0,0 +1,277 @@
+#include "FileInfo.hxx"
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif // defined(__linux__)
+#endif // defined(_WIN32)
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+
+#include "Stats.hxx"
+#include "Utils.hxx"
+
+namespace FWMFW
+{
+    namespace Utils
+    {
+        namespace
+        {
+#if defined(_WIN32)
+            // FILETIME is already in ticks of 100 ns
+            std::int64_t toTicks(const FILETIME& time)
+            {
+                ULARGE_INTEGER value;
+                value.LowPart = time.dwLowDateTime;
+                value.HighPart = time.dwHighDateTime;
+                return (static_cast<std::int64_t>(value.QuadPart));
+            }
+
+            std::uint64_t toSize(DWORD high, DWORD low)
+            {
+                return ((static_cast<std::uint64_t>(high) << 32) | low);
+            }
+
+            FileType toFileType(DWORD attributes)
+            {
+                return (((attributes & FILE_ATTRIBUTE_DIRECTORY) != 0) ? FileType::Directory : FileType::File);
+            }
+#else
+            const std::int64_t TICKS_PER_SECOND = 10000000;
+
+            // big enough for the entries of most directories in a single call
+            const std::size_t DIRECTORY_BUFFER_SIZE = 64 * 1024;
+
+            std::int64_t toTicks(const struct timespec& time)
+            {
+                return (static_cast<std::int64_t>(time.tv_sec) * TICKS_PER_SECOND + time.tv_nsec / 100);
+            }
+
+            void setFileInfo(const struct stat& status, FileInfo& info)
+            {
+                info.type = S_ISDIR(status.st_mode) ? FileType::Directory :
+                    (S_ISREG(status.st_mode) ? FileType::File : FileType::Other);
+                info.hasSize = true;
+                info.size = static_cast<std::uint64_t>(status.st_size);
+                info.hasModificationTime = true;
+#if defined(__APPLE__)
+                info.modificationTime = toTicks(status.st_mtimespec);
+#else
+                info.modificationTime = toTicks(status.st_mtim);
+#endif // defined(__APPLE__)
+                info.hasIdentity = true;
+                info.identity.volume = static_cast<std::uint64_t>(status.st_dev);
+                info.identity.file = static_cast<std::uint64_t>(status.st_ino);
+                return;
+            }
+
+            bool isDotEntry(const char* name)
+            {
+                return ((name[0] == '.') && ((name[1] == '\0') || ((name[1] == '.') && (name[2] == '\0'))));
+            }
+
+            // the type is the one the enumeration told, only links (and entries of file systems that do not tell
+            // types) are looked up
+            void reportEntry(int dirFd, const char* name, unsigned char type, const DirectoryEntryCallback& callback)
+            {
+                FileInfo info;
+                struct stat status;
+                if (type == DT_UNKNOWN) {
+                    Stats::count(Stats::Counter::FileInfoCalls);
+                    if (fstatat(dirFd, name, &status, AT_SYMLINK_NOFOLLOW) != 0) return;
+                    if (!S_ISLNK(status.st_mode)) {
+                        setFileInfo(status, info);
+                        callback(name, info);
+                        return;
+                    }
+                    type = DT_LNK;
+                }
+
+                if (type == DT_LNK) {
+                    info.isLink = true;
+                    Stats::count(Stats::Counter::FileInfoCalls);
+                    // a link that leads nowhere is reported as what it is
+                    if (fstatat(dirFd, name, &status, 0) == 0) setFileInfo(status, info);
+                    else info.type = FileType::Other;
+                }
+                else {
+                    info.type = (type == DT_DIR) ? FileType::Directory :
+                        ((type == DT_REG) ? FileType::File : FileType::Other);
+                }
+                callback(name, info);
+                return;
+            }
+
+#if defined(__linux__)
+            // what getdents64 fills the buffer with (struct linux_dirent64, which the C library does not declare).
+            // the name follows the fixed part, the records are padded to 8 bytes.
+            struct DirectoryRecord
+            {
+                std::uint64_t inode;
+                std::int64_t offset;
+                unsigned short length;
+                unsigned char type;
+            }; // struct DirectoryRecord
+
+            const std::size_t RECORD_NAME_OFFSET = offsetof(DirectoryRecord, type) + 1;
+#endif // defined(__linux__)
+#endif // defined(_WIN32)
+        } // anonymous namespace
+
+        bool getFileInfo(const std::string& path, FileInfo& info, bool withIdentity)
+        {
+            Stats::count(Stats::Counter::FileInfoCalls);
+            info = FileInfo();
+#if defined(_WIN32)
+            std::wstring widePath = utf8StrToW32WStr(path);
+            if (!withIdentity) {
+                // tells about a link itself, which has the type of what it points to
+                WIN32_FILE_ATTRIBUTE_DATA attributeData;
+                if (GetFileAttributesExW(widePath.c_str(), GetFileExInfoStandard, &attributeData) == 0) return (false);
+
+                info.type = toFileType(attributeData.dwFileAttributes);
+                info.hasSize = true;
+                info.size = toSize(attributeData.nFileSizeHigh, attributeData.nFileSizeLow);
+                info.hasModificationTime = true;
+                info.modificationTime = toTicks(attributeData.ftLastWriteTime);
+                return (true);
+            }
+
+            // a directory can only be opened with backup semantics. no access is needed to read the information.
+            HANDLE hFile = CreateFileW(
+                widePath.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                FILE_FLAG_BACKUP_SEMANTICS, nullptr
+            );
+            if (hFile == INVALID_HANDLE_VALUE) return (false);
+
+            BY_HANDLE_FILE_INFORMATION information;
+            BOOL isOK = GetFileInformationByHandle(hFile, &information);
+            CloseHandle(hFile);
+            if (isOK == 0) return (false);
+
+            info.type = toFileType(information.dwFileAttributes);
+            info.hasSize = true;
+            info.size = toSize(information.nFileSizeHigh, information.nFileSizeLow);
+            info.hasModificationTime = true;
+            info.modificationTime = toTicks(information.ftLastWriteTime);
+            info.hasIdentity = true;
+            info.identity.volume = information.dwVolumeSerialNumber;
+            info.identity.file = toSize(information.nFileIndexHigh, information.nFileIndexLow);
+            return (true);
+#else
+            // the identity comes with the rest
+            (void) withIdentity;
+            struct stat status;
+            if (stat(path.c_str(), &status) != 0) return (false);
+            setFileInfo(status, info);
+            return (true);
+#endif // defined(_WIN32)
+        }
+
+        std::int64_t getCurrentFileTime(void)
+        {
+#if defined(_WIN32)
+            FILETIME now;
+            GetSystemTimeAsFileTime(&now);
+            return (toTicks(now));
+#else
+            struct timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            return (toTicks(now));
+#endif // defined(_WIN32)
+        }
+
+        bool readDirectory(const std::string& dir, const DirectoryEntryCallback& callback)
+        {
+#if defined(_WIN32)
+            // must end with "*". the basic information leaves out the short names.
+            std::wstring pattern = utf8StrToW32WStr(dir);
+            pattern.push_back(L'*');
+            WIN32_FIND_DATAW findData;
+            HANDLE hFind = FindFirstFileExW(
+                pattern.c_str(), FindExInfoBasic, &findData, FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH
+            );
+            if (hFind == INVALID_HANDLE_VALUE) return (false);
+
+            std::string name;
+            try {
+                do {
+                    std::wstring_view wideName{ findData.cFileName };
+                    if ((wideName == L".") || (wideName == L"..")) continue;
+
+                    FileInfo info;
+                    info.type = toFileType(findData.dwFileAttributes);
+                    // dwReserved0 holds the reparse tag, only symbolic links and junctions lead elsewhere
+                    info.isLink = ((findData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0) &&
+                        ((findData.dwReserved0 == IO_REPARSE_TAG_SYMLINK) ||
+                         (findData.dwReserved0 == IO_REPARSE_TAG_MOUNT_POINT));
+                    // the size and time of a link are its own, not those of what it points to
+                    if (!info.isLink) {
+                        info.hasSize = true;
+                        info.size = toSize(findData.nFileSizeHigh, findData.nFileSizeLow);
+                        info.hasModificationTime = true;
+                        info.modificationTime = toTicks(findData.ftLastWriteTime);
+                    }
+                    w32WStrToUTF8Str(wideName, name);
+                    callback(name, info);
+                } while (FindNextFileW(hFind, &findData) != 0);
+            }
+            catch (...) {
+                FindClose(hFind);
+                throw;
+            }
+            FindClose(hFind);
+            return (true);
+#elif defined(__linux__)
+            int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (fd < 0) return (false);
+
+            // not on the stack: a callback may read another directory
+            std::unique_ptr<char[]> buffer(new char[DIRECTORY_BUFFER_SIZE]);
+            try {
+                for (;;) {
+                    long length = syscall(SYS_getdents64, fd, buffer.get(), DIRECTORY_BUFFER_SIZE);
+                    if (length <= 0) break;
+                    for (long offset = 0; offset < length;) {
+                        const auto* record = reinterpret_cast<const DirectoryRecord*>(buffer.get() + offset);
+                        const char* name = buffer.get() + offset + RECORD_NAME_OFFSET;
+                        offset += record->length;
+                        if (!isDotEntry(name)) reportEntry(fd, name, record->type, callback);
+                    }
+                }
+            }
+            catch (...) {
+                ::close(fd);
+                throw;
+            }
+            ::close(fd);
+            return (true);
+#else
+            DIR* dirStream = opendir(dir.c_str());
+            if (dirStream == nullptr) return (false);
+
+            try {
+                for (struct dirent* entry = readdir(dirStream); entry != nullptr; entry = readdir(dirStream)) {
+                    if (isDotEntry(entry->d_name)) continue;
+                    reportEntry(dirfd(dirStream), entry->d_name, entry->d_type, callback);
+                }
+            }
+            catch (...) {
+                closedir(dirStream);
+                throw;
+            }
+            closedir(dirStream);
+            return (true);
+#endif // defined(_WIN32)
+        }
+    } // namespace Utils
+} // namespace FWMFW
@@ -0,0 +1,71 @@
+#if !defined(DOTSLASHZERO_FWMFW_FILEINFO_HXX)
+#define DOTSLASHZERO_FWMFW_FILEINFO_HXX
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace FWMFW
+{
+    namespace Utils
+    {
+        // what identifies a file no matter which path leads to it: the volume serial number and file ID on Windows,
+        // the device and inode number elsewhere
+        struct FileIdentity
+        {
+            std::uint64_t volume;
+            std::uint64_t file;
+
+            bool operator==(const FileIdentity& other) const
+            {
+                return ((volume == other.volume) && (file == other.file));
+            }
+            bool operator<(const FileIdentity& other) const
+            {
+                return ((volume < other.volume) || ((volume == other.volume) && (file < other.file)));
+            }
+        }; // struct FileIdentity
+
+        enum class FileType
+        {
+            Missing,
+            File,
+            Directory,
+            Other
+        }; // enum class FileType
+
+        // what a single call into the file system told about a file. links are followed, the rest is about what
+        // they point to. the flags tell which of the other fields were filled in.
+        struct FileInfo
+        {
+            FileType type{ FileType::Missing };
+            bool isLink{ false };               // a symbolic link or junction, only told by readDirectory
+            bool hasSize{ false };
+            std::uint64_t size{ 0 };
+            bool hasModificationTime{ false };
+            std::int64_t modificationTime{ 0 }; // in ticks of 100 ns, see getCurrentFileTime
+            bool hasIdentity{ false };
+            FileIdentity identity{ 0, 0 };
+        }; // struct FileInfo
+
+        // the type, size and modification time of path in one call. the identity comes with them except on Windows,
+        // where it takes a handle: it is only read there if withIdentity is set. returns false (and leaves the type
+        // Missing) if path does not exist or cannot be read.
+        bool getFileInfo(const std::string& path, FileInfo& info, bool withIdentity = false);
+
+        // the current time, in the ticks and epoch of the modification times of getFileInfo
+        std::int64_t getCurrentFileTime(void);
+
+        typedef std::function<void(std::string_view name, const FileInfo& info)> DirectoryEntryCallback;
+
+        // reports every entry of dir (which must end with a path separator) but "." and "..", with what the
+        // enumeration itself told about it: the type everywhere, and the size and modification time on Windows (not
+        // for links). the entries are fetched in large batches, with getdents64 on Linux and a large fetch
+        // FindFirstFileEx on Windows. links, and entries of file systems that do not tell the type, take one more
+        // call each. returns false if dir could not be opened.
+        bool readDirectory(const std::string& dir, const DirectoryEntryCallback& callback);
+    } // namespace Utils
+} // namespace FWMFW
+
+#endif // !defined(DOTSLASHZERO_FWMFW_FILEINFO_HXX)
@@ -0,0 +1,164 @@
+#include "ListFile.hxx"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+#include "Utils.hxx"
+#include "WinNetFW.hxx"
+
+namespace FWMFW
+{
+    namespace Reconcile
+    {
+        namespace
+        {
+            const std::string_view INCLUDE_KEYWORD{ "include" };
+            // deeper than this is taken to be a loop the paths did not give away (e.g. through links)
+            const std::size_t MAX_INCLUDE_DEPTH = 16;
+
+            std::string toLower(std::string_view text)
+            {
+                std::string result(text);
+                for (auto&& c : result) {
+                    if ((c >= 'A') && (c <= 'Z')) c = static_cast<char>(c - 'A' + 'a');
+                }
+                return (result);
+            }
+
+            std::string getIncludedGroup(const std::filesystem::path& file)
+            {
+                std::string group = toLower(Utils::pathToUTF8Str(file.stem()));
+                for (auto&& c : group) {
+                    if (!WinNetFW::isValidGroupName(std::string_view(&c, 1))) c = '-';
+                }
+                if (group.length() > WinNetFW::MAX_GROUP_NAME_LENGTH) group.resize(WinNetFW::MAX_GROUP_NAME_LENGTH);
+                return (group);
+            }
+
+            class ListWalker
+            {
+            public:
+                ListWalker(const ListVisitor& visitor, std::string& error) : _visitor(visitor), _error(error), _files()
+                { return; }
+
+                bool read(const std::filesystem::path& file, const std::string& group)
+                {
+                    std::error_code errorCode;
+                    auto canonical = std::filesystem::weakly_canonical(file, errorCode);
+                    if (errorCode) canonical = file;
+                    if (std::find(_files.begin(), _files.end(), canonical) != _files.end()) {
+                        _error = "the list file \"" + Utils::pathToUTF8Str(file) + "\" includes itself";
+                        return (false);
+                    }
+                    if (_files.size() == MAX_INCLUDE_DEPTH) {
+                        _error = "the list files are included too deep at \"" + Utils::pathToUTF8Str(file) + "\"";
+                        return (false);
+                    }
+
+                    ListFileReader reader;
+                    if (!reader.open(Utils::pathToUTF8Str(file))) {
+                        _error = "unable to read the list file \"" + Utils::pathToUTF8Str(file) + "\"";
+                        return (false);
+                    }
+
+                    _files.push_back(canonical);
+                    std::string currentGroup = group;
+                    for (ListLine line; reader.next(line);) {
+                        if (line.type == ListLine::Type::Section) {
+                            currentGroup = toLower(line.text);
+                            if (!WinNetFW::isValidGroupName(currentGroup)) {
+                                _error = "invalid section name \"" + std::string(line.text) + "\" in line " +
+                                    std::to_string(line.number) + " of \"" + Utils::pathToUTF8Str(file) + "\"";
+                                return (false);
+                            }
+                            _visitor(currentGroup, line);
+                        }
+                        else if (line.type == ListLine::Type::Include) {
+                            std::filesystem::path included = Utils::utf8StrToPath(line.text);
+                            if (included.is_relative()) included = file.parent_path() / included;
+                            auto includedGroup = getIncludedGroup(included);
+                            if (includedGroup.empty()) {
+                                _error = "no group name for \"" + Utils::pathToUTF8Str(included) + "\"";
+                                return (false);
+                            }
+                            _visitor(includedGroup, line);
+                            if (!read(included, includedGroup)) return (false);
+                        }
+                        else {
+                            _visitor(currentGroup, line);
+                        }
+                    }
+                    _files.pop_back();
+                    return (true);
+                }
+
+            private:
+                const ListVisitor& _visitor;
+                std::string& _error;
+                std::vector<std::filesystem::path> _files; // the ones being read, the includer first
+            }; // class ListWalker
+        } // anonymous namespace
+
+        bool ListFileReader::open(const std::string& listFile)
+        {
+            close();
+            if (!_file.open(listFile)) return (false);
+
+            const char BOM[] = "\xEF\xBB\xBF";
+            if (Utils::stringStartsWith(std::string_view(_file.getData(), _file.getSize()), BOM)) {
+                _offset = sizeof(BOM) - 1;
+            }
+            return (true);
+        }
+
+        void ListFileReader::close(void)
+        {
+            _file.close();
+            _offset = 0;
+            _lineNumber = 0;
+            return;
+        }
+
+        bool ListFileReader::next(ListLine& line)
+        {
+            const char* data = _file.getData();
+            const std::size_t size = _file.getSize();
+
+            while (_offset < size) {
+                const char* begin = data + _offset;
+                auto end = static_cast<const char*>(std::memchr(begin, '\n', size - _offset));
+                if (end == nullptr) end = data + size;
+                _offset = static_cast<std::size_t>(end - data) + 1;
+                _lineNumber++;
+
+                // the '\r' of "\r\n" is white space
+                auto text = Utils::trimWhiteSpaces(std::string_view(begin, static_cast<std::size_t>(end - begin)));
+                if (text.empty() || text[0] == '#') continue;
+
+                line.type = ListLine::Type::Entry;
+                line.isExclusion = (text[0] == '!');
+                line.text = line.isExclusion ? Utils::trimWhiteSpaces(text.substr(1)) : text;
+                line.number = _lineNumber;
+                if ((text[0] == '[') && (text.back() == ']')) {
+                    line.type = ListLine::Type::Section;
+                    line.text = Utils::trimWhiteSpaces(text.substr(1, text.length() - 2));
+                }
+                else if (Utils::stringStartsWith(text, INCLUDE_KEYWORD) && (text.length() > INCLUDE_KEYWORD.length()) &&
+                    ((text[INCLUDE_KEYWORD.length()] == ' ') || (text[INCLUDE_KEYWORD.length()] == '\t'))) {
+                    line.type = ListLine::Type::Include;
+                    line.text = Utils::trimWhiteSpaces(text.substr(INCLUDE_KEYWORD.length()));
+                }
+                return (true);
+            }
+            return (false);
+        }
+
+        bool readListFile(const std::string& listFile, const ListVisitor& visitor, std::string& error)
+        {
+            ListWalker walker(visitor, error);
+            return (walker.read(Utils::utf8StrToPath(listFile), std::string()));
+        }
+    } // namespace Reconcile
+} // namespace FWMFW
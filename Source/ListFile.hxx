@@ -0,0 +1,69 @@
+#if !defined(DOTSLASHZERO_FWMFW_LISTFILE_HXX)
+#define DOTSLASHZERO_FWMFW_LISTFILE_HXX
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+
+#include "MappedFile.hxx"
+
+namespace FWMFW
+{
+    namespace Reconcile
+    {
+        // one entry of a list file. text points into the mapping of the file and stays valid until the reader is
+        // closed or opens another file.
+        struct ListLine
+        {
+            enum class Type
+            {
+                Entry,      // a file, folder or pattern
+                Section,    // "[name]": the entries that follow are in the group of that name
+                Include     // "include <list file>": the entries of another list file, in a group of their own
+            }; // enum class Type
+
+            Type type;
+            std::string_view text;  // trimmed, without the '!' of exclusions, the brackets or the "include"
+            bool isExclusion;
+            std::size_t number;     // 1 based
+        }; // struct ListLine
+
+        // reads the entries of a list file straight from a mapping of the file: lines are cut out in place, nothing
+        // is copied or allocated per line. empty lines and comments (lines starting with '#') are skipped, and so is
+        // a UTF-8 byte order mark. both "\n" and "\r\n" line endings are accepted.
+        class ListFileReader
+        {
+        public:
+            ListFileReader(void) : _file(), _offset(0), _lineNumber(0) { return; }
+
+            // returns false if the file cannot be opened
+            bool open(const std::string& listFile);
+            void close(void);
+
+            // the next entry, or false at the end of the file
+            bool next(ListLine& line);
+
+            ListFileReader(const ListFileReader&) = delete;
+            ListFileReader& operator=(const ListFileReader&) = delete;
+
+        private:
+            Utils::MappedFile _file;
+            std::size_t _offset;
+            std::size_t _lineNumber;
+        }; // class ListFileReader
+
+        // group is the lower case name of the group the line is in: its section, or the included file it comes from
+        // (named after the file, without its extension and with the characters a group name can not have replaced
+        // by '-'). the lines before the first section of the list file are in the group with the empty name.
+        // section and include lines are passed on as well, with the name of the group they start.
+        typedef std::function<void(const std::string& group, const ListLine& line)> ListVisitor;
+
+        // reads a list file and the list files it includes (relative paths are relative to the including file), in
+        // order. returns false, with a message in error, if one of them can not be read, includes itself or has a
+        // section with an invalid name (see WinNetFW::isValidGroupName).
+        bool readListFile(const std::string& listFile, const ListVisitor& visitor, std::string& error);
+    } // namespace Reconcile
+} // namespace FWMFW
+
+#endif // !defined(DOTSLASHZERO_FWMFW_LISTFILE_HXX)
@@ -0,0 +1,114 @@
+#include "MappedFile.hxx"
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // defined(_WIN32)
+
+#include <algorithm>
+#include <cstdint>
+
+#include "Utils.hxx"
+
+namespace FWMFW
+{
+    namespace Utils
+    {
+#if defined(_WIN32)
+        MappedFile::MappedFile(void) :
+            _isOpen(false), _data(nullptr), _size(0), _fileHandle(INVALID_HANDLE_VALUE), _mappingHandle(NULL)
+        { return; }
+#else
+        MappedFile::MappedFile(void) : _isOpen(false), _data(nullptr), _size(0)
+        { return; }
+#endif // defined(_WIN32)
+
+        MappedFile::~MappedFile(void)
+        {
+            close();
+            return;
+        }
+
+        bool MappedFile::open(const std::string& file, std::size_t maxSize)
+        {
+            close();
+
+#if defined(_WIN32)
+            _fileHandle = CreateFileW(
+                Utils::utf8StrToW32WStr(file).c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                FILE_ATTRIBUTE_NORMAL, NULL
+            );
+            if (_fileHandle == INVALID_HANDLE_VALUE) return (false);
+
+            LARGE_INTEGER fileSize;
+            if (GetFileSizeEx(_fileHandle, &fileSize) == 0) {
+                close();
+                return (false);
+            }
+
+            _size = static_cast<std::size_t>(std::min<ULONGLONG>(static_cast<ULONGLONG>(fileSize.QuadPart), maxSize));
+            if (_size > 0) {
+                // mapping an empty file is not allowed
+                _mappingHandle = CreateFileMappingW(_fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+                if (_mappingHandle == NULL) {
+                    close();
+                    return (false);
+                }
+                _data = static_cast<const char*>(MapViewOfFile(_mappingHandle, FILE_MAP_READ, 0, 0, _size));
+                if (_data == nullptr) {
+                    close();
+                    return (false);
+                }
+            }
+#else
+            // a FIFO would block the open until a writer shows up
+            int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+            if (fd < 0) return (false);
+
+            struct stat fileStat;
+            if (fstat(fd, &fileStat) != 0) {
+                ::close(fd);
+                return (false);
+            }
+
+            _size = static_cast<std::size_t>(std::min<std::uint64_t>(fileStat.st_size, maxSize));
+            if (_size > 0) {
+                void* data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (data == MAP_FAILED) {
+                    ::close(fd);
+                    _size = 0;
+                    return (false);
+                }
+                _data = static_cast<const char*>(data);
+            }
+
+            // the mapping stays valid after the descriptor is closed
+            ::close(fd);
+#endif // defined(_WIN32)
+
+            _isOpen = true;
+            return (true);
+        }
+
+        void MappedFile::close(void)
+        {
+#if defined(_WIN32)
+            if (_data != nullptr) UnmapViewOfFile(_data);
+            if (_mappingHandle != NULL) CloseHandle(_mappingHandle);
+            if (_fileHandle != INVALID_HANDLE_VALUE) CloseHandle(_fileHandle);
+            _mappingHandle = NULL;
+            _fileHandle = INVALID_HANDLE_VALUE;
+#else
+            if (_data != nullptr) munmap(const_cast<char*>(_data), _size);
+#endif // defined(_WIN32)
+            _isOpen = false;
+            _data = nullptr;
+            _size = 0;
+            return;
+        }
+    } // namespace Utils
+} // namespace FWMFW
@@ -0,0 +1,44 @@
+#if !defined(DOTSLASHZERO_FWMFW_MAPPEDFILE_HXX)
+#define DOTSLASHZERO_FWMFW_MAPPEDFILE_HXX
+
+#include <cstddef>
+#include <string>
+
+namespace FWMFW
+{
+    namespace Utils
+    {
+        // read-only memory mapping of a whole file, or of its beginning (RAII)
+        class MappedFile
+        {
+        public:
+            static const std::size_t WHOLE_FILE = static_cast<std::size_t>(-1);
+
+            MappedFile(void);
+            ~MappedFile(void);
+
+            // returns false if the file does not exist or cannot be mapped. empty files can be opened but have no data.
+            // only the first maxSize bytes are mapped (getSize() is the size of what was mapped).
+            bool open(const std::string& file, std::size_t maxSize = WHOLE_FILE);
+            void close(void);
+
+            bool isOpen(void) const { return (_isOpen); }
+            const char* getData(void) const { return (_data); }
+            std::size_t getSize(void) const { return (_size); }
+
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+
+        private:
+            bool _isOpen;
+            const char* _data;
+            std::size_t _size;
+#if defined(_WIN32)
+            void* _fileHandle;
+            void* _mappingHandle;
+#endif // defined(_WIN32)
+        }; // class MappedFile
+    } // namespace Utils
+} // namespace FWMFW
+
+#endif // !defined(DOTSLASHZERO_FWMFW_MAPPEDFILE_HXX)
@@ -0,0 +1,322 @@
+#include "MemoryRuleStore.hxx"
+
+#include <thread>
+
+#include "Utils.hxx"
+
+namespace FWMFW
+{
+    namespace WinNetFW
+    {
+        MemoryRuleStore::MemoryRuleStore(void) : MemoryRuleStore(Latency())
+        { return; }
+
+        MemoryRuleStore::MemoryRuleStore(const Latency& latency) :
+            _mutex(), _rules(), _rulesByName(), _removedCount(0), _activeEnumerations(0),
+            _addsBeforeFailure(NO_FAILURE),
+            _enumerateCallLatency(0), _enumerateRuleLatency(0), _createLatency(0), _addLatency(0), _removeLatency(0),
+            _lookupLatency(0), _isSleeping(false),
+            _enumerateCalls(0), _enumeratedRules(0), _addCalls(0), _removeCalls(0), _lookupCalls(0)
+        {
+            setLatency(latency);
+            return;
+        }
+
+        void MemoryRuleStore::setLatency(const Latency& latency)
+        {
+            _enumerateCallLatency = latency.enumerateCall.count();
+            _enumerateRuleLatency = latency.enumerateRule.count();
+            _createLatency = latency.create.count();
+            _addLatency = latency.add.count();
+            _removeLatency = latency.remove.count();
+            _lookupLatency = latency.lookup.count();
+            _isSleeping = latency.isSleeping;
+            return;
+        }
+
+        MemoryRuleStore::CallCounts MemoryRuleStore::getCallCounts(void) const
+        {
+            return (CallCounts{
+                _enumerateCalls.load(), _enumeratedRules.load(), _addCalls.load(), _removeCalls.load(),
+                _lookupCalls.load()
+            });
+        }
+
+        void MemoryRuleStore::resetCallCounts(void)
+        {
+            _enumerateCalls = 0;
+            _enumeratedRules = 0;
+            _addCalls = 0;
+            _removeCalls = 0;
+            _lookupCalls = 0;
+            return;
+        }
+
+        std::vector<Rule> MemoryRuleStore::getAllRules(void) const
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            std::vector<Rule> result;
+            result.reserve(_rules.size() - _removedCount);
+            for (auto&& stored : _rules) {
+                if (stored.removed) continue;
+                result.push_back(Rule{
+                    Utils::utf16StrToUTF8Str(stored.name),
+                    Utils::utf16StrToUTF8Str(stored.applicationName),
+                    Utils::utf16StrToUTF8Str(stored.description),
+                    stored.direction,
+                    stored.action,
+                    stored.enabled
+                });
+            }
+            return (result);
+        }
+
+        void MemoryRuleStore::setAddFailureAfter(std::size_t successfulAdds)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _addsBeforeFailure = successfulAdds;
+            return;
+        }
+
+        std::size_t MemoryRuleStore::getRuleCount(void) const
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return (_rules.size() - _removedCount);
+        }
+
+        // what a batch of INetFwRule objects costs: every fetched rule's name is read (and copied, like the BSTR from
+        // get_Name), the properties of the rules that matched the prefix, and their application names only if those
+        // matched as well
+        class MemoryRuleStore::Cursor : public RuleCursor
+        {
+        public:
+            Cursor(const MemoryRuleStore& store, const RuleQuery& query) :
+                _store(store), _query(query), _namePrefix(Utils::utf8StrToUTF16Str(query.namePrefix)),
+                _batchSize((query.batchSize > 0) ? query.batchSize : 1), _fetched(), _idx(0), _isDone(false)
+            {
+                _fetched.reserve(_batchSize);
+                std::lock_guard<std::mutex> lock(_store._mutex);
+                _store._activeEnumerations++;
+                return;
+            }
+
+            virtual ~Cursor(void)
+            {
+                std::lock_guard<std::mutex> lock(_store._mutex);
+                _store._activeEnumerations--;
+                return;
+            }
+
+            virtual bool next(RuleBatch& batch) override
+            {
+                batch.clear();
+                while (batch.empty() && !_isDone) fetch(batch);
+                return (!batch.empty());
+            }
+
+        private:
+            struct FetchedRule
+            {
+                std::u16string name;
+                std::u16string applicationName;
+                RuleDirection direction;
+                RuleAction action;
+                bool enabled;
+            }; // struct FetchedRule
+
+            void fetch(RuleBatch& batch)
+            {
+                std::size_t fetched = 0;
+                _fetched.clear();
+                {
+                    std::lock_guard<std::mutex> lock(_store._mutex);
+                    for (; _idx < _store._rules.size() && fetched < _batchSize; _idx++) {
+                        const StoredRule& stored = _store._rules[_idx];
+                        if (stored.removed) continue;
+                        fetched++;
+
+                        std::u16string name = stored.name;
+                        if (name.compare(0, _namePrefix.length(), _namePrefix) != 0) continue;
+                        if (_query.direction && (*_query.direction != stored.direction)) continue;
+                        if (_query.action && (*_query.action != stored.action)) continue;
+                        if (_query.enabled && (*_query.enabled != stored.enabled)) continue;
+                        _fetched.push_back(FetchedRule{
+                            std::move(name), stored.applicationName, stored.direction, stored.action, stored.enabled
+                        });
+                    }
+                }
+
+                _store._enumerateCalls++;
+                _store._enumeratedRules += fetched;
+                _store.spend(std::chrono::nanoseconds(
+                    _store._enumerateCallLatency.load() +
+                    _store._enumerateRuleLatency.load() * static_cast<std::int64_t>(fetched)
+                ));
+                if (fetched == 0) {
+                    _isDone = true;
+                    return;
+                }
+
+                // the filters are free to call back into the store
+                for (auto&& rule : _fetched) {
+                    RuleRecord& record = batch.add();
+                    Utils::utf16StrToUTF8Str(rule.name, record.name);
+                    if (_query.nameFilter && !_query.nameFilter(record.name)) {
+                        batch.removeLast();
+                        continue;
+                    }
+                    Utils::utf16StrToUTF8Str(rule.applicationName, record.applicationName);
+                    if (_query.applicationNameFilter && !_query.applicationNameFilter(record.applicationName)) {
+                        batch.removeLast();
+                        continue;
+                    }
+                    record.direction = rule.direction;
+                    record.action = rule.action;
+                    record.enabled = rule.enabled;
+                }
+                return;
+            }
+
+            const MemoryRuleStore& _store;
+            const RuleQuery _query;
+            const std::u16string _namePrefix;
+            const std::size_t _batchSize;
+            std::vector<FetchedRule> _fetched;
+            std::size_t _idx;
+            bool _isDone;
+        }; // class MemoryRuleStore::Cursor
+
+        std::unique_ptr<RuleCursor> MemoryRuleStore::openRules(const RuleQuery& query) const
+        {
+            return (std::unique_ptr<RuleCursor>(new Cursor(*this, query)));
+        }
+
+        bool MemoryRuleStore::hasRule(const std::string& name) const
+        {
+            _lookupCalls++;
+            spend(std::chrono::nanoseconds(_lookupLatency.load()));
+
+            auto key = Utils::utf8StrToUTF16Str(name);
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            return (_rulesByName.count(key) != 0);
+        }
+
+        bool MemoryRuleStore::addRule(const Rule& rule)
+        {
+            spend(std::chrono::nanoseconds(_createLatency.load()));
+            auto stored = toStoredRule(rule);
+
+            _addCalls++;
+            spend(std::chrono::nanoseconds(_addLatency.load()));
+            return (insert(std::move(stored)));
+        }
+
+        bool MemoryRuleStore::removeRule(const std::string& name)
+        {
+            _removeCalls++;
+            spend(std::chrono::nanoseconds(_removeLatency.load()));
+
+            auto key = Utils::utf8StrToUTF16Str(name);
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto itr = _rulesByName.find(key);
+            // removing a rule that does not exist is not an error for INetFwRules::Remove either
+            if (itr == _rulesByName.end()) return (true);
+
+            for (auto&& idx : itr->second) {
+                _rules[idx].removed = true;
+                _removedCount++;
+            }
+            _rulesByName.erase(itr);
+
+            if ((_activeEnumerations == 0) && (_removedCount > _rules.size() / 2)) compact();
+            return (true);
+        }
+
+        std::size_t MemoryRuleStore::addRules(const std::vector<Rule>& rules)
+        {
+            // everything is converted before the first rule goes in
+            spend(std::chrono::nanoseconds(_createLatency.load()));
+            std::vector<StoredRule> prepared;
+            prepared.reserve(rules.size());
+            for (auto&& rule : rules) prepared.push_back(toStoredRule(rule));
+
+            std::size_t added = 0;
+            for (auto&& stored : prepared) {
+                _addCalls++;
+                spend(std::chrono::nanoseconds(_addLatency.load()));
+                if (!insert(std::move(stored))) break;
+                added++;
+            }
+            return (added);
+        }
+
+        std::size_t MemoryRuleStore::removeRules(const std::vector<std::string>& names)
+        {
+            std::size_t removed = 0;
+            for (auto&& name : names) {
+                if (!removeRule(name)) break;
+                removed++;
+            }
+            return (removed);
+        }
+
+        MemoryRuleStore::StoredRule MemoryRuleStore::toStoredRule(const Rule& rule)
+        {
+            return (StoredRule{
+                Utils::utf8StrToUTF16Str(rule.name),
+                Utils::utf8StrToUTF16Str(rule.applicationName),
+                Utils::utf8StrToUTF16Str(rule.description),
+                rule.direction,
+                rule.action,
+                rule.enabled,
+                false
+            });
+        }
+
+        bool MemoryRuleStore::insert(StoredRule&& stored)
+        {
+            // like INetFwRules::Add, a rule without a name is rejected
+            if (stored.name.empty()) return (false);
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_addsBeforeFailure != NO_FAILURE) {
+                if (_addsBeforeFailure == 0) return (false);
+                _addsBeforeFailure--;
+            }
+
+            _rulesByName[stored.name].push_back(_rules.size());
+            _rules.push_back(std::move(stored));
+            return (true);
+        }
+
+        void MemoryRuleStore::compact(void)
+        {
+            std::vector<StoredRule> rules;
+            rules.reserve(_rules.size() - _removedCount);
+            _rulesByName.clear();
+            for (auto&& stored : _rules) {
+                if (stored.removed) continue;
+                _rulesByName[stored.name].push_back(rules.size());
+                rules.push_back(std::move(stored));
+            }
+            _rules.swap(rules);
+            _removedCount = 0;
+            return;
+        }
+
+        void MemoryRuleStore::spend(std::chrono::nanoseconds latency) const
+        {
+            if (latency.count() <= 0) return;
+            if (_isSleeping.load()) {
+                std::this_thread::sleep_for(latency);
+                return;
+            }
+            // sleeping is far too coarse for latencies in the order of microseconds
+            auto until = std::chrono::steady_clock::now() + latency;
+            while (std::chrono::steady_clock::now() < until) {}
+            return;
+        }
+    } // namespace WinNetFW
+} // namespace FWMFW
@@ -0,0 +1,123 @@
+#if !defined(DOTSLASHZERO_FWMFW_MEMORYRULESTORE_HXX)
+#define DOTSLASHZERO_FWMFW_MEMORYRULESTORE_HXX
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "RuleStore.hxx"
+
+namespace FWMFW
+{
+    namespace WinNetFW
+    {
+        // a rule store that lives in memory only. it mimics the behavior and the costs of INetFwRules: the strings
+        // are kept in UTF-16 and converted on every access, enumeration returns the rules in the order they were
+        // added and every call can be given a simulated latency.
+        class MemoryRuleStore : public RuleStore
+        {
+        public:
+            // the latencies are spent busy waiting outside of the store's lock, like a round trip to the firewall
+            // service would be, so concurrent callers overlap
+            struct Latency
+            {
+                // sleep instead of busy waiting: the caller waits for another process and leaves the processor to
+                // other threads. sleeping is coarse, the latencies should be a few 100 us or more.
+                bool isSleeping{ false };
+                std::chrono::nanoseconds enumerateCall{ 0 }; // per call to the enumerator (i.e. IEnumVARIANT::Next)
+                std::chrono::nanoseconds enumerateRule{ 0 }; // per rule fetched by the enumerator
+                // looking up and creating a rule object (CoCreateInstance and QueryInterface): paid for every
+                // addRule, but only once per addRules batch which creates its objects from one class factory
+                std::chrono::nanoseconds create{ 0 };
+                std::chrono::nanoseconds add{ 0 };
+                std::chrono::nanoseconds remove{ 0 };
+                std::chrono::nanoseconds lookup{ 0 }; // per hasRule
+            }; // struct Latency
+
+            struct CallCounts
+            {
+                std::size_t enumerateCalls;
+                std::size_t enumeratedRules;
+                std::size_t add;
+                std::size_t remove;
+                std::size_t lookup;
+            }; // struct CallCounts
+
+            MemoryRuleStore(void);
+            explicit MemoryRuleStore(const Latency& latency);
+
+            void setLatency(const Latency& latency);
+            CallCounts getCallCounts(void) const;
+            void resetCallCounts(void);
+
+            // copy of all the rules, in enumeration order
+            std::vector<Rule> getAllRules(void) const;
+
+            // fault injection: after the given number of further successful adds, every add fails.
+            // NO_FAILURE turns it off again.
+            static const std::size_t NO_FAILURE = static_cast<std::size_t>(-1);
+            void setAddFailureAfter(std::size_t successfulAdds);
+
+            virtual std::size_t getRuleCount(void) const override;
+            virtual std::unique_ptr<RuleCursor> openRules(const RuleQuery& query) const override;
+            virtual bool hasRule(const std::string& name) const override;
+            virtual bool addRule(const Rule& rule) override;
+            virtual bool removeRule(const std::string& name) override;
+            virtual std::size_t addRules(const std::vector<Rule>& rules) override;
+            virtual std::size_t removeRules(const std::vector<std::string>& names) override;
+
+            MemoryRuleStore(const MemoryRuleStore&) = delete;
+            MemoryRuleStore& operator=(const MemoryRuleStore&) = delete;
+
+        private:
+            class Cursor;
+
+            struct StoredRule
+            {
+                std::u16string name;
+                std::u16string applicationName;
+                std::u16string description;
+                RuleDirection direction;
+                RuleAction action;
+                bool enabled;
+                bool removed;
+            }; // struct StoredRule
+
+            static StoredRule toStoredRule(const Rule& rule);
+            bool insert(StoredRule&& stored);
+
+            // removed rules are only marked and get compacted away once they make up half of the store
+            void compact(void);
+
+            void spend(std::chrono::nanoseconds latency) const;
+
+            mutable std::mutex _mutex;
+            std::vector<StoredRule> _rules;
+            std::unordered_map<std::u16string, std::vector<std::size_t>> _rulesByName;
+            std::size_t _removedCount;
+            mutable std::size_t _activeEnumerations;
+            std::size_t _addsBeforeFailure;
+
+            std::atomic<std::int64_t> _enumerateCallLatency;
+            std::atomic<std::int64_t> _enumerateRuleLatency;
+            std::atomic<std::int64_t> _createLatency;
+            std::atomic<std::int64_t> _addLatency;
+            std::atomic<std::int64_t> _removeLatency;
+            std::atomic<std::int64_t> _lookupLatency;
+            std::atomic<bool> _isSleeping;
+
+            mutable std::atomic<std::size_t> _enumerateCalls;
+            mutable std::atomic<std::size_t> _enumeratedRules;
+            std::atomic<std::size_t> _addCalls;
+            std::atomic<std::size_t> _removeCalls;
+            mutable std::atomic<std::size_t> _lookupCalls;
+        }; // class MemoryRuleStore
+    } // namespace WinNetFW
+} // namespace FWMFW
+
+#endif // !defined(DOTSLASHZERO_FWMFW_MEMORYRULESTORE_HXX)
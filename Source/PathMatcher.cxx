@@ -0,0 +1,245 @@
+#include "PathMatcher.hxx"
+
+#include <algorithm>
+
+#include "Utils.hxx"
+
+namespace FWMFW
+{
+    namespace Scanner
+    {
+        namespace
+        {
+            const std::string ANY_DEPTH{ "**" };
+
+            bool isSameChar(char lhs, char rhs)
+            {
+#if defined(_WIN32)
+                // file names are case insensitive
+                if (lhs >= 'A' && lhs <= 'Z') lhs = static_cast<char>(lhs - 'A' + 'a');
+                if (rhs >= 'A' && rhs <= 'Z') rhs = static_cast<char>(rhs - 'A' + 'a');
+#endif // defined(_WIN32)
+                return (lhs == rhs);
+            }
+
+            bool isSameName(std::string_view lhs, std::string_view rhs)
+            {
+                if (lhs.length() != rhs.length()) return (false);
+                for (std::size_t idx = 0; idx < lhs.length(); idx++) {
+                    if (!isSameChar(lhs[idx], rhs[idx])) return (false);
+                }
+                return (true);
+            }
+
+            // '*' and '?' within a single segment. a '*' that did not work out only ever has to be retried from the
+            // last '*', which keeps this linear for all practical patterns.
+            bool isGlobMatch(std::string_view pattern, std::string_view name)
+            {
+                std::size_t patternPos = 0;
+                std::size_t namePos = 0;
+                std::size_t starPos = std::string_view::npos;
+                std::size_t starNamePos = 0;
+
+                while (namePos < name.length()) {
+                    if (patternPos < pattern.length() && pattern[patternPos] == '*') {
+                        starPos = patternPos++;
+                        starNamePos = namePos;
+                    }
+                    else if (patternPos < pattern.length() &&
+                        (pattern[patternPos] == '?' || isSameChar(pattern[patternPos], name[namePos]))) {
+                        patternPos++;
+                        namePos++;
+                    }
+                    else if (starPos != std::string_view::npos) {
+                        patternPos = starPos + 1;
+                        namePos = ++starNamePos;
+                    }
+                    else {
+                        return (false);
+                    }
+                }
+                while (patternPos < pattern.length() && pattern[patternPos] == '*') patternPos++;
+                return (patternPos == pattern.length());
+            }
+
+            bool isAbsolute(const std::string& path)
+            {
+#if defined(_WIN32)
+                if (path.length() >= 2 && path[1] == ':') return (true);
+#endif // defined(_WIN32)
+                return (!path.empty() && path[0] == Utils::PATH_SEPARATOR);
+            }
+
+            // the segments of a path. an absolute path on POSIX starts with an empty segment (the root), empty
+            // segments anywhere else are dropped.
+            std::vector<std::string_view> splitPath(std::string_view path)
+            {
+                std::vector<std::string_view> result;
+                std::size_t start = 0;
+                for (;;) {
+                    std::size_t end = path.find(Utils::PATH_SEPARATOR, start);
+                    std::string_view segment = path.substr(start, (end == std::string_view::npos) ? end : end - start);
+                    if (!segment.empty() || start == 0) result.push_back(segment);
+                    if (end == std::string_view::npos) break;
+                    start = end + 1;
+                }
+                if (result.size() > 1 && result.back().empty()) result.pop_back();
+                return (result);
+            }
+        } // anonymous namespace
+
+        void PathMatcher::addInclude(std::string_view pattern)
+        {
+            add(pattern, false);
+            return;
+        }
+
+        void PathMatcher::addExclude(std::string_view pattern)
+        {
+            add(pattern, true);
+            return;
+        }
+
+        PathMatcher::State PathMatcher::getState(const std::string& path) const
+        {
+            State state = _initial;
+            for (auto&& segment : splitPath(path)) state = step(state, segment);
+            return (state);
+        }
+
+        PathMatcher::State PathMatcher::step(const State& dir, std::string_view name) const
+        {
+            State result;
+            result.isIncluded = dir.isIncluded;
+            result.isExcluded = dir.isExcluded;
+            if (result.isExcluded) return (result);
+
+            for (auto&& position : dir.positions) {
+                const Segment& segment = _segments[position];
+                if (segment.kind == Segment::Kind::AnyDepth) {
+                    // takes this name and stays for the next one
+                    enter(result, position);
+                    if (segment.isLast) mark(result, segment);
+                }
+                else if (isMatch(segment, name)) {
+                    if (segment.isLast) mark(result, segment);
+                    else enter(result, position + 1);
+                }
+            }
+
+            if (result.isExcluded) {
+                result.positions.clear();
+            }
+            else if (result.isIncluded) {
+                // only the exclusions matter below an included directory
+                result.positions.erase(
+                    std::remove_if(
+                        result.positions.begin(), result.positions.end(),
+                        [this] (std::uint32_t position) -> bool { return (!_segments[position].isExclusion); }
+                    ),
+                    result.positions.end()
+                );
+            }
+            return (result);
+        }
+
+        bool PathMatcher::isPruned(const State& dir) const
+        {
+            if (dir.isExcluded) return (true);
+            if (dir.isIncluded) return (false);
+            for (auto&& position : dir.positions) {
+                if (!_segments[position].isExclusion) return (false);
+            }
+            return (true);
+        }
+
+        bool PathMatcher::isMatch(const State& dir, std::string_view name) const
+        {
+            if (dir.isExcluded) return (false);
+
+            bool isIncluded = dir.isIncluded;
+            for (auto&& position : dir.positions) {
+                // a file has nothing below it, so only the patterns that end with it count. a "**" in the middle
+                // of a pattern is always followed by the position of the next segment (see enter).
+                const Segment& segment = _segments[position];
+                if (!segment.isLast || !isMatch(segment, name)) continue;
+                if (segment.isExclusion) return (false);
+                isIncluded = true;
+            }
+            return (isIncluded);
+        }
+
+        bool PathMatcher::hasWildcards(std::string_view pattern)
+        {
+            return (pattern.find_first_of("*?") != std::string_view::npos);
+        }
+
+        std::string PathMatcher::getBase(const std::string& pattern)
+        {
+            std::string result;
+            for (auto&& segment : splitPath(pattern)) {
+                if (hasWildcards(segment)) break;
+                result.append(segment).push_back(Utils::PATH_SEPARATOR);
+            }
+            return (result);
+        }
+
+        void PathMatcher::add(std::string_view pattern, bool isExclusion)
+        {
+            std::string normalized = Utils::replaceChars(pattern, '/', Utils::PATH_SEPARATOR, false);
+            if (!isAbsolute(normalized)) normalized = ANY_DEPTH + Utils::PATH_SEPARATOR + normalized;
+
+            auto segments = splitPath(normalized);
+            if (segments.empty()) return;
+
+            std::uint32_t first = static_cast<std::uint32_t>(_segments.size());
+            for (std::size_t idx = 0; idx < segments.size(); idx++) {
+                Segment segment;
+                if (segments[idx] == ANY_DEPTH) segment.kind = Segment::Kind::AnyDepth;
+                else if (hasWildcards(segments[idx])) segment.kind = Segment::Kind::Glob;
+                else segment.kind = Segment::Kind::Literal;
+                segment.text = std::string(segments[idx]);
+                segment.isExclusion = isExclusion;
+                segment.isLast = (idx + 1 == segments.size());
+                _segments.push_back(std::move(segment));
+            }
+
+            enter(_initial, first);
+            return;
+        }
+
+        void PathMatcher::enter(State& state, std::uint32_t position) const
+        {
+            for (;;) {
+                if (std::find(state.positions.begin(), state.positions.end(), position) != state.positions.end()) {
+                    return;
+                }
+                state.positions.push_back(position);
+
+                // "**" may also match no segment at all
+                const Segment& segment = _segments[position];
+                if (segment.kind != Segment::Kind::AnyDepth || segment.isLast) return;
+                position++;
+            }
+        }
+
+        void PathMatcher::mark(State& state, const Segment& segment) const
+        {
+            if (segment.isExclusion) state.isExcluded = true;
+            else state.isIncluded = true;
+            return;
+        }
+
+        bool PathMatcher::isMatch(const Segment& segment, std::string_view name) const
+        {
+            switch (segment.kind) {
+                case Segment::Kind::Literal:
+                    return (isSameName(segment.text, name));
+                case Segment::Kind::Glob:
+                    return (isGlobMatch(segment.text, name));
+                default:
+                    return (true);
+            }
+        }
+    } // namespace Scanner
+} // namespace FWMFW
@@ -0,0 +1,81 @@
+#if !defined(DOTSLASHZERO_FWMFW_PATHMATCHER_HXX)
+#define DOTSLASHZERO_FWMFW_PATHMATCHER_HXX
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace FWMFW
+{
+    namespace Scanner
+    {
+        // a set of include and exclude patterns, matched one path segment at a time so that a directory walk can
+        // carry the state of a directory down to its entries and stop at subtrees that can not match anything.
+        // in a pattern, '*' matches any number of characters within a segment, '?' a single character and a "**"
+        // segment any number of segments. a path matches a pattern if the path or one of its parent directories
+        // does, i.e. including a directory includes everything below it. patterns that are not absolute match at any
+        // depth. exclusions always win over inclusions.
+        class PathMatcher
+        {
+        public:
+            // where a directory walk stands within the patterns
+            struct State
+            {
+                std::vector<std::uint32_t> positions; // the pattern segments the next path segment is matched against
+                bool isIncluded{ false };
+                bool isExcluded{ false };
+            }; // struct State
+
+            PathMatcher(void) : _segments(), _initial() { return; }
+
+            void addInclude(std::string_view pattern);
+            void addExclude(std::string_view pattern);
+
+            bool isEmpty(void) const { return (_segments.empty()); }
+
+            // the state of a path, matched from the file system root on. dir paths may end with a separator.
+            State getState(const std::string& path) const;
+
+            // the state of the entry name of the directory in state dir
+            State step(const State& dir, std::string_view name) const;
+
+            // whether nothing at or below the directory in state dir can match
+            bool isPruned(const State& dir) const;
+
+            // whether the file name of the directory in state dir matches, without building its state
+            bool isMatch(const State& dir, std::string_view name) const;
+
+            static bool hasWildcards(std::string_view pattern);
+
+            // the leading segments of a pattern that do not have wildcards, ending with a separator
+            static std::string getBase(const std::string& pattern);
+
+        private:
+            struct Segment
+            {
+                enum class Kind
+                {
+                    Literal,
+                    Glob,
+                    AnyDepth // "**"
+                }; // enum class Kind
+
+                Kind kind;
+                std::string text;
+                bool isExclusion;
+                bool isLast; // of its pattern, otherwise the next segment follows at the next index
+            }; // struct Segment
+
+            void add(std::string_view pattern, bool isExclusion);
+            void enter(State& state, std::uint32_t position) const;
+            void mark(State& state, const Segment& segment) const;
+            bool isMatch(const Segment& segment, std::string_view name) const;
+
+            std::vector<Segment> _segments;
+            State _initial;
+        }; // class PathMatcher
+    } // namespace Scanner
+} // namespace FWMFW
+
+#endif // !defined(DOTSLASHZERO_FWMFW_PATHMATCHER_HXX)
@@ -0,0 +1,132 @@
+#include "PathTable.hxx"
+
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+
+namespace FWMFW
+{
+    namespace Utils
+    {
+        char* StringArena::allocate(std::size_t size)
+        {
+            if (size > _left) {
+                // strings larger than a quarter of a chunk get a chunk of their own, the current one stays open
+                if (size > CHUNK_SIZE / 4) {
+                    _chunks.emplace_back(new char[size]);
+                    _size += size;
+                    return (_chunks.back().get());
+                }
+                _chunks.emplace_back(new char[CHUNK_SIZE]);
+                _size += CHUNK_SIZE;
+                _current = _chunks.back().get();
+                _left = CHUNK_SIZE;
+            }
+
+            char* result = _current;
+            _current += size;
+            _left -= size;
+            return (result);
+        }
+
+        std::string_view StringArena::add(std::string_view str)
+        {
+            if (str.empty()) return (std::string_view());
+            char* result = allocate(str.length());
+            std::memcpy(result, str.data(), str.length());
+            return (std::string_view(result, str.length()));
+        }
+
+        void PathTable::reserve(std::size_t count)
+        {
+            _records.reserve(count);
+            while (_slots.size() < count * 2) grow();
+            return;
+        }
+
+        PathTable::Id PathTable::add(std::string_view path, std::string_view ruleName)
+        {
+            if (_records.size() * 2 >= _slots.size()) grow();
+
+            std::uint64_t hash = getHash(path);
+            Id existing = find(path, hash);
+            if (existing != NO_ID) return (existing);
+
+            if (_records.size() >= NO_ID || path.length() > 0xFFFFFFFFu || ruleName.length() > 0xFFFFFFFFu) {
+                throw (std::length_error("PathTable: too many or too long paths"));
+            }
+
+            std::size_t size = path.length() + ruleName.length();
+            char* stored = (size > 0) ? _arena.allocate(size) : nullptr;
+            if (!path.empty()) std::memcpy(stored, path.data(), path.length());
+            if (!ruleName.empty()) std::memcpy(stored + path.length(), ruleName.data(), ruleName.length());
+
+            Id id = static_cast<Id>(_records.size());
+            _records.push_back(Record{
+                stored, static_cast<std::uint32_t>(path.length()), static_cast<std::uint32_t>(ruleName.length())
+            });
+            insert(hash, id);
+            return (id);
+        }
+
+        PathTable::Id PathTable::find(std::string_view path) const
+        {
+            if (_slots.empty()) return (NO_ID);
+            return (find(path, getHash(path)));
+        }
+
+        PathTable::Id PathTable::find(std::string_view path, std::uint64_t hash) const
+        {
+            std::uint64_t tag = hash & 0xFFFFFFFF00000000ull;
+            for (std::size_t pos = static_cast<std::size_t>(hash) & _mask;; pos = (pos + 1) & _mask) {
+                std::uint64_t slot = _slots[pos];
+                if (slot == 0) return (NO_ID);
+                if ((slot & 0xFFFFFFFF00000000ull) == tag) {
+                    Id id = static_cast<Id>(slot & 0xFFFFFFFFu) - 1;
+                    if (getPath(id) == path) return (id);
+                }
+            }
+        }
+
+        std::string_view PathTable::getRuleName(Id id) const
+        {
+            const Record& record = _records[id];
+            return (std::string_view(record.path + record.pathLength, record.ruleNameLength));
+        }
+
+        std::size_t PathTable::getMemoryUsage(void) const
+        {
+            return (
+                _arena.getMemoryUsage() + _records.capacity() * sizeof(Record) +
+                _slots.capacity() * sizeof(std::uint64_t)
+            );
+        }
+
+        std::uint64_t PathTable::getHash(std::string_view path)
+        {
+            std::uint64_t hash = std::hash<std::string_view>()(path);
+            // the lower bits pick the slot and the upper ones are compared, both have to be mixed well
+            hash ^= hash >> 33;
+            hash *= 0xFF51AFD7ED558CCDull;
+            hash ^= hash >> 33;
+            return (hash);
+        }
+
+        void PathTable::grow(void)
+        {
+            std::size_t capacity = _slots.empty() ? 64 : _slots.size() * 2;
+            _slots.assign(capacity, 0);
+            _mask = capacity - 1;
+            for (Id id = 0; id < static_cast<Id>(_records.size()); id++) insert(getHash(getPath(id)), id);
+            return;
+        }
+
+        void PathTable::insert(std::uint64_t hash, Id id)
+        {
+            std::size_t pos = static_cast<std::size_t>(hash) & _mask;
+            while (_slots[pos] != 0) pos = (pos + 1) & _mask;
+            _slots[pos] = (hash & 0xFFFFFFFF00000000ull) | (static_cast<std::uint64_t>(id) + 1);
+            return;
+        }
+    } // namespace Utils
+} // namespace FWMFW
@@ -0,0 +1,104 @@
+#if !defined(DOTSLASHZERO_FWMFW_PATHTABLE_HXX)
+#define DOTSLASHZERO_FWMFW_PATHTABLE_HXX
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace FWMFW
+{
+    namespace Utils
+    {
+        // bump allocator for strings: they are copied back to back into large chunks and live as long as the arena.
+        // nothing is freed on its own, and a string never moves once it is in.
+        class StringArena
+        {
+        public:
+            StringArena(void) : _chunks(), _current(nullptr), _left(0), _size(0) { return; }
+
+            // room for size bytes
+            char* allocate(std::size_t size);
+            // returns the copy
+            std::string_view add(std::string_view str);
+
+            // bytes allocated for the chunks
+            std::size_t getMemoryUsage(void) const { return (_size); }
+
+            StringArena(StringArena&&) = default;
+            StringArena& operator=(StringArena&&) = default;
+            StringArena(const StringArena&) = delete;
+            StringArena& operator=(const StringArena&) = delete;
+
+        private:
+            static const std::size_t CHUNK_SIZE = 256 * 1024;
+
+            std::vector<std::unique_ptr<char[]>> _chunks;
+            char* _current;
+            std::size_t _left;
+            std::size_t _size;
+        }; // class StringArena
+
+        // a set of paths with a rule name each. the strings are kept in an arena, a rule name right behind its path
+        // (the files to block are added without one, only the rules read from the policy have names). every entry is
+        // a single record, found through a flat open addressing index. the views it hands out stay valid as long as
+        // the table (moving the table does not invalidate them).
+        class PathTable
+        {
+        public:
+            typedef std::uint32_t Id; // the entries are numbered in the order they were added
+            static const Id NO_ID = static_cast<Id>(-1);
+
+            PathTable(void) : _arena(), _records(), _slots(), _mask(0) { return; }
+
+            void reserve(std::size_t count);
+
+            // adds path with its rule name, unless path is in the table already (the first rule name wins). returns
+            // the id of the entry of path.
+            Id add(std::string_view path, std::string_view ruleName);
+
+            // NO_ID if path is not in the table
+            Id find(std::string_view path) const;
+
+            std::size_t size(void) const { return (_records.size()); }
+            bool empty(void) const { return (_records.empty()); }
+
+            std::string_view getPath(Id id) const
+            {
+                return (std::string_view(_records[id].path, _records[id].pathLength));
+            }
+            std::string_view getRuleName(Id id) const;
+
+            // bytes held by the strings, the records and the index
+            std::size_t getMemoryUsage(void) const;
+
+            PathTable(PathTable&&) = default;
+            PathTable& operator=(PathTable&&) = default;
+            PathTable(const PathTable&) = delete;
+            PathTable& operator=(const PathTable&) = delete;
+
+        private:
+            // the rule name starts where the path ends
+            struct Record
+            {
+                const char* path;
+                std::uint32_t pathLength;
+                std::uint32_t ruleNameLength;
+            }; // struct Record
+
+            // a slot is empty (0) or holds the upper half of the path's hash and the id + 1 of its entry
+            static std::uint64_t getHash(std::string_view path);
+            Id find(std::string_view path, std::uint64_t hash) const;
+            void grow(void);
+            void insert(std::uint64_t hash, Id id);
+
+            StringArena _arena;
+            std::vector<Record> _records;
+            std::vector<std::uint64_t> _slots;
+            std::size_t _mask;
+        }; // class PathTable
+    } // namespace Utils
+} // namespace FWMFW
+
+#endif // !defined(DOTSLASHZERO_FWMFW_PATHTABLE_HXX)
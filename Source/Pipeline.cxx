@@ -0,0 +1,196 @@
+#include "Pipeline.hxx"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <thread>
+
+#include "BoundedQueue.hxx"
+#include "PathTable.hxx"
+#include "Reconcile.hxx"
+#include "Stats.hxx"
+
+namespace FWMFW
+{
+    namespace Reconcile
+    {
+        namespace
+        {
+            typedef WinNetFW::RuleChangeResult::Status Status;
+        } // anonymous namespace
+
+        PipelineResult runPipelined(
+            const BlockList& list, const Scanner::ScanOptions& options, const PolicyFactory& createPolicy,
+            const PipelineOptions& pipelineOptions
+        )
+        {
+            Stats::ScopedTimer timer("pipeline");
+            PipelineResult result{ {}, 0, 0 };
+
+            // the enumeration, done when isEnumerated is set. isKept tells which of the existing entries are listed.
+            Utils::PathTable existing;
+            RuleNameIndex existingByName;
+            std::vector<bool> isKept;
+            std::exception_ptr enumerateError;
+            std::atomic<bool> isEnumerated{ false };
+            std::thread enumerator([&] (void) -> void {
+                try {
+                    WinNetFW::ThreadSession session(createPolicy);
+                    session.getPolicy().getBlockRules(existing);
+                    existingByName = RuleNameIndex(existing);
+                    isKept.assign(existing.size(), false);
+                }
+                catch (...) {
+                    enumerateError = std::current_exception();
+                }
+                isEnumerated.store(true, std::memory_order_release);
+                return;
+            });
+
+            // the committer, its results belong to it until it is joined
+            Utils::BoundedQueue<Entry> queue(pipelineOptions.queueCapacity);
+            const std::size_t batchSize = std::max<std::size_t>(pipelineOptions.batchSize, 1);
+            std::vector<WinNetFW::RuleChangeResult> blockResults;
+            std::exception_ptr commitError;
+            bool isFailed = false;
+            std::thread committer([&] (void) -> void {
+                std::unique_ptr<WinNetFW::ThreadSession> session;
+                try {
+                    session.reset(new WinNetFW::ThreadSession(createPolicy));
+                }
+                catch (...) {
+                    commitError = std::current_exception();
+                    isFailed = true;
+                }
+
+                // the queue is drained no matter what, or the scan would wait for room forever
+                std::vector<Entry> batch;
+                batch.reserve(batchSize);
+                for (Entry entry; queue.pop(entry);) {
+                    // whatever came in while the last batch was committed goes in with this one
+                    batch.push_back(entry);
+                    while (batch.size() < batchSize && queue.tryPop(entry)) batch.push_back(entry);
+
+                    if (!isFailed) {
+                        WinNetFW::RuleTransaction transaction;
+                        transaction.reserve(batch.size(), 0);
+                        for (auto&& file : batch) transaction.block(file.appName);
+                        try {
+                            auto results = session->getPolicy().commit(transaction);
+                            for (auto&& change : results) isFailed = isFailed || (change.status != Status::Applied);
+                            blockResults.insert(blockResults.end(), results.begin(), results.end());
+                            result.batchCount++;
+                            batch.clear();
+                        }
+                        catch (...) {
+                            commitError = std::current_exception();
+                            isFailed = true;
+                        }
+                    }
+                    for (auto&& file : batch) {
+                        blockResults.push_back(
+                            WinNetFW::RuleChangeResult{ std::string(file.appName), true, Status::NotAttempted }
+                        );
+                    }
+                    batch.clear();
+                }
+                return;
+            });
+
+            // the scan. the files found before the rules are known wait in pending, the views handed to the
+            // committer point into the arena of desired and stay valid while it grows.
+            Utils::PathTable desired;
+            std::vector<Utils::PathTable::Id> pending;
+            bool isExistingKnown = false;
+            // whether a file is blocked, by the rule name it gets, which does not depend on the case of its path. the
+            // entries of every spelling of the file are marked as kept, removing any of them by name would remove them
+            // all. a file blocked by rules of an earlier naming scheme gets its new rules here, the old ones go with
+            // the stale rules.
+            auto isBlocked = [&] (std::string_view path) -> bool {
+                std::uint64_t pathHash = WinNetFW::getPathHash(path);
+                auto range = existingByName.find(pathHash);
+                bool isFound = false;
+                for (auto itr = range.first; itr != range.second; ++itr) {
+                    if (WinNetFW::isCurrentRuleName(existing.getRuleName(*itr), path, pathHash, {})) {
+                        isKept[*itr] = true;
+                        isFound = true;
+                    }
+                }
+                return (isFound);
+            };
+            auto forward = [&] (Utils::PathTable::Id id) -> void {
+                auto path = desired.getPath(id);
+                if (!isBlocked(path)) queue.push(Entry{ path, desired.getRuleName(id) });
+                return;
+            };
+            auto flushPending = [&] (void) -> void {
+                isExistingKnown = true;
+                if (enumerateError == nullptr) {
+                    for (auto&& id : pending) forward(id);
+                }
+                pending.clear();
+                pending.shrink_to_fit();
+                return;
+            };
+
+            std::exception_ptr scanError;
+            try {
+                list.expand(options, desired, [&] (Utils::PathTable::Id id) -> void {
+                    if (!isExistingKnown) {
+                        if (!isEnumerated.load(std::memory_order_acquire)) {
+                            pending.push_back(id);
+                            return;
+                        }
+                        flushPending();
+                    }
+                    if (enumerateError == nullptr) forward(id);
+                    return;
+                });
+            }
+            catch (...) {
+                scanError = std::current_exception();
+            }
+
+            enumerator.join();
+            if (!isExistingKnown && scanError == nullptr) flushPending();
+            queue.close();
+            committer.join();
+
+            if (scanError != nullptr) std::rethrow_exception(scanError);
+            if (enumerateError != nullptr) std::rethrow_exception(enumerateError);
+            if (commitError != nullptr) std::rethrow_exception(commitError);
+            result.results = std::move(blockResults);
+
+            // the rules of files that are no longer listed (or were renamed), by path like the removes of a plan
+            std::vector<Utils::PathTable::Id> stale;
+            for (Utils::PathTable::Id id = 0; id < static_cast<Utils::PathTable::Id>(existing.size()); id++) {
+                if (!isKept[id]) stale.push_back(id);
+            }
+            result.keptCount = existing.size() - stale.size();
+            std::sort(
+                stale.begin(), stale.end(),
+                [&existing] (Utils::PathTable::Id lhs, Utils::PathTable::Id rhs) -> bool {
+                    return (existing.getPath(lhs) < existing.getPath(rhs));
+                }
+            );
+
+            if (isFailed) {
+                for (auto&& id : stale) {
+                    result.results.push_back(
+                        WinNetFW::RuleChangeResult{ std::string(existing.getPath(id)), false, Status::NotAttempted }
+                    );
+                }
+                return (result);
+            }
+            if (!stale.empty()) {
+                WinNetFW::RuleTransaction transaction;
+                transaction.reserve(0, stale.size());
+                for (auto&& id : stale) transaction.unblock(existing.getPath(id), existing.getRuleName(id));
+                auto results = createPolicy()->commit(transaction);
+                result.results.insert(result.results.end(), results.begin(), results.end());
+            }
+            return (result);
+        }
+    } // namespace Reconcile
+} // namespace FWMFW
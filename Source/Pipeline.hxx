@@ -0,0 +1,44 @@
+#if !defined(DOTSLASHZERO_FWMFW_PIPELINE_HXX)
+#define DOTSLASHZERO_FWMFW_PIPELINE_HXX
+
+#include <cstddef>
+#include <vector>
+
+#include "BlockList.hxx"
+#include "Scanner.hxx"
+#include "WinNetFW.hxx"
+
+namespace FWMFW
+{
+    namespace Reconcile
+    {
+        struct PipelineOptions
+        {
+            std::size_t queueCapacity{ 4096 };  // files on their way from the scan to the committer
+            std::size_t batchSize{ 512 };       // most files committed in one transaction
+        }; // struct PipelineOptions
+
+        struct PipelineResult
+        {
+            // the blocks in the order they were committed, followed by the unblocks
+            std::vector<WinNetFW::RuleChangeResult> results;
+            std::size_t keptCount;  // files that were blocked already
+            std::size_t batchCount; // transactions the blocks were committed in
+        }; // struct PipelineResult
+
+        typedef WinNetFW::PolicyFactory PolicyFactory;
+
+        // reconciles the firewall with the list like createPlan and applyPlan, but without waiting for one phase to
+        // finish before the next starts: the existing rules are enumerated while the list is expanded, and once
+        // they are known every new file without a rule streams through a bounded queue to a committer that blocks
+        // them in batches. the stale rules are removed after the scan. every batch is a transaction of its own, and
+        // once one fails the rest is not attempted (the batches before it stay committed).
+        // the enumeration and the committer run on threads of their own, which initialize WinNetFW themselves.
+        PipelineResult runPipelined(
+            const BlockList& list, const Scanner::ScanOptions& options, const PolicyFactory& createPolicy,
+            const PipelineOptions& pipelineOptions = PipelineOptions()
+        );
+    } // namespace Reconcile
+} // namespace FWMFW
+
+#endif // !defined(DOTSLASHZERO_FWMFW_PIPELINE_HXX)
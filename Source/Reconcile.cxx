@@ -0,0 +1,262 @@
+#include "Reconcile.hxx"
+
+#include <algorithm>
+
+namespace FWMFW
+{
+    namespace Reconcile
+    {
+        namespace
+        {
+            void sortByAppName(std::vector<Utils::PathTable::Id>& ids, const Utils::PathTable& table)
+            {
+                std::sort(
+                    ids.begin(), ids.end(),
+                    [&table] (Utils::PathTable::Id lhs, Utils::PathTable::Id rhs) -> bool {
+                        return (table.getPath(lhs) < table.getPath(rhs));
+                    }
+                );
+                return;
+            }
+
+            void addToTransaction(const Plan& plan, WinNetFW::RuleTransaction& transaction)
+            {
+                for (auto&& entry : plan.getAdds()) transaction.block(entry.appName, plan.getGroup());
+                for (auto&& entry : plan.getRemoves()) transaction.unblock(entry.appName, entry.ruleName);
+                return;
+            }
+
+            WinNetFW::RuleTransaction toTransaction(const Plan& plan)
+            {
+                WinNetFW::RuleTransaction transaction;
+                transaction.reserve(plan.getAdds().size(), plan.getRemoves().size());
+                addToTransaction(plan, transaction);
+                return (transaction);
+            }
+
+            WinNetFW::RuleTransaction toTransaction(const std::vector<Plan>& plans)
+            {
+                std::size_t addCount = 0;
+                std::size_t removeCount = 0;
+                for (auto&& plan : plans) {
+                    addCount += plan.getAdds().size();
+                    removeCount += plan.getRemoves().size();
+                }
+                WinNetFW::RuleTransaction transaction;
+                transaction.reserve(addCount, removeCount);
+                for (auto&& plan : plans) addToTransaction(plan, transaction);
+                return (transaction);
+            }
+
+            // the position of an entry in the merge order: by the hash of its normalized path (see
+            // WinNetFW::getPathHash), so that the spellings of a file end up next to each other. the keys sort as a
+            // compact array, ordering by the paths themselves would chase pointers and compare their long prefixes.
+            struct SortKey
+            {
+                std::uint64_t hash;
+                Utils::PathTable::Id id;
+            }; // struct SortKey
+
+            std::vector<SortKey> getSortedKeys(const Utils::PathTable& table)
+            {
+                std::vector<SortKey> keys;
+                keys.reserve(table.size());
+                for (Utils::PathTable::Id id = 0; id < static_cast<Utils::PathTable::Id>(table.size()); id++) {
+                    keys.push_back(SortKey{ WinNetFW::getPathHash(table.getPath(id)), id });
+                }
+                std::sort(keys.begin(), keys.end(), [] (const SortKey& lhs, const SortKey& rhs) -> bool {
+                    return ((lhs.hash < rhs.hash) || ((lhs.hash == rhs.hash) && (lhs.id < rhs.id)));
+                });
+                return (keys);
+            }
+
+            // the end of the run of keys with the hash of keys[pos]
+            std::size_t getRunEnd(const std::vector<SortKey>& keys, std::size_t pos)
+            {
+                std::size_t end = pos + 1;
+                while ((end < keys.size()) && (keys[end].hash == keys[pos].hash)) end++;
+                return (end);
+            }
+        } // anonymous namespace
+
+        RuleNameIndex::RuleNameIndex(const Utils::PathTable& table) : _hashes(), _ids()
+        {
+            std::vector<SortKey> keys;
+            keys.reserve(table.size());
+            for (Utils::PathTable::Id id = 0; id < static_cast<Utils::PathTable::Id>(table.size()); id++) {
+                std::uint64_t pathHash;
+                if (WinNetFW::getRuleHash(table.getRuleName(id), pathHash)) keys.push_back(SortKey{ pathHash, id });
+            }
+            std::sort(keys.begin(), keys.end(), [] (const SortKey& lhs, const SortKey& rhs) -> bool {
+                return ((lhs.hash < rhs.hash) || ((lhs.hash == rhs.hash) && (lhs.id < rhs.id)));
+            });
+            _hashes.reserve(keys.size());
+            _ids.reserve(keys.size());
+            for (auto&& key : keys) {
+                _hashes.push_back(key.hash);
+                _ids.push_back(key.id);
+            }
+            return;
+        }
+
+        std::pair<RuleNameIndex::Iterator, RuleNameIndex::Iterator> RuleNameIndex::find(std::uint64_t pathHash) const
+        {
+            auto range = std::equal_range(_hashes.begin(), _hashes.end(), pathHash);
+            return (std::make_pair(
+                _ids.begin() + (range.first - _hashes.begin()), _ids.begin() + (range.second - _hashes.begin())
+            ));
+        }
+
+        Plan createPlan(Utils::PathTable&& desired, Utils::PathTable&& existing, const std::string& group)
+        {
+            Plan plan;
+            plan._group = group;
+            plan._desired = std::move(desired);
+            plan._existing = std::move(existing);
+            const auto& desiredTable = plan._desired;
+            const auto& existingTable = plan._existing;
+
+            // the tables hold every path once, so there are no repeated entries to skip. runs of entries with the
+            // same hash are the spellings of one file (or, rarely, paths whose hashes collide).
+            const auto desiredKeys = getSortedKeys(desiredTable);
+            const auto existingKeys = getSortedKeys(existingTable);
+            plan._keeps.reserve(std::min(desiredKeys.size(), existingKeys.size()));
+            std::size_t desiredPos = 0;
+            std::size_t existingPos = 0;
+            while ((desiredPos < desiredKeys.size()) || (existingPos < existingKeys.size())) {
+                if ((existingPos == existingKeys.size()) || ((desiredPos < desiredKeys.size()) &&
+                    (desiredKeys[desiredPos].hash < existingKeys[existingPos].hash))) {
+                    plan._adds.push_back(desiredKeys[desiredPos++].id);
+                    continue;
+                }
+                if ((desiredPos == desiredKeys.size()) ||
+                    (existingKeys[existingPos].hash < desiredKeys[desiredPos].hash)) {
+                    plan._removes.push_back(existingKeys[existingPos++].id);
+                    continue;
+                }
+
+                std::uint64_t hash = desiredKeys[desiredPos].hash;
+                std::size_t desiredEnd = getRunEnd(desiredKeys, desiredPos);
+                std::size_t existingEnd = getRunEnd(existingKeys, existingPos);
+                auto isNamedFor = [&] (std::size_t existingIdx, std::size_t desiredIdx) -> bool {
+                    return (WinNetFW::isCurrentRuleName(
+                        existingTable.getRuleName(existingKeys[existingIdx].id),
+                        desiredTable.getPath(desiredKeys[desiredIdx].id), hash, group
+                    ));
+                };
+                auto isSamePath = [&] (std::size_t existingIdx, std::size_t desiredIdx) -> bool {
+                    return (
+                        existingTable.getPath(existingKeys[existingIdx].id) ==
+                        desiredTable.getPath(desiredKeys[desiredIdx].id)
+                    );
+                };
+
+                // nearly every run is a single file, listed and blocked
+                if ((desiredEnd == desiredPos + 1) && (existingEnd == existingPos + 1)) {
+                    if (isNamedFor(existingPos, desiredPos)) {
+                        plan._keeps.push_back(existingKeys[existingPos].id);
+                    }
+                    else {
+                        plan._adds.push_back(desiredKeys[desiredPos].id);
+                        plan._removes.push_back(existingKeys[existingPos].id);
+                        if (isSamePath(existingPos, desiredPos)) plan._renameCount++;
+                    }
+                    desiredPos = desiredEnd;
+                    existingPos = existingEnd;
+                    continue;
+                }
+
+                // an existing entry is kept if its rule name is the one a desired path gets, which does not depend on
+                // the case of the path: removing it by name would take the rules of every spelling of the file with
+                // it. a desired path is added unless an existing entry is named for it, an entry of the same path
+                // under a name of an earlier naming scheme is renamed (the new rules go in before the old ones are
+                // removed, within the same transaction).
+                for (std::size_t dIdx = desiredPos; dIdx < desiredEnd; dIdx++) {
+                    bool isCovered = false;
+                    bool isRenamed = false;
+                    for (std::size_t eIdx = existingPos; eIdx < existingEnd; eIdx++) {
+                        if (isNamedFor(eIdx, dIdx)) isCovered = true;
+                        else if (isSamePath(eIdx, dIdx)) isRenamed = true;
+                    }
+                    if (isCovered) continue;
+                    plan._adds.push_back(desiredKeys[dIdx].id);
+                    if (isRenamed) plan._renameCount++;
+                }
+                for (std::size_t eIdx = existingPos; eIdx < existingEnd; eIdx++) {
+                    bool isKept = false;
+                    for (std::size_t dIdx = desiredPos; !isKept && (dIdx < desiredEnd); dIdx++) {
+                        isKept = isNamedFor(eIdx, dIdx);
+                    }
+                    if (isKept) plan._keeps.push_back(existingKeys[eIdx].id);
+                    else plan._removes.push_back(existingKeys[eIdx].id);
+                }
+                desiredPos = desiredEnd;
+                existingPos = existingEnd;
+            }
+
+            // the changes are listed by path
+            sortByAppName(plan._adds, desiredTable);
+            sortByAppName(plan._removes, existingTable);
+            return (plan);
+        }
+
+        std::vector<WinNetFW::RuleChangeResult> applyPlan(const Plan& plan, WinNetFW::FireWallPolicy& policy)
+        {
+            return (policy.commit(toTransaction(plan)));
+        }
+
+        std::vector<WinNetFW::RuleChangeResult> applyPlan(
+            const Plan& plan, const WinNetFW::PolicyFactory& createPolicy, const WinNetFW::ShardedCommitOptions& options
+        )
+        {
+            return (WinNetFW::commitSharded(toTransaction(plan), createPolicy, options));
+        }
+
+        std::vector<WinNetFW::RuleChangeResult> applyPlans(
+            const std::vector<Plan>& plans, WinNetFW::FireWallPolicy& policy
+        )
+        {
+            return (policy.commit(toTransaction(plans)));
+        }
+
+        std::vector<WinNetFW::RuleChangeResult> applyPlans(
+            const std::vector<Plan>& plans, const WinNetFW::PolicyFactory& createPolicy,
+            const WinNetFW::ShardedCommitOptions& options
+        )
+        {
+            return (WinNetFW::commitSharded(toTransaction(plans), createPolicy, options));
+        }
+
+        bool getCommittedRules(
+            const Plan& plan, const std::vector<WinNetFW::RuleChangeResult>& results, Utils::PathTable& rules
+        )
+        {
+            typedef WinNetFW::RuleChangeResult::Status Status;
+
+            auto adds = plan.getAdds();
+            auto removes = plan.getRemoves();
+            if (results.size() != adds.size() + removes.size()) return (false);
+            for (auto&& result : results) {
+                if (result.status == Status::RollbackFailed) return (false);
+            }
+
+            rules.reserve(rules.size() + plan.getKeeps().size() + adds.size());
+            for (auto&& entry : plan.getKeeps()) rules.add(entry.appName, entry.ruleName);
+            // the results are in the order of the transaction: the adds first, then the removes. the adds and
+            // removes of a renamed file are applied or undone together, only one of them ends up in rules.
+            for (std::size_t idx = 0; idx < adds.size(); idx++) {
+                if (results[idx].status != Status::Applied) continue;
+                auto entry = adds[idx];
+                rules.add(
+                    entry.appName, WinNetFW::getRuleName(WinNetFW::RuleDirection::Out, entry.appName, plan.getGroup())
+                );
+            }
+            for (std::size_t idx = 0; idx < removes.size(); idx++) {
+                if (results[adds.size() + idx].status == Status::Applied) continue;
+                auto entry = removes[idx];
+                rules.add(entry.appName, entry.ruleName);
+            }
+            return (true);
+        }
+    } // namespace Reconcile
+} // namespace FWMFW
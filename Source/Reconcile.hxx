@@ -0,0 +1,164 @@
+#if !defined(DOTSLASHZERO_FWMFW_RECONCILE_HXX)
+#define DOTSLASHZERO_FWMFW_RECONCILE_HXX
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "PathTable.hxx"
+#include "ShardedCommit.hxx"
+#include "WinNetFW.hxx"
+
+namespace FWMFW
+{
+    namespace Reconcile
+    {
+        // an entry of a plan, the views point into the plan's tables
+        struct Entry
+        {
+            std::string_view appName;
+            std::string_view ruleName;
+        }; // struct Entry
+
+        // a list of entries of one of the plan's tables, valid as long as the plan
+        class EntryList
+        {
+        public:
+            class Iterator
+            {
+            public:
+                typedef std::forward_iterator_tag iterator_category;
+                typedef Entry value_type;
+                typedef std::ptrdiff_t difference_type;
+                typedef const Entry* pointer;
+                typedef Entry reference;
+
+                Iterator(const Utils::PathTable::Id* id, const Utils::PathTable* table) : _id(id), _table(table)
+                { return; }
+
+                Entry operator*(void) const { return (Entry{ _table->getPath(*_id), _table->getRuleName(*_id) }); }
+                Iterator& operator++(void) { _id++; return (*this); }
+                bool operator==(const Iterator& other) const { return (_id == other._id); }
+                bool operator!=(const Iterator& other) const { return (_id != other._id); }
+
+            private:
+                const Utils::PathTable::Id* _id;
+                const Utils::PathTable* _table;
+            }; // class Iterator
+
+            EntryList(const std::vector<Utils::PathTable::Id>& ids, const Utils::PathTable& table) :
+                _ids(&ids), _table(&table)
+            { return; }
+
+            std::size_t size(void) const { return (_ids->size()); }
+            bool empty(void) const { return (_ids->empty()); }
+            Entry operator[](std::size_t idx) const
+            {
+                return (Entry{ _table->getPath((*_ids)[idx]), _table->getRuleName((*_ids)[idx]) });
+            }
+
+            Iterator begin(void) const { return (Iterator(_ids->data(), _table)); }
+            Iterator end(void) const { return (Iterator(_ids->data() + _ids->size(), _table)); }
+
+        private:
+            const std::vector<Utils::PathTable::Id>* _ids;
+            const Utils::PathTable* _table;
+        }; // class EntryList
+
+        // entries of a table of existing rules by the path hash in their OUT rule name (see WinNetFW::getRuleHash). a
+        // rule name only depends on the path as the file system compares it (see WinNetFW::getRuleName), so the rules
+        // of a file are found in whatever case its path was written. a file blocked under several spellings has an
+        // entry of the same name for each. rules of earlier naming schemes have no hash and are left out.
+        class RuleNameIndex
+        {
+        public:
+            typedef std::vector<Utils::PathTable::Id>::const_iterator Iterator;
+
+            RuleNameIndex(void) : _hashes(), _ids() { return; }
+            explicit RuleNameIndex(const Utils::PathTable& table);
+
+            // the ids of the entries whose rule name has pathHash. the names can still differ in the group or the
+            // label, WinNetFW::isCurrentRuleName tells whether one is the name of a file.
+            std::pair<Iterator, Iterator> find(std::uint64_t pathHash) const;
+
+        private:
+            std::vector<std::uint64_t> _hashes; // sorted
+            std::vector<Utils::PathTable::Id> _ids; // the entry of each hash
+        }; // class RuleNameIndex
+
+        // what it takes to get from the rules that exist to the files that should be blocked. a plan does not change
+        // once it is created. it owns the tables it was created from, and lists the entries by their ids in them.
+        // adds and removes are sorted by application name, keeps are in the order they were found in.
+        // a file that stays blocked by rules of an earlier naming scheme (see WinNetFW::isCurrentRuleName) is renamed:
+        // it is an add and a remove at once.
+        class Plan
+        {
+        public:
+            Plan(void) : _group(), _desired(), _existing(), _adds(), _removes(), _keeps(), _renameCount(0) { return; }
+
+            // the group the rules are named for (see WinNetFW::getRuleName)
+            const std::string& getGroup(void) const { return (_group); }
+
+            // ruleName as in the desired table, the rules are named by WinNetFW::getRuleName
+            EntryList getAdds(void) const { return (EntryList(_adds, _desired)); }
+            // ruleName of the existing OUT rule
+            EntryList getRemoves(void) const { return (EntryList(_removes, _existing)); }
+            // ruleName of the existing OUT rule
+            EntryList getKeeps(void) const { return (EntryList(_keeps, _existing)); }
+
+            // the files among the adds (and removes) that are only renamed
+            std::size_t getRenameCount(void) const { return (_renameCount); }
+
+            bool isEmpty(void) const { return (_adds.empty() && _removes.empty()); }
+
+        private:
+            friend Plan createPlan(Utils::PathTable&& desired, Utils::PathTable&& existing, const std::string& group);
+
+            std::string _group;
+            Utils::PathTable _desired;
+            Utils::PathTable _existing;
+            std::vector<Utils::PathTable::Id> _adds;
+            std::vector<Utils::PathTable::Id> _removes;
+            std::vector<Utils::PathTable::Id> _keeps;
+            std::size_t _renameCount;
+        }; // class Plan
+
+        // desired: the files to block, existing: the blocked files as returned by FireWallPolicy::getBlockRules.
+        // both tables are sorted by the hash of the normalized path and merged, a desired path is kept if an existing
+        // entry has the rule name it gets (so that a file whose path changed case keeps its rules). the existing ones
+        // that were not matched are removed.
+        // the rule names of the desired table are not used. the existing rules are expected to be those of the group,
+        // rules named for another group are renamed.
+        Plan createPlan(
+            Utils::PathTable&& desired, Utils::PathTable&& existing, const std::string& group = std::string()
+        );
+
+        // commits the adds and removes of the plan as one transaction
+        std::vector<WinNetFW::RuleChangeResult> applyPlan(const Plan& plan, WinNetFW::FireWallPolicy& policy);
+        // the same, committed by several threads (see WinNetFW::commitSharded)
+        std::vector<WinNetFW::RuleChangeResult> applyPlan(
+            const Plan& plan, const WinNetFW::PolicyFactory& createPolicy, const WinNetFW::ShardedCommitOptions& options
+        );
+        // the plans of several groups as one transaction: the adds of all plans, then their removes
+        std::vector<WinNetFW::RuleChangeResult> applyPlans(
+            const std::vector<Plan>& plans, WinNetFW::FireWallPolicy& policy
+        );
+        std::vector<WinNetFW::RuleChangeResult> applyPlans(
+            const std::vector<Plan>& plans, const WinNetFW::PolicyFactory& createPolicy,
+            const WinNetFW::ShardedCommitOptions& options
+        );
+
+        // the blocked files once the plan was applied with the given results, as getBlockRules would return them:
+        // the kept ones, the adds that were applied and the removes that were not. returns false (and leaves rules
+        // incomplete) if the outcome of a change is unknown, i.e. a roll back failed.
+        bool getCommittedRules(
+            const Plan& plan, const std::vector<WinNetFW::RuleChangeResult>& results, Utils::PathTable& rules
+        );
+    } // namespace Reconcile
+} // namespace FWMFW
+
+#endif // !defined(DOTSLASHZERO_FWMFW_RECONCILE_HXX)
@@ -0,0 +1,318 @@
+#include "RuleGroups.hxx"
+
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <string_view>
+#include <unordered_set>
+
+#include "ListFile.hxx"
+#include "Utils.hxx"
+
+namespace FWMFW
+{
+    namespace Reconcile
+    {
+        namespace
+        {
+            const char* const STATE_HEADER = "FWMFW groups 1";
+            const char* const STATE_RULES = "rules ";
+            const char* const STATE_GROUP = "group ";
+            const char* const STATE_FILE = "file ";
+            const char* const STATE_END = "end";
+            const std::size_t FINGERPRINT_DIGITS = 16;
+
+            // FNV-1a
+            void addToFingerprint(std::uint64_t& fingerprint, std::string_view data)
+            {
+                for (char c : data) {
+                    fingerprint ^= static_cast<unsigned char>(c);
+                    fingerprint *= 1099511628211ULL;
+                }
+                return;
+            }
+
+            // spreads the bits of a path hash, so that the sum of many of them does not cancel out
+            std::uint64_t mix(std::uint64_t value)
+            {
+                value ^= value >> 30;
+                value *= 0xbf58476d1ce4e5b9ULL;
+                value ^= value >> 27;
+                value *= 0x94d049bb133111ebULL;
+                value ^= value >> 31;
+                return (value);
+            }
+
+            std::string formatFingerprint(std::uint64_t fingerprint)
+            {
+                const char* const HEX_DIGITS = "0123456789abcdef";
+                std::string digits(FINGERPRINT_DIGITS, '0');
+                for (std::size_t idx = FINGERPRINT_DIGITS; idx-- > 0; fingerprint >>= 4) {
+                    digits[idx] = HEX_DIGITS[fingerprint & 0xF];
+                }
+                return (digits);
+            }
+
+            bool parseFingerprint(std::string_view text, std::uint64_t& fingerprint)
+            {
+                if (text.length() != FINGERPRINT_DIGITS) return (false);
+                auto result = std::from_chars(text.data(), text.data() + text.length(), fingerprint, 16);
+                return ((result.ec == std::errc()) && (result.ptr == text.data() + text.length()));
+            }
+        } // anonymous namespace
+
+        bool GroupedList::load(const std::string& listFile, const Scanner::Classifier& classifier)
+        {
+            _groups.clear();
+            _isGrouped = false;
+            _error.clear();
+
+            // a group's lines are only compared with those of the last run for the same kind of files
+            std::uint64_t emptyFingerprint = 14695981039346656037ULL;
+            addToFingerprint(emptyFingerprint, classifier.getIndexKey());
+
+            std::unordered_map<std::string, std::size_t> indexes;
+            auto getGroup = [this, &indexes, emptyFingerprint] (const std::string& name) -> ListGroup& {
+                auto inserted = indexes.emplace(name, _groups.size());
+                if (inserted.second) {
+                    _groups.emplace_back();
+                    _groups.back().name = name;
+                    _groups.back().listFingerprint = emptyFingerprint;
+                }
+                return (_groups[inserted.first->second]);
+            };
+            getGroup(std::string());
+
+            bool isRead = readListFile(
+                listFile,
+                [this, &classifier, &getGroup] (const std::string& name, const ListLine& line) -> void {
+                    ListGroup& group = getGroup(name);
+                    if (line.type != ListLine::Type::Entry) {
+                        _isGrouped = true;
+                        return;
+                    }
+                    group.list.addLine(line, classifier);
+                    addToFingerprint(group.listFingerprint, line.isExclusion ? "!" : " ");
+                    addToFingerprint(group.listFingerprint, line.text);
+                    addToFingerprint(group.listFingerprint, "\n");
+                    return;
+                },
+                _error
+            );
+            for (auto&& group : _groups) group.list.finish();
+            if (!isRead) _groups.clear();
+            return (isRead);
+        }
+
+        void GroupedList::expand(const Scanner::ScanOptions& options)
+        {
+            for (auto&& group : _groups) {
+                group.files = Utils::PathTable();
+                group.list.expand(options, group.files);
+
+                // a sum does not depend on the order the scanner found the files in
+                std::uint64_t fingerprint = 0;
+                for (Utils::PathTable::Id id = 0; id < static_cast<Utils::PathTable::Id>(group.files.size()); id++) {
+                    fingerprint += mix(WinNetFW::getPathHash(group.files.getPath(id)));
+                }
+                group.filesFingerprint = fingerprint;
+            }
+            return;
+        }
+
+        bool GroupState::load(const std::string& file)
+        {
+            _groups.clear();
+            _policyRuleCount = 0;
+            _isLoaded = false;
+
+            std::ifstream inFile{ Utils::utf8StrToPath(file), std::ios::binary };
+            std::string line;
+            if (!std::getline(inFile, line) || (line != STATE_HEADER)) return (false);
+            if (!std::getline(inFile, line) || !Utils::stringStartsWith(line, STATE_RULES)) return (false);
+            try {
+                _policyRuleCount = std::stoull(line.substr(std::string_view(STATE_RULES).length()));
+            }
+            catch (std::exception&) {
+                return (false);
+            }
+
+            // a state that was cut short does not have its end line
+            Record* group = nullptr;
+            while (std::getline(inFile, line)) {
+                std::string_view text(line);
+                if (text == STATE_END) {
+                    _isLoaded = true;
+                    return (true);
+                }
+                if (Utils::stringStartsWith(text, STATE_FILE)) {
+                    if (group == nullptr) break;
+                    group->files.emplace_back(text.substr(std::string_view(STATE_FILE).length()));
+                    continue;
+                }
+
+                // "group <list fingerprint> <files fingerprint> <name>"
+                if (!Utils::stringStartsWith(text, STATE_GROUP)) break;
+                text.remove_prefix(std::string_view(STATE_GROUP).length());
+                Record record{ 0, 0, std::vector<std::string>() };
+                const std::size_t NAME_OFFSET = FINGERPRINT_DIGITS * 2 + 2;
+                if ((text.length() < NAME_OFFSET) || (text[FINGERPRINT_DIGITS] != ' ') ||
+                    (text[NAME_OFFSET - 1] != ' ')) {
+                    break;
+                }
+                auto listText = text.substr(0, FINGERPRINT_DIGITS);
+                auto filesText = text.substr(FINGERPRINT_DIGITS + 1, FINGERPRINT_DIGITS);
+                if (!parseFingerprint(listText, record.listFingerprint) ||
+                    !parseFingerprint(filesText, record.filesFingerprint)) {
+                    break;
+                }
+                auto name = text.substr(NAME_OFFSET);
+                if (!name.empty() && !WinNetFW::isValidGroupName(name)) break;
+                group = &(_groups[std::string(name)] = std::move(record));
+            }
+
+            _groups.clear();
+            _policyRuleCount = 0;
+            return (false);
+        }
+
+        bool GroupState::isCurrent(std::uint64_t policyRuleCount) const
+        {
+            return (_isLoaded && (policyRuleCount == _policyRuleCount));
+        }
+
+        bool GroupState::isUnchanged(const ListGroup& group) const
+        {
+            auto itr = _groups.find(group.name);
+            return (
+                (itr != _groups.end()) && (itr->second.listFingerprint == group.listFingerprint) &&
+                (itr->second.filesFingerprint == group.filesFingerprint)
+            );
+        }
+
+        bool GroupState::hasOtherGroups(const std::vector<ListGroup>& groups) const
+        {
+            for (auto&& entry : _groups) {
+                bool isListed = std::any_of(groups.begin(), groups.end(), [&entry] (const ListGroup& group) -> bool {
+                    return (group.name == entry.first);
+                });
+                if (!isListed) return (true);
+            }
+            return (false);
+        }
+
+        void GroupState::getBlockRules(const std::string& group, Utils::PathTable& rules) const
+        {
+            auto itr = _groups.find(group);
+            if (itr == _groups.end()) return;
+            rules.reserve(rules.size() + itr->second.files.size());
+            for (auto&& appName : itr->second.files) {
+                rules.add(appName, WinNetFW::getRuleName(WinNetFW::RuleDirection::Out, appName, group));
+            }
+            return;
+        }
+
+        std::vector<std::string> GroupState::getGroupNames(void) const
+        {
+            std::vector<std::string> names;
+            names.reserve(_groups.size());
+            for (auto&& entry : _groups) names.push_back(entry.first);
+            return (names);
+        }
+
+        void GroupState::update(const std::vector<ListGroup>& groups, const std::vector<Plan>& plans)
+        {
+            std::map<std::string, Record> next;
+            for (auto&& group : groups) {
+                Record& record = next[group.name];
+                record.listFingerprint = group.listFingerprint;
+                record.filesFingerprint = group.filesFingerprint;
+                auto previous = _groups.find(group.name);
+                if (previous != _groups.end()) record.files = std::move(previous->second.files);
+            }
+            for (auto&& plan : plans) {
+                auto itr = next.find(plan.getGroup());
+                if (itr == next.end()) continue;
+                auto& files = itr->second.files;
+                files.clear();
+                files.reserve(plan.getAdds().size() + plan.getKeeps().size());
+                for (auto&& entry : plan.getAdds()) files.emplace_back(entry.appName);
+                for (auto&& entry : plan.getKeeps()) files.emplace_back(entry.appName);
+            }
+            _groups.swap(next);
+            return;
+        }
+
+        bool GroupState::save(const std::string& file, std::uint64_t policyRuleCount) const
+        {
+            std::string tmpFile = file + ".tmp";
+            {
+                std::ofstream outFile{ Utils::utf8StrToPath(tmpFile), std::ios::binary | std::ios::trunc };
+                outFile << STATE_HEADER << "\n" << STATE_RULES << policyRuleCount << "\n";
+                for (auto&& entry : _groups) {
+                    outFile << STATE_GROUP << formatFingerprint(entry.second.listFingerprint) << " " <<
+                        formatFingerprint(entry.second.filesFingerprint) << " " << entry.first << "\n";
+                    for (auto&& appName : entry.second.files) outFile << STATE_FILE << appName << "\n";
+                }
+                outFile << STATE_END << "\n";
+                if (!outFile.good()) return (false);
+            }
+
+            std::error_code errorCode;
+            std::filesystem::rename(Utils::utf8StrToPath(tmpFile), Utils::utf8StrToPath(file), errorCode);
+            return (!errorCode);
+        }
+
+        GroupPlan createGroupPlan(
+            std::vector<ListGroup>& groups, const GroupState& state, const WinNetFW::FireWallPolicy& policy
+        )
+        {
+            GroupPlan result{ std::vector<Plan>(), 0, 0, false };
+
+            bool isTrusted = state.isCurrent(policy.getRuleCount());
+            std::vector<bool> isChanged(groups.size(), true);
+            std::unordered_set<std::string> unchanged;
+            for (std::size_t idx = 0; isTrusted && (idx < groups.size()); idx++) {
+                if (!state.isUnchanged(groups[idx])) continue;
+                isChanged[idx] = false;
+                unchanged.insert(groups[idx].name);
+                result.unchangedCount++;
+            }
+
+            // group name -> its rules: those of the planned groups from the state if it can be trusted, or those of
+            // all groups at once from the policy
+            std::map<std::string, Utils::PathTable> rules;
+            if (isTrusted) {
+                for (auto&& name : state.getGroupNames()) {
+                    if (unchanged.count(name) == 0) state.getBlockRules(name, rules[name]);
+                }
+            }
+            else {
+                for (auto&& rule : policy.enumerateRules(WinNetFW::getBlockRuleQuery())) {
+                    if (rule.applicationName.empty()) continue;
+                    rules[std::string(WinNetFW::getRuleGroup(rule.name))].add(rule.applicationName, rule.name);
+                }
+                result.isEnumerated = true;
+            }
+
+            for (std::size_t idx = 0; idx < groups.size(); idx++) {
+                if (!isChanged[idx]) continue;
+                Utils::PathTable existing;
+                auto itr = rules.find(groups[idx].name);
+                if (itr != rules.end()) {
+                    existing = std::move(itr->second);
+                    rules.erase(itr);
+                }
+                result.plans.push_back(createPlan(std::move(groups[idx].files), std::move(existing), groups[idx].name));
+            }
+
+            // what is left belongs to groups that are no longer listed, in the order of their names
+            for (auto&& entry : rules) {
+                result.plans.push_back(createPlan(Utils::PathTable(), std::move(entry.second), entry.first));
+                result.removedCount++;
+            }
+            return (result);
+        }
+    } // namespace Reconcile
+} // namespace FWMFW
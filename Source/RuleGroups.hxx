@@ -0,0 +1,123 @@
+#if !defined(DOTSLASHZERO_FWMFW_RULEGROUPS_HXX)
+#define DOTSLASHZERO_FWMFW_RULEGROUPS_HXX
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "BlockList.hxx"
+#include "PathTable.hxx"
+#include "Reconcile.hxx"
+#include "Scanner.hxx"
+#include "WinNetFW.hxx"
+
+namespace FWMFW
+{
+    namespace Reconcile
+    {
+        // the lines of a section of the list file, or of an included list file. a group has rules of its own (named
+        // with its name, see WinNetFW::getRuleName) and is reconciled on its own, only if it changed.
+        struct ListGroup
+        {
+            std::string name; // empty for the lines before the first section
+            BlockList list;
+            std::uint64_t listFingerprint{ 0 };     // of its lines and the classifier
+            Utils::PathTable files;                 // once expanded
+            std::uint64_t filesFingerprint{ 0 };    // of the expanded files, in any order
+        }; // struct ListGroup
+
+        // a list file split into its groups. the group with the empty name is always there, with the lines that are
+        // not in a section (if any). a group that has several sections (or is included more than once) gets all of
+        // their lines. exclusions only apply to their own group.
+        class GroupedList
+        {
+        public:
+            GroupedList(void) : _groups(), _isGrouped(false), _error() { return; }
+
+            // returns false, with a message in getError, if the list file could not be read (see readListFile)
+            bool load(const std::string& listFile, const Scanner::Classifier& classifier);
+            const std::string& getError(void) const { return (_error); }
+
+            // whether the list has sections or includes. if not, the empty group has the whole list.
+            bool isGrouped(void) const { return (_isGrouped); }
+
+            std::vector<ListGroup>& getGroups(void) { return (_groups); }
+            const std::vector<ListGroup>& getGroups(void) const { return (_groups); }
+
+            // expands every group into its files, and takes their fingerprints
+            void expand(const Scanner::ScanOptions& options);
+
+        private:
+            std::vector<ListGroup> _groups;
+            bool _isGrouped;
+            std::string _error;
+        }; // class GroupedList
+
+        // the groups as a run committed them: their fingerprints, so that the next run can tell which groups changed,
+        // and their blocked files, so that it does not have to read the rules of the ones that did from the policy.
+        // like the rule journal, the state is trusted as long as the policy has as many rules as that run left it
+        // with. file format, a line per item between a header and an end line: "group <list fingerprint> <files
+        // fingerprint> <name>", followed by "file <path>" for each of its blocked files.
+        class GroupState
+        {
+        public:
+            GroupState(void) : _groups(), _policyRuleCount(0), _isLoaded(false) { return; }
+
+            // returns false (and leaves the state empty) if the file is missing or invalid
+            bool load(const std::string& file);
+
+            bool isLoaded(void) const { return (_isLoaded); }
+            // whether a policy with that many rules is taken to be the one the state was written for
+            bool isCurrent(std::uint64_t policyRuleCount) const;
+
+            // whether the group was committed with the same lines and files
+            bool isUnchanged(const ListGroup& group) const;
+            // whether there are groups in the state that are not in groups
+            bool hasOtherGroups(const std::vector<ListGroup>& groups) const;
+
+            // adds the rules of the group's files to rules, named as WinNetFW::RuleTransaction::block names them
+            void getBlockRules(const std::string& group, Utils::PathTable& rules) const;
+            // the names of the groups in the state
+            std::vector<std::string> getGroupNames(void) const;
+
+            // takes the fingerprints of groups, and the blocked files of the planned ones from their plans (which
+            // must have been applied in full). the groups that are not listed any more are dropped.
+            void update(const std::vector<ListGroup>& groups, const std::vector<Plan>& plans);
+
+            // writes to a temporary file first and then replaces file
+            bool save(const std::string& file, std::uint64_t policyRuleCount) const;
+
+        private:
+            struct Record
+            {
+                std::uint64_t listFingerprint;
+                std::uint64_t filesFingerprint;
+                std::vector<std::string> files;
+            }; // struct Record
+
+            std::map<std::string, Record> _groups; // in the order they are saved in
+            std::uint64_t _policyRuleCount;
+            bool _isLoaded;
+        }; // class GroupState
+
+        // the plans of the groups that changed, and of the groups that are gone
+        struct GroupPlan
+        {
+            std::vector<Plan> plans;
+            std::size_t unchangedCount;     // groups that were skipped
+            std::size_t removedCount;       // groups with rules that are no longer listed
+            bool isEnumerated;              // whether the rules had to be read from the policy
+        }; // struct GroupPlan
+
+        // compares the expanded groups with the state, and plans the groups that changed against their rules. the
+        // rules come from the state if it is current. otherwise every group is planned, against the rules read from
+        // the policy in one enumeration. the files of the planned groups are moved into the plans.
+        GroupPlan createGroupPlan(
+            std::vector<ListGroup>& groups, const GroupState& state, const WinNetFW::FireWallPolicy& policy
+        );
+    } // namespace Reconcile
+} // namespace FWMFW
+
+#endif // !defined(DOTSLASHZERO_FWMFW_RULEGROUPS_HXX)
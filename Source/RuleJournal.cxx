@@ -0,0 +1,231 @@
+#include "RuleJournal.hxx"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "Utils.hxx"
+
+namespace FWMFW
+{
+    namespace Reconcile
+    {
+        namespace
+        {
+            const char JOURNAL_MAGIC[8] = { 'F', 'W', 'M', 'F', 'W', 'J', 'N', 'L' };
+            const std::uint32_t JOURNAL_VERSION = 1;
+
+            struct FileHeader
+            {
+                char magic[8];
+                std::uint32_t version;
+                std::uint32_t entryCount;
+                std::uint64_t policyRuleCount;
+                std::uint64_t stringPoolSize;
+                std::uint64_t checksum; // of everything after the header
+            }; // struct FileHeader
+
+            struct JournalEntry
+            {
+                std::uint32_t pathOffset;
+                std::uint32_t pathLength;
+                std::uint32_t ruleNameOffset;
+                std::uint32_t ruleNameLength;
+            }; // struct JournalEntry
+
+            static_assert(sizeof(FileHeader) == 40, "unexpected padding in the journal header");
+            static_assert(sizeof(JournalEntry) == 16, "unexpected padding in the journal entry");
+
+            // FNV-1a, over several pieces
+            class Checksum
+            {
+            public:
+                Checksum(void) : _value(14695981039346656037ULL) { return; }
+
+                void add(const void* data, std::size_t size)
+                {
+                    const auto* bytes = static_cast<const unsigned char*>(data);
+                    for (std::size_t idx = 0; idx < size; idx++) {
+                        _value ^= bytes[idx];
+                        _value *= 1099511628211ULL;
+                    }
+                    return;
+                }
+
+                std::uint64_t getValue(void) const { return (_value); }
+
+            private:
+                std::uint64_t _value;
+            }; // class Checksum
+
+            const JournalEntry& getEntry(const void* entries, std::size_t idx)
+            {
+                return (static_cast<const JournalEntry*>(entries)[idx]);
+            }
+        } // anonymous namespace
+
+        RuleJournal::RuleJournal(void) :
+            _file(), _entries(nullptr), _strings(nullptr), _entryCount(0), _policyRuleCount(0), _isLoaded(false)
+        { return; }
+
+        bool RuleJournal::load(const std::string& file)
+        {
+            close();
+            if (!_file.open(file)) return (false);
+
+            const char* data = _file.getData();
+            std::size_t size = _file.getSize();
+            if (size < sizeof(FileHeader)) {
+                close();
+                return (false);
+            }
+
+            FileHeader header;
+            std::memcpy(&header, data, sizeof(header));
+            if (std::memcmp(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 ||
+                header.version != JOURNAL_VERSION) {
+                close();
+                return (false);
+            }
+
+            std::uint64_t expectedSize = sizeof(FileHeader) +
+                std::uint64_t{ header.entryCount } * sizeof(JournalEntry) + header.stringPoolSize;
+            if (expectedSize != size) {
+                close();
+                return (false);
+            }
+
+            // a journal that was cut short or changed must not be mistaken for the rules
+            Checksum checksum;
+            checksum.add(data + sizeof(FileHeader), size - sizeof(FileHeader));
+            if (checksum.getValue() != header.checksum) {
+                close();
+                return (false);
+            }
+
+            _entries = data + sizeof(FileHeader);
+            _strings = data + sizeof(FileHeader) + std::size_t{ header.entryCount } * sizeof(JournalEntry);
+            _entryCount = header.entryCount;
+            _policyRuleCount = header.policyRuleCount;
+
+            // validate every reference once so that lookups do not need to
+            for (std::size_t idx = 0; idx < _entryCount; idx++) {
+                const JournalEntry& entry = getEntry(_entries, idx);
+                if ((std::uint64_t{ entry.pathOffset } + entry.pathLength > header.stringPoolSize) ||
+                    (std::uint64_t{ entry.ruleNameOffset } + entry.ruleNameLength > header.stringPoolSize)) {
+                    close();
+                    return (false);
+                }
+            }
+
+            _isLoaded = true;
+            return (true);
+        }
+
+        void RuleJournal::close(void)
+        {
+            _file.close();
+            _entries = nullptr;
+            _strings = nullptr;
+            _entryCount = 0;
+            _policyRuleCount = 0;
+            _isLoaded = false;
+            return;
+        }
+
+        bool RuleJournal::isCurrent(std::uint64_t policyRuleCount) const
+        {
+            return (_isLoaded && (policyRuleCount == _policyRuleCount));
+        }
+
+        std::string_view RuleJournal::getPath(std::size_t idx) const
+        {
+            const JournalEntry& entry = getEntry(_entries, idx);
+            return (std::string_view(_strings + entry.pathOffset, entry.pathLength));
+        }
+
+        std::string_view RuleJournal::getRuleName(std::size_t idx) const
+        {
+            const JournalEntry& entry = getEntry(_entries, idx);
+            return (std::string_view(_strings + entry.ruleNameOffset, entry.ruleNameLength));
+        }
+
+        void RuleJournal::getBlockRules(Utils::PathTable& rules) const
+        {
+            rules.reserve(rules.size() + _entryCount);
+            for (std::size_t idx = 0; idx < _entryCount; idx++) rules.add(getPath(idx), getRuleName(idx));
+            return;
+        }
+
+        bool RuleJournal::isEqual(const Utils::PathTable& rules) const
+        {
+            // the journal holds every path once, like the table
+            if (rules.size() != _entryCount) return (false);
+            for (std::size_t idx = 0; idx < _entryCount; idx++) {
+                auto id = rules.find(getPath(idx));
+                if ((id == Utils::PathTable::NO_ID) || (rules.getRuleName(id) != getRuleName(idx))) return (false);
+            }
+            return (true);
+        }
+
+        bool RuleJournal::save(const std::string& file, const Utils::PathTable& rules, std::uint64_t policyRuleCount)
+        {
+            std::vector<Utils::PathTable::Id> sorted;
+            sorted.reserve(rules.size());
+            for (Utils::PathTable::Id id = 0; id < rules.size(); id++) sorted.push_back(id);
+            std::sort(
+                sorted.begin(), sorted.end(),
+                [&rules] (Utils::PathTable::Id lhs, Utils::PathTable::Id rhs) -> bool {
+                    return (rules.getPath(lhs) < rules.getPath(rhs));
+                }
+            );
+
+            std::vector<JournalEntry> entries;
+            std::string strings;
+            entries.reserve(sorted.size());
+            for (auto&& id : sorted) {
+                auto path = rules.getPath(id);
+                auto ruleName = rules.getRuleName(id);
+                JournalEntry entry;
+                entry.pathOffset = static_cast<std::uint32_t>(strings.length());
+                entry.pathLength = static_cast<std::uint32_t>(path.length());
+                strings.append(path);
+                entry.ruleNameOffset = static_cast<std::uint32_t>(strings.length());
+                entry.ruleNameLength = static_cast<std::uint32_t>(ruleName.length());
+                strings.append(ruleName);
+                entries.push_back(entry);
+                if (strings.length() > UINT32_MAX) return (false);
+            }
+
+            Checksum checksum;
+            checksum.add(entries.data(), entries.size() * sizeof(JournalEntry));
+            checksum.add(strings.data(), strings.length());
+
+            FileHeader header;
+            std::memcpy(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+            header.version = JOURNAL_VERSION;
+            header.entryCount = static_cast<std::uint32_t>(entries.size());
+            header.policyRuleCount = policyRuleCount;
+            header.stringPoolSize = strings.length();
+            header.checksum = checksum.getValue();
+
+            std::string tmpFile = file + ".tmp";
+            {
+                std::ofstream outFile{ Utils::utf8StrToPath(tmpFile), std::ios::binary | std::ios::trunc };
+                outFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+                outFile.write(
+                    reinterpret_cast<const char*>(entries.data()),
+                    static_cast<std::streamsize>(entries.size() * sizeof(JournalEntry))
+                );
+                outFile.write(strings.data(), static_cast<std::streamsize>(strings.length()));
+                if (!outFile.good()) return (false);
+            }
+
+            std::error_code errorCode;
+            std::filesystem::rename(Utils::utf8StrToPath(tmpFile), Utils::utf8StrToPath(file), errorCode);
+            return (!errorCode);
+        }
+    } // namespace Reconcile
+} // namespace FWMFW
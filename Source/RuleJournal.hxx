@@ -0,0 +1,65 @@
+#if !defined(DOTSLASHZERO_FWMFW_RULEJOURNAL_HXX)
+#define DOTSLASHZERO_FWMFW_RULEJOURNAL_HXX
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "MappedFile.hxx"
+#include "PathTable.hxx"
+
+namespace FWMFW
+{
+    namespace Reconcile
+    {
+        // the block rules as the previous run left them, so that a run does not have to enumerate the whole firewall
+        // policy to find its own rules. the journal is read in place from a memory mapped file.
+        // the policy is trusted to be unchanged as long as it has as many rules as right after that run's commit. a
+        // change by someone else that keeps the number of rules goes unnoticed, FWMFW --verify enumerates anyway.
+        // file layout (native endianness, all offsets relative to the string pool):
+        //     header | entries (sorted by path) | string pool
+        class RuleJournal
+        {
+        public:
+            RuleJournal(void);
+
+            // returns false (and leaves the journal empty) if the file is missing, invalid or its checksum does not
+            // match its contents
+            bool load(const std::string& file);
+            void close(void);
+
+            bool isLoaded(void) const { return (_isLoaded); }
+            // the number of rules of the whole policy right after the journal was written
+            std::uint64_t getPolicyRuleCount(void) const { return (_policyRuleCount); }
+            // whether a policy with that many rules is taken to be the one the journal was written for
+            bool isCurrent(std::uint64_t policyRuleCount) const;
+
+            std::size_t size(void) const { return (_entryCount); }
+            std::string_view getPath(std::size_t idx) const;
+            std::string_view getRuleName(std::size_t idx) const;
+
+            // adds the recorded rules to rules, as FireWallPolicy::getBlockRules does
+            void getBlockRules(Utils::PathTable& rules) const;
+            // whether rules holds exactly the recorded rules
+            bool isEqual(const Utils::PathTable& rules) const;
+
+            // writes rules (as returned by getBlockRules) to a temporary file first and then replaces file. on
+            // Windows, a journal that is still loaded from the same file must be closed before saving.
+            static bool save(const std::string& file, const Utils::PathTable& rules, std::uint64_t policyRuleCount);
+
+            RuleJournal(const RuleJournal&) = delete;
+            RuleJournal& operator=(const RuleJournal&) = delete;
+
+        private:
+            Utils::MappedFile _file;
+            const void* _entries;
+            const char* _strings;
+            std::size_t _entryCount;
+            std::uint64_t _policyRuleCount;
+            bool _isLoaded;
+        }; // class RuleJournal
+    } // namespace Reconcile
+} // namespace FWMFW
+
+#endif // !defined(DOTSLASHZERO_FWMFW_RULEJOURNAL_HXX)
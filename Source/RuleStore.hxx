@@ -0,0 +1,156 @@
+#if !defined(DOTSLASHZERO_FWMFW_RULESTORE_HXX)
+#define DOTSLASHZERO_FWMFW_RULESTORE_HXX
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace FWMFW
+{
+    namespace WinNetFW
+    {
+        enum class RuleDirection
+        {
+            In,
+            Out
+        }; // enum class RuleDirection
+
+        enum class RuleAction
+        {
+            Block,
+            Allow
+        }; // enum class RuleAction
+
+        // a firewall rule, all strings are UTF-8
+        struct Rule
+        {
+            std::string name;
+            std::string applicationName;
+            std::string description;
+            RuleDirection direction;
+            RuleAction action;
+            bool enabled;
+        }; // struct Rule
+
+        // a rule as it is enumerated: everything but the description
+        struct RuleRecord
+        {
+            std::string name;
+            std::string applicationName;
+            RuleDirection direction;
+            RuleAction action;
+            bool enabled;
+        }; // struct RuleRecord
+
+        // the conditions are checked by the store in the order of their cost, each one before what the next one
+        // needs is fetched or converted. a rule that fails one is not looked at any further.
+        struct RuleQuery
+        {
+            typedef std::function<bool(const std::string&)> FilterFunction;
+
+            // only rules whose name starts with the prefix are visited. checked before anything else of a rule is
+            // read or converted.
+            std::string namePrefix;
+            // only rules with these properties (any, if not set)
+            std::optional<RuleDirection> direction;
+            std::optional<RuleAction> action;
+            std::optional<bool> enabled;
+            // checked on the converted UTF-8 strings, last
+            FilterFunction nameFilter;
+            FilterFunction applicationNameFilter;
+            // number of rules fetched from the enumerator at once
+            std::size_t batchSize{ 256 };
+        }; // struct RuleQuery
+
+        // the rules of one step of an enumeration. clearing it keeps the records, so that their strings keep their
+        // buffers for the next step.
+        class RuleBatch
+        {
+        public:
+            typedef std::vector<RuleRecord>::const_iterator const_iterator;
+
+            RuleBatch(void) : _records(), _size(0) { return; }
+
+            std::size_t size(void) const { return (_size); }
+            bool empty(void) const { return (_size == 0); }
+            const RuleRecord& operator[](std::size_t idx) const { return (_records[idx]); }
+            const_iterator begin(void) const { return (_records.begin()); }
+            const_iterator end(void) const { return (_records.begin() + static_cast<std::ptrdiff_t>(_size)); }
+
+            void clear(void) { _size = 0; return; }
+            // the next record, to be filled in (it still holds whatever it held before)
+            RuleRecord& add(void)
+            {
+                if (_size == _records.size()) _records.emplace_back();
+                return (_records[_size++]);
+            }
+            // takes back the record add returned last, for a rule that turned out not to match
+            void removeLast(void) { _size--; return; }
+
+        private:
+            std::vector<RuleRecord> _records;
+            std::size_t _size;
+        }; // class RuleBatch
+
+        // an enumeration of the rules that match a query, opened by RuleStore::openRules. nothing is fetched before
+        // the first call to next, and nothing after the caller stops calling it. the store must outlive the cursor,
+        // and may be called (and changed) in between two steps.
+        class RuleCursor
+        {
+        public:
+            virtual ~RuleCursor(void) { return; }
+
+            // replaces the contents of batch by the next matching rules, fetching as many batches of the query's
+            // size from the enumerator as it takes to find one. returns false (with an empty batch) once there are
+            // no more rules.
+            virtual bool next(RuleBatch& batch) = 0;
+        }; // class RuleCursor
+
+        // backend interface of FireWallPolicy: the collection of rules of a firewall policy (i.e. INetFwRules).
+        // like the Windows firewall, rule names do not have to be unique.
+        class RuleStore
+        {
+        public:
+            virtual ~RuleStore(void) { return; }
+
+            typedef std::function<void(const std::string& name, const std::string& applicationName)> RuleVisitor;
+
+            virtual std::size_t getRuleCount(void) const = 0;
+
+            // starts an enumeration of the rules of the policy that match the query
+            virtual std::unique_ptr<RuleCursor> openRules(const RuleQuery& query) const = 0;
+
+            // visits every rule of the policy that matches the query
+            void enumerateRules(const RuleQuery& query, const RuleVisitor& visitor) const
+            {
+                auto cursor = openRules(query);
+                RuleBatch batch;
+                while (cursor->next(batch)) {
+                    for (auto&& rule : batch) visitor(rule.name, rule.applicationName);
+                }
+                return;
+            }
+
+            // whether a rule with the given name exists, looked up by name (i.e. INetFwRules::Item)
+            virtual bool hasRule(const std::string& name) const = 0;
+
+            virtual bool addRule(const Rule& rule) = 0;
+
+            // removes the rules with the given name
+            virtual bool removeRule(const std::string& name) = 0;
+
+            // adds the rules in order and stops at the first one that fails. returns the number of rules added.
+            // everything that can be done up front (creating and filling in the rule objects) is done before the
+            // first rule is added, so a failure while preparing leaves the store untouched.
+            virtual std::size_t addRules(const std::vector<Rule>& rules) = 0;
+
+            // removes the rules in order and stops at the first one that fails. returns the number of rules removed.
+            virtual std::size_t removeRules(const std::vector<std::string>& names) = 0;
+        }; // class RuleStore
+    } // namespace WinNetFW
+} // namespace FWMFW
+
+#endif // !defined(DOTSLASHZERO_FWMFW_RULESTORE_HXX)
@@ -0,0 +1,284 @@
+#include "ScanIndex.hxx"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "Utils.hxx"
+
+namespace FWMFW
+{
+    namespace Scanner
+    {
+        namespace
+        {
+            const char INDEX_MAGIC[8] = { 'F', 'W', 'M', 'F', 'W', 'I', 'D', 'X' };
+            const std::uint32_t INDEX_VERSION = 1;
+
+            struct FileHeader
+            {
+                char magic[8];
+                std::uint32_t version;
+                std::uint32_t directoryCount;
+                std::uint32_t nameCount;
+                std::uint32_t fileFilterLength;
+                std::uint64_t stringPoolSize;
+            }; // struct FileHeader
+
+            struct DirectoryEntry
+            {
+                std::int64_t modificationTime;
+                std::uint32_t pathOffset;
+                std::uint32_t pathLength;
+                // subdirectories come first, followed by the files
+                std::uint32_t firstName;
+                std::uint32_t subdirectoryCount;
+                std::uint32_t fileCount;
+                std::uint32_t reserved;
+            }; // struct DirectoryEntry
+
+            struct NameEntry
+            {
+                std::uint32_t offset;
+                std::uint32_t length;
+            }; // struct NameEntry
+
+            static_assert(sizeof(FileHeader) == 32, "unexpected padding in the index header");
+            static_assert(sizeof(DirectoryEntry) == 32, "unexpected padding in the index directory entry");
+
+            const DirectoryEntry* asEntry(const void* entry) { return (static_cast<const DirectoryEntry*>(entry)); }
+        } // anonymous namespace
+
+        std::int64_t ScanIndex::Directory::getModificationTime(void) const
+        {
+            return (asEntry(_entry)->modificationTime);
+        }
+
+        std::size_t ScanIndex::Directory::getSubdirectoryCount(void) const
+        {
+            return (asEntry(_entry)->subdirectoryCount);
+        }
+
+        std::string_view ScanIndex::Directory::getSubdirectory(std::size_t idx) const
+        {
+            return (_index->getName(asEntry(_entry)->firstName + idx));
+        }
+
+        std::size_t ScanIndex::Directory::getFileCount(void) const
+        {
+            return (asEntry(_entry)->fileCount);
+        }
+
+        std::string_view ScanIndex::Directory::getFile(std::size_t idx) const
+        {
+            return (_index->getName(asEntry(_entry)->firstName + asEntry(_entry)->subdirectoryCount + idx));
+        }
+
+        ScanIndex::ScanIndex(void) :
+            _file(), _directories(nullptr), _names(nullptr), _strings(nullptr), _directoryCount(0), _nameCount(0)
+        { return; }
+
+        bool ScanIndex::load(const std::string& file, const std::string& fileFilter)
+        {
+            close();
+            if (!_file.open(file)) return (false);
+
+            const char* data = _file.getData();
+            std::size_t size = _file.getSize();
+            if (size < sizeof(FileHeader)) {
+                close();
+                return (false);
+            }
+
+            FileHeader header;
+            std::memcpy(&header, data, sizeof(header));
+            if (std::memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 || header.version != INDEX_VERSION) {
+                close();
+                return (false);
+            }
+
+            std::uint64_t expectedSize = sizeof(FileHeader) +
+                std::uint64_t{ header.directoryCount } * sizeof(DirectoryEntry) +
+                std::uint64_t{ header.nameCount } * sizeof(NameEntry) +
+                header.fileFilterLength + header.stringPoolSize;
+            if (expectedSize != size) {
+                close();
+                return (false);
+            }
+
+            const char* directories = data + sizeof(FileHeader);
+            const char* names = directories + std::size_t{ header.directoryCount } * sizeof(DirectoryEntry);
+            const char* storedFileFilter = names + std::size_t{ header.nameCount } * sizeof(NameEntry);
+            if (std::string_view(storedFileFilter, header.fileFilterLength) != fileFilter) {
+                close();
+                return (false);
+            }
+
+            _directories = directories;
+            _names = names;
+            _strings = storedFileFilter + header.fileFilterLength;
+            _directoryCount = header.directoryCount;
+            _nameCount = header.nameCount;
+
+            // validate every reference once so that lookups do not need to
+            for (std::size_t idx = 0; idx < _nameCount; idx++) {
+                const NameEntry& name = static_cast<const NameEntry*>(_names)[idx];
+                if (std::uint64_t{ name.offset } + name.length > header.stringPoolSize) {
+                    close();
+                    return (false);
+                }
+            }
+            for (std::size_t idx = 0; idx < _directoryCount; idx++) {
+                const DirectoryEntry& entry = static_cast<const DirectoryEntry*>(_directories)[idx];
+                if ((std::uint64_t{ entry.pathOffset } + entry.pathLength > header.stringPoolSize) ||
+                    (std::uint64_t{ entry.firstName } + entry.subdirectoryCount + entry.fileCount > _nameCount)) {
+                    close();
+                    return (false);
+                }
+            }
+
+            return (true);
+        }
+
+        void ScanIndex::close(void)
+        {
+            _file.close();
+            _directories = nullptr;
+            _names = nullptr;
+            _strings = nullptr;
+            _directoryCount = 0;
+            _nameCount = 0;
+            return;
+        }
+
+        bool ScanIndex::find(std::string_view dir, Directory& directory) const
+        {
+            const DirectoryEntry* begin = static_cast<const DirectoryEntry*>(_directories);
+            const DirectoryEntry* end = begin + _directoryCount;
+            const DirectoryEntry* itr = std::lower_bound(
+                begin, end, dir,
+                [this] (const DirectoryEntry& entry, std::string_view value) -> bool {
+                    return (getString(entry.pathOffset, entry.pathLength) < value);
+                }
+            );
+            if (itr == end || getString(itr->pathOffset, itr->pathLength) != dir) return (false);
+
+            directory._index = this;
+            directory._entry = itr;
+            return (true);
+        }
+
+        std::string_view ScanIndex::getString(std::uint32_t offset, std::uint32_t length) const
+        {
+            return (std::string_view(_strings + offset, length));
+        }
+
+        std::string_view ScanIndex::getName(std::size_t idx) const
+        {
+            const NameEntry& name = static_cast<const NameEntry*>(_names)[idx];
+            return (getString(name.offset, name.length));
+        }
+
+        ScanIndexBuilder::ScanIndexBuilder(const std::string& fileFilter) : _fileFilter(fileFilter), _mutex(), _records()
+        { return; }
+
+        void ScanIndexBuilder::add(
+            const std::string& dir,
+            std::int64_t modificationTime,
+            std::vector<std::string>&& subdirectories,
+            std::vector<std::string>&& files
+        )
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _records.push_back(Record{ dir, modificationTime, std::move(subdirectories), std::move(files) });
+            return;
+        }
+
+        std::size_t ScanIndexBuilder::getDirectoryCount(void) const
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return (_records.size());
+        }
+
+        bool ScanIndexBuilder::save(const std::string& file) const
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            std::vector<const Record*> sorted;
+            sorted.reserve(_records.size());
+            for (auto&& record : _records) sorted.push_back(&record);
+            std::sort(sorted.begin(), sorted.end(), [] (const Record* lhs, const Record* rhs) -> bool {
+                return (lhs->dir < rhs->dir);
+            });
+            // a directory can be reported twice if it was reachable from two roots
+            sorted.erase(
+                std::unique(sorted.begin(), sorted.end(), [] (const Record* lhs, const Record* rhs) -> bool {
+                    return (lhs->dir == rhs->dir);
+                }),
+                sorted.end()
+            );
+
+            std::vector<DirectoryEntry> directories;
+            std::vector<NameEntry> names;
+            std::string strings;
+            directories.reserve(sorted.size());
+
+            auto addString = [&strings] (const std::string& str) -> std::uint32_t {
+                auto offset = static_cast<std::uint32_t>(strings.length());
+                strings.append(str);
+                return (offset);
+            };
+
+            for (auto&& record : sorted) {
+                DirectoryEntry entry;
+                entry.modificationTime = record->modificationTime;
+                entry.pathOffset = addString(record->dir);
+                entry.pathLength = static_cast<std::uint32_t>(record->dir.length());
+                entry.firstName = static_cast<std::uint32_t>(names.size());
+                entry.subdirectoryCount = static_cast<std::uint32_t>(record->subdirectories.size());
+                entry.fileCount = static_cast<std::uint32_t>(record->files.size());
+                entry.reserved = 0;
+                directories.push_back(entry);
+
+                for (auto&& subdir : record->subdirectories) {
+                    names.push_back(NameEntry{ addString(subdir), static_cast<std::uint32_t>(subdir.length()) });
+                }
+                for (auto&& name : record->files) {
+                    names.push_back(NameEntry{ addString(name), static_cast<std::uint32_t>(name.length()) });
+                }
+            }
+
+            if (strings.length() > UINT32_MAX) return (false);
+
+            FileHeader header;
+            std::memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+            header.version = INDEX_VERSION;
+            header.directoryCount = static_cast<std::uint32_t>(directories.size());
+            header.nameCount = static_cast<std::uint32_t>(names.size());
+            header.fileFilterLength = static_cast<std::uint32_t>(_fileFilter.length());
+            header.stringPoolSize = strings.length();
+
+            std::string tmpFile = file + ".tmp";
+            {
+                std::ofstream outFile{ Utils::utf8StrToPath(tmpFile), std::ios::binary | std::ios::trunc };
+                outFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+                outFile.write(
+                    reinterpret_cast<const char*>(directories.data()),
+                    static_cast<std::streamsize>(directories.size() * sizeof(DirectoryEntry))
+                );
+                outFile.write(
+                    reinterpret_cast<const char*>(names.data()),
+                    static_cast<std::streamsize>(names.size() * sizeof(NameEntry))
+                );
+                outFile.write(_fileFilter.data(), static_cast<std::streamsize>(_fileFilter.length()));
+                outFile.write(strings.data(), static_cast<std::streamsize>(strings.length()));
+                if (!outFile.good()) return (false);
+            }
+
+            std::error_code errorCode;
+            std::filesystem::rename(Utils::utf8StrToPath(tmpFile), Utils::utf8StrToPath(file), errorCode);
+            return (!errorCode);
+        }
+    } // namespace Scanner
+} // namespace FWMFW
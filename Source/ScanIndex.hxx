@@ -0,0 +1,108 @@
+#if !defined(DOTSLASHZERO_FWMFW_SCANINDEX_HXX)
+#define DOTSLASHZERO_FWMFW_SCANINDEX_HXX
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "MappedFile.hxx"
+
+namespace FWMFW
+{
+    namespace Scanner
+    {
+        // the results of a previous scan, keyed by directory path. the index is read in place from a memory mapped
+        // file, nothing is parsed or copied at load time.
+        // file layout (native endianness, all offsets relative to the string pool):
+        //     header | directory entries (sorted by path) | name entries | file filter | string pool
+        class ScanIndex
+        {
+        public:
+            // a directory as it was when the index was created. only valid while the index is loaded.
+            class Directory
+            {
+            public:
+                Directory(void) : _index(nullptr), _entry(nullptr) { return; }
+
+                std::int64_t getModificationTime(void) const;
+
+                std::size_t getSubdirectoryCount(void) const;
+                std::string_view getSubdirectory(std::size_t idx) const;
+
+                // only the files that the file filter selected
+                std::size_t getFileCount(void) const;
+                std::string_view getFile(std::size_t idx) const;
+
+            private:
+                friend class ScanIndex;
+                const ScanIndex* _index;
+                const void* _entry;
+            }; // class Directory
+
+            ScanIndex(void);
+
+            // returns false (and leaves the index empty) if the file is missing, invalid or was created for a
+            // different file filter (Classifier::getIndexKey)
+            bool load(const std::string& file, const std::string& fileFilter);
+            void close(void);
+
+            bool isLoaded(void) const { return (_directoryCount > 0); }
+            std::size_t getDirectoryCount(void) const { return (_directoryCount); }
+
+            bool find(std::string_view dir, Directory& directory) const;
+
+            ScanIndex(const ScanIndex&) = delete;
+            ScanIndex& operator=(const ScanIndex&) = delete;
+
+        private:
+            std::string_view getString(std::uint32_t offset, std::uint32_t length) const;
+            std::string_view getName(std::size_t idx) const;
+
+            Utils::MappedFile _file;
+            const void* _directories;
+            const void* _names;
+            const char* _strings;
+            std::size_t _directoryCount;
+            std::size_t _nameCount;
+        }; // class ScanIndex
+
+        // collects the directories of a running scan (from any number of walkers) and writes them as a new index
+        class ScanIndexBuilder
+        {
+        public:
+            ScanIndexBuilder(const std::string& fileFilter);
+
+            // thread safe
+            void add(
+                const std::string& dir,
+                std::int64_t modificationTime,
+                std::vector<std::string>&& subdirectories,
+                std::vector<std::string>&& files
+            );
+
+            std::size_t getDirectoryCount(void) const;
+
+            // writes to a temporary file first and then replaces file. on Windows, an index that is still loaded
+            // from the same file must be closed before saving.
+            bool save(const std::string& file) const;
+
+        private:
+            struct Record
+            {
+                std::string dir;
+                std::int64_t modificationTime;
+                std::vector<std::string> subdirectories;
+                std::vector<std::string> files;
+            }; // struct Record
+
+            std::string _fileFilter;
+            mutable std::mutex _mutex;
+            std::vector<Record> _records;
+        }; // class ScanIndexBuilder
+    } // namespace Scanner
+} // namespace FWMFW
+
+#endif // !defined(DOTSLASHZERO_FWMFW_SCANINDEX_HXX)
@@ -0,0 +1,661 @@
+#include "Scanner.hxx"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_set>
+
+#include "BoundedQueue.hxx"
+#include "ScanIndex.hxx"
+#include "Stats.hxx"
+#include "Utils.hxx"
+
+namespace FWMFW
+{
+    namespace Scanner
+    {
+        namespace
+        {
+            // number of matches a walker buffers before handing them over to the sink
+            const std::size_t SINK_BATCH_SIZE = 256;
+
+            // directories modified less than this long before the scan started are not written to the index: a
+            // change made within the same time stamp tick right after the enumeration would go unnoticed otherwise.
+            // covers the 2 second resolution of FAT volumes.
+            const std::int64_t INDEX_SETTLE_TICKS = 2 * 10000000LL;
+
+            // batches of candidates waiting for the sniffing threads
+            const std::size_t SNIFF_QUEUE_CAPACITY = 64;
+
+            // shards of the set of visited directories, picked by the hash of the identity
+            const std::size_t VISITED_SHARD_COUNT = 16;
+
+            struct WorkItem
+            {
+                std::size_t rootIndex;
+                std::string dir;
+                PathMatcher::State matcherState; // only with a matcher
+                bool isLinked; // reached through a link, directly or further up
+                // what the entry (or the root) brought along about the directory itself. only taken if it has the
+                // identity, i.e. if it is what the directory told: the listing of the parent is not always up to date.
+                Utils::FileInfo info;
+            }; // struct WorkItem
+
+            struct FileIdentityHash
+            {
+                std::size_t operator()(const FileIdentity& identity) const
+                {
+                    std::uint64_t hash = identity.file * 0x9E3779B97F4A7C15ULL;
+                    hash ^= identity.volume + (hash >> 29);
+                    return (static_cast<std::size_t>(hash ^ (hash >> 32)));
+                }
+            }; // struct FileIdentityHash
+
+            // the directories the walkers already went into. a shard is only locked for a single insert.
+            class VisitedSet
+            {
+            public:
+                // false if the identity was inserted before
+                bool insert(const FileIdentity& identity)
+                {
+                    auto hash = FileIdentityHash()(identity);
+                    Shard& shard = _shards[(hash >> 8) % VISITED_SHARD_COUNT];
+                    std::lock_guard<std::mutex> lock(shard.mutex);
+                    return (shard.identities.insert(identity).second);
+                }
+
+            private:
+                struct Shard
+                {
+                    std::mutex mutex;
+                    std::unordered_set<FileIdentity, FileIdentityHash> identities;
+                }; // struct Shard
+
+                Shard _shards[VISITED_SHARD_COUNT];
+            }; // class VisitedSet
+
+            // roots are compared as the file system compares names
+            std::string getRootKey(const std::string& root)
+            {
+                std::string result = root;
+#if defined(_WIN32)
+                for (auto&& c : result) {
+                    if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+                }
+#endif // defined(_WIN32)
+                return (result);
+            }
+
+            // the owner pushes and pops at the back, thieves take from the front
+            class WorkQueue
+            {
+            public:
+                void push(WorkItem&& item)
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _items.push_back(std::move(item));
+                    return;
+                }
+
+                bool pop(WorkItem& item)
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    if (_items.empty()) return (false);
+                    item = std::move(_items.back());
+                    _items.pop_back();
+                    return (true);
+                }
+
+                bool steal(WorkItem& item)
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    if (_items.empty()) return (false);
+                    item = std::move(_items.front());
+                    _items.pop_front();
+                    return (true);
+                }
+
+            private:
+                std::mutex _mutex;
+                std::deque<WorkItem> _items;
+            }; // class WorkQueue
+
+            class ScanState
+            {
+            public:
+                ScanState(const ScanOptions& options, const Backend& backend, Sink& sink, std::size_t walkerCount) :
+                    _options(options), _backend(backend), _sink(sink), _queues(walkerCount),
+                    _queued(0), _pending(0), _idle(0), _visited(0), _enumerated(0), _pruned(0), _skipped(0),
+                    _skippedRoots(0), _unreadable(0), _failed(false),
+                    _useIndex((options.previousIndex != nullptr) || (options.nextIndex != nullptr)),
+                    _settledBefore(_useIndex ? backend.getCurrentTime() - INDEX_SETTLE_TICKS : 0)
+                {
+                    for (auto&& queue : _queues) queue.reset(new WorkQueue());
+                    return;
+                }
+
+                void enqueue(std::size_t walker, WorkItem&& item)
+                {
+                    _pending++;
+                    _queues[walker]->push(std::move(item));
+                    _queued++;
+                    if (_idle.load() > 0) {
+                        std::lock_guard<std::mutex> lock(_idleMutex);
+                        _idleCondition.notify_one();
+                    }
+                    return;
+                }
+
+                void walk(std::size_t walker)
+                {
+                    Stats::ScopedTimer timer("scan walker");
+                    std::vector<Match> matches;
+                    matches.reserve(SINK_BATCH_SIZE);
+
+                    try {
+                        WorkItem item;
+                        while (take(walker, item)) {
+                            walkDirectory(walker, item, matches);
+                            if (matches.size() >= SINK_BATCH_SIZE) flush(matches);
+                            finish();
+                        }
+                        flush(matches);
+                    }
+                    catch (...) {
+                        std::lock_guard<std::mutex> lock(_sinkMutex);
+                        if (!_failed.exchange(true)) _error = std::current_exception();
+                        // wake everyone up so they can bail out
+                        std::lock_guard<std::mutex> idleLock(_idleMutex);
+                        _idleCondition.notify_all();
+                    }
+                    return;
+                }
+
+                void rethrowIfFailed(void) const
+                {
+                    if (_error) std::rethrow_exception(_error);
+                    return;
+                }
+
+                ScanSummary getSummary(void) const
+                {
+                    return (ScanSummary{
+                        _visited.load(), _enumerated.load(), _pruned.load(), _skipped.load(), _skippedRoots.load(),
+                        _unreadable.load()
+                    });
+                }
+
+                void addPruned(void) { _pruned++; return; }
+                void addSkippedRoot(void)
+                {
+                    _skippedRoots++;
+                    Stats::count(Stats::Counter::DirectoriesSkipped);
+                    return;
+                }
+
+            private:
+                bool take(std::size_t walker, WorkItem& item)
+                {
+                    for (;;) {
+                        if (_failed.load()) return (false);
+
+                        if (_queues[walker]->pop(item)) {
+                            _queued--;
+                            return (true);
+                        }
+                        for (std::size_t offset = 1; offset < _queues.size(); offset++) {
+                            if (_queues[(walker + offset) % _queues.size()]->steal(item)) {
+                                _queued--;
+                                return (true);
+                            }
+                        }
+
+                        std::unique_lock<std::mutex> lock(_idleMutex);
+                        _idle++;
+                        _idleCondition.wait(lock, [this] (void) -> bool {
+                            return ((_queued.load() > 0) || (_pending.load() == 0) || _failed.load());
+                        });
+                        _idle--;
+                        if (_pending.load() == 0) return (false);
+                    }
+                }
+
+                void finish(void)
+                {
+                    if (--_pending == 0) {
+                        std::lock_guard<std::mutex> lock(_idleMutex);
+                        _idleCondition.notify_all();
+                    }
+                    return;
+                }
+
+                void walkDirectory(std::size_t walker, const WorkItem& item, std::vector<Match>& matches)
+                {
+                    // the identity and the time in one call, unless they came with the item
+                    Utils::FileInfo info = item.info;
+                    bool isKnown = info.hasIdentity && info.hasModificationTime;
+                    if (!isKnown && (_options.followLinks || _useIndex) &&
+                        !_backend.getInfo(item.dir, _options.followLinks, info)) {
+                        info = Utils::FileInfo();
+                    }
+
+                    if (_options.followLinks && !isFirstVisit(item, info)) {
+                        _skipped++;
+                        Stats::count(Stats::Counter::DirectoriesSkipped);
+                        return;
+                    }
+
+                    _visited++;
+                    bool hasLinks = false;
+                    if (!_useIndex || !info.hasModificationTime) {
+                        enumerateDirectory(walker, item, matches, nullptr, nullptr, hasLinks);
+                        return;
+                    }
+                    std::int64_t modificationTime = info.modificationTime;
+
+                    ScanIndex::Directory cached;
+                    if ((_options.previousIndex != nullptr) && _options.previousIndex->find(item.dir, cached) &&
+                        (cached.getModificationTime() == modificationTime)) {
+                        reuseDirectory(walker, item, matches, cached);
+                        return;
+                    }
+
+                    std::vector<std::string> subdirectories;
+                    std::vector<std::string> files;
+                    bool isRead = enumerateDirectory(walker, item, matches, &subdirectories, &files, hasLinks);
+                    // the target of a link changes without the directory holding it, and whether it is followed
+                    // depends on the run: such a directory is enumerated every time. one that could not be read is
+                    // not known to be empty.
+                    if ((_options.nextIndex != nullptr) && (modificationTime < _settledBefore) && !hasLinks && isRead) {
+                        _options.nextIndex->add(item.dir, modificationTime, std::move(subdirectories), std::move(files));
+                    }
+                    return;
+                }
+
+                // every directory is looked up by its identity, whether it was reached through a link or not: the
+                // link might have been the first way there
+                bool isFirstVisit(const WorkItem& item, const Utils::FileInfo& info)
+                {
+                    // no loop can be ruled out below a link
+                    if (!info.hasIdentity) return (!item.isLinked);
+                    return (_visitedDirectories.insert(info.identity));
+                }
+
+                // hasLinks tells whether the directory holds links to directories. returns false if it could not be
+                // read, what was listed before that is still reported.
+                bool enumerateDirectory(
+                    std::size_t walker,
+                    const WorkItem& item,
+                    std::vector<Match>& matches,
+                    std::vector<std::string>* subdirectories,
+                    std::vector<std::string>* files,
+                    bool& hasLinks
+                )
+                {
+                    _enumerated++;
+                    std::size_t entryCount = 0;
+                    hasLinks = false;
+                    bool isRead = _backend.enumerate(
+                        item.dir,
+                        [&] (std::string_view name, const Utils::FileInfo& info) -> void {
+                            entryCount++;
+                            bool isDirectory = (info.type == Utils::FileType::Directory);
+                            if (isDirectory && info.isLink) {
+                                hasLinks = true;
+                                if (_options.followLinks && _options.traverseAll) {
+                                    enqueueSubdirectory(walker, item, name, info);
+                                }
+                            }
+                            else if (isDirectory) {
+                                if (subdirectories != nullptr) subdirectories->emplace_back(name);
+                                if (_options.traverseAll) enqueueSubdirectory(walker, item, name, info);
+                            }
+                            else if (_options.classifier.isCandidate(name)) {
+                                if (files != nullptr) files->emplace_back(name);
+                                addMatch(item, name, matches);
+                            }
+                            return;
+                        }
+                    );
+                    Stats::count(Stats::Counter::DirectoriesWalked);
+                    Stats::count(Stats::Counter::EntriesVisited, entryCount);
+                    if (!isRead) {
+                        _unreadable++;
+                        Stats::count(Stats::Counter::DirectoriesUnreadable);
+                    }
+                    return (isRead);
+                }
+
+                void reuseDirectory(
+                    std::size_t walker,
+                    const WorkItem& item,
+                    std::vector<Match>& matches,
+                    const ScanIndex::Directory& cached
+                )
+                {
+                    std::vector<std::string> subdirectories;
+                    std::vector<std::string> files;
+                    bool record = (_options.nextIndex != nullptr);
+
+                    for (std::size_t idx = 0; idx < cached.getSubdirectoryCount(); idx++) {
+                        auto name = cached.getSubdirectory(idx);
+                        if (record) subdirectories.emplace_back(name);
+                        if (_options.traverseAll) enqueueSubdirectory(walker, item, name, Utils::FileInfo());
+                    }
+                    for (std::size_t idx = 0; idx < cached.getFileCount(); idx++) {
+                        auto name = cached.getFile(idx);
+                        if (record) files.emplace_back(name);
+                        addMatch(item, name, matches);
+                    }
+
+                    if (record) {
+                        _options.nextIndex->add(
+                            item.dir, cached.getModificationTime(), std::move(subdirectories), std::move(files)
+                        );
+                    }
+                    return;
+                }
+
+                void enqueueSubdirectory(
+                    std::size_t walker, const WorkItem& item, std::string_view name, const Utils::FileInfo& info
+                )
+                {
+                    PathMatcher::State matcherState;
+                    if (_options.matcher != nullptr) {
+                        matcherState = _options.matcher->step(item.matcherState, name);
+                        if (_options.matcher->isPruned(matcherState)) {
+                            _pruned++;
+                            return;
+                        }
+                    }
+
+                    std::string subdir;
+                    subdir.reserve(item.dir.length() + name.length() + 1);
+                    subdir.append(item.dir).append(name).push_back(Utils::PATH_SEPARATOR);
+                    bool isLinked = item.isLinked || info.isLink;
+                    enqueue(
+                        walker, WorkItem{ item.rootIndex, std::move(subdir), std::move(matcherState), isLinked, info }
+                    );
+                    return;
+                }
+
+                void addMatch(const WorkItem& item, std::string_view name, std::vector<Match>& matches)
+                {
+                    if ((_options.matcher != nullptr) && !_options.matcher->isMatch(item.matcherState, name)) return;
+
+                    std::string file;
+                    file.reserve(item.dir.length() + name.length());
+                    file.append(item.dir).append(name);
+                    matches.push_back(Match{ item.rootIndex, std::move(file) });
+                    return;
+                }
+
+                void flush(std::vector<Match>& matches)
+                {
+                    if (matches.empty()) return;
+                    std::lock_guard<std::mutex> lock(_sinkMutex);
+                    _sink.consume(matches);
+                    matches.clear();
+                    return;
+                }
+
+                const ScanOptions& _options;
+                const Backend& _backend;
+                Sink& _sink;
+                std::mutex _sinkMutex;
+
+                std::vector<std::unique_ptr<WorkQueue>> _queues;
+                std::atomic<std::size_t> _queued;  // directories sitting in a queue
+                std::atomic<std::size_t> _pending; // directories queued or being walked
+                std::atomic<std::size_t> _idle;
+                std::mutex _idleMutex;
+                std::condition_variable _idleCondition;
+
+                std::atomic<std::size_t> _visited;
+                std::atomic<std::size_t> _enumerated;
+                std::atomic<std::size_t> _pruned;
+                std::atomic<std::size_t> _skipped;
+                std::atomic<std::size_t> _skippedRoots;
+                std::atomic<std::size_t> _unreadable;
+                VisitedSet _visitedDirectories; // only when following links
+                std::atomic<bool> _failed;
+                std::exception_ptr _error;
+
+                bool _useIndex;
+                std::int64_t _settledBefore;
+            }; // class ScanState
+
+            // reads the headers of the candidates on threads of its own and passes the PE images on to the sink, so
+            // the walkers do not wait for the files to be read
+            class SniffingSink : public Sink
+            {
+            public:
+                SniffingSink(Sink& sink, std::size_t threadCount) :
+                    _sink(sink), _sinkMutex(), _batches(SNIFF_QUEUE_CAPACITY), _threads(), _error()
+                {
+                    _threads.reserve(threadCount);
+                    for (std::size_t idx = 0; idx < threadCount; idx++) {
+                        _threads.emplace_back([this] (void) -> void { sniff(); });
+                    }
+                    return;
+                }
+
+                virtual ~SniffingSink(void)
+                {
+                    join();
+                    return;
+                }
+
+                virtual void consume(std::vector<Match>& matches) override
+                {
+                    _batches.push(std::move(matches));
+                    matches = std::vector<Match>();
+                    return;
+                }
+
+                // waits until everything consumed so far went through, rethrows the first error of a thread
+                void finish(void)
+                {
+                    join();
+                    if (_error) std::rethrow_exception(_error);
+                    return;
+                }
+
+                SniffingSink(const SniffingSink&) = delete;
+                SniffingSink& operator=(const SniffingSink&) = delete;
+
+            private:
+                void sniff(void)
+                {
+                    Stats::ScopedTimer timer("sniff");
+                    std::vector<Match> batch;
+                    std::vector<Match> matches;
+                    // after an error the batches are still taken off the queue, so that the walkers never block
+                    while (_batches.pop(batch)) {
+                        try {
+                            for (auto&& match : batch) {
+                                if (Classifier::isPEFile(match.path)) matches.push_back(std::move(match));
+                            }
+                            if (matches.empty()) continue;
+                            std::lock_guard<std::mutex> lock(_sinkMutex);
+                            if (!_error) _sink.consume(matches);
+                        }
+                        catch (...) {
+                            std::lock_guard<std::mutex> lock(_sinkMutex);
+                            if (!_error) _error = std::current_exception();
+                        }
+                        matches.clear();
+                    }
+                    return;
+                }
+
+                void join(void)
+                {
+                    _batches.close();
+                    for (auto&& thread : _threads) thread.join();
+                    _threads.clear();
+                    return;
+                }
+
+                Sink& _sink;
+                std::mutex _sinkMutex;
+                Utils::BoundedQueue<std::vector<Match>> _batches;
+                std::vector<std::thread> _threads;
+                std::exception_ptr _error;
+            }; // class SniffingSink
+        } // anonymous namespace
+
+        bool FileSystemBackend::enumerate(const std::string& dir, const EntryCallback& callback) const
+        {
+            std::error_code errorCode;
+            std::filesystem::directory_iterator itr{ Utils::utf8StrToPath(dir), errorCode };
+            if (errorCode) return (false);
+
+            Utils::FileInfo info;
+            for (; itr != std::filesystem::directory_iterator(); itr.increment(errorCode)) {
+                // is_directory follows links, is_symlink tells whether there was one
+                info.type = itr->is_directory(errorCode) ? Utils::FileType::Directory : Utils::FileType::File;
+                info.isLink = itr->is_symlink(errorCode);
+                callback(Utils::pathToUTF8Str(itr->path().filename()), info);
+            }
+
+            return (true);
+        }
+
+        bool FileSystemBackend::getInfo(const std::string& dir, bool withIdentity, Utils::FileInfo& info) const
+        {
+            return (Utils::getFileInfo(dir, info, withIdentity));
+        }
+
+        std::int64_t FileSystemBackend::getCurrentTime(void) const
+        {
+            return (Utils::getCurrentFileTime());
+        }
+
+        bool NativeBackend::enumerate(const std::string& dir, const EntryCallback& callback) const
+        {
+            return (Utils::readDirectory(dir, callback));
+        }
+
+        bool NativeBackend::getInfo(const std::string& dir, bool withIdentity, Utils::FileInfo& info) const
+        {
+            return (Utils::getFileInfo(dir, info, withIdentity));
+        }
+
+        std::int64_t NativeBackend::getCurrentTime(void) const
+        {
+            return (Utils::getCurrentFileTime());
+        }
+
+        std::shared_ptr<const Backend> getDefaultBackend(void)
+        {
+            static const std::shared_ptr<const Backend> backend{ new NativeBackend() };
+            return (backend);
+        }
+
+        void VectorSink::consume(std::vector<Match>& newMatches)
+        {
+            if (matches.empty()) {
+                matches.swap(newMatches);
+                return;
+            }
+            matches.insert(
+                matches.end(), std::make_move_iterator(newMatches.begin()), std::make_move_iterator(newMatches.end())
+            );
+            return;
+        }
+
+        DirectoryScanner::DirectoryScanner(const ScanOptions& options, std::shared_ptr<const Backend> backend) :
+            _options(options),
+            _backend(
+                (backend != nullptr) ? backend : ((options.backend != nullptr) ? options.backend : getDefaultBackend())
+            )
+        {
+            if (_options.threadCount == 0) {
+                _options.threadCount = std::thread::hardware_concurrency();
+                if (_options.threadCount == 0) _options.threadCount = 1;
+            }
+            if (_options.sniffThreadCount == 0) {
+                _options.sniffThreadCount = std::thread::hardware_concurrency();
+                if (_options.sniffThreadCount == 0) _options.sniffThreadCount = 1;
+            }
+            return;
+        }
+
+        ScanSummary DirectoryScanner::scan(const std::vector<std::string>& roots, Sink& sink) const
+        {
+            if (roots.empty()) return (ScanSummary{ 0, 0, 0, 0, 0, 0 });
+            Stats::ScopedTimer timer("scan");
+
+            // the walkers only go by the names, the contents of the candidates are checked behind them
+            std::unique_ptr<SniffingSink> sniffingSink;
+            if (_options.classifier.isCheckingContent()) {
+                sniffingSink.reset(new SniffingSink(sink, _options.sniffThreadCount));
+            }
+
+            ScanState state(_options, *_backend, sniffingSink ? *sniffingSink : sink, _options.threadCount);
+            std::vector<std::pair<std::string, WorkItem>> items;
+            items.reserve(roots.size());
+            for (std::size_t idx = 0; idx < roots.size(); idx++) {
+                PathMatcher::State matcherState;
+                if (_options.matcher != nullptr) {
+                    matcherState = _options.matcher->getState(roots[idx]);
+                    if (_options.matcher->isPruned(matcherState)) {
+                        state.addPruned();
+                        continue;
+                    }
+                }
+                WorkItem item{ idx, roots[idx], std::move(matcherState), false, Utils::FileInfo() };
+                items.emplace_back(getRootKey(roots[idx]), std::move(item));
+            }
+
+            // overlapping roots are dropped before any walking starts. once sorted, a root inside another one comes
+            // after it, with nothing but roots inside the same one in between. without traverseAll only the root
+            // itself is walked, so a root inside another one is not found under it and stays.
+            std::stable_sort(
+                items.begin(), items.end(),
+                [] (const std::pair<std::string, WorkItem>& lhs, const std::pair<std::string, WorkItem>& rhs) -> bool {
+                    return (lhs.first < rhs.first);
+                }
+            );
+            std::set<FileIdentity> rootIdentities;
+            const std::string* lastKey = nullptr;
+            std::size_t walker = 0;
+            for (auto&& item : items) {
+                bool isCovered = (lastKey != nullptr) && (_options.traverseAll ?
+                    (item.first.compare(0, lastKey->length(), *lastKey) == 0) : (item.first == *lastKey));
+                if (isCovered) {
+                    state.addSkippedRoot();
+                    continue;
+                }
+                // the walker takes the identity and time from here instead of asking again
+                auto& info = item.second.info;
+                if (!_backend->getInfo(item.second.dir, true, info)) info = Utils::FileInfo();
+                if (info.hasIdentity && !rootIdentities.insert(info.identity).second) {
+                    state.addSkippedRoot();
+                    continue;
+                }
+                lastKey = &item.first;
+                state.enqueue(walker++ % _options.threadCount, std::move(item.second));
+            }
+
+            // the calling thread is walker 0
+            std::vector<std::thread> walkers;
+            walkers.reserve(_options.threadCount - 1);
+            for (std::size_t walker = 1; walker < _options.threadCount; walker++) {
+                walkers.emplace_back([&state, walker] (void) -> void { state.walk(walker); });
+            }
+            state.walk(0);
+            for (auto&& walker : walkers) walker.join();
+
+            state.rethrowIfFailed();
+            if (sniffingSink) sniffingSink->finish();
+            return (state.getSummary());
+        }
+    } // namespace Scanner
+} // namespace FWMFW
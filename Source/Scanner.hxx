@@ -0,0 +1,154 @@
+#if !defined(DOTSLASHZERO_FWMFW_SCANNER_HXX)
+#define DOTSLASHZERO_FWMFW_SCANNER_HXX
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Classifier.hxx"
+#include "FileInfo.hxx"
+#include "PathMatcher.hxx"
+
+namespace FWMFW
+{
+    // parallel directory traversal
+    namespace Scanner
+    {
+        typedef Utils::FileIdentity FileIdentity;
+
+        // enumerates the immediate children of a single directory
+        class Backend
+        {
+        public:
+            virtual ~Backend(void) { return; }
+
+            // isLink is set for symbolic links and junctions, the type is the one of what the link points to. the
+            // scanner only goes by the type, and by the identity and time of linked directories if they came along.
+            typedef std::function<void(std::string_view name, const Utils::FileInfo& info)> EntryCallback;
+
+            // dir always ends with a path separator. "." and ".." must not be reported.
+            // returns false if the directory could not be opened.
+            virtual bool enumerate(const std::string& dir, const EntryCallback& callback) const = 0;
+
+            // the modification time of the directory and, if withIdentity, its identity (links are followed), in a
+            // single call where the platform allows. a backend without identities leaves them out. times are in
+            // ticks of 100 ns, the epoch is up to the backend but must be the same as the one of getCurrentTime.
+            // returns false if the directory cannot be read.
+            virtual bool getInfo(const std::string& dir, bool withIdentity, Utils::FileInfo& info) const = 0;
+            virtual std::int64_t getCurrentTime(void) const = 0;
+        }; // class Backend
+
+        // portable backend that enumerates with std::filesystem. what it tells about the directories themselves comes
+        // from Utils::getFileInfo.
+        class FileSystemBackend : public Backend
+        {
+        public:
+            virtual bool enumerate(const std::string& dir, const EntryCallback& callback) const override;
+            virtual bool getInfo(const std::string& dir, bool withIdentity, Utils::FileInfo& info) const override;
+            virtual std::int64_t getCurrentTime(void) const override;
+        }; // class FileSystemBackend
+
+        // native backend on top of Utils::readDirectory and Utils::getFileInfo: FindFirstFileEx on Windows,
+        // getdents64 on Linux
+        class NativeBackend : public Backend
+        {
+        public:
+            virtual bool enumerate(const std::string& dir, const EntryCallback& callback) const override;
+            virtual bool getInfo(const std::string& dir, bool withIdentity, Utils::FileInfo& info) const override;
+            virtual std::int64_t getCurrentTime(void) const override;
+        }; // class NativeBackend
+
+        // the native backend of the platform being compiled for
+        std::shared_ptr<const Backend> getDefaultBackend(void);
+
+        struct Match
+        {
+            std::size_t rootIndex; // index of the root (as passed to scan) the file was found under
+            std::string path;
+        }; // struct Match
+
+        // receives the matches of all walkers (or sniffing threads). calls are serialized by the scanner so
+        // implementations do not need to do their own locking. the matches may be moved out of the vector.
+        class Sink
+        {
+        public:
+            virtual ~Sink(void) { return; }
+
+            virtual void consume(std::vector<Match>& matches) = 0;
+        }; // class Sink
+
+        // a sink that simply collects everything
+        class VectorSink : public Sink
+        {
+        public:
+            virtual void consume(std::vector<Match>& matches) override;
+
+            std::vector<Match> matches;
+        }; // class VectorSink
+
+        class ScanIndex;
+        class ScanIndexBuilder;
+
+        struct ScanOptions
+        {
+            Classifier classifier;
+            bool traverseAll{ true };
+            std::size_t threadCount{ 0 }; // 0 means one walker per hardware thread
+            // walk into directories that symbolic links and junctions point to. every directory is then looked up
+            // by its identity first and walked only once, so link loops end and a target reached twice is not walked
+            // again. without identities from the backend, linked directories are not followed after all.
+            bool followLinks{ false };
+            // threads reading the headers of the candidates when the classifier checks contents, 0 means one per
+            // hardware thread. the walkers hand the candidates over and carry on.
+            std::size_t sniffThreadCount{ 0 };
+
+            // directories whose modification time still matches the previous index are not enumerated again, their
+            // recorded subdirectories and files are used instead. every directory walked is recorded in nextIndex.
+            const ScanIndex* previousIndex{ nullptr };
+            ScanIndexBuilder* nextIndex{ nullptr };
+
+            // only the files the matcher accepts are reported, and subtrees it rules out are not walked at all. the
+            // index still records every directory walked in full, it does not depend on the matcher.
+            const PathMatcher* matcher{ nullptr };
+
+            // the backend to enumerate with when the scanner is not given one, nullptr for getDefaultBackend()
+            std::shared_ptr<const Backend> backend{ nullptr };
+        }; // struct ScanOptions
+
+        struct ScanSummary
+        {
+            std::size_t directoriesVisited;
+            std::size_t directoriesEnumerated; // the rest were taken from the previous index
+            std::size_t directoriesPruned; // ruled out by the matcher, not visited
+            std::size_t directoriesSkipped; // reached before (through a link), not visited again
+            std::size_t rootsSkipped; // inside another root or the same directory as one, not visited
+            std::size_t directoriesUnreadable; // could not be enumerated (no access, removed), taken as empty
+        }; // struct ScanSummary
+
+        // walks directory trees with a pool of walkers. each walker owns a queue of directories that it consumes
+        // depth first, idle walkers steal the oldest (and usually largest) pending directories from the others.
+        class DirectoryScanner
+        {
+        public:
+            // backend overrides the one of the options
+            DirectoryScanner(const ScanOptions& options, std::shared_ptr<const Backend> backend = nullptr);
+
+            // walks all the roots (which must end with a path separator) and streams the matching files into sink.
+            // roots that overlap are left out before the walk starts: a root inside another one (with traverseAll) or
+            // the same directory under another path is found under that one. blocks until every walker is done.
+            ScanSummary scan(const std::vector<std::string>& roots, Sink& sink) const;
+
+            const ScanOptions& getOptions(void) const { return (_options); }
+
+        private:
+            ScanOptions _options;
+            std::shared_ptr<const Backend> _backend;
+        }; // class DirectoryScanner
+    } // namespace Scanner
+} // namespace FWMFW
+
+#endif // !defined(DOTSLASHZERO_FWMFW_SCANNER_HXX)
@@ -0,0 +1,371 @@
+#include "Service.hxx"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+
+#include "Stats.hxx"
+
+namespace FWMFW
+{
+    namespace Service
+    {
+        namespace
+        {
+            typedef WinNetFW::RuleChangeResult::Status Status;
+
+            // how often run looks at the stop flag while there is nothing to commit
+            const std::chrono::milliseconds STOP_POLL_INTERVAL{ 100 };
+
+            const char* const BLOCK_COMMAND = "block";
+            const char* const UNBLOCK_COMMAND = "unblock";
+            const char* const ERROR_REPLY = "error";
+
+            // in the order of Status
+            const char* const STATUS_NAMES[] = {
+                "applied", "failed", "rolled-back", "not-attempted", "rollback-failed"
+            };
+
+            const char* getStatusName(Status status)
+            {
+                return (STATUS_NAMES[static_cast<std::size_t>(status)]);
+            }
+
+            bool parseStatus(std::string_view name, Status& status)
+            {
+                for (std::size_t idx = 0; idx < std::size(STATUS_NAMES); idx++) {
+                    if (name != STATUS_NAMES[idx]) continue;
+                    status = static_cast<Status>(idx);
+                    return (true);
+                }
+                return (false);
+            }
+
+            // "<word> <argument>"
+            bool splitLine(std::string_view line, std::string_view& word, std::string_view& argument)
+            {
+                auto pos = line.find(' ');
+                if (pos == std::string_view::npos) return (false);
+                word = line.substr(0, pos);
+                argument = line.substr(pos + 1);
+                return (true);
+            }
+
+            // a message goes on a single line
+            std::string getErrorReply(std::string_view message)
+            {
+                std::string reply = std::string(ERROR_REPLY) + " ";
+                reply.append(message);
+                std::replace(reply.begin(), reply.end(), '\n', ' ');
+                std::replace(reply.begin(), reply.end(), '\r', ' ');
+                reply += "\n\n";
+                return (reply);
+            }
+        } // anonymous namespace
+
+        RuleService::RuleService(
+            WinNetFW::FireWallPolicy& policy, const ServiceOptions& options, const ResultCallback& resultCallback
+        ) :
+            _policy(policy), _options(options), _resultCallback(resultCallback), _blocked(),
+            _mutex(), _condition(), _pending(), _pendingChanges(0), _connections(), _acceptError(), _stats{ 0, 0, 0 }
+        { return; }
+
+        RuleService::~RuleService(void) { return; }
+
+        void RuleService::load(void)
+        {
+            Stats::ScopedTimer timer("load rules");
+            _blocked.clear();
+            for (auto&& rule : _policy.enumerateRules(WinNetFW::getBlockRuleQuery())) {
+                if (!rule.applicationName.empty()) _blocked[WinNetFW::getPathKey(rule.applicationName)] = rule.name;
+            }
+            return;
+        }
+
+        void RuleService::run(Listener& listener, const std::atomic<bool>& stop)
+        {
+            std::thread acceptor([this, &listener] (void) -> void { accept(listener); });
+
+            for (;;) {
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    if (_acceptError != nullptr) break;
+                }
+                if (stop.load()) break;
+                commitNext(STOP_POLL_INTERVAL, false);
+            }
+
+            // no new clients and no new requests, but the ones already read are committed and answered
+            listener.close();
+            acceptor.join();
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                for (auto&& connection : _connections) connection->close();
+            }
+            for (;;) {
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    if (_connections.empty() && _pending.empty()) break;
+                }
+                commitNext(STOP_POLL_INTERVAL, true);
+            }
+
+            if (_acceptError != nullptr) std::rethrow_exception(_acceptError);
+            return;
+        }
+
+        std::vector<WinNetFW::RuleChangeResult> RuleService::submit(std::vector<RequestedChange>&& changes)
+        {
+            std::unique_ptr<Request> request(new Request());
+            request->changes = std::move(changes);
+            request->arrival = std::chrono::steady_clock::now();
+            auto results = request->results.get_future();
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stats.requests++;
+                _stats.changes += request->changes.size();
+                _pendingChanges += request->changes.size();
+                _pending.push_back(std::move(request));
+            }
+            _condition.notify_all();
+            return (results.get());
+        }
+
+        ServiceStats RuleService::getStats(void) const
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return (_stats);
+        }
+
+        void RuleService::accept(Listener& listener)
+        {
+            try {
+                for (;;) {
+                    auto connection = listener.accept();
+                    if (connection == nullptr) break;
+
+                    Connection* openConnection = connection.get();
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _connections.push_back(openConnection);
+                    try {
+                        // a thread per client, which mostly waits for the commit of its request
+                        std::thread(&RuleService::serve, this, std::move(connection)).detach();
+                    } catch (...) {
+                        _connections.pop_back();
+                        throw;
+                    }
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _acceptError = std::current_exception();
+            }
+            _condition.notify_all();
+            return;
+        }
+
+        void RuleService::serve(std::unique_ptr<Connection> connection)
+        {
+            try {
+                std::string line;
+                // a client may send any number of requests over its connection
+                for (;;) {
+                    std::vector<RequestedChange> changes;
+                    std::string error;
+                    bool isComplete = false;
+                    while (connection->readLine(line)) {
+                        if (!line.empty() && (line.back() == '\r')) line.pop_back();
+                        if (line.empty()) {
+                            isComplete = true;
+                            break;
+                        }
+
+                        std::string_view command;
+                        std::string_view appName;
+                        if (!splitLine(line, command, appName) || appName.empty() ||
+                            ((command != BLOCK_COMMAND) && (command != UNBLOCK_COMMAND))) {
+                            // the rest of the request is read anyway, the reply goes after it
+                            if (error.empty()) error = "Invalid request \"" + line + "\".";
+                            continue;
+                        }
+                        changes.push_back(RequestedChange{ std::string(appName), command == BLOCK_COMMAND });
+                    }
+                    if (!isComplete) break;
+
+                    std::string reply;
+                    if (error.empty()) {
+                        try {
+                            for (auto&& result : submit(std::move(changes))) {
+                                reply += getStatusName(result.status);
+                                reply += ' ';
+                                reply += result.appName;
+                                reply += '\n';
+                            }
+                            reply += '\n';
+                        } catch (const std::exception& e) {
+                            reply = getErrorReply(e.what());
+                        }
+                    } else {
+                        reply = getErrorReply(error);
+                    }
+                    if (!connection->write(reply)) break;
+                }
+            } catch (...) {
+                // a connection that failed only ends that client
+            }
+
+            // the connection itself goes once it is off the list, where run could still be closing it
+            std::lock_guard<std::mutex> lock(_mutex);
+            _connections.erase(std::find(_connections.begin(), _connections.end(), connection.get()));
+            _condition.notify_all();
+            return;
+        }
+
+        void RuleService::commitNext(std::chrono::milliseconds timeout, bool isStopping)
+        {
+            std::vector<std::unique_ptr<Request>> requests;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (!_condition.wait_for(lock, timeout, [this] (void) -> bool { return (!_pending.empty()); })) {
+                    return;
+                }
+                // the window opens with the first request, a full one is committed at once, and so is everything
+                // once the service is stopping
+                if (!isStopping) {
+                    _condition.wait_until(
+                        lock, _pending.front()->arrival + _options.coalesceWindow,
+                        [this] (void) -> bool { return (_pendingChanges >= _options.maxCommitChanges); }
+                    );
+                }
+                requests.swap(_pending);
+                _pendingChanges = 0;
+            }
+            commit(requests);
+            return;
+        }
+
+        void RuleService::commit(std::vector<std::unique_ptr<Request>>& requests)
+        {
+            Stats::ScopedTimer timer("service commit");
+
+            // the last request for a file decides its state, the files keep the order (and the spelling) they were
+            // first requested in. a file is known by its path key, whatever case its path was written in.
+            std::vector<std::pair<std::string, std::string>> files; // path key, appName
+            std::unordered_map<std::string, bool> isBlockRequested;
+            for (auto&& request : requests) {
+                for (auto&& change : request->changes) {
+                    auto key = WinNetFW::getPathKey(change.appName);
+                    auto inserted = isBlockRequested.emplace(key, change.isBlock);
+                    if (inserted.second) files.emplace_back(std::move(key), change.appName);
+                    else inserted.first->second = change.isBlock;
+                }
+            }
+
+            // only the files that are not as requested yet are changed
+            WinNetFW::RuleTransaction transaction;
+            std::vector<const std::string*> blocked;
+            std::vector<const std::string*> unblocked;
+            for (auto&& file : files) {
+                auto rule = _blocked.find(file.first);
+                if (isBlockRequested[file.first] && (rule == _blocked.end())) {
+                    transaction.block(file.second);
+                    blocked.push_back(&file.first);
+                } else if (!isBlockRequested[file.first] && (rule != _blocked.end())) {
+                    transaction.unblock(file.second, rule->second);
+                    unblocked.push_back(&file.first);
+                }
+            }
+
+            std::unordered_map<std::string, Status> statuses;
+            try {
+                if (!transaction.isEmpty()) {
+                    auto results = _policy.commit(transaction);
+                    {
+                        std::lock_guard<std::mutex> lock(_mutex);
+                        _stats.commits++;
+                    }
+                    // the results are blocks first, then unblocks, as the changes were added
+                    for (std::size_t idx = 0; idx < results.size(); idx++) {
+                        const std::string& key =
+                            (idx < blocked.size()) ? *blocked[idx] : *unblocked[idx - blocked.size()];
+                        auto&& result = results[idx];
+                        statuses[key] = result.status;
+                        // a change that could not be rolled back is in effect
+                        if ((result.status == Status::Applied) || (result.status == Status::RollbackFailed)) {
+                            if (result.isBlock) {
+                                _blocked[key] = WinNetFW::getRuleName(WinNetFW::RuleDirection::Out, result.appName);
+                            } else {
+                                _blocked.erase(key);
+                            }
+                        }
+                        if (_resultCallback) _resultCallback(result);
+                    }
+                }
+            } catch (...) {
+                for (auto&& request : requests) request->results.set_exception(std::current_exception());
+                return;
+            }
+
+            for (auto&& request : requests) {
+                std::vector<WinNetFW::RuleChangeResult> results;
+                results.reserve(request->changes.size());
+                for (auto&& change : request->changes) {
+                    auto key = WinNetFW::getPathKey(change.appName);
+                    Status status = Status::Applied;
+                    if (isBlockRequested[key] != change.isBlock) {
+                        // a later request of this commit reversed it
+                        status = Status::RolledBack;
+                    } else {
+                        auto committed = statuses.find(key);
+                        if (committed != statuses.end()) status = committed->second;
+                    }
+                    results.push_back(WinNetFW::RuleChangeResult{ change.appName, change.isBlock, status });
+                }
+                request->results.set_value(std::move(results));
+            }
+            return;
+        }
+
+        std::vector<WinNetFW::RuleChangeResult> sendRequest(
+            const std::string& address, const std::vector<RequestedChange>& changes
+        )
+        {
+            std::string request;
+            for (auto&& change : changes) {
+                if (change.appName.empty() || (change.appName.find_first_of("\r\n") != std::string::npos)) {
+                    throw (std::runtime_error("Invalid path \"" + change.appName + "\"."));
+                }
+                request += change.isBlock ? BLOCK_COMMAND : UNBLOCK_COMMAND;
+                request += ' ';
+                request += change.appName;
+                request += '\n';
+            }
+            request += '\n';
+
+            auto connection = connect(address);
+            if (!connection->write(request)) throw (std::runtime_error("The service closed the connection."));
+
+            std::vector<WinNetFW::RuleChangeResult> results;
+            results.reserve(changes.size());
+            std::string line;
+            for (;;) {
+                if (!connection->readLine(line)) throw (std::runtime_error("The service closed the connection."));
+                if (line.empty()) break;
+
+                std::string_view word;
+                std::string_view appName;
+                Status status;
+                if (!splitLine(line, word, appName)) throw (std::runtime_error("Invalid reply \"" + line + "\"."));
+                if (word == ERROR_REPLY) throw (std::runtime_error("Service error: " + std::string(appName)));
+                if (!parseStatus(word, status) || (results.size() == changes.size())) {
+                    throw (std::runtime_error("Invalid reply \"" + line + "\"."));
+                }
+                results.push_back(
+                    WinNetFW::RuleChangeResult{ std::string(appName), changes[results.size()].isBlock, status }
+                );
+            }
+            if (results.size() != changes.size()) throw (std::runtime_error("Incomplete reply from the service."));
+            return (results);
+        }
+    } // namespace Service
+} // namespace FWMFW
@@ -0,0 +1,123 @@
+#if !defined(DOTSLASHZERO_FWMFW_SERVICE_HXX)
+#define DOTSLASHZERO_FWMFW_SERVICE_HXX
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Transport.hxx"
+#include "WinNetFW.hxx"
+
+namespace FWMFW
+{
+    namespace Service
+    {
+        struct RequestedChange
+        {
+            std::string appName;
+            bool isBlock; // false for unblocks
+        }; // struct RequestedChange
+
+        struct ServiceOptions
+        {
+            // the requests that come in within this long of the first one are committed together with it
+            std::chrono::milliseconds coalesceWindow{ 50 };
+            // but a commit is not held back for more changes than this
+            std::size_t maxCommitChanges{ 10000 };
+        }; // struct ServiceOptions
+
+        struct ServiceStats
+        {
+            std::size_t requests;
+            std::size_t changes;    // as requested, before the duplicates and no-ops were dropped
+            std::size_t commits;
+        }; // struct ServiceStats
+
+        // keeps one policy and the block rules it holds, and applies the requests of many clients to it. requests
+        // that arrive close together go into one transaction: for a file requested more than once the last request
+        // wins, files already as requested are left alone, and the rest is committed as a whole.
+        // every change gets the status of its file's part of the commit. a change that a later request of the same
+        // commit reversed is reported as rolled back, and one that had nothing to do as applied.
+        //
+        // protocol, one line per item:
+        //     client: "block <path>" and "unblock <path>", then an empty line
+        //     service: "<status> <path>" for every change in the order requested, then an empty line; or
+        //              "error <message>" if the request could not be read or committed
+        class RuleService
+        {
+        public:
+            typedef std::function<void(const WinNetFW::RuleChangeResult&)> ResultCallback;
+
+            // the policy is only used from the thread that calls load and run
+            RuleService(
+                WinNetFW::FireWallPolicy& policy, const ServiceOptions& options,
+                const ResultCallback& resultCallback = nullptr
+            );
+            ~RuleService(void);
+
+            // reads the block rules from the policy
+            void load(void);
+
+            // accepts clients on listener and commits their requests on the calling thread until stop is set. the
+            // requests that were read by then are committed and answered before it returns. rethrows what accepting
+            // clients threw, after the same.
+            void run(Listener& listener, const std::atomic<bool>& stop);
+
+            // what a client's request goes through: waits until the request was committed (by run, on another
+            // thread). results are in the order of changes. throws what the commit threw.
+            std::vector<WinNetFW::RuleChangeResult> submit(std::vector<RequestedChange>&& changes);
+
+            ServiceStats getStats(void) const;
+            std::size_t getBlockedCount(void) const { return (_blocked.size()); }
+
+            RuleService(const RuleService&) = delete;
+            RuleService& operator=(const RuleService&) = delete;
+
+        private:
+            struct Request
+            {
+                std::vector<RequestedChange> changes;
+                std::chrono::steady_clock::time_point arrival;
+                std::promise<std::vector<WinNetFW::RuleChangeResult>> results;
+            }; // struct Request
+
+            void accept(Listener& listener);
+            void serve(std::unique_ptr<Connection> connection);
+            // waits for requests for up to timeout, then for the rest of their window, and commits them
+            void commitNext(std::chrono::milliseconds timeout, bool isStopping);
+            void commit(std::vector<std::unique_ptr<Request>>& requests);
+
+            WinNetFW::FireWallPolicy& _policy;
+            ServiceOptions _options;
+            ResultCallback _resultCallback;
+            // path key (see WinNetFW::getPathKey) -> OUT rule name of every blocked file, only used by the committing
+            // thread
+            std::unordered_map<std::string, std::string> _blocked;
+
+            mutable std::mutex _mutex;
+            std::condition_variable _condition;
+            std::vector<std::unique_ptr<Request>> _pending;
+            std::size_t _pendingChanges;
+            std::vector<Connection*> _connections; // open ones, to be closed when stopping
+            std::exception_ptr _acceptError;
+            ServiceStats _stats;
+        }; // class RuleService
+
+        // sends the changes to the service at address and waits for the results, in the order of changes. throws
+        // std::runtime_error if the service can not be reached or reported an error.
+        std::vector<WinNetFW::RuleChangeResult> sendRequest(
+            const std::string& address, const std::vector<RequestedChange>& changes
+        );
+    } // namespace Service
+} // namespace FWMFW
+
+#endif // !defined(DOTSLASHZERO_FWMFW_SERVICE_HXX)
@@ -0,0 +1,145 @@
+#include "ShardedCommit.hxx"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "Stats.hxx"
+
+namespace FWMFW
+{
+    namespace WinNetFW
+    {
+        namespace
+        {
+            typedef RuleChangeResult::Status Status;
+
+            // the owner takes shards from the front (in order), thieves from the back
+            class ShardQueue
+            {
+            public:
+                void push(std::size_t shard)
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _shards.push_back(shard);
+                    return;
+                }
+
+                bool pop(std::size_t& shard)
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    if (_shards.empty()) return (false);
+                    shard = _shards.front();
+                    _shards.pop_front();
+                    return (true);
+                }
+
+                bool steal(std::size_t& shard)
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    if (_shards.empty()) return (false);
+                    shard = _shards.back();
+                    _shards.pop_back();
+                    return (true);
+                }
+
+            private:
+                std::mutex _mutex;
+                std::deque<std::size_t> _shards;
+            }; // class ShardQueue
+        } // anonymous namespace
+
+        std::vector<RuleChangeResult> commitSharded(
+            const RuleTransaction& transaction, const PolicyFactory& createPolicy, const ShardedCommitOptions& options
+        )
+        {
+            Stats::ScopedTimer timer("sharded commit");
+
+            // whatever is not reached stays not attempted
+            std::vector<RuleChangeResult> result = transaction.getResults(Status::NotAttempted);
+            const std::size_t changeCount = transaction.getChangeCount();
+            const std::size_t shardSize = std::max<std::size_t>(options.shardSize, 1);
+            const std::size_t shardCount = (changeCount + shardSize - 1) / shardSize;
+            if (shardCount == 0) return (result);
+
+            std::size_t workerCount = options.threadCount;
+            if (workerCount == 0) workerCount = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+            workerCount = std::min(workerCount, shardCount);
+
+            // every worker starts out with a contiguous run of shards
+            std::vector<std::unique_ptr<ShardQueue>> queues;
+            for (std::size_t worker = 0; worker < workerCount; worker++) {
+                queues.emplace_back(new ShardQueue());
+                for (std::size_t shard = worker * shardCount / workerCount;
+                    shard < (worker + 1) * shardCount / workerCount; shard++) {
+                    queues.back()->push(shard);
+                }
+            }
+
+            // a shard's results and flag are only written by the worker that took it
+            std::vector<char> isShardApplied(shardCount, 0);
+            std::vector<std::exception_ptr> errors(workerCount);
+            std::atomic<bool> isFailed{ false };
+            auto take = [&queues] (std::size_t worker, std::size_t& shard) -> bool {
+                if (queues[worker]->pop(shard)) return (true);
+                for (std::size_t offset = 1; offset < queues.size(); offset++) {
+                    if (queues[(worker + offset) % queues.size()]->steal(shard)) return (true);
+                }
+                return (false);
+            };
+
+            std::vector<std::thread> workers;
+            for (std::size_t worker = 0; worker < workerCount; worker++) {
+                workers.emplace_back([&, worker] (void) -> void {
+                    try {
+                        ThreadSession session(createPolicy);
+                        for (std::size_t shard = 0; !isFailed.load() && take(worker, shard);) {
+                            std::size_t first = shard * shardSize;
+                            auto results = session.getPolicy().commit(transaction.getRange(first, shardSize));
+
+                            bool isApplied = true;
+                            for (auto&& change : results) isApplied = isApplied && (change.status == Status::Applied);
+                            std::copy(results.begin(), results.end(), result.begin() + first);
+                            isShardApplied[shard] = isApplied ? 1 : 0;
+                            if (!isApplied) isFailed = true;
+                        }
+                    }
+                    catch (...) {
+                        errors[worker] = std::current_exception();
+                        isFailed = true;
+                    }
+                    return;
+                });
+            }
+            for (auto&& worker : workers) worker.join();
+
+            if (isFailed.load()) {
+                Stats::ScopedTimer rollbackTimer("roll back shards");
+                auto policy = createPolicy();
+                for (std::size_t shard = shardCount; shard-- > 0;) {
+                    if (isShardApplied[shard] == 0) continue;
+
+                    std::size_t first = shard * shardSize;
+                    auto range = transaction.getRange(first, shardSize);
+                    auto undone = policy->commit(range.getInverse());
+                    // the inverse lists the blocks that undo the unblocks first
+                    for (std::size_t idx = 0; idx < range.getChangeCount(); idx++) {
+                        std::size_t inverseIdx = (idx < range.getBlockCount()) ?
+                            range.getUnblockCount() + idx : idx - range.getBlockCount();
+                        bool isUndone = (undone[inverseIdx].status == Status::Applied);
+                        result[first + idx].status = isUndone ? Status::RolledBack : Status::RollbackFailed;
+                    }
+                }
+            }
+
+            for (auto&& error : errors) {
+                if (error != nullptr) std::rethrow_exception(error);
+            }
+            return (result);
+        }
+    } // namespace WinNetFW
+} // namespace FWMFW
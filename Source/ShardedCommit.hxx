@@ -0,0 +1,32 @@
+#if !defined(DOTSLASHZERO_FWMFW_SHARDEDCOMMIT_HXX)
+#define DOTSLASHZERO_FWMFW_SHARDEDCOMMIT_HXX
+
+#include <cstddef>
+#include <vector>
+
+#include "WinNetFW.hxx"
+
+namespace FWMFW
+{
+    namespace WinNetFW
+    {
+        struct ShardedCommitOptions
+        {
+            std::size_t threadCount{ 0 };   // workers, 0 means one per hardware thread
+            std::size_t shardSize{ 64 };    // changes committed as one transaction
+        }; // struct ShardedCommitOptions
+
+        // commits the transaction like FireWallPolicy::commit, with the changes split into shards that worker
+        // threads commit concurrently. every worker runs a ThreadSession of its own. the shards are dealt out in
+        // order, and a worker that runs out steals from the back of the others, so one slow shard does not hold up
+        // the rest. if a shard fails, no further shards are started and the ones already committed are undone
+        // (on the calling thread, which needs WinNetFW to be initialized), so the whole stays all or nothing.
+        // returns a result per change, in the order commit would.
+        std::vector<RuleChangeResult> commitSharded(
+            const RuleTransaction& transaction, const PolicyFactory& createPolicy,
+            const ShardedCommitOptions& options = ShardedCommitOptions()
+        );
+    } // namespace WinNetFW
+} // namespace FWMFW
+
+#endif // !defined(DOTSLASHZERO_FWMFW_SHARDEDCOMMIT_HXX)
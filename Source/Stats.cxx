@@ -0,0 +1,183 @@
+#include "Stats.hxx"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Utils.hxx"
+
+namespace FWMFW
+{
+    namespace Stats
+    {
+        namespace Detail
+        {
+            std::atomic<bool> isEnabled{ false };
+            std::atomic<std::uint64_t> counters[static_cast<std::size_t>(Counter::COUNT)];
+        } // namespace Detail
+
+        namespace
+        {
+            const char* const COUNTER_NAMES[static_cast<std::size_t>(Counter::COUNT)]{
+                "directories walked",
+                "directories skipped",
+                "directories unreadable",
+                "entries visited",
+                "file info calls",
+                "files sniffed",
+                "rules enumerated",
+                "rules added",
+                "rules removed",
+                "rule store calls",
+                "COM calls",
+                "string conversions"
+            };
+
+            struct Event
+            {
+                const char* name;
+                std::chrono::steady_clock::time_point start;
+                std::chrono::steady_clock::duration duration;
+            }; // struct Event
+
+            // every thread records into a buffer of its own, so timing takes no lock
+            struct ThreadEvents
+            {
+                std::size_t thread;
+                std::vector<Event> events;
+            }; // struct ThreadEvents
+
+            std::chrono::steady_clock::time_point startTime;
+            std::mutex threadsMutex;
+            std::vector<std::unique_ptr<ThreadEvents>> threads;
+            thread_local ThreadEvents* ownEvents = nullptr;
+
+            double toMicroseconds(std::chrono::steady_clock::duration duration)
+            {
+                return (std::chrono::duration<double, std::micro>(duration).count());
+            }
+
+            std::string toJSONString(const char* str)
+            {
+                std::string result{ "\"" };
+                for (; *str != '\0'; str++) {
+                    if (*str == '"' || *str == '\\') result.push_back('\\');
+                    result.push_back(*str);
+                }
+                result.push_back('"');
+                return (result);
+            }
+        } // anonymous namespace
+
+        void Detail::record(const char* name, std::chrono::steady_clock::time_point start)
+        {
+            auto duration = std::chrono::steady_clock::now() - start;
+            if (ownEvents == nullptr) {
+                std::lock_guard<std::mutex> lock(threadsMutex);
+                threads.emplace_back(new ThreadEvents{ threads.size(), std::vector<Event>() });
+                ownEvents = threads.back().get();
+            }
+            ownEvents->events.push_back(Event{ name, start, duration });
+            return;
+        }
+
+        void enable(void)
+        {
+            startTime = std::chrono::steady_clock::now();
+            Detail::isEnabled = true;
+            return;
+        }
+
+        void printSummary(std::ostream& out)
+        {
+            struct Timer
+            {
+                const char* name;
+                std::size_t calls;
+                std::chrono::steady_clock::duration total;
+                std::chrono::steady_clock::duration longest;
+            }; // struct Timer
+
+            // the timers in the order they were first finished
+            std::vector<Timer> timers;
+            {
+                std::lock_guard<std::mutex> lock(threadsMutex);
+                for (auto&& thread : threads) {
+                    for (auto&& event : thread->events) {
+                        auto itr = std::find_if(timers.begin(), timers.end(), [&event] (const Timer& timer) -> bool {
+                            return (std::strcmp(timer.name, event.name) == 0);
+                        });
+                        if (itr == timers.end()) {
+                            timers.push_back(Timer{ event.name, 0, std::chrono::steady_clock::duration::zero(),
+                                std::chrono::steady_clock::duration::zero() });
+                            itr = timers.end() - 1;
+                        }
+                        itr->calls++;
+                        itr->total += event.duration;
+                        itr->longest = std::max(itr->longest, event.duration);
+                    }
+                }
+            }
+
+            auto flags = out.flags();
+            out << std::fixed << std::setprecision(3);
+            out << std::left << std::setw(28) << "timer" << std::right << std::setw(10) << "calls" <<
+                std::setw(14) << "total ms" << std::setw(14) << "average ms" << std::setw(14) << "longest ms" << "\n";
+            for (auto&& timer : timers) {
+                double total = toMicroseconds(timer.total) / 1e3;
+                out << std::left << std::setw(28) << timer.name << std::right << std::setw(10) << timer.calls <<
+                    std::setw(14) << total << std::setw(14) << total / static_cast<double>(timer.calls) <<
+                    std::setw(14) << toMicroseconds(timer.longest) / 1e3 << "\n";
+            }
+
+            out << std::left << std::setw(28) << "counter" << std::right << std::setw(10) << "count" << "\n";
+            for (std::size_t idx = 0; idx < static_cast<std::size_t>(Counter::COUNT); idx++) {
+                out << std::left << std::setw(28) << COUNTER_NAMES[idx] << std::right << std::setw(10) <<
+                    Detail::counters[idx].load() << "\n";
+            }
+            out.flags(flags);
+            out.flush();
+            return;
+        }
+
+        bool writeTrace(const std::string& file)
+        {
+            std::ofstream out{ Utils::utf8StrToPath(file), std::ios::binary | std::ios::trunc };
+            if (!out) return (false);
+
+            // trace event format: complete events ("X") with times in microseconds
+            out << std::fixed << std::setprecision(3);
+            out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+            const char* separator = "";
+            auto end = std::chrono::steady_clock::now();
+            {
+                std::lock_guard<std::mutex> lock(threadsMutex);
+                for (auto&& thread : threads) {
+                    for (auto&& event : thread->events) {
+                        out << separator << "{\"name\":" << toJSONString(event.name) <<
+                            ",\"cat\":\"FWMFW\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread->thread <<
+                            ",\"ts\":" << toMicroseconds(event.start - startTime) <<
+                            ",\"dur\":" << toMicroseconds(event.duration) << "}";
+                        separator = ",\n";
+                    }
+                }
+            }
+
+            // the counters as they stand at the end of the run
+            for (std::size_t idx = 0; idx < static_cast<std::size_t>(Counter::COUNT); idx++) {
+                out << separator << "{\"name\":" << toJSONString(COUNTER_NAMES[idx]) <<
+                    ",\"cat\":\"FWMFW\",\"ph\":\"C\",\"pid\":1,\"tid\":0,\"ts\":" << toMicroseconds(end - startTime) <<
+                    ",\"args\":{\"count\":" << Detail::counters[idx].load() << "}}";
+                separator = ",\n";
+            }
+            out << "\n]}\n";
+
+            out.flush();
+            return (static_cast<bool>(out));
+        }
+    } // namespace Stats
+} // namespace FWMFW
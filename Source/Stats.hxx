@@ -0,0 +1,91 @@
+#if !defined(DOTSLASHZERO_FWMFW_STATS_HXX)
+#define DOTSLASHZERO_FWMFW_STATS_HXX
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace FWMFW
+{
+    // instrumentation: counters and scoped timers that cost a relaxed load and a branch while disabled
+    namespace Stats
+    {
+        enum class Counter
+        {
+            DirectoriesWalked,     // directories enumerated by the scanner
+            DirectoriesSkipped,    // directories (and roots) the scanner had already been in
+            DirectoriesUnreadable, // directories the scanner could not enumerate
+            EntriesVisited,        // files and directories seen by the scanner
+            FileInfoCalls,         // Utils::getFileInfo, and the entries Utils::readDirectory looked up
+            FilesSniffed,          // files whose headers were read by the Classifier
+            RulesEnumerated,       // rules handed to FireWallPolicy by the store
+            RulesAdded,
+            RulesRemoved,
+            StoreCalls,            // calls into the RuleStore
+            ComCalls,              // calls into the firewall's COM objects
+            Conversions,           // UTF-8 <-> UTF-16 conversions
+            COUNT
+        }; // enum class Counter
+
+        namespace Detail
+        {
+            extern std::atomic<bool> isEnabled;
+            extern std::atomic<std::uint64_t> counters[static_cast<std::size_t>(Counter::COUNT)];
+
+            void record(const char* name, std::chrono::steady_clock::time_point start);
+        } // namespace Detail
+
+        // turns the instrumentation on, before any work is started. there is no turning it off again.
+        void enable(void);
+
+        inline bool isEnabled(void) { return (Detail::isEnabled.load(std::memory_order_relaxed)); }
+
+        inline void count(Counter counter, std::uint64_t amount = 1)
+        {
+            if (!isEnabled()) return;
+            Detail::counters[static_cast<std::size_t>(counter)].fetch_add(amount, std::memory_order_relaxed);
+            return;
+        }
+
+        // times its own scope. name must be a string literal (or otherwise outlive the program's instrumentation).
+        class ScopedTimer
+        {
+        public:
+            explicit ScopedTimer(const char* name) : _name(isEnabled() ? name : nullptr), _start()
+            {
+                if (_name != nullptr) _start = std::chrono::steady_clock::now();
+                return;
+            }
+
+            ~ScopedTimer(void) { stop(); return; }
+
+            // ends the timed scope early
+            void stop(void)
+            {
+                if (_name != nullptr) Detail::record(_name, _start);
+                _name = nullptr;
+                return;
+            }
+
+            ScopedTimer(const ScopedTimer&) = delete;
+            ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+        private:
+            const char* _name;
+            std::chrono::steady_clock::time_point _start;
+        }; // class ScopedTimer
+
+        // the reports read what the threads recorded, so they must only run once no other thread is timing anything
+
+        // a table of the timers (calls, total, average and longest time per name) and the counters
+        void printSummary(std::ostream& out);
+
+        // every timed scope as a Chrome trace event (chrome://tracing, Perfetto), and the counters at the end.
+        // returns false if the file cannot be written.
+        bool writeTrace(const std::string& file);
+    } // namespace Stats
+} // namespace FWMFW
+
+#endif // !defined(DOTSLASHZERO_FWMFW_STATS_HXX)
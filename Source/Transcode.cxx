@@ -0,0 +1,188 @@
+#include "Transcode.hxx"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FWMFW_TRANSCODE_SSE2
+#include <emmintrin.h>
+#endif // SSE2
+
+#include <cstdint>
+#include <cstring>
+
+namespace FWMFW
+{
+    namespace Utils
+    {
+        namespace
+        {
+            const char16_t REPLACEMENT_CHARACTER = 0xFFFD;
+
+            // copies the ASCII code units at the start of src to dst, a block at a time. returns how many were copied,
+            // the caller continues with the scalar path from there (which handles the tail of fewer than a block).
+            std::size_t copyASCIIToUTF8(const char16_t* src, std::size_t length, char* dst)
+            {
+                std::size_t idx = 0;
+#if defined(FWMFW_TRANSCODE_SSE2)
+                const __m128i nonASCIIMask = _mm_set1_epi16(static_cast<short>(0xFF80));
+                const __m128i zero = _mm_setzero_si128();
+                for (; idx + 16 <= length; idx += 16) {
+                    __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + idx));
+                    __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + idx + 8));
+                    __m128i nonASCII = _mm_and_si128(_mm_or_si128(low, high), nonASCIIMask);
+                    if (_mm_movemask_epi8(_mm_cmpeq_epi16(nonASCII, zero)) != 0xFFFF) break;
+                    // every code unit is below 0x80, so the saturating pack just drops the high bytes
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + idx), _mm_packus_epi16(low, high));
+                }
+#else
+                for (; idx + 4 <= length; idx += 4) {
+                    std::uint64_t block;
+                    std::memcpy(&block, src + idx, sizeof(block));
+                    if ((block & 0xFF80FF80FF80FF80ull) != 0) break;
+                    for (std::size_t lane = 0; lane < 4; lane++) dst[idx + lane] = static_cast<char>(src[idx + lane]);
+                }
+#endif // defined(FWMFW_TRANSCODE_SSE2)
+                return (idx);
+            }
+
+            std::size_t copyASCIIToUTF16(const char* src, std::size_t length, char16_t* dst)
+            {
+                std::size_t idx = 0;
+#if defined(FWMFW_TRANSCODE_SSE2)
+                const __m128i zero = _mm_setzero_si128();
+                for (; idx + 16 <= length; idx += 16) {
+                    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + idx));
+                    if (_mm_movemask_epi8(bytes) != 0) break;
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + idx), _mm_unpacklo_epi8(bytes, zero));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + idx + 8), _mm_unpackhi_epi8(bytes, zero));
+                }
+#else
+                for (; idx + 8 <= length; idx += 8) {
+                    std::uint64_t block;
+                    std::memcpy(&block, src + idx, sizeof(block));
+                    if ((block & 0x8080808080808080ull) != 0) break;
+                    for (std::size_t lane = 0; lane < 8; lane++) {
+                        dst[idx + lane] = static_cast<char16_t>(src[idx + lane]);
+                    }
+                }
+#endif // defined(FWMFW_TRANSCODE_SSE2)
+                return (idx);
+            }
+        } // anonymous namespace
+
+        std::size_t transcodeUTF16ToUTF8(const char16_t* src, std::size_t length, char* dst)
+        {
+            std::size_t idx = 0;
+            char* out = dst;
+            while (idx < length) {
+                std::size_t copied = copyASCIIToUTF8(src + idx, length - idx, out);
+                idx += copied;
+                out += copied;
+
+                // the scalar path takes over until the end of the block that stopped the fast path
+                std::size_t scalarEnd = (idx + 16 < length) ? idx + 16 : length;
+                while (idx < scalarEnd) {
+                    char32_t codePoint = src[idx++];
+                    if (codePoint < 0x80) {
+                        *out++ = static_cast<char>(codePoint);
+                        continue;
+                    }
+
+                    if (codePoint >= 0xD800 && codePoint <= 0xDBFF && idx < length &&
+                        src[idx] >= 0xDC00 && src[idx] <= 0xDFFF) {
+                        codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (src[idx] - 0xDC00);
+                        idx++;
+                    }
+                    else if (codePoint >= 0xD800 && codePoint <= 0xDFFF) {
+                        // unpaired surrogate
+                        codePoint = REPLACEMENT_CHARACTER;
+                    }
+
+                    if (codePoint < 0x800) {
+                        *out++ = static_cast<char>(0xC0 | (codePoint >> 6));
+                        *out++ = static_cast<char>(0x80 | (codePoint & 0x3F));
+                    }
+                    else if (codePoint < 0x10000) {
+                        *out++ = static_cast<char>(0xE0 | (codePoint >> 12));
+                        *out++ = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+                        *out++ = static_cast<char>(0x80 | (codePoint & 0x3F));
+                    }
+                    else {
+                        *out++ = static_cast<char>(0xF0 | (codePoint >> 18));
+                        *out++ = static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+                        *out++ = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+                        *out++ = static_cast<char>(0x80 | (codePoint & 0x3F));
+                    }
+                }
+            }
+            return (static_cast<std::size_t>(out - dst));
+        }
+
+        std::size_t transcodeUTF8ToUTF16(const char* src, std::size_t length, char16_t* dst)
+        {
+            std::size_t idx = 0;
+            char16_t* out = dst;
+            while (idx < length) {
+                std::size_t copied = copyASCIIToUTF16(src + idx, length - idx, out);
+                idx += copied;
+                out += copied;
+
+                // the scalar path takes over until the end of the block that stopped the fast path (or a little
+                // beyond it, sequences are always decoded as a whole)
+                std::size_t scalarEnd = (idx + 16 < length) ? idx + 16 : length;
+                while (idx < scalarEnd) {
+                    auto lead = static_cast<unsigned char>(src[idx]);
+                    std::size_t trailCount = 0;
+                    char32_t codePoint = 0;
+                    char32_t minimum = 0;
+                    if (lead < 0x80) {
+                        *out++ = static_cast<char16_t>(lead);
+                        idx++;
+                        continue;
+                    }
+                    else if ((lead & 0xE0) == 0xC0) {
+                        trailCount = 1;
+                        codePoint = lead & 0x1F;
+                        minimum = 0x80;
+                    }
+                    else if ((lead & 0xF0) == 0xE0) {
+                        trailCount = 2;
+                        codePoint = lead & 0x0F;
+                        minimum = 0x800;
+                    }
+                    else if ((lead & 0xF8) == 0xF0) {
+                        trailCount = 3;
+                        codePoint = lead & 0x07;
+                        minimum = 0x10000;
+                    }
+                    else {
+                        *out++ = REPLACEMENT_CHARACTER;
+                        idx++;
+                        continue;
+                    }
+
+                    std::size_t consumed = 1;
+                    while (consumed <= trailCount && idx + consumed < length &&
+                        (static_cast<unsigned char>(src[idx + consumed]) & 0xC0) == 0x80) {
+                        codePoint = (codePoint << 6) | (static_cast<unsigned char>(src[idx + consumed]) & 0x3F);
+                        consumed++;
+                    }
+                    idx += consumed;
+
+                    // truncated, overlong, surrogate or out of range sequences
+                    if (consumed != trailCount + 1 || codePoint < minimum || codePoint > 0x10FFFF ||
+                        (codePoint >= 0xD800 && codePoint <= 0xDFFF)) {
+                        *out++ = REPLACEMENT_CHARACTER;
+                    }
+                    else if (codePoint >= 0x10000) {
+                        codePoint -= 0x10000;
+                        *out++ = static_cast<char16_t>(0xD800 + (codePoint >> 10));
+                        *out++ = static_cast<char16_t>(0xDC00 + (codePoint & 0x3FF));
+                    }
+                    else {
+                        *out++ = static_cast<char16_t>(codePoint);
+                    }
+                }
+            }
+            return (static_cast<std::size_t>(out - dst));
+        }
+    } // namespace Utils
+} // namespace FWMFW
@@ -0,0 +1,29 @@
+#if !defined(DOTSLASHZERO_FWMFW_TRANSCODE_HXX)
+#define DOTSLASHZERO_FWMFW_TRANSCODE_HXX
+
+#include <cstddef>
+
+namespace FWMFW
+{
+    namespace Utils
+    {
+        // single pass UTF-16 <-> UTF-8 conversion into a buffer of the caller. runs of ASCII are checked and copied a
+        // block at a time (with SSE2 where available, 8 bytes per step otherwise), everything else goes through a
+        // scalar path. invalid input (unpaired surrogates, overlong, truncated or out of range sequences) is replaced
+        // with U+FFFD, one replacement per invalid code unit or sequence.
+
+        // the most UTF-8 bytes a UTF-16 string of length code units can turn into
+        inline std::size_t getMaxUTF8Length(std::size_t length) { return (length * 3); }
+
+        // the most UTF-16 code units a UTF-8 string of length bytes can turn into
+        inline std::size_t getMaxUTF16Length(std::size_t length) { return (length); }
+
+        // dst must have room for getMaxUTF8Length(length) bytes. returns the number of bytes written.
+        std::size_t transcodeUTF16ToUTF8(const char16_t* src, std::size_t length, char* dst);
+
+        // dst must have room for getMaxUTF16Length(length) code units. returns the number of code units written.
+        std::size_t transcodeUTF8ToUTF16(const char* src, std::size_t length, char16_t* dst);
+    } // namespace Utils
+} // namespace FWMFW
+
+#endif // !defined(DOTSLASHZERO_FWMFW_TRANSCODE_HXX)
@@ -0,0 +1,390 @@
+#include "Transport.hxx"
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif // defined(_WIN32)
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+#include "Utils.hxx"
+
+namespace FWMFW
+{
+    namespace Service
+    {
+        namespace
+        {
+            // a client that sends more than this without a line break is not talking to us
+            const std::size_t MAX_LINE_LENGTH = 64 * 1024;
+            const std::size_t READ_CHUNK_SIZE = 4096;
+
+            // cuts the first complete line out of buffer
+            bool takeLine(std::string& buffer, std::string& line)
+            {
+                auto pos = buffer.find('\n');
+                if (pos == std::string::npos) {
+                    if (buffer.length() > MAX_LINE_LENGTH) throw (std::runtime_error("Line too long."));
+                    return (false);
+                }
+                line.assign(buffer, 0, pos);
+                buffer.erase(0, pos + 1);
+                return (true);
+            }
+
+#if defined(_WIN32)
+            const DWORD PIPE_BUFFER_SIZE = 64 * 1024;
+            const DWORD CONNECT_TIMEOUT_MS = 5000;
+
+            std::runtime_error getLastError(const char* function)
+            {
+                return (std::runtime_error(
+                    std::string(function) + " failed (error " + std::to_string(GetLastError()) + ")."
+                ));
+            }
+
+            class NamedPipeConnection : public Connection
+            {
+            public:
+                NamedPipeConnection(HANDLE pipe, bool isServer) :
+                    _pipe(pipe), _isServer(isServer), _isClosed(false), _buffer()
+                { return; }
+
+                virtual ~NamedPipeConnection(void)
+                {
+                    if (_isServer) {
+                        // the client gets to read everything that was written before the pipe goes
+                        FlushFileBuffers(_pipe);
+                        DisconnectNamedPipe(_pipe);
+                    }
+                    CloseHandle(_pipe);
+                    return;
+                }
+
+                virtual bool readLine(std::string& line) override
+                {
+                    while (!takeLine(_buffer, line)) {
+                        if (_isClosed.load()) return (false);
+                        char chunk[READ_CHUNK_SIZE];
+                        DWORD read = 0;
+                        if (ReadFile(_pipe, chunk, sizeof(chunk), &read, nullptr) == 0) {
+                            if (isDisconnected(GetLastError())) return (false);
+                            throw (getLastError("ReadFile"));
+                        }
+                        if (read == 0) return (false);
+                        _buffer.append(chunk, read);
+                    }
+                    return (true);
+                }
+
+                virtual bool write(std::string_view data) override
+                {
+                    while (!data.empty()) {
+                        DWORD written = 0;
+                        if (WriteFile(_pipe, data.data(), static_cast<DWORD>(data.length()), &written, nullptr) == 0) {
+                            if (isDisconnected(GetLastError())) return (false);
+                            throw (getLastError("WriteFile"));
+                        }
+                        data.remove_prefix(written);
+                    }
+                    return (true);
+                }
+
+                virtual void close(void) override
+                {
+                    _isClosed = true;
+                    // wakes up a ReadFile blocked on another thread
+                    CancelIoEx(_pipe, nullptr);
+                    return;
+                }
+
+            private:
+                static bool isDisconnected(DWORD error)
+                {
+                    return ((error == ERROR_BROKEN_PIPE) || (error == ERROR_NO_DATA) ||
+                        (error == ERROR_PIPE_NOT_CONNECTED) || (error == ERROR_OPERATION_ABORTED));
+                }
+
+                HANDLE _pipe;
+                bool _isServer;
+                std::atomic<bool> _isClosed;
+                std::string _buffer;
+            }; // class NamedPipeConnection
+#else
+            std::runtime_error getLastError(const char* function)
+            {
+                return (std::runtime_error(std::string(function) + " failed: " + std::strerror(errno)));
+            }
+
+            // no SIGPIPE for writing to a client that went away
+#if defined(MSG_NOSIGNAL)
+            const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+            const int SEND_FLAGS = 0;
+#endif // defined(MSG_NOSIGNAL)
+
+            void setCloseOnExec(int fd)
+            {
+                fcntl(fd, F_SETFD, FD_CLOEXEC);
+#if defined(SO_NOSIGPIPE)
+                int value = 1;
+                setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &value, sizeof(value));
+#endif // defined(SO_NOSIGPIPE)
+                return;
+            }
+
+            sockaddr_un getSocketAddress(const std::string& address)
+            {
+                sockaddr_un socketAddress;
+                std::memset(&socketAddress, 0, sizeof(socketAddress));
+                if (address.empty() || (address.length() >= sizeof(socketAddress.sun_path))) {
+                    throw (std::runtime_error("Invalid socket path \"" + address + "\"."));
+                }
+                socketAddress.sun_family = AF_UNIX;
+                std::memcpy(socketAddress.sun_path, address.c_str(), address.length());
+                return (socketAddress);
+            }
+
+            class UnixSocketConnection : public Connection
+            {
+            public:
+                explicit UnixSocketConnection(int fd) : _fd(fd), _buffer()
+                { return; }
+
+                virtual ~UnixSocketConnection(void)
+                {
+                    ::close(_fd);
+                    return;
+                }
+
+                virtual bool readLine(std::string& line) override
+                {
+                    while (!takeLine(_buffer, line)) {
+                        char chunk[READ_CHUNK_SIZE];
+                        auto length = ::recv(_fd, chunk, sizeof(chunk), 0);
+                        if (length < 0) {
+                            if (errno == EINTR) continue;
+                            if (errno == ECONNRESET) return (false);
+                            throw (getLastError("recv"));
+                        }
+                        if (length == 0) return (false);
+                        _buffer.append(chunk, static_cast<std::size_t>(length));
+                    }
+                    return (true);
+                }
+
+                virtual bool write(std::string_view data) override
+                {
+                    while (!data.empty()) {
+                        auto length = ::send(_fd, data.data(), data.length(), SEND_FLAGS);
+                        if (length < 0) {
+                            if (errno == EINTR) continue;
+                            if ((errno == EPIPE) || (errno == ECONNRESET)) return (false);
+                            throw (getLastError("send"));
+                        }
+                        data.remove_prefix(static_cast<std::size_t>(length));
+                    }
+                    return (true);
+                }
+
+                virtual void close(void) override
+                {
+                    // the descriptor stays open until the owner is done with it, a blocked recv returns 0
+                    ::shutdown(_fd, SHUT_RD);
+                    return;
+                }
+
+            private:
+                int _fd;
+                std::string _buffer;
+            }; // class UnixSocketConnection
+#endif // defined(_WIN32)
+        } // anonymous namespace
+
+#if defined(_WIN32)
+        struct NamedPipeListener::State
+        {
+            std::wstring address;
+            // there is always an instance of the pipe waiting for the next client, so that no other process can
+            // take the name in between
+            HANDLE pending{ INVALID_HANDLE_VALUE };
+            std::atomic<bool> isClosed{ false };
+
+            HANDLE createInstance(bool isFirst)
+            {
+                HANDLE pipe = CreateNamedPipeW(
+                    address.c_str(), PIPE_ACCESS_DUPLEX | (isFirst ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0),
+                    PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                    PIPE_UNLIMITED_INSTANCES, PIPE_BUFFER_SIZE, PIPE_BUFFER_SIZE, 0, nullptr
+                );
+                if (pipe == INVALID_HANDLE_VALUE) throw (getLastError("CreateNamedPipe"));
+                return (pipe);
+            }
+        }; // struct NamedPipeListener::State
+
+        NamedPipeListener::NamedPipeListener(const std::string& address) : _state(new State())
+        {
+            _state->address = Utils::utf8StrToW32WStr(address);
+            _state->pending = _state->createInstance(true);
+            return;
+        }
+
+        NamedPipeListener::~NamedPipeListener(void)
+        {
+            if (_state->pending != INVALID_HANDLE_VALUE) CloseHandle(_state->pending);
+            return;
+        }
+
+        std::unique_ptr<Connection> NamedPipeListener::accept(void)
+        {
+            for (;;) {
+                if (_state->isClosed.load()) return (nullptr);
+
+                HANDLE pipe = _state->pending;
+                bool isConnected = (ConnectNamedPipe(pipe, nullptr) != 0) || (GetLastError() == ERROR_PIPE_CONNECTED);
+                if (_state->isClosed.load()) return (nullptr);
+
+                _state->pending = _state->createInstance(false);
+                if (isConnected) return (std::unique_ptr<Connection>(new NamedPipeConnection(pipe, true)));
+                CloseHandle(pipe);
+            }
+        }
+
+        void NamedPipeListener::close(void)
+        {
+            _state->isClosed = true;
+            // ConnectNamedPipe only returns for a client
+            HANDLE pipe = CreateFileW(
+                _state->address.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr
+            );
+            if (pipe != INVALID_HANDLE_VALUE) CloseHandle(pipe);
+            return;
+        }
+#else
+        struct UnixSocketListener::State
+        {
+            std::string address;
+            int fd{ -1 };
+            std::atomic<bool> isClosed{ false };
+        }; // struct UnixSocketListener::State
+
+        UnixSocketListener::UnixSocketListener(const std::string& address) : _state(new State())
+        {
+            auto socketAddress = getSocketAddress(address);
+            _state->address = address;
+            _state->fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (_state->fd < 0) throw (getLastError("socket"));
+            setCloseOnExec(_state->fd);
+
+            // a socket file left behind by a service that did not stop cleanly
+            ::unlink(address.c_str());
+            if (::bind(_state->fd, reinterpret_cast<const sockaddr*>(&socketAddress), sizeof(socketAddress)) != 0) {
+                auto error = getLastError("bind");
+                ::close(_state->fd);
+                throw (error);
+            }
+            // nobody can connect before listen, so the permissions are in place in time
+            if ((::chmod(address.c_str(), S_IRUSR | S_IWUSR) != 0) || (::listen(_state->fd, SOMAXCONN) != 0)) {
+                auto error = getLastError("listen");
+                ::close(_state->fd);
+                ::unlink(address.c_str());
+                throw (error);
+            }
+            return;
+        }
+
+        UnixSocketListener::~UnixSocketListener(void)
+        {
+            ::close(_state->fd);
+            ::unlink(_state->address.c_str());
+            return;
+        }
+
+        std::unique_ptr<Connection> UnixSocketListener::accept(void)
+        {
+            for (;;) {
+                int fd = ::accept(_state->fd, nullptr, nullptr);
+                if (_state->isClosed.load()) {
+                    if (fd >= 0) ::close(fd);
+                    return (nullptr);
+                }
+                if (fd >= 0) {
+                    setCloseOnExec(fd);
+                    return (std::unique_ptr<Connection>(new UnixSocketConnection(fd)));
+                }
+                if ((errno == EINTR) || (errno == ECONNABORTED)) continue;
+                throw (getLastError("accept"));
+            }
+        }
+
+        void UnixSocketListener::close(void)
+        {
+            _state->isClosed = true;
+            // makes a blocked accept return
+            ::shutdown(_state->fd, SHUT_RDWR);
+            return;
+        }
+#endif // defined(_WIN32)
+
+        std::string getDefaultAddress(void)
+        {
+#if defined(_WIN32)
+            return ("\\\\.\\pipe\\FWMFW");
+#else
+            std::error_code errorCode;
+            auto dir = std::filesystem::temp_directory_path(errorCode);
+            if (errorCode) dir = "/tmp";
+            return ((dir / "FWMFW.sock").string());
+#endif // defined(_WIN32)
+        }
+
+        std::unique_ptr<Listener> listen(const std::string& address)
+        {
+#if defined(_WIN32)
+            return (std::unique_ptr<Listener>(new NamedPipeListener(address)));
+#else
+            return (std::unique_ptr<Listener>(new UnixSocketListener(address)));
+#endif // defined(_WIN32)
+        }
+
+        std::unique_ptr<Connection> connect(const std::string& address)
+        {
+#if defined(_WIN32)
+            std::wstring wideAddress = Utils::utf8StrToW32WStr(address);
+            for (;;) {
+                HANDLE pipe = CreateFileW(
+                    wideAddress.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr
+                );
+                if (pipe != INVALID_HANDLE_VALUE) {
+                    return (std::unique_ptr<Connection>(new NamedPipeConnection(pipe, false)));
+                }
+                // every instance is taken, wait for the service to put up the next one
+                if ((GetLastError() != ERROR_PIPE_BUSY) ||
+                    (WaitNamedPipeW(wideAddress.c_str(), CONNECT_TIMEOUT_MS) == 0)) {
+                    throw (std::runtime_error("Unable to connect to \"" + address + "\"."));
+                }
+            }
+#else
+            auto socketAddress = getSocketAddress(address);
+            int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0) throw (getLastError("socket"));
+            setCloseOnExec(fd);
+            if (::connect(fd, reinterpret_cast<const sockaddr*>(&socketAddress), sizeof(socketAddress)) != 0) {
+                std::string error = std::strerror(errno);
+                ::close(fd);
+                throw (std::runtime_error("Unable to connect to \"" + address + "\": " + error));
+            }
+            return (std::unique_ptr<Connection>(new UnixSocketConnection(fd)));
+#endif // defined(_WIN32)
+        }
+    } // namespace Service
+} // namespace FWMFW
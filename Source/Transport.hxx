@@ -0,0 +1,93 @@
+#if !defined(DOTSLASHZERO_FWMFW_TRANSPORT_HXX)
+#define DOTSLASHZERO_FWMFW_TRANSPORT_HXX
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace FWMFW
+{
+    // a long running FWMFW that applies the block and unblock requests of other processes
+    namespace Service
+    {
+        // a byte stream between the service and one client. errors of the system are thrown as std::runtime_error,
+        // a connection closed by the other side is not an error.
+        class Connection
+        {
+        public:
+            virtual ~Connection(void) { return; }
+
+            // reads up to the next '\n' (which is not stored in line). returns false once the other side closed the
+            // connection (or close was called), a partial last line is dropped.
+            virtual bool readLine(std::string& line) = 0;
+
+            // returns false if the other side closed the connection
+            virtual bool write(std::string_view data) = 0;
+
+            // stops reading, from any thread: a readLine blocked on another thread returns false, and so does every
+            // one after it. what is written still goes out.
+            virtual void close(void) = 0;
+        }; // class Connection
+
+        class Listener
+        {
+        public:
+            virtual ~Listener(void) { return; }
+
+            // waits for the next client. returns nullptr once close was called.
+            virtual std::unique_ptr<Connection> accept(void) = 0;
+
+            // stops accepting, from any thread
+            virtual void close(void) = 0;
+        }; // class Listener
+
+#if defined(_WIN32)
+        // a named pipe ("\\.\pipe\<name>"), local clients only. the pipe keeps its default security: everyone may
+        // read it, only administrators (and the account the service runs as) may write requests to it.
+        class NamedPipeListener : public Listener
+        {
+        public:
+            explicit NamedPipeListener(const std::string& address);
+            virtual ~NamedPipeListener(void);
+
+            virtual std::unique_ptr<Connection> accept(void) override;
+            virtual void close(void) override;
+
+            NamedPipeListener(const NamedPipeListener&) = delete;
+            NamedPipeListener& operator=(const NamedPipeListener&) = delete;
+
+        private:
+            struct State;
+            std::unique_ptr<State> _state;
+        }; // class NamedPipeListener
+#else
+        // a Unix domain socket. the socket file is replaced if it exists, and only its owner may connect.
+        class UnixSocketListener : public Listener
+        {
+        public:
+            explicit UnixSocketListener(const std::string& address);
+            virtual ~UnixSocketListener(void);
+
+            virtual std::unique_ptr<Connection> accept(void) override;
+            virtual void close(void) override;
+
+            UnixSocketListener(const UnixSocketListener&) = delete;
+            UnixSocketListener& operator=(const UnixSocketListener&) = delete;
+
+        private:
+            struct State;
+            std::unique_ptr<State> _state;
+        }; // class UnixSocketListener
+#endif // defined(_WIN32)
+
+        // where the service listens unless told otherwise: the pipe \\.\pipe\FWMFW on Windows, FWMFW.sock in the
+        // temporary directory elsewhere
+        std::string getDefaultAddress(void);
+
+        // the native listener and connection of the platform. throw std::runtime_error if that fails.
+        std::unique_ptr<Listener> listen(const std::string& address);
+        std::unique_ptr<Connection> connect(const std::string& address);
+    } // namespace Service
+} // namespace FWMFW
+
+#endif // !defined(DOTSLASHZERO_FWMFW_TRANSPORT_HXX)
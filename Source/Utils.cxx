@@ -1,162 +1,159 @@
 #include "Utils.hxx"
 
-#include <Windows.h>
-
 #include <cctype>
+#include <filesystem>
+
+#include "Scanner.hxx"
+#include "Stats.hxx"
+#include "Transcode.hxx"
 
 namespace FWMFW
 {
     namespace Utils
     {
-        std::string trimChars(const std::string& str, std::function<bool(int)>&& trimPred)
+        std::string_view trimChars(std::string_view str, const std::function<bool(int)>& trimPred)
         {
-            if (str.length() == 0) return (str);
-            std::string trimmed = str;
-            while (trimPred(trimmed[0])) trimmed = trimmed.substr(1);
-            while (trimPred(trimmed[trimmed.length() - 1])) trimmed = trimmed.substr(0, trimmed.length() - 1);
-            return (trimmed);
+            std::string_view::size_type begin = 0;
+            std::string_view::size_type end = str.length();
+            while (begin < end && trimPred(static_cast<unsigned char>(str[begin]))) begin++;
+            while (end > begin && trimPred(static_cast<unsigned char>(str[end - 1]))) end--;
+            return (str.substr(begin, end - begin));
         }
 
-        std::string trimWhiteSpaces(const std::string& str)
+        std::string_view trimWhiteSpaces(std::string_view str)
         {
-            return (Utils::trimChars(str, [](int c) -> bool { return (std::isspace(c) != 0); }));
+            // the same as trimChars with std::isspace, without a call through std::function for every character
+            auto isSpace = [] (char c) -> bool { return (std::isspace(static_cast<unsigned char>(c)) != 0); };
+            std::string_view::size_type begin = 0;
+            std::string_view::size_type end = str.length();
+            while (begin < end && isSpace(str[begin])) begin++;
+            while (end > begin && isSpace(str[end - 1])) end--;
+            return (str.substr(begin, end - begin));
         }
 
         std::string replaceChars(
-            const std::string& str, const char findChar, const char replacement, bool stopAtFirstHit
+            std::string_view str, const char findChar, const char replacement, bool stopAtFirstHit
         )
         {
-            if (str.length() == 0) return (str);
-            std::string result = str;
-            for (std::string::size_type idx = 0; idx < result.length(); idx++) {
-                if (result[idx] == findChar) {
-                    result[idx] = replacement;
-                    if (stopAtFirstHit) break;
-                }
-            }
+            std::string result{ str };
+            replaceCharsInPlace(result, findChar, replacement, stopAtFirstHit);
             return (result);
         }
 
-        bool stringStartsWith(const std::string& str, const std::string& beginning)
+        void replaceCharsInPlace(std::string& str, const char findChar, const char replacement, bool stopAtFirstHit)
+        {
+            for (auto pos = str.find(findChar); pos != std::string::npos; pos = str.find(findChar, pos + 1)) {
+                str[pos] = replacement;
+                if (stopAtFirstHit) break;
+            }
+            return;
+        }
+
+        bool stringStartsWith(std::string_view str, std::string_view beginning)
         {
             if (str.length() < beginning.length()) return (false);
-            return (str.substr(0, beginning.length()).compare(beginning) == 0);
+            return (str.compare(0, beginning.length(), beginning) == 0);
         }
 
-        bool stringEndsWith(const std::string& str, const std::string& ending)
+        bool stringEndsWith(std::string_view str, std::string_view ending)
         {
             if (str.length() < ending.length()) return (false);
-            return (str.substr(str.length() - ending.length()).compare(ending) == 0);
+            return (str.compare(str.length() - ending.length(), ending.length(), ending) == 0);
         }
 
-        bool stringContains(const std::string& str, const std::string& strToFind)
+        bool stringContains(std::string_view str, std::string_view strToFind)
         {
             if (str.length() < strToFind.length()) return (false);
-            return (str.find(strToFind) != std::string::npos);
+            return (str.find(strToFind) != std::string_view::npos);
         }
 
-        std::string w32WStrToUTF8Str(const std::wstring& wstr)
+        std::string utf16StrToUTF8Str(std::u16string_view str)
         {
-            // let's use the Windows API function: WideCharToMultiByte
+            std::string result;
+            utf16StrToUTF8Str(str, result);
+            return (result);
+        }
 
-            // 1st, count the number of bytes needed to store the converted UTF-8 string
-            int bytesRequired = WideCharToMultiByte(
-                CP_UTF8,
-                WC_ERR_INVALID_CHARS,
-                wstr.c_str(),
-                static_cast<int>(wstr.length()),
-                NULL,
-                0,
-                NULL,
-                NULL
-            );
+        std::u16string utf8StrToUTF16Str(std::string_view str)
+        {
+            std::u16string result;
+            utf8StrToUTF16Str(str, result);
+            return (result);
+        }
 
-            // then do the actual conversion
-            std::string result(static_cast<std::string::size_type>(bytesRequired), '\0');
-            WideCharToMultiByte(
-                CP_UTF8,
-                WC_ERR_INVALID_CHARS,
-                wstr.c_str(),
-                static_cast<int>(wstr.length()),
-                &(result.front()),
-                static_cast<int>(result.length()),
-                NULL,
-                NULL
-            );
+        void utf16StrToUTF8Str(std::u16string_view str, std::string& result)
+        {
+            Stats::count(Stats::Counter::Conversions);
+            result.resize(getMaxUTF8Length(str.length()));
+            result.resize(transcodeUTF16ToUTF8(str.data(), str.length(), &result[0]));
+            return;
+        }
 
+        void utf8StrToUTF16Str(std::string_view str, std::u16string& result)
+        {
+            Stats::count(Stats::Counter::Conversions);
+            result.resize(getMaxUTF16Length(str.length()));
+            result.resize(transcodeUTF8ToUTF16(str.data(), str.length(), &result[0]));
+            return;
+        }
+
+#if defined(_WIN32)
+        // wchar_t holds UTF-16 code units on Windows
+        static_assert(sizeof(wchar_t) == sizeof(char16_t), "wchar_t is not a UTF-16 code unit");
+
+        std::string w32WStrToUTF8Str(std::wstring_view wstr)
+        {
+            std::string result;
+            w32WStrToUTF8Str(wstr, result);
             return (result);
         }
 
-        std::wstring utf8StrToW32WStr(const std::string& str)
+        std::wstring utf8StrToW32WStr(std::string_view str)
         {
-            // same as the opposite function
-            int charsRequired = MultiByteToWideChar(
-                CP_UTF8, MB_ERR_INVALID_CHARS, str.c_str(), static_cast<int>(str.length()), NULL, 0
+            Stats::count(Stats::Counter::Conversions);
+            std::wstring result(getMaxUTF16Length(str.length()), L'\0');
+            result.resize(
+                transcodeUTF8ToUTF16(str.data(), str.length(), reinterpret_cast<char16_t*>(&result[0]))
             );
+            return (result);
+        }
 
-            std::wstring result(static_cast<std::wstring::size_type>(charsRequired), L'\0');
-            MultiByteToWideChar(
-                CP_UTF8,
-                MB_ERR_INVALID_CHARS,
-                str.c_str(),
-                static_cast<int>(str.length()),
-                &(result.front()), 
-                static_cast<int>(result.length())
+        void w32WStrToUTF8Str(std::wstring_view wstr, std::string& result)
+        {
+            Stats::count(Stats::Counter::Conversions);
+            result.resize(getMaxUTF8Length(wstr.length()));
+            result.resize(
+                transcodeUTF16ToUTF8(reinterpret_cast<const char16_t*>(wstr.data()), wstr.length(), &result[0])
             );
-
-            return (result);
+            return;
         }
+#endif // defined(_WIN32)
 
-        bool doesDirectoryExist(const std::string& dir)
+        std::filesystem::path utf8StrToPath(std::string_view str)
         {
-            auto attributes = GetFileAttributesA(dir.c_str());
-            return ((attributes != INVALID_FILE_ATTRIBUTES) && (attributes & FILE_ATTRIBUTE_DIRECTORY));
+            return (std::filesystem::u8path(str.begin(), str.end()));
         }
 
-        bool doesFileExist(const std::string& file)
+        std::string pathToUTF8Str(const std::filesystem::path& path)
         {
-            auto attributes = GetFileAttributesA(file.c_str());
-            return (attributes != INVALID_FILE_ATTRIBUTES);
+            auto str = path.u8string();
+            return (std::string(str.begin(), str.end()));
         }
 
-        // RVO (and/or copy elision & move operations) should optimize the return operation
-        // (i.e. no copying will happen).
         std::vector<std::string> getFilesInDirectory(
             const std::string& dir, const std::string& fileEnding, bool traverseAll
         )
         {
-            std::vector<std::string> result;
-            WIN32_FIND_DATAA findData;
-            HANDLE hFind = INVALID_HANDLE_VALUE;
+            Scanner::ScanOptions options;
+            options.classifier = Scanner::Classifier({ fileEnding });
+            options.traverseAll = traverseAll;
 
-            // must end with "*"
-            std::string dirF = dir + "*";
-
-            hFind = FindFirstFileA(dirF.c_str(), &findData);
-            if (hFind == INVALID_HANDLE_VALUE) {
-                return (result);
-            }
-
-            do {
-                if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && traverseAll) {
-                    // avoid the results '.' and '..'
-                    std::string subdirname{ findData.cFileName };
-                    if (subdirname.compare(".") != 0 && subdirname.compare("..") != 0) {
-                        auto subdir = dir + std::string(findData.cFileName) + "\\";
-                        auto subdirFiles = Utils::getFilesInDirectory(subdir, fileEnding, traverseAll);
-                        result.insert(result.cend(), subdirFiles.cbegin(), subdirFiles.cend());
-                    }
-                }
-                else {
-                    std::string file(findData.cFileName);
-                    if (Utils::stringEndsWith(file, fileEnding)) {
-                        result.push_back(dir + file);
-                    }
-                }
-            } while (FindNextFileA(hFind, &findData) != 0);
-
-            FindClose(hFind);
+            Scanner::VectorSink sink;
+            Scanner::DirectoryScanner(options).scan({ dir }, sink);
 
+            std::vector<std::string> result;
+            result.reserve(sink.matches.size());
+            for (auto&& match : sink.matches) result.push_back(std::move(match.path));
             return (result);
         }
     } // namespace Utils
@@ -1,8 +1,10 @@
 #if !defined(DOTSLASHZERO_FWMFW_UTILS_HXX)
 #define DOTSLASHZERO_FWMFW_UTILS_HXX
 
+#include <filesystem>
 #include <functional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace FWMFW
@@ -10,30 +12,61 @@ namespace FWMFW
     // utilities for useful operations.
     namespace Utils
     {
-        // trims front and rear characters using the provided predicate
-        std::string trimChars(const std::string& str, std::function<bool(int)>&& trimPred);
+        // the separator used when building paths on the platform being compiled for
+#if defined(_WIN32)
+        const char PATH_SEPARATOR = '\\';
+#else
+        const char PATH_SEPARATOR = '/';
+#endif // defined(_WIN32)
 
-        std::string trimWhiteSpaces(const std::string& str);
+        // the string functions work on views and do not allocate, except for the ones that return a std::string
+
+        // trims front and rear characters using the provided predicate. the result points into str.
+        std::string_view trimChars(std::string_view str, const std::function<bool(int)>& trimPred);
+
+        std::string_view trimWhiteSpaces(std::string_view str);
 
         std::string replaceChars(
-            const std::string& str, const char findChar, const char replacement, bool stopAtFirstHit = true
+            std::string_view str, const char findChar, const char replacement, bool stopAtFirstHit = true
         );
 
-        bool stringStartsWith(const std::string& str, const std::string& beginning);
+        void replaceCharsInPlace(
+            std::string& str, const char findChar, const char replacement, bool stopAtFirstHit = true
+        );
+
+        bool stringStartsWith(std::string_view str, std::string_view beginning);
+
+        bool stringEndsWith(std::string_view str, std::string_view ending);
+
+        bool stringContains(std::string_view str, std::string_view strToFind);
+
+        // portable conversions between UTF-16 and UTF-8 (see Transcode.hxx), invalid sequences become U+FFFD
+        std::string utf16StrToUTF8Str(std::u16string_view str);
+
+        std::u16string utf8StrToUTF16Str(std::string_view str);
+
+        // the same, into result (which is overwritten). reusing result for many strings saves the allocations.
+        void utf16StrToUTF8Str(std::u16string_view str, std::string& result);
 
-        bool stringEndsWith(const std::string& str, const std::string& ending);
+        void utf8StrToUTF16Str(std::string_view str, std::u16string& result);
 
-        bool stringContains(const std::string& str, const std::string& strToFind);
+#if defined(_WIN32)
+        // converts Windows' wide string (UTF-16) to UTF-8 encoding
+        std::string w32WStrToUTF8Str(std::wstring_view wstr);
 
-        // converts Windows' wide string (usually in UTF-16) to UTF-8 encoding
-        std::string w32WStrToUTF8Str(const std::wstring& wstr);
+        std::wstring utf8StrToW32WStr(std::string_view str);
 
-        std::wstring utf8StrToW32WStr(const std::string& str);
+        void w32WStrToUTF8Str(std::wstring_view wstr, std::string& result);
+#endif // defined(_WIN32)
 
-        bool doesDirectoryExist(const std::string& dir);
+        // std::filesystem paths from and to UTF-8, which a std::string is only taken to be outside of Windows
+        std::filesystem::path utf8StrToPath(std::string_view str);
 
-        bool doesFileExist(const std::string& file);
+        std::string pathToUTF8Str(const std::filesystem::path& path);
 
+        // dir must end with a path separator, fileEnding is matched case insensitively. this is a convenience
+        // wrapper around Scanner::DirectoryScanner, callers with more than one directory should hand all of them to
+        // a single scanner instead.
         std::vector<std::string> getFilesInDirectory(
             const std::string& dir, const std::string& fileEnding, bool traverseAll = false
         );
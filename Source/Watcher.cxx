@@ -0,0 +1,195 @@
+#include "Watcher.hxx"
+
+#include <algorithm>
+#include <filesystem>
+#include <set>
+#include <stdexcept>
+
+#include "FileInfo.hxx"
+#include "Reconcile.hxx"
+#include "Stats.hxx"
+#include "Utils.hxx"
+
+namespace FWMFW
+{
+    namespace Watch
+    {
+        Watcher::Watcher(
+            WinNetFW::FireWallPolicy& policy, ChangeSource& source, const std::string& listFile,
+            const WatchOptions& options, const ResultCallback& resultCallback
+        ) :
+            _policy(policy), _source(source),
+            _listFile(Utils::pathToUTF8Str(std::filesystem::absolute(Utils::utf8StrToPath(listFile)))),
+            _options(options), _resultCallback(resultCallback), _list(), _blocked()
+        {
+            _options.scanOptions.previousIndex = nullptr;
+            _options.scanOptions.nextIndex = nullptr;
+            return;
+        }
+
+        bool Watcher::synchronize(void)
+        {
+            Stats::ScopedTimer timer("watch synchronize");
+            Reconcile::BlockList list;
+            if (!list.load(_listFile, _options.scanOptions.classifier)) return (false);
+            _list = std::move(list);
+
+            // the watches go up first, so that nothing that changes during the scan is missed
+            watchAll();
+
+            Utils::PathTable desired;
+            _list.expand(_options.scanOptions, desired);
+            Utils::PathTable existing;
+            _policy.getBlockRules(existing);
+            auto plan = Reconcile::createPlan(std::move(desired), std::move(existing));
+            auto results = Reconcile::applyPlan(plan, _policy);
+
+            _blocked.clear();
+            for (auto&& entry : plan.getKeeps()) _blocked[std::string(entry.appName)] = entry.ruleName;
+
+            // results are the adds followed by the removes, as planned
+            const auto& adds = plan.getAdds();
+            const auto& removes = plan.getRemoves();
+            for (std::size_t idx = 0; idx < results.size(); idx++) {
+                bool isApplied = (results[idx].status == WinNetFW::RuleChangeResult::Status::Applied);
+                if (idx < adds.size()) {
+                    auto entry = adds[idx];
+                    if (isApplied) {
+                        _blocked[std::string(entry.appName)] =
+                            WinNetFW::getRuleName(WinNetFW::RuleDirection::Out, entry.appName);
+                    }
+                }
+                else {
+                    auto entry = removes[idx - adds.size()];
+                    if (!isApplied) _blocked[std::string(entry.appName)] = entry.ruleName;
+                }
+                if (_resultCallback != nullptr) _resultCallback(results[idx]);
+            }
+            return (true);
+        }
+
+        bool Watcher::update(std::chrono::milliseconds timeout)
+        {
+            std::vector<Change> changes;
+            if (!_source.wait(timeout, changes)) return (false);
+
+            auto start = std::chrono::steady_clock::now();
+            while (std::chrono::steady_clock::now() - start < _options.maxDelay) {
+                if (!_source.wait(_options.debounce, changes)) break;
+            }
+
+            // the events only say where to look, what counts is how things are after the debounce time
+            std::vector<std::string> paths;
+            paths.reserve(changes.size());
+            for (auto&& change : changes) {
+                if (change.kind == Change::Kind::Overflow || change.kind == Change::Kind::Modified) {
+                    // the list file is the only watched file
+                    if (!synchronize()) {
+                        // most likely in the middle of being replaced, its rename brings us back here
+                        watchAll();
+                    }
+                    return (true);
+                }
+                paths.push_back(change.path);
+            }
+            std::sort(paths.begin(), paths.end());
+            paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+
+            apply(paths);
+            return (true);
+        }
+
+        bool Watcher::run(const std::atomic<bool>& stop)
+        {
+            if (!synchronize()) return (false);
+
+            // the timeout only decides how quickly stop is noticed
+            while (!stop) update(std::chrono::milliseconds(250));
+            return (true);
+        }
+
+        void Watcher::watchAll(void)
+        {
+            _source.clear();
+            if (!_source.watchFile(_listFile)) {
+                throw (std::runtime_error("Unable to watch the list file \"" + _listFile + "\"."));
+            }
+            for (auto&& folder : _list.getFolders()) {
+                if (!_source.watchTree(folder)) {
+                    throw (std::runtime_error("Unable to watch the folder \"" + folder + "\"."));
+                }
+            }
+            return;
+        }
+
+        void Watcher::apply(const std::vector<std::string>& paths)
+        {
+            Stats::ScopedTimer timer("watch update");
+            std::set<std::string> toBlock;
+            std::map<std::string, std::string> toUnblock;
+
+            auto requestBlock = [&] (const std::string& appName) -> void {
+                if (_blocked.count(appName) == 0) toBlock.insert(appName);
+                return;
+            };
+
+            Utils::FileInfo info;
+            for (auto&& path : paths) {
+                if (_list.findFolder(path) == Reconcile::BlockList::NO_FOLDER) continue;
+
+                // a watched directory itself is reported with its separator
+                bool isDirectoryPath = !path.empty() && (path.back() == Utils::PATH_SEPARATOR);
+                const std::string dir = isDirectoryPath ? path : path + Utils::PATH_SEPARATOR;
+                Utils::getFileInfo(path, info);
+                if (info.type == Utils::FileType::Directory) {
+                    // a new directory (or one moved in) may already have files in it
+                    Scanner::VectorSink sink;
+                    Scanner::DirectoryScanner(_list.getScanOptions(_options.scanOptions)).scan(
+                        { dir }, sink
+                    );
+                    for (auto&& match : sink.matches) requestBlock(match.path);
+                }
+                else if (info.type != Utils::FileType::Missing) {
+                    if (_options.scanOptions.classifier.isMatch(path) && _list.isMatch(path)) {
+                        requestBlock(path);
+                    }
+                }
+                else {
+                    // gone: the file itself, or everything that was below it
+                    auto itr = _blocked.end();
+                    if (!isDirectoryPath) itr = _blocked.find(path);
+                    if (itr != _blocked.end()) toUnblock.insert(*itr);
+
+                    for (itr = _blocked.lower_bound(dir); itr != _blocked.end(); ++itr) {
+                        if (!Utils::stringStartsWith(itr->first, dir)) break;
+                        toUnblock.insert(*itr);
+                    }
+                }
+            }
+            if (toBlock.empty() && toUnblock.empty()) return;
+
+            WinNetFW::RuleTransaction transaction;
+            transaction.reserve(toBlock.size(), toUnblock.size());
+            for (auto&& file : toBlock) transaction.block(file);
+            for (auto&& file : toUnblock) transaction.unblock(file.first, file.second);
+            auto results = _policy.commit(transaction);
+
+            // results are the blocks followed by the unblocks, both in the order of their containers
+            auto blockItr = toBlock.begin();
+            auto unblockItr = toUnblock.begin();
+            for (auto&& result : results) {
+                bool isApplied = (result.status == WinNetFW::RuleChangeResult::Status::Applied);
+                if (result.isBlock) {
+                    if (isApplied) _blocked[*blockItr] = WinNetFW::getRuleName(WinNetFW::RuleDirection::Out, *blockItr);
+                    ++blockItr;
+                }
+                else {
+                    if (isApplied) _blocked.erase(unblockItr->first);
+                    ++unblockItr;
+                }
+                if (_resultCallback != nullptr) _resultCallback(result);
+            }
+            return;
+        }
+    } // namespace Watch
+} // namespace FWMFW
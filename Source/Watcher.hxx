@@ -0,0 +1,73 @@
+#if !defined(DOTSLASHZERO_FWMFW_WATCHER_HXX)
+#define DOTSLASHZERO_FWMFW_WATCHER_HXX
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "BlockList.hxx"
+#include "ChangeSource.hxx"
+#include "Scanner.hxx"
+#include "WinNetFW.hxx"
+
+namespace FWMFW
+{
+    namespace Watch
+    {
+        struct WatchOptions
+        {
+            // changes are collected until nothing happened for this long
+            std::chrono::milliseconds debounce{ 500 };
+            // but a steady stream of changes does not hold the update back for longer than this
+            std::chrono::milliseconds maxDelay{ 5000 };
+            // for the folders (the scan index is not used)
+            Scanner::ScanOptions scanOptions;
+        }; // struct WatchOptions
+
+        // keeps the block rules in line with a list file: every listed folder is watched, and only the rules of the
+        // files that appeared or disappeared are changed. changes of the list file itself (and lost notifications)
+        // lead to a full synchronization.
+        class Watcher
+        {
+        public:
+            typedef std::function<void(const WinNetFW::RuleChangeResult&)> ResultCallback;
+
+            Watcher(
+                WinNetFW::FireWallPolicy& policy, ChangeSource& source, const std::string& listFile,
+                const WatchOptions& options, const ResultCallback& resultCallback = nullptr
+            );
+
+            // reloads the list file, scans every folder and reconciles the rules with the result. returns false
+            // (without changing anything) if the list file could not be read.
+            bool synchronize(void);
+
+            // waits up to timeout for changes, then collects changes for the debounce time and applies them.
+            // returns false if nothing happened.
+            bool update(std::chrono::milliseconds timeout);
+
+            // synchronizes, then updates until stop is set. returns false if the list file could not be read.
+            bool run(const std::atomic<bool>& stop);
+
+            std::size_t getBlockedCount(void) const { return (_blocked.size()); }
+
+        private:
+            void watchAll(void);
+            void apply(const std::vector<std::string>& paths);
+
+            WinNetFW::FireWallPolicy& _policy;
+            ChangeSource& _source;
+            std::string _listFile;
+            WatchOptions _options;
+            ResultCallback _resultCallback;
+
+            Reconcile::BlockList _list;
+            // appName -> OUT rule name of every blocked file, sorted so that whole directories can be looked up
+            std::map<std::string, std::string> _blocked;
+        }; // class Watcher
+    } // namespace Watch
+} // namespace FWMFW
+
+#endif // !defined(DOTSLASHZERO_FWMFW_WATCHER_HXX)
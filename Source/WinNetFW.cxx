@@ -1,9 +1,16 @@
 #include "WinNetFW.hxx"
 
-#include <netfw.h>
+#if defined(_WIN32)
+#include <Windows.h>
 
-#include <memory>
+#include "ComRuleStore.hxx"
+#else
+#include "MemoryRuleStore.hxx"
+#endif // defined(_WIN32)
 
+#include <algorithm>
+
+#include "Stats.hxx"
 #include "Utils.hxx"
 
 namespace FWMFW
@@ -12,276 +19,596 @@ namespace FWMFW
     {
         namespace
         {
-            // A simple deleter for COM pointers stored within the std::unique_ptr class
-            template<typename COMPtrType>
-            struct ReleaseDeleter
+            // TODO: make this more generic, and remove any references to FMWFW.
+            const std::string RULE_IN_NAME_PREFIX{ "FWMFW_IN_" };
+            const std::string RULE_OUT_NAME_PREFIX{ "FWMFW_OUT_" };
+            const std::string RULE_DESCRIPTION{ "Blocked using FMWFW." };
+            const std::size_t HASH_DIGITS = 16;
+            const char GROUP_SEPARATOR = '@';
+
+            Rule makeBlockRule(const std::string& name, const std::string& appName, RuleDirection direction)
             {
-                void operator()(COMPtrType ptr) const
-                {
-                    ptr->Release();
-                    return;
+                return (Rule{ name, appName, RULE_DESCRIPTION, direction, RuleAction::Block, true });
+            }
+
+            // a character of a path as it goes into a rule name: the file system does not tell these apart
+            char normalize(char c)
+            {
+                if (c == '/') return ('\\');
+                return (((c >= 'A') && (c <= 'Z')) ? static_cast<char>(c - 'A' + 'a') : c);
+            }
+
+            // the readable part of a rule name (before it is normalized): the path from the file's parent directory on
+            std::string_view getRuleLabel(std::string_view appName)
+            {
+                std::size_t start = appName.length();
+                for (int separators = 0; start > 0; start--) {
+                    if ((normalize(appName[start - 1]) == '\\') && (++separators == 2)) break;
                 }
-            }; // struct ReleaseDeleter
+                return (appName.substr(start));
+            }
+
+            void formatHash(std::uint64_t hash, char* digits)
+            {
+                const char* const HEX_DIGITS = "0123456789abcdef";
+                for (std::size_t idx = HASH_DIGITS; idx-- > 0; hash >>= 4) digits[idx] = HEX_DIGITS[hash & 0xF];
+                return;
+            }
+
+            bool isHash(std::string_view text)
+            {
+                if (text.length() != HASH_DIGITS) return (false);
+                return (std::all_of(text.begin(), text.end(), [] (char c) -> bool {
+                    return (((c >= '0') && (c <= '9')) || ((c >= 'a') && (c <= 'f')));
+                }));
+            }
+
+            // what goes between the prefix and the hash
+            std::size_t getGroupLength(std::string_view group)
+            {
+                return (group.empty() ? 0 : group.length() + 1);
+            }
         } // anonymous namespace
 
+        std::uint64_t getPathHash(std::string_view appName)
+        {
+            std::uint64_t hash = 14695981039346656037ULL;
+            for (char c : appName) {
+                hash ^= static_cast<unsigned char>(normalize(c));
+                hash *= 1099511628211ULL;
+            }
+            return (hash);
+        }
+
+        std::string getPathKey(std::string_view appName)
+        {
+            std::string key;
+            key.reserve(appName.length());
+            for (char c : appName) key.push_back(normalize(c));
+            return (key);
+        }
+
+        std::string getRuleName(RuleDirection direction, std::string_view appName, std::string_view group)
+        {
+            const std::string& prefix = (direction == RuleDirection::In) ? RULE_IN_NAME_PREFIX : RULE_OUT_NAME_PREFIX;
+            auto label = getRuleLabel(appName);
+            char digits[HASH_DIGITS];
+            formatHash(getPathHash(appName), digits);
+
+            std::string result;
+            result.reserve(prefix.length() + getGroupLength(group) + HASH_DIGITS + 1 + label.length());
+            result.append(prefix);
+            if (!group.empty()) result.append(group).append(1, GROUP_SEPARATOR);
+            result.append(digits, HASH_DIGITS).append(1, '_');
+            for (char c : label) result.push_back(normalize(c));
+            return (result);
+        }
+
+        std::string getInRuleName(std::string_view outRuleName)
+        {
+            if (outRuleName.compare(0, RULE_OUT_NAME_PREFIX.length(), RULE_OUT_NAME_PREFIX) != 0) {
+                throw (Exception("Not the name of a block rule: \"" + std::string(outRuleName) + "\"."));
+            }
+            return (RULE_IN_NAME_PREFIX + std::string(outRuleName.substr(RULE_OUT_NAME_PREFIX.length())));
+        }
+
+        bool isCurrentRuleName(std::string_view outRuleName, std::string_view appName, std::string_view group)
+        {
+            return (isCurrentRuleName(outRuleName, appName, getPathHash(appName), group));
+        }
+
+        bool isCurrentRuleName(
+            std::string_view outRuleName, std::string_view appName, std::uint64_t pathHash, std::string_view group
+        )
+        {
+            // compared piece by piece, this runs for every rule that stays blocked
+            auto label = getRuleLabel(appName);
+            std::size_t length =
+                RULE_OUT_NAME_PREFIX.length() + getGroupLength(group) + HASH_DIGITS + 1 + label.length();
+            if (outRuleName.length() != length) return (false);
+            if (outRuleName.compare(0, RULE_OUT_NAME_PREFIX.length(), RULE_OUT_NAME_PREFIX) != 0) return (false);
+            outRuleName.remove_prefix(RULE_OUT_NAME_PREFIX.length());
+            if (!group.empty()) {
+                if ((outRuleName.compare(0, group.length(), group) != 0) ||
+                    (outRuleName[group.length()] != GROUP_SEPARATOR)) {
+                    return (false);
+                }
+                outRuleName.remove_prefix(group.length() + 1);
+            }
+
+            char digits[HASH_DIGITS];
+            formatHash(pathHash, digits);
+            if ((outRuleName.compare(0, HASH_DIGITS, digits, HASH_DIGITS) != 0) || (outRuleName[HASH_DIGITS] != '_')) {
+                return (false);
+            }
+            outRuleName.remove_prefix(HASH_DIGITS + 1);
+            for (std::size_t idx = 0; idx < label.length(); idx++) {
+                if (outRuleName[idx] != normalize(label[idx])) return (false);
+            }
+            return (true);
+        }
+
+        bool getRuleHash(std::string_view outRuleName, std::uint64_t& pathHash)
+        {
+            if (outRuleName.compare(0, RULE_OUT_NAME_PREFIX.length(), RULE_OUT_NAME_PREFIX) != 0) return (false);
+            outRuleName.remove_prefix(RULE_OUT_NAME_PREFIX.length() + getGroupLength(getRuleGroup(outRuleName)));
+            if ((outRuleName.length() <= HASH_DIGITS) || !isHash(outRuleName.substr(0, HASH_DIGITS)) ||
+                (outRuleName[HASH_DIGITS] != '_')) {
+                return (false);
+            }
+            pathHash = 0;
+            for (std::size_t idx = 0; idx < HASH_DIGITS; idx++) {
+                char c = outRuleName[idx];
+                pathHash = (pathHash << 4) | static_cast<std::uint64_t>((c <= '9') ? (c - '0') : (c - 'a' + 10));
+            }
+            return (true);
+        }
+
+        bool isValidGroupName(std::string_view group)
+        {
+            if (group.empty() || (group.length() > MAX_GROUP_NAME_LENGTH)) return (false);
+            return (std::all_of(group.begin(), group.end(), [] (char c) -> bool {
+                return (((c >= 'a') && (c <= 'z')) || ((c >= '0') && (c <= '9')) || (c == '-') || (c == '.'));
+            }));
+        }
+
+        std::string_view getRuleGroup(std::string_view outRuleName)
+        {
+            std::string_view noGroup;
+            if (outRuleName.compare(0, RULE_OUT_NAME_PREFIX.length(), RULE_OUT_NAME_PREFIX) != 0) return (noGroup);
+            outRuleName.remove_prefix(RULE_OUT_NAME_PREFIX.length());
+
+            // "<group>@<hash>_", where a label of an earlier version could have a '@' as well
+            auto pos = outRuleName.find(GROUP_SEPARATOR);
+            if ((pos == std::string_view::npos) || (outRuleName.length() <= pos + 1 + HASH_DIGITS)) return (noGroup);
+            auto group = outRuleName.substr(0, pos);
+            if (!isValidGroupName(group) || !isHash(outRuleName.substr(pos + 1, HASH_DIGITS)) ||
+                (outRuleName[pos + 1 + HASH_DIGITS] != '_')) {
+                return (noGroup);
+            }
+            return (group);
+        }
+
+        RuleQuery getBlockRuleQuery(void)
+        {
+            RuleQuery query;
+            query.namePrefix = RULE_OUT_NAME_PREFIX;
+            return (query);
+        }
+
+        void RuleTransaction::block(std::string_view appName, std::string_view group)
+        {
+            _blocks.push_back(Change{ std::string(appName), getRuleName(RuleDirection::Out, appName, group) });
+            return;
+        }
+
+        void RuleTransaction::unblock(std::string_view appName, std::string_view ruleName)
+        {
+            _unblocks.push_back(Change{ std::string(appName), std::string(ruleName) });
+            return;
+        }
+
+        void RuleTransaction::unblockNamed(std::string_view appName, std::string_view group)
+        {
+            _unblocks.push_back(Change{ std::string(appName), getRuleName(RuleDirection::Out, appName, group) });
+            return;
+        }
+
+        void RuleTransaction::reserve(std::size_t blockCount, std::size_t unblockCount)
+        {
+            _blocks.reserve(blockCount);
+            _unblocks.reserve(unblockCount);
+            return;
+        }
+
+        std::vector<RuleChangeResult> RuleTransaction::getResults(RuleChangeResult::Status status) const
+        {
+            std::vector<RuleChangeResult> result;
+            result.reserve(getChangeCount());
+            for (auto&& change : _blocks) result.push_back(RuleChangeResult{ change.appName, true, status });
+            for (auto&& change : _unblocks) result.push_back(RuleChangeResult{ change.appName, false, status });
+            return (result);
+        }
+
+        RuleTransaction RuleTransaction::getRange(std::size_t first, std::size_t count) const
+        {
+            RuleTransaction result;
+            std::size_t end = std::min(first + count, getChangeCount());
+            for (std::size_t idx = first; idx < end; idx++) {
+                if (idx < _blocks.size()) result._blocks.push_back(_blocks[idx]);
+                else result._unblocks.push_back(_unblocks[idx - _blocks.size()]);
+            }
+            return (result);
+        }
+
+        RuleTransaction RuleTransaction::getInverse(void) const
+        {
+            RuleTransaction result;
+            result.reserve(_unblocks.size(), _blocks.size());
+            // the rules come back under the names they had, even those of an earlier naming scheme
+            result._blocks = _unblocks;
+            result._unblocks = _blocks;
+            return (result);
+        }
+
         bool initialize(void)
         {
+#if defined(_WIN32)
             HRESULT result = CoInitialize(NULL);
             return (SUCCEEDED(result));
+#else
+            return (true);
+#endif // defined(_WIN32)
         }
 
         void terminate(void)
         {
+#if defined(_WIN32)
             CoUninitialize();
+#endif // defined(_WIN32)
             return;
         }
 
-        FireWallPolicy::FireWallPolicy(void) : _implUnknown(nullptr), _implDispatch(nullptr)
+        ThreadSession::ThreadSession(const PolicyFactory& createPolicy) : _policy()
         {
-            HRESULT result = CoCreateInstance(
-                CLSID_NetFwPolicy2, NULL, CLSCTX_INPROC_SERVER, IID_IUnknown, (LPVOID*) &_implUnknown
-            );
-
-            if (FAILED(result)) {
-                throw (Exception("FireWallPolicy: CoCreateInstance failed!"));
+            if (!initialize()) throw (Exception("Unable to initialize WinNetFW on this thread."));
+            try {
+                _policy = createPolicy();
+            }
+            catch (...) {
+                terminate();
+                throw;
             }
+            return;
+        }
+
+        RuleRange::Iterator& RuleRange::Iterator::operator++(void)
+        {
+            if (++_idx < _range->_batch.size()) return (*this);
+            _idx = 0;
+            if (!_range->nextBatch()) _range = nullptr;
+            return (*this);
+        }
 
-            result = _implUnknown->QueryInterface(IID_IDispatch, (void**) &_implDispatch);
+        RuleRange::RuleRange(std::unique_ptr<RuleCursor> cursor) :
+            _cursor(std::move(cursor)), _batch(), _isStarted(false)
+        { return; }
 
-            if (FAILED(result)) {
-                throw (Exception("FireWallPolicy: QueryInterface failed!"));
+        bool RuleRange::nextBatch(void)
+        {
+            _isStarted = true;
+            try {
+                bool hasRules = _cursor->next(_batch);
+                Stats::count(Stats::Counter::RulesEnumerated, _batch.size());
+                return (hasRules);
+            }
+            catch (std::exception& e) {
+                std::string msg("Error getting rules: ");
+                msg = msg.append(e.what());
+                throw (Exception(msg));
+            }
+            catch (...) {
+                throw (Exception("An unknown error has occurred."));
             }
+        }
 
+        RuleRange::Iterator RuleRange::begin(void)
+        {
+            if (!_isStarted) nextBatch();
+            return (_batch.empty() ? end() : Iterator(this));
+        }
+
+        ThreadSession::~ThreadSession(void)
+        {
+            // the policy's COM objects have to go before COM does
+            _policy.reset();
+            terminate();
+            return;
+        }
+
+#if defined(_WIN32)
+        FireWallPolicy::FireWallPolicy(void) : _store(std::make_shared<ComRuleStore>())
+        { return; }
+#else
+        FireWallPolicy::FireWallPolicy(void) : _store(std::make_shared<MemoryRuleStore>())
+        { return; }
+#endif // defined(_WIN32)
+
+        FireWallPolicy::FireWallPolicy(std::shared_ptr<RuleStore> store) : _store(store)
+        {
+            if (_store == nullptr) {
+                throw (Exception("FireWallPolicy: no rule store given!"));
+            }
             return;
         }
 
         FireWallPolicy::~FireWallPolicy(void)
         {
-            if (_implDispatch != nullptr) {
-                _implDispatch->Release();
-                _implDispatch = nullptr;
+            return;
+        }
+
+        RuleRange FireWallPolicy::enumerateRules(const RuleQuery& query) const
+        {
+            try {
+                Stats::count(Stats::Counter::StoreCalls);
+                return (RuleRange(_store->openRules(query)));
+            }
+            catch (std::exception& e) {
+                std::string msg("Error getting rules: ");
+                msg = msg.append(e.what());
+                throw (Exception(msg));
             }
-            if (_implUnknown != nullptr) {
-                _implUnknown->Release();
-                _implUnknown = nullptr;
+            catch (...) {
+                throw (Exception("An unknown error has occurred."));
             }
-            return;
         }
 
         std::unordered_map<std::string, std::string> FireWallPolicy::getRules(
             const FireWallPolicy::FilterFunction&& ruleNameFilter, const FireWallPolicy::FilterFunction&& appNameFilter
         ) const
         {
+            Stats::ScopedTimer timer("enumerate rules");
+            RuleQuery query;
+            query.nameFilter = ruleNameFilter;
+            query.applicationNameFilter = appNameFilter;
+
             std::unordered_map<std::string, std::string> result;
-            INetFwPolicy2* fwPolicy = nullptr;
+            for (auto&& rule : enumerateRules(query)) {
+                // ignore rules that have empty names
+                if (rule.name.empty() || rule.applicationName.empty()) continue;
+                result[rule.applicationName] = rule.name;
+            }
+            return (result);
+        }
 
-            try {
-                fwPolicy = static_cast<INetFwPolicy2*>(_implDispatch);
+        std::unordered_map<std::string, std::string> FireWallPolicy::getRulesByPrefix(
+            const std::string& ruleNamePrefix, std::size_t reservedCount
+        ) const
+        {
+            Stats::ScopedTimer timer("enumerate rules");
+            RuleQuery query;
+            query.namePrefix = ruleNamePrefix;
 
-                INetFwRules* fwRulesTmp = nullptr;
-                fwPolicy->get_Rules(&fwRulesTmp);
+            std::unordered_map<std::string, std::string> result;
+            result.reserve(reservedCount);
+            for (auto&& rule : enumerateRules(query)) {
+                // ignore rules that have empty names
+                if (rule.name.empty() || rule.applicationName.empty()) continue;
+                result[rule.applicationName] = rule.name;
+            }
+            return (result);
+        }
 
-                typedef ReleaseDeleter<INetFwRules*> FWRulesDeleter;
-                std::unique_ptr<INetFwRules, FWRulesDeleter> fwRules(fwRulesTmp, FWRulesDeleter());
+        std::unordered_map<std::string, std::string> FireWallPolicy::getBlockRules(std::size_t reservedCount) const
+        {
+            return (getRulesByPrefix(RULE_OUT_NAME_PREFIX, reservedCount));
+        }
 
-                IEnumVARIANT* elemsTmp = nullptr;
-                fwRules->get__NewEnum(reinterpret_cast<IUnknown**>(&elemsTmp));
+        std::size_t FireWallPolicy::getRuleCount(void) const
+        {
+            Stats::count(Stats::Counter::StoreCalls);
+            return (_store->getRuleCount());
+        }
 
-                typedef ReleaseDeleter<IEnumVARIANT*> EnumVARIANTDeleter;
-                std::unique_ptr<IEnumVARIANT, EnumVARIANTDeleter> elems(elemsTmp, EnumVARIANTDeleter());
+        bool FireWallPolicy::isBlocked(std::string_view appName, std::string_view group) const
+        {
+            try {
+                Stats::count(Stats::Counter::StoreCalls);
+                if (!_store->hasRule(getRuleName(RuleDirection::Out, appName, group))) return (false);
+                Stats::count(Stats::Counter::StoreCalls);
+                return (_store->hasRule(getRuleName(RuleDirection::In, appName, group)));
+            }
+            catch (std::exception& e) {
+                std::string msg("Error looking up rules: ");
+                msg = msg.append(e.what());
+                throw (Exception(msg));
+            }
+            catch (...) {
+                throw (Exception("An unknown error has occurred."));
+            }
+        }
 
-                long ruleCount = 0;
-                fwRules->get_Count(&ruleCount);
+        void FireWallPolicy::getBlockRules(Utils::PathTable& rules) const
+        {
+            Stats::ScopedTimer timer("enumerate rules");
+            for (auto&& rule : enumerateRules(getBlockRuleQuery())) {
+                // ignore rules that have empty names
+                if (rule.name.empty() || rule.applicationName.empty()) continue;
+                rules.add(rule.applicationName, rule.name);
+            }
+            return;
+        }
 
-                for (long ctr = 1; ctr <= ruleCount; ctr++) {
-                    VARIANT vResult[1];
-                    elems->Next(1, vResult, NULL);
+        std::size_t FireWallPolicy::addBlockRules(
+            const std::vector<std::string>& appNames,
+            const RuleChangedCallback&& fileBlockAddedCallback
+        )
+        {
+            std::size_t result = 0;
 
-                    typedef ReleaseDeleter<INetFwRule*> FWRuleDeleter;
-                    std::unique_ptr<INetFwRule, FWRuleDeleter> fwRule(
-                        static_cast<INetFwRule*>(vResult[0].pdispVal), FWRuleDeleter()
+            try {
+                for (auto&& appName : appNames) {
+                    // IN and OUT rules
+                    bool isInAdded = _store->addRule(
+                        makeBlockRule(getRuleName(RuleDirection::In, appName), appName, RuleDirection::In)
+                    );
+                    bool isOutAdded = _store->addRule(
+                        makeBlockRule(getRuleName(RuleDirection::Out, appName), appName, RuleDirection::Out)
                     );
 
-                    BSTR name;
-                    BSTR applicationName;
-                    fwRule->get_Name(&name);
-                    fwRule->get_ApplicationName(&applicationName);
-
-                    // ignore rules that have empty names
-                    if (SysStringLen(name) > 0 && SysStringLen(applicationName) > 0) {
-                        auto ruleName = Utils::w32WStrToUTF8Str(name);
-                        auto appName = Utils::w32WStrToUTF8Str(applicationName);
-
-                        bool isMatch = true;
-                        if (ruleNameFilter != nullptr) {
-                            isMatch = isMatch && ruleNameFilter(ruleName);
-                        }
-                        if (appNameFilter != nullptr) {
-                            isMatch = isMatch && appNameFilter(ruleName);
-                        }
+                    Stats::count(Stats::Counter::StoreCalls, 2);
+                    Stats::count(Stats::Counter::RulesAdded, (isInAdded ? 1 : 0) + (isOutAdded ? 1 : 0));
 
-                        if (isMatch) {
-                            result[appName] = ruleName;
+                    if (isInAdded && isOutAdded) {
+                        result++;
+                        if (fileBlockAddedCallback != nullptr) {
+                            fileBlockAddedCallback(appName);
                         }
                     }
                 }
-
-                return (result);
             }
             catch (std::exception& e) {
-                std::string msg("Error getting rules: ");
+                std::string msg("Error adding rules: ");
                 msg = msg.append(e.what());
                 throw (Exception(msg));
             }
             catch (...) {
                 throw (Exception("An unknown error has occurred."));
             }
+            return (result);
         }
 
-        std::size_t FireWallPolicy::addBlockRules(
+        std::size_t FireWallPolicy::removeBlockRules(
             const std::unordered_map<std::string, std::string>& rules,
-            const RuleChangedCallback&& fileBlockAddedCallback
+            const RuleChangedCallback&& fileBlockRemovedCallback
         )
         {
             std::size_t result = 0;
-            INetFwPolicy2* fwPolicy = nullptr;
 
             try {
-                fwPolicy = static_cast<INetFwPolicy2*>(_implDispatch);
-
-                INetFwRules* fwRulesTmp = nullptr;
-                fwPolicy->get_Rules(&fwRulesTmp);
-
-                typedef ReleaseDeleter<INetFwRules*> FWRulesDeleter;
-                std::unique_ptr<INetFwRules, FWRulesDeleter> fwRules(fwRulesTmp, FWRulesDeleter());
-
-                HRESULT hResult = ERROR_SUCCESS;
                 for (auto&& rule : rules) {
                     const auto& appName = rule.first;
                     const auto& ruleName = rule.second;
 
                     // IN and OUT rules
-                    std::unordered_map<NET_FW_RULE_DIRECTION, bool> directions;
-                    directions[NET_FW_RULE_DIR_IN] = false;
-                    directions[NET_FW_RULE_DIR_OUT] = false;
-
-                    for (auto&& direction : directions) {
-                        const auto& fwRuleDirection = direction.first;
-                        IUnknown* fwRuleUnknownTmp = nullptr;
-                        hResult = CoCreateInstance(
-                            CLSID_NetFwRule, NULL, CLSCTX_INPROC_SERVER, IID_IUnknown, (LPVOID*) &fwRuleUnknownTmp
-                        );
-                        if (FAILED(hResult)) {
-                            throw (Exception("CoCreateInstance failed."));
-                        }
-
-                        typedef ReleaseDeleter<IUnknown*> UnknownDeleter;
-                        std::unique_ptr<IUnknown, UnknownDeleter> fwRuleUnknown(fwRuleUnknownTmp, UnknownDeleter());
-
-                        IDispatch* fwRuleDispatchTmp = nullptr;
-                        hResult = fwRuleUnknown->QueryInterface(IID_IDispatch, (void**) &fwRuleDispatchTmp);
-                        if (FAILED(hResult)) {
-                            throw (Exception("QueryInterface failed."));
-                        }
-
-                        typedef ReleaseDeleter<IDispatch*> DispatchDeleter;
-                        std::unique_ptr<IDispatch, DispatchDeleter> fwRuleDispatch(
-                            fwRuleDispatchTmp, DispatchDeleter()
-                        );
+                    bool isInRemoved = _store->removeRule(getInRuleName(ruleName));
+                    bool isOutRemoved = _store->removeRule(ruleName);
 
-                        // just a weak pointer
-                        INetFwRule* fwRule = static_cast<INetFwRule*>(fwRuleDispatch.get());
+                    Stats::count(Stats::Counter::StoreCalls, 2);
+                    Stats::count(Stats::Counter::RulesRemoved, (isInRemoved ? 1 : 0) + (isOutRemoved ? 1 : 0));
 
-                        // TODO: make this more generic, and remove any references to FMWFW.
-                        fwRule->put_Action(NET_FW_ACTION_BLOCK);
-                        fwRule->put_ApplicationName(const_cast<BSTR>(Utils::utf8StrToW32WStr(appName).c_str()));
-                        fwRule->put_Description(OLESTR("Blocked using FMWFW."));
-                        fwRule->put_Direction(fwRuleDirection);
-                        fwRule->put_Enabled(VARIANT_TRUE);
-
-                        std::wstring ruleNameWStr;
-                        if (fwRuleDirection == NET_FW_RULE_DIR_IN) {
-                            ruleNameWStr = std::wstring(L"FWMFW_IN_") + Utils::utf8StrToW32WStr(ruleName);
-                        }
-                        else {
-                            ruleNameWStr = std::wstring(L"FWMFW_OUT_") + Utils::utf8StrToW32WStr(ruleName);
-                        }
-                        fwRule->put_Name(const_cast<BSTR>(ruleNameWStr.c_str()));
-
-                        hResult = fwRules->Add(fwRule);
-                        directions[fwRuleDirection] = SUCCEEDED(hResult);
-                        if (directions[NET_FW_RULE_DIR_IN] && directions[NET_FW_RULE_DIR_OUT]) {
-                            result++;
-                            if (fileBlockAddedCallback != nullptr) {
-                                fileBlockAddedCallback(appName);
-                            }
+                    if (isInRemoved && isOutRemoved) {
+                        result++;
+                        if (fileBlockRemovedCallback != nullptr) {
+                            fileBlockRemovedCallback(appName);
                         }
                     }
                 }
             }
             catch (std::exception& e) {
-                std::string msg("Error adding rules: ");
+                std::string msg("Error removing rules: ");
                 msg = msg.append(e.what());
                 throw (Exception(msg));
             }
             catch (...) {
                 throw (Exception("An unknown error has occurred."));
             }
+
             return (result);
         }
 
-        std::size_t FireWallPolicy::removeBlockRules(
-            const std::unordered_map<std::string, std::string>& rules,
-            const RuleChangedCallback&& fileBlockRemovedCallback
-        )
+        std::vector<RuleChangeResult> FireWallPolicy::commit(const RuleTransaction& transaction)
         {
-            std::size_t result = 0;
-            INetFwPolicy2* fwPolicy = nullptr;
+            typedef RuleChangeResult::Status Status;
+            Stats::ScopedTimer timer("commit");
 
-            try {
-                fwPolicy = static_cast<INetFwPolicy2*>(_implDispatch);
+            const auto& blocks = transaction._blocks;
+            const auto& unblocks = transaction._unblocks;
 
-                INetFwRules* fwRulesTmp = nullptr;
-                fwPolicy->get_Rules(&fwRulesTmp);
+            std::vector<RuleChangeResult> result = transaction.getResults(Status::Applied);
 
-                typedef ReleaseDeleter<INetFwRules*> FWRulesDeleter;
-                std::unique_ptr<INetFwRules, FWRulesDeleter> fwRules(fwRulesTmp, FWRulesDeleter());
+            try {
+                // every change is two rules: IN at 2 * idx and OUT at 2 * idx + 1
+                std::vector<Rule> rulesToAdd;
+                rulesToAdd.reserve(blocks.size() * 2);
+                for (auto&& change : blocks) {
+                    rulesToAdd.push_back(
+                        makeBlockRule(getInRuleName(change.ruleName), change.appName, RuleDirection::In)
+                    );
+                    rulesToAdd.push_back(makeBlockRule(change.ruleName, change.appName, RuleDirection::Out));
+                }
 
-                for (auto&& rule : rules) {
-                    const auto& appName = rule.first;
-                    const auto& ruleName = rule.second;
+                std::vector<std::string> rulesToRemove;
+                rulesToRemove.reserve(unblocks.size() * 2);
+                for (auto&& change : unblocks) {
+                    rulesToRemove.push_back(getInRuleName(change.ruleName));
+                    rulesToRemove.push_back(change.ruleName);
+                }
 
-                    // IN and OUT rules
-                    std::unordered_map<NET_FW_RULE_DIRECTION, bool> directions;
-                    directions[NET_FW_RULE_DIR_IN] = false;
-                    directions[NET_FW_RULE_DIR_OUT] = false;
-
-                    for (auto&& direction : directions) {
-                        const auto& fwRuleDirection = direction.first;
-
-                        // TODO: Remove assumption that the ruleName has default prefix of "FWMFW_OUT_"
-                        std::wstring ruleNameWStr = Utils::utf8StrToW32WStr(ruleName);
-                        if (fwRuleDirection == NET_FW_RULE_DIR_IN) {
-                            // change "FWMFW_OUT_" to "FWMFW_IN_"
-                            ruleNameWStr = std::wstring(L"FWMFW_IN_") +
-                                ruleNameWStr.substr(wcsnlen_s(L"FWMFW_OUT_", 10));
-                        }
+                // undoes the first addedCount rules of rulesToAdd, last one first
+                auto rollBackAdds = [&] (std::size_t addedCount) -> void {
+                    Stats::ScopedTimer rollbackTimer("roll back");
+                    for (std::size_t idx = addedCount; idx-- > 0;) {
+                        bool isUndone = _store->removeRule(rulesToAdd[idx].name);
+                        Stats::count(Stats::Counter::StoreCalls);
+                        if (isUndone) Stats::count(Stats::Counter::RulesRemoved);
+                        Status& status = result[idx / 2].status;
+                        if (!isUndone) status = Status::RollbackFailed;
+                        else if (status == Status::Applied) status = Status::RolledBack;
+                    }
+                    return;
+                };
 
-                        HRESULT hResult = fwRules->Remove(const_cast<BSTR>(ruleNameWStr.c_str()));
+                // marks the change at failedIdx as failed and everything after it as not attempted
+                auto markFailed = [&] (std::size_t failedIdx) -> void {
+                    result[failedIdx].status = Status::Failed;
+                    for (std::size_t idx = failedIdx + 1; idx < result.size(); idx++) {
+                        result[idx].status = Status::NotAttempted;
+                    }
+                    return;
+                };
 
-                        directions[fwRuleDirection] = SUCCEEDED(hResult);
-                        if (directions[NET_FW_RULE_DIR_IN] && directions[NET_FW_RULE_DIR_OUT]) {
-                            result++;
-                            if (fileBlockRemovedCallback != nullptr) {
-                                fileBlockRemovedCallback(appName);
-                            }
-                        }
+                std::size_t addedCount = 0;
+                {
+                    Stats::ScopedTimer addTimer("add rules");
+                    addedCount = _store->addRules(rulesToAdd);
+                }
+                Stats::count(Stats::Counter::StoreCalls);
+                Stats::count(Stats::Counter::RulesAdded, addedCount);
+                if (addedCount < rulesToAdd.size()) {
+                    markFailed(addedCount / 2);
+                    rollBackAdds(addedCount);
+                    return (result);
+                }
 
+                std::size_t removedCount = 0;
+                {
+                    Stats::ScopedTimer removeTimer("remove rules");
+                    removedCount = _store->removeRules(rulesToRemove);
+                }
+                Stats::count(Stats::Counter::StoreCalls);
+                Stats::count(Stats::Counter::RulesRemoved, removedCount);
+                if (removedCount < rulesToRemove.size()) {
+                    markFailed(blocks.size() + removedCount / 2);
+
+                    // put the removed rules back, then take out the added ones
+                    for (std::size_t idx = removedCount; idx-- > 0;) {
+                        const auto& change = unblocks[idx / 2];
+                        bool isOut = (idx % 2 == 1);
+                        bool isUndone = _store->addRule(makeBlockRule(
+                            rulesToRemove[idx], change.appName, isOut ? RuleDirection::Out : RuleDirection::In
+                        ));
+                        Stats::count(Stats::Counter::StoreCalls);
+                        if (isUndone) Stats::count(Stats::Counter::RulesAdded);
+                        Status& status = result[blocks.size() + idx / 2].status;
+                        if (!isUndone) status = Status::RollbackFailed;
+                        else if (status == Status::Applied) status = Status::RolledBack;
                     }
+                    rollBackAdds(addedCount);
                 }
             }
             catch (std::exception& e) {
-                std::string msg("Error removing rules: ");
+                std::string msg("Error committing rules: ");
                 msg = msg.append(e.what());
                 throw (Exception(msg));
             }
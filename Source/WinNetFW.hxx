@@ -1,12 +1,19 @@
 #if !defined(DOTSLASHZERO_FWMFW_WINNETFW_HXX)
 #define DOTSLASHZERO_FWMFW_WINNETFW_HXX
 
-#include <Windows.h>
-
+#include <cstdint>
+#include <cstddef>
 #include <exception>
 #include <functional>
+#include <iterator>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
+
+#include "PathTable.hxx"
+#include "RuleStore.hxx"
 
 // set of wrapper classes using bridge pattern (for RAII)
 
@@ -18,7 +25,7 @@ namespace FWMFW
         bool initialize(void);
         void terminate(void);
 
-        class Exception : std::exception
+        class Exception : public std::exception
         {
         public:
             Exception(void) : std::exception(), _message("")
@@ -29,48 +36,244 @@ namespace FWMFW
 
             std::string getMessage(void) const { return (_message); }
 
-            virtual const char* what(void) const /*noexcept override*/ { return (_message.c_str()); }
+            virtual const char* what(void) const noexcept override { return (_message.c_str()); }
 
         private:
             std::string _message;
         }; // class Exception
 
+        // the rules of a file are named after the file alone: the prefix, the 64 bit hash of its path and the path
+        // from its parent directory on, e.g. "FWMFW_OUT_0123456789abcdef_bin\tool.exe". files with the same name in
+        // different folders get rules of their own, and the rules of a file can be found and removed by name without
+        // enumerating the policy.
+        // the path is normalized first, as the file system compares paths: '/' is taken as '\' and ASCII letters are
+        // lower case. the hash is FNV-1a, it must not change between versions or the rules of earlier runs would not
+        // be found.
+        // the rules of a file in a group (see Reconcile::GroupedList) have the group's name and a '@' between the
+        // prefix and the hash, e.g. "FWMFW_OUT_games@0123456789abcdef_bin\tool.exe", so that the rules of a group can
+        // be told apart by name. the files of the empty group are named as above.
+        std::uint64_t getPathHash(std::string_view appName);
+        // the normalized path the hash is taken of: paths with the same key are the same file and share its rules
+        std::string getPathKey(std::string_view appName);
+        std::string getRuleName(RuleDirection direction, std::string_view appName, std::string_view group = {});
+        // the IN rule that goes with an OUT rule name (as returned by getRules)
+        std::string getInRuleName(std::string_view outRuleName);
+        // whether an OUT rule name is the one getRuleName gives the file in the group. rules of earlier versions,
+        // which were named after the path from the listed folder's parent on, are not and have to be renamed.
+        bool isCurrentRuleName(std::string_view outRuleName, std::string_view appName, std::string_view group = {});
+        // the same with the getPathHash of appName, for callers that have it already
+        bool isCurrentRuleName(
+            std::string_view outRuleName, std::string_view appName, std::uint64_t pathHash, std::string_view group
+        );
+        // the path hash in an OUT rule name of the current scheme, in any group. false for other names.
+        bool getRuleHash(std::string_view outRuleName, std::uint64_t& pathHash);
+
+        const std::size_t MAX_GROUP_NAME_LENGTH = 64;
+        // group names are made of lower case ASCII letters, digits, '-' and '.'
+        bool isValidGroupName(std::string_view group);
+        // the group of a block rule by its OUT rule name. rules that are not named after a group (including those
+        // of earlier versions) are in the empty group.
+        std::string_view getRuleGroup(std::string_view outRuleName);
+        // the OUT rules of the files blocked through FireWallPolicy, by their name prefix
+        RuleQuery getBlockRuleQuery(void);
+
+        struct RuleChangeResult
+        {
+            enum class Status
+            {
+                Applied,
+                Failed,         // this change failed, everything before it was rolled back
+                RolledBack,     // this change was applied but undone because a later one failed
+                NotAttempted,   // a change before this one failed
+                RollbackFailed  // this change was applied and could not be undone
+            }; // enum class Status
+
+            std::string appName;
+            bool isBlock; // false for unblocks
+            Status status;
+        }; // struct RuleChangeResult
+
+        // a set of block/unblock changes that FireWallPolicy::commit applies as one unit
+        class RuleTransaction
+        {
+        public:
+            RuleTransaction(void) : _blocks(), _unblocks() { return; }
+
+            // the rules are named by getRuleName
+            void block(std::string_view appName, std::string_view group = {});
+            // ruleName as returned by getRules (the OUT rule name), which may be one of an earlier naming scheme
+            void unblock(std::string_view appName, std::string_view ruleName);
+            // the rules getRuleName names for the file in the group, without looking them up first
+            void unblockNamed(std::string_view appName, std::string_view group = {});
+
+            void reserve(std::size_t blockCount, std::size_t unblockCount);
+            std::size_t getBlockCount(void) const { return (_blocks.size()); }
+            std::size_t getUnblockCount(void) const { return (_unblocks.size()); }
+            bool isEmpty(void) const { return (_blocks.empty() && _unblocks.empty()); }
+
+            // the changes are counted blocks first, then unblocks, which is also the order commit reports them in
+            std::size_t getChangeCount(void) const { return (_blocks.size() + _unblocks.size()); }
+            // a result with the given status for every change
+            std::vector<RuleChangeResult> getResults(RuleChangeResult::Status status) const;
+            // the changes first to first + count - 1 as a transaction of their own
+            RuleTransaction getRange(std::size_t first, std::size_t count) const;
+            // the changes that undo this transaction: blocks of its unblocks followed by unblocks of its blocks
+            RuleTransaction getInverse(void) const;
+
+        private:
+            friend class FireWallPolicy;
+
+            struct Change
+            {
+                std::string appName;
+                std::string ruleName; // of the OUT rule
+            }; // struct Change
+
+            std::vector<Change> _blocks;
+            std::vector<Change> _unblocks;
+        }; // class RuleTransaction
+
+        // the rules of a policy that match a query, enumerated lazily: a batch is only fetched once the one before
+        // it has been gone through, and nothing is fetched after the caller stops. a range is gone through once, as
+        // an input range or a batch at a time. errors of the store are thrown as Exception.
+        class RuleRange
+        {
+        public:
+            class Iterator
+            {
+            public:
+                typedef std::input_iterator_tag iterator_category;
+                typedef RuleRecord value_type;
+                typedef std::ptrdiff_t difference_type;
+                typedef const RuleRecord* pointer;
+                typedef const RuleRecord& reference;
+
+                Iterator(void) : _range(nullptr), _idx(0) { return; }
+                explicit Iterator(RuleRange* range) : _range(range), _idx(0) { return; }
+
+                reference operator*(void) const { return (_range->_batch[_idx]); }
+                pointer operator->(void) const { return (&_range->_batch[_idx]); }
+                Iterator& operator++(void);
+
+                bool operator==(const Iterator& other) const
+                {
+                    return ((_range == other._range) && (_idx == other._idx));
+                }
+                bool operator!=(const Iterator& other) const { return (!(*this == other)); }
+
+            private:
+                RuleRange* _range; // nullptr at the end
+                std::size_t _idx;
+            }; // class Iterator
+
+            explicit RuleRange(std::unique_ptr<RuleCursor> cursor);
+
+            // replaces the current batch by the next one. returns false once there are no more rules.
+            bool nextBatch(void);
+            const RuleBatch& getBatch(void) const { return (_batch); }
+
+            // from the current batch on, the first one is fetched if there is none yet
+            Iterator begin(void);
+            Iterator end(void) { return (Iterator()); }
+
+            RuleRange(RuleRange&&) = default;
+            RuleRange(const RuleRange&) = delete;
+            RuleRange& operator=(const RuleRange&) = delete;
+
+        private:
+            std::unique_ptr<RuleCursor> _cursor;
+            RuleBatch _batch;
+            bool _isStarted;
+        }; // class RuleRange
+
+        class FireWallPolicy;
+
+        // a policy for the calling thread. COM objects must not be used outside the thread that created them, so
+        // on Windows every call has to connect to the firewall on its own.
+        typedef std::function<std::unique_ptr<FireWallPolicy>(void)> PolicyFactory;
+
         class FireWallPolicy
         {
         public:
+            // uses the system firewall (on Windows), or a MemoryRuleStore elsewhere
             FireWallPolicy(void);
+            explicit FireWallPolicy(std::shared_ptr<RuleStore> store);
             ~FireWallPolicy(void);
 
-            typedef std::function<bool(const std::string&)> FilterFunction;
+            typedef RuleQuery::FilterFunction FilterFunction;
 
-            // TODO: attach more information to the return data (e.g. blocked/allowed, enabled, etc.)
+            // the rules that match the query, as they are enumerated. the filtering is done by the store, a rule
+            // that does not match is dropped before the rest of it is fetched.
+            RuleRange enumerateRules(const RuleQuery& query) const;
+
+            // map<appName, ruleName> of the rules with an application that pass both filters, built from the whole
+            // policy. enumerateRules is cheaper for anything but that.
             std::unordered_map<std::string, std::string> getRules(
                 const FilterFunction&& ruleNameFilter = nullptr,
                 const FilterFunction&& appNameFilter = nullptr
             ) const;
 
+            // only looks at the rules whose names start with ruleNamePrefix. the prefix is checked by the store before
+            // anything else of a rule is fetched or converted, which makes this much cheaper than filtering with
+            // getRules on policies with many foreign rules. reservedCount is a hint for the size of the result.
+            std::unordered_map<std::string, std::string> getRulesByPrefix(
+                const std::string& ruleNamePrefix, std::size_t reservedCount = 0
+            ) const;
+
+            // the number of rules of the whole policy, without enumerating them
+            std::size_t getRuleCount(void) const;
+            // whether the file is blocked by the rules getRuleName names for it in the group, looked up by name without
+            // enumerating
+            bool isBlocked(std::string_view appName, std::string_view group = {}) const;
+
+            // the files blocked through this class: getRulesByPrefix for the prefix of the OUT rules
+            std::unordered_map<std::string, std::string> getBlockRules(std::size_t reservedCount = 0) const;
+            // the same, added to a path table (rule names are the OUT rule names here as well)
+            void getBlockRules(Utils::PathTable& rules) const;
+
             typedef std::function<void(const std::string&)> RuleChangedCallback;
 
             // technically, these two functions does not modify the class itself
-            // (as well as the two pointer data members) so they can be marked as "const"
-            // arg: map<appName, ruleName>
+            // (as well as the store pointer) so they can be marked as "const"
             std::size_t addBlockRules(
-                const std::unordered_map<std::string, std::string>& rules,
+                const std::vector<std::string>& appNames,
                 const RuleChangedCallback&& fileBlockAddedCallback = nullptr
             );
+            // arg: map<appName, ruleName> as returned by getRules
             std::size_t removeBlockRules(
                 const std::unordered_map<std::string, std::string>& rules,
                 const RuleChangedCallback&& fileBlockRemovedCallback = nullptr
             );
 
+            // applies all the changes of the transaction, or none of them: all rules are prepared before the first
+            // one is committed, and if one fails the ones already committed are rolled back. returns a result per
+            // change, blocks first, in the order they were added to the transaction.
+            std::vector<RuleChangeResult> commit(const RuleTransaction& transaction);
+
             FireWallPolicy(const FireWallPolicy&) = delete;
             FireWallPolicy(const FireWallPolicy&&) = delete;
             FireWallPolicy& operator=(const FireWallPolicy&) = delete;
             FireWallPolicy& operator=(const FireWallPolicy&&) = delete;
         private:
-            IUnknown* _implUnknown;
-            IDispatch* _implDispatch;
+            std::shared_ptr<RuleStore> _store;
         }; // class FireWallPolicy
+
+        // WinNetFW initialized on the calling thread, and a policy created there, for the lifetime of the object.
+        // what a worker thread needs to change rules.
+        class ThreadSession
+        {
+        public:
+            explicit ThreadSession(const PolicyFactory& createPolicy);
+            ~ThreadSession(void);
+
+            FireWallPolicy& getPolicy(void) { return (*_policy); }
+
+            ThreadSession(const ThreadSession&) = delete;
+            ThreadSession& operator=(const ThreadSession&) = delete;
+
+        private:
+            std::unique_ptr<FireWallPolicy> _policy;
+        }; // class ThreadSession
     } // namespace WinNetFW
 } // namespace FWMFW
 